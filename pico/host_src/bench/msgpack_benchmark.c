@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_sim.h"
+#include "hardware_definitions.h"
+#include "sensor_definitions.h"
+#include "uart_controller/uart_sensor_controller.h"
+
+#include "hardware/dma.h"
+
+// Host benchmark for the msgpack packing and command handling paths, run against the real sensor tables in
+// sensor_definitions.c. Each case is repeated until it has run for at least MIN_CASE_TIME_NS, then reported
+// as time and bytes per packet, so wire format and packing changes can be compared on numbers.
+//
+//      PiFeederBenchmarks [name filter]
+//
+// Built with the host shim, so absolute numbers are for the host and only the relative ones carry over to the
+// RP2040. Not registered with ctest.
+
+#define MIN_CASE_TIME_NS                (250 * 1000 * 1000ull)
+#define MAX_CASE_NAME_LENGTH            (64)
+#define MAX_BENCHMARK_CASES             (32)
+
+// Bytes sent to the controller link go nowhere, so it runs as fast as the simulated UART allows
+#define BENCHMARK_CONTROLLER_BAUDRATE   (1000000000)
+
+
+typedef struct {
+    char mName[MAX_CASE_NAME_LENGTH];
+    size_t (*mRun)(void *context);                  // Runs one iteration, returning the bytes it produced (or consumed)
+    void (*mPrepare)(void *context);                // Untimed, before each iteration (optional). Iterations are then timed one by one
+    void *mContext;
+    uint8_t mPacketsPerIteration;
+} BenchmarkCase;
+
+typedef struct {
+    const MsgPackSensorPacket *mSensorPacket;
+    char mOutBuffer[MPACK_OUT_BUFFER_SIZE];
+} PackSensorContext;
+
+typedef struct {
+    MsgPackSensorPacket *mSensorPacket;
+} PatchSensorContext;
+
+typedef struct {
+    char mOutBuffer[MPACK_OUT_BUFFER_SIZE];
+} PackBufferContext;
+
+typedef struct {
+    ControllerInterface *mController;
+    uint8_t mFrame[COMMAND_LENGTH + 1];             // Start byte, then the command buffer
+    size_t mResponseBytes;                          // Measured once, before the case runs
+} CommandContext;
+
+
+static ControllerInterface _controller = {
+    .mUART = SENSOR_CONTROLLER_UART,
+    .mMsgPackSensors = sensorPackets,
+    .mNumMsgPackSensors = NUM_SENSORS
+};
+
+static BenchmarkCase _cases[MAX_BENCHMARK_CASES];
+static int _numCases = 0;
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t) ts.tv_sec * 1000000000ull) + (uint64_t) ts.tv_nsec;
+}
+
+static void add_case(const char *name, size_t (*run)(void *), void (*prepare)(void *), void *context, uint8_t packets) {
+    if(_numCases >= MAX_BENCHMARK_CASES) {
+        fprintf(stderr, "Too many benchmark cases, dropping %s\n", name);
+        return;
+    }
+
+    BenchmarkCase *benchmarkCase = &_cases[_numCases++];
+    snprintf(benchmarkCase->mName, MAX_CASE_NAME_LENGTH, "%s", name);
+    benchmarkCase->mRun = run;
+    benchmarkCase->mPrepare = prepare;
+    benchmarkCase->mContext = context;
+    benchmarkCase->mPacketsPerIteration = packets;
+}
+
+// Builds the bytes the remote end sends for a command with zeroed arguments
+static void build_command_frame(SensorCommandIdentifier command, uint8_t *frame) {
+    uint16_t checksum = command;
+
+    memset(frame, 0, COMMAND_LENGTH + 1);
+    frame[0] = COMMAND_START_BYTE;
+    frame[1] = command;
+    frame[COMMAND_LENGTH] = (uint8_t) (checksum & 0xFF);
+}
+
+// Gives every sensor a representative status and readings, so the variable width packers see realistic values
+static void fill_sensor_packets(void) {
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        MsgPackSensorData *data = &sensorPackets[i].mCurrentSensorData;
+        data->mStatus = SENSOR_CONNECTED_VALID_DATA;
+
+        for(int r = 0; r < data->mNumReadings; ++r) {
+            data->mSensorReadings[r].mValue = data->mSensorReadings[r].mDescription->mMaxValue;
+        }
+    }
+}
+
+
+        // Cases //
+
+static size_t run_pack_header(void *context) {
+    PackBufferContext *c = (PackBufferContext *) context;
+    HeaderPacket headerPacket = {
+        GET_ALL_SENSOR_VALUES,
+        COMMAND_OK
+    };
+
+    return pack_header_data(headerPacket, c->mOutBuffer, MPACK_OUT_BUFFER_SIZE).mBytesUsed;
+}
+
+static size_t run_pack_terminator(void *context) {
+    PackBufferContext *c = (PackBufferContext *) context;
+
+    return pack_terminator_packet(GET_ALL_SENSOR_VALUES, c->mOutBuffer, MPACK_OUT_BUFFER_SIZE).mBytesUsed;
+}
+
+static size_t run_pack_sensor(void *context) {
+    PackSensorContext *c = (PackSensorContext *) context;
+
+    return pack_sensor_packet(c->mSensorPacket, c->mOutBuffer, MPACK_OUT_BUFFER_SIZE).mBytesUsed;
+}
+
+static size_t run_patch_sensor_cache(void *context) {
+    PatchSensorContext *c = (PatchSensorContext *) context;
+
+    // Alternate a value so every patch has something to write
+    c->mSensorPacket->mCurrentSensorData.mSensorReadings[0].mValue.mIntValue ^= 1;
+    update_sensor_packet_cache(c->mSensorPacket);
+
+    return c->mSensorPacket->mPacketCache.mPacketSize;
+}
+
+static size_t run_pack_sensor_values(void *context) {
+    PackBufferContext *c = (PackBufferContext *) context;
+
+    return pack_sensor_values_packet(sensorPackets, NUM_SENSORS, c->mOutBuffer, MPACK_OUT_BUFFER_SIZE).mBytesUsed;
+}
+
+// Stands in for the RX DMA: writes bytes into the RX ring where the channel would, and counts them off its
+// transfer count. No bytes reach the simulated UART, so the real channel never writes alongside
+static void push_rx_ring_bytes(ControllerInterface *controller, const uint8_t *bytes, size_t numBytes) {
+    dma_channel_hw_t *hw = &dma_hw->ch[controller->mRXDMAChannel];
+    size_t writePos = (size_t) (hw->write_addr - (uintptr_t) controller->mRXRing) % RX_RING_SIZE;
+
+    for(size_t i = 0; i < numBytes; ++i) {
+        controller->mRXRing[writePos] = bytes[i];
+        writePos = (writePos + 1) % RX_RING_SIZE;
+    }
+
+    hw->write_addr = (uintptr_t) &controller->mRXRing[writePos];
+    hw->transfer_count -= (uint32_t) numBytes;
+}
+
+// Receives a command frame through the RX ring, then parses and handles it, as the controller's update does.
+// Frames land at a different ring position each time, so some are split across the wrap
+static size_t run_rx_ring(void *context) {
+    CommandContext *c = (CommandContext *) context;
+
+    push_rx_ring_bytes(c->mController, c->mFrame, sizeof(c->mFrame));
+    service_rx_dma(c->mController);
+    handle_pending_commands(c->mController);
+
+    return sizeof(c->mFrame);
+}
+
+// Parses and handles a command frame, as the RX DMA ring is serviced. Anything sent goes into the TX ring
+static size_t run_incoming_bytes(void *context) {
+    CommandContext *c = (CommandContext *) context;
+
+    handle_incoming_bytes(c->mController, c->mFrame, sizeof(c->mFrame));
+    handle_pending_commands(c->mController);
+
+    return c->mResponseBytes ? c->mResponseBytes : sizeof(c->mFrame);
+}
+
+// Drops whatever the last response left in the TX ring, so every iteration starts with it empty. Waiting for
+// the simulated DMA to send it would take far longer than the response itself
+static void prepare_command(void *context) {
+    CommandContext *c = (CommandContext *) context;
+
+    dma_channel_abort(c->mController->mTXDMAChannel);
+    c->mController->mTXRingReadPos = 0;
+    c->mController->mTXRingCount = 0;
+    c->mController->mTXInFlight = 0;
+}
+
+// Runs the command once to see how many bytes its response puts on the wire
+static void measure_response_bytes(CommandContext *context) {
+    SimUARTStats before;
+    SimUARTStats after;
+
+    flush_tx(context->mController);
+    sim_uart_get_stats(context->mController->mUART, &before);
+    handle_incoming_bytes(context->mController, context->mFrame, sizeof(context->mFrame));
+    handle_pending_commands(context->mController);
+    flush_tx(context->mController);
+    sim_uart_get_stats(context->mController->mUART, &after);
+
+    context->mResponseBytes = (size_t) (after.mBytesTransmitted - before.mBytesTransmitted);
+}
+
+
+        // Runner //
+
+static void run_case(BenchmarkCase *benchmarkCase) {
+    uint64_t iterations = 0;
+    uint64_t elapsedNS = 0;
+    size_t bytes = 0;
+
+    // Warm up
+    for(int i = 0; i < 16; ++i) {
+        if(benchmarkCase->mPrepare) {
+            benchmarkCase->mPrepare(benchmarkCase->mContext);
+        }
+        bytes = benchmarkCase->mRun(benchmarkCase->mContext);
+    }
+
+    if(benchmarkCase->mPrepare) {
+        // Time each iteration on its own, leaving the untimed preparation out
+        while(elapsedNS < MIN_CASE_TIME_NS) {
+            benchmarkCase->mPrepare(benchmarkCase->mContext);
+
+            uint64_t start = now_ns();
+            bytes = benchmarkCase->mRun(benchmarkCase->mContext);
+            elapsedNS += now_ns() - start;
+            iterations++;
+        }
+    } else {
+        // Time growing batches until one runs long enough, sizing each from the last
+        uint64_t batch = 1;
+        while(elapsedNS < MIN_CASE_TIME_NS) {
+            if(elapsedNS) {
+                uint64_t scaled = (batch * MIN_CASE_TIME_NS * 5) / (elapsedNS * 4);
+                batch = (scaled > (batch * 100)) ? (batch * 100) : (scaled + 1);
+            }
+
+            uint64_t start = now_ns();
+            for(uint64_t i = 0; i < batch; ++i) {
+                bytes = benchmarkCase->mRun(benchmarkCase->mContext);
+            }
+            elapsedNS = now_ns() - start;
+            iterations = batch;
+        }
+    }
+
+    double nsPerIteration = (double) elapsedNS / (double) iterations;
+    uint8_t packets = benchmarkCase->mPacketsPerIteration;
+
+    printf("%-48s %12llu %12.1f %8u %12.1f %12.1f\n",
+        benchmarkCase->mName,
+        (unsigned long long) iterations,
+        nsPerIteration,
+        packets,
+        nsPerIteration / packets,
+        (double) bytes / packets
+    );
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+    char name[MAX_CASE_NAME_LENGTH];
+
+    static PackBufferContext headerContext;
+    static PackBufferContext terminatorContext;
+    static PackBufferContext valuesContext;
+    static PackSensorContext sensorContexts[NUM_SENSORS];
+    static PatchSensorContext patchContexts[NUM_SENSORS];
+    static CommandContext rxRingContext;
+    static CommandContext dispatchContext;
+    static CommandContext allValuesContext;
+    static CommandContext compactValuesContext;
+
+    fill_sensor_packets();
+
+    // Builds every packet cache, as on the device
+    init_sensor_controller(&_controller, SENSOR_CONTROLLER_TX_PIN, SENSOR_CONTROLLER_RX_PIN, BENCHMARK_CONTROLLER_BAUDRATE);
+
+    // Packers
+    add_case("pack_header_data", run_pack_header, NULL, &headerContext, 1);
+    add_case("pack_terminator_packet", run_pack_terminator, NULL, &terminatorContext, 1);
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        sensorContexts[i].mSensorPacket = &sensorPackets[i];
+        snprintf(name, MAX_CASE_NAME_LENGTH, "pack_sensor_packet/%s", sensorPackets[i].mSensorName);
+        add_case(name, run_pack_sensor, NULL, &sensorContexts[i], 1);
+    }
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        patchContexts[i].mSensorPacket = &sensorPackets[i];
+        snprintf(name, MAX_CASE_NAME_LENGTH, "update_sensor_packet_cache/%s", sensorPackets[i].mSensorName);
+        add_case(name, run_patch_sensor_cache, NULL, &patchContexts[i], 1);
+    }
+    add_case("pack_sensor_values_packet", run_pack_sensor_values, NULL, &valuesContext, 1);
+
+    // Command parsing
+    rxRingContext.mController = &_controller;
+    build_command_frame(NO_COMMAND, rxRingContext.mFrame);
+    add_case("service_rx_dma/NO_COMMAND", run_rx_ring, NULL, &rxRingContext, 1);
+
+    dispatchContext.mController = &_controller;
+    build_command_frame(NO_COMMAND, dispatchContext.mFrame);
+    add_case("handle_incoming_bytes/NO_COMMAND", run_incoming_bytes, NULL, &dispatchContext, 1);
+
+    // Whole response paths, from the command frame to the TX ring. Packets are header, data and terminator
+    allValuesContext.mController = &_controller;
+    build_command_frame(GET_ALL_SENSOR_VALUES, allValuesContext.mFrame);
+    measure_response_bytes(&allValuesContext);
+    add_case("GET_ALL_SENSOR_VALUES", run_incoming_bytes, prepare_command, &allValuesContext, NUM_SENSORS + 2);
+
+    compactValuesContext.mController = &_controller;
+    build_command_frame(GET_ALL_SENSOR_VALUES_COMPACT, compactValuesContext.mFrame);
+    measure_response_bytes(&compactValuesContext);
+    add_case("GET_ALL_SENSOR_VALUES_COMPACT", run_incoming_bytes, prepare_command, &compactValuesContext, 3);
+
+    printf("%-48s %12s %12s %8s %12s %12s\n", "Case", "Iterations", "ns/iter", "Packets", "ns/packet", "Bytes/packet");
+    for(int i = 0; i < _numCases; ++i) {
+        if(filter && !strstr(_cases[i].mName, filter)) {
+            continue;
+        }
+
+        run_case(&_cases[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "sim_internal.h"
+
+#include "hardware/adc.h"
+
+#define NUM_ADC_INPUTS          (5)
+
+
+static uint16_t _adcInputs[NUM_ADC_INPUTS];
+static uint _selectedInput;
+
+
+        // SDK ADC API //
+
+void adc_init(void) {
+    _selectedInput = 0;
+}
+
+void adc_gpio_init(uint gpio) {
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+    gpio_disable_pulls(gpio);
+}
+
+void adc_select_input(uint input) {
+    if(input < NUM_ADC_INPUTS) {
+        _selectedInput = input;
+    }
+}
+
+uint adc_get_selected_input(void) {
+    return _selectedInput;
+}
+
+uint16_t adc_read(void) {
+    // A conversion takes 96 ADC clock cycles at 48MHz
+    sleep_us(2);
+    return _adcInputs[_selectedInput];
+}
+
+
+        // Simulation API //
+
+void sim_adc_set_input(uint input, uint16_t rawValue) {
+    if(input < NUM_ADC_INPUTS) {
+        _adcInputs[input] = rawValue & 0x0FFF;
+    }
+}
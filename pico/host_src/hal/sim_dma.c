@@ -0,0 +1,424 @@
+#include "sim_internal.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+
+#define ENGINE_IDLE_POLL_NS         (5 * 1000)      // How often a channel waiting on a peripheral is retried
+#define MAX_ELEMENTS_PER_PASS       (64)            // Bounds how long one channel can hog the engine
+
+
+typedef enum {
+    PORT_MEMORY,
+    PORT_UART,
+    PORT_PIO_RX,
+    PORT_PIO_TX,
+    PORT_I2C
+} SimDMAPortType;
+
+typedef struct {
+    SimDMAPortType mType;
+    uart_inst_t *mUART;
+    PIO mPIO;
+    uint mSM;
+    i2c_inst_t *mI2C;
+} SimDMAPort;
+
+typedef struct {
+    bool mClaimed;
+    dma_channel_config mConfig;
+    uint64_t mTransfers;
+    uint64_t mBytes;
+} SimDMAChannel;
+
+dma_hw_t sim_dma_hw_inst;
+
+static SimDMAChannel _channels[NUM_DMA_CHANNELS];
+static pthread_mutex_t _dmaLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _dmaWork = PTHREAD_COND_INITIALIZER;
+static pthread_once_t _engineOnce = PTHREAD_ONCE_INIT;
+
+
+static SimDMAPort port_for_address(uintptr_t address) {
+    SimDMAPort port = {PORT_MEMORY, 0, 0, 0, 0};
+    bool isRX;
+
+    if((port.mUART = sim_uart_from_data_register(address))) {
+        port.mType = PORT_UART;
+    } else if((port.mI2C = sim_i2c_from_data_register(address))) {
+        port.mType = PORT_I2C;
+    } else if(sim_pio_from_fifo_register(address, &port.mPIO, &port.mSM, &isRX)) {
+        port.mType = isRX ? PORT_PIO_RX : PORT_PIO_TX;
+    }
+
+    return port;
+}
+
+static bool port_readable(SimDMAPort *port) {
+    switch(port->mType) {
+        case PORT_UART:
+            return uart_is_readable(port->mUART);
+        case PORT_PIO_RX:
+            return !pio_sm_is_rx_fifo_empty(port->mPIO, port->mSM);
+        case PORT_PIO_TX:
+            return false;
+        case PORT_I2C:
+            return sim_i2c_data_readable(port->mI2C);
+        default:
+            return true;
+    }
+}
+
+static bool port_writable(SimDMAPort *port) {
+    switch(port->mType) {
+        case PORT_UART:
+            return uart_is_writable(port->mUART);
+        case PORT_PIO_TX:
+            return !pio_sm_is_tx_fifo_full(port->mPIO, port->mSM);
+        case PORT_PIO_RX:
+            return false;
+        case PORT_I2C:
+            return sim_i2c_command_writable(port->mI2C);
+        default:
+            return true;
+    }
+}
+
+static uint32_t port_read(SimDMAPort *port, uintptr_t address, uint size) {
+    uint32_t value = 0;
+    uint8_t b;
+
+    switch(port->mType) {
+        case PORT_UART:
+            uart_read_blocking(port->mUART, &b, 1);
+            return b;
+        case PORT_PIO_RX:
+            // Any read pops the FIFO, a narrow one returns the byte lane it addresses
+            return pio_sm_get(port->mPIO, port->mSM) >> ((address & 3) * 8);
+        case PORT_I2C:
+            return sim_i2c_read_data(port->mI2C);
+        default:
+            memcpy(&value, (const void *) address, size);
+            return value;
+    }
+}
+
+static void port_write(SimDMAPort *port, uintptr_t address, uint32_t value, uint size) {
+    uint8_t b = (uint8_t) value;
+
+    switch(port->mType) {
+        case PORT_UART:
+            uart_write_blocking(port->mUART, &b, 1);
+            break;
+        case PORT_PIO_TX:
+            pio_sm_put(port->mPIO, port->mSM, value);
+            break;
+        case PORT_I2C:
+            sim_i2c_write_command(port->mI2C, (uint16_t) value);
+            break;
+        default:
+            memcpy((void *) address, &value, size);
+            break;
+    }
+}
+
+static uintptr_t advance_address(uintptr_t address, uint size, bool increment, uint ringSizeBits) {
+    if(!increment) {
+        return address;
+    }
+
+    if(ringSizeBits) {
+        uintptr_t ringMask = (((uintptr_t) 1) << ringSizeBits) - 1;
+        return (address & ~ringMask) | ((address + size) & ringMask);
+    }
+
+    return address + size;
+}
+
+static void start_channel_locked(uint channel) {
+    dma_channel_hw_t *hw = &dma_hw->ch[channel];
+
+    if(!_channels[channel].mConfig.enable) {
+        return;
+    }
+
+    i2c_inst_t *i2c = sim_i2c_from_data_register(hw->write_addr);
+    if(i2c || (i2c = sim_i2c_from_data_register(hw->read_addr))) {
+        sim_i2c_dma_started(i2c);
+    }
+
+    hw->ctrl_trig |= DMA_CH0_CTRL_TRIG_BUSY_BITS;
+    _channels[channel].mTransfers++;
+    pthread_cond_signal(&_dmaWork);
+}
+
+// Moves as many elements as the peripherals at either end allow. Returns true if anything moved, and sets
+// the channel's interrupt flag if the transfer completed.
+static bool run_channel_locked(uint channel) {
+    dma_channel_hw_t *hw = &dma_hw->ch[channel];
+    SimDMAChannel *c = &_channels[channel];
+    uint size = 1u << c->mConfig.size;
+    SimDMAPort src = port_for_address(hw->read_addr);
+    SimDMAPort dst = port_for_address(hw->write_addr);
+    bool moved = false;
+
+    for(int i = 0; (i < MAX_ELEMENTS_PER_PASS) && hw->transfer_count; ++i) {
+        // The destination must have room before the source is consumed
+        if(!port_writable(&dst) || !port_readable(&src)) {
+            break;
+        }
+
+        uint32_t value = port_read(&src, hw->read_addr, size);
+        port_write(&dst, hw->write_addr, value, size);
+
+        hw->read_addr = advance_address(hw->read_addr, size, c->mConfig.read_increment,
+                                        c->mConfig.ring_write ? 0 : c->mConfig.ring_size_bits);
+        hw->write_addr = advance_address(hw->write_addr, size, c->mConfig.write_increment,
+                                         c->mConfig.ring_write ? c->mConfig.ring_size_bits : 0);
+        hw->transfer_count--;
+        c->mBytes += size;
+        moved = true;
+    }
+
+    if(!hw->transfer_count) {
+        hw->ctrl_trig &= ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+
+        if(!c->mConfig.irq_quiet) {
+            dma_hw->intr |= (1u << channel);
+            dma_hw->ints0 = dma_hw->intr & dma_hw->inte0;
+        }
+
+        if(c->mConfig.chain_to != channel) {
+            start_channel_locked(c->mConfig.chain_to);
+        }
+    }
+
+    return moved;
+}
+
+static bool any_channel_busy_locked(void) {
+    for(uint i = 0; i < NUM_DMA_CHANNELS; ++i) {
+        if(dma_hw->ch[i].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void* dma_engine(void *arg) {
+    (void) arg;
+
+    while(1) {
+        pthread_mutex_lock(&_dmaLock);
+        while(!any_channel_busy_locked()) {
+            pthread_cond_wait(&_dmaWork, &_dmaLock);
+        }
+
+        bool moved = false;
+        for(uint i = 0; i < NUM_DMA_CHANNELS; ++i) {
+            if(dma_hw->ch[i].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) {
+                moved |= run_channel_locked(i);
+            }
+        }
+        bool raiseIRQ = (dma_hw->ints0 != 0);
+        pthread_mutex_unlock(&_dmaLock);
+
+        // Make the transferred data visible before anything acts on the register updates
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if(raiseIRQ) {
+            sim_irq_raise(DMA_IRQ_0);
+        }
+
+        if(!moved) {
+            sim_sleep_until_ns(sim_time_ns() + ENGINE_IDLE_POLL_NS);
+        }
+    }
+
+    return 0;
+}
+
+static void start_engine(void) {
+    pthread_t thread;
+
+    if(pthread_create(&thread, 0, dma_engine, 0)) {
+        sim_panic("Could not start DMA engine thread");
+    }
+    pthread_detach(thread);
+}
+
+static void set_register_locked(uint channel, volatile uintptr_t *reg, uintptr_t value, bool trigger) {
+    *reg = value;
+    if(trigger) {
+        start_channel_locked(channel);
+    }
+}
+
+
+        // SDK DMA API //
+
+void dma_channel_claim(uint channel) {
+    pthread_mutex_lock(&_dmaLock);
+    bool alreadyClaimed = _channels[channel].mClaimed;
+    _channels[channel].mClaimed = true;
+    pthread_mutex_unlock(&_dmaLock);
+
+    if(alreadyClaimed) {
+        sim_panic("DMA channel already claimed");
+    }
+}
+
+void dma_channel_unclaim(uint channel) {
+    pthread_mutex_lock(&_dmaLock);
+    _channels[channel].mClaimed = false;
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+int dma_claim_unused_channel(bool required) {
+    pthread_mutex_lock(&_dmaLock);
+    for(uint i = 0; i < NUM_DMA_CHANNELS; ++i) {
+        if(!_channels[i].mClaimed) {
+            _channels[i].mClaimed = true;
+            pthread_mutex_unlock(&_dmaLock);
+            return (int) i;
+        }
+    }
+    pthread_mutex_unlock(&_dmaLock);
+
+    if(required) {
+        sim_panic("No DMA channels are available");
+    }
+    return -1;
+}
+
+bool dma_channel_is_claimed(uint channel) {
+    pthread_mutex_lock(&_dmaLock);
+    bool claimed = _channels[channel].mClaimed;
+    pthread_mutex_unlock(&_dmaLock);
+
+    return claimed;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c;
+    memset(&c, 0, sizeof(c));
+
+    c.size = DMA_SIZE_32;
+    c.read_increment = true;
+    c.write_increment = false;
+    c.dreq = DREQ_FORCE;
+    c.chain_to = channel;
+    c.enable = true;
+
+    return c;
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger) {
+    pthread_once(&_engineOnce, start_engine);
+
+    pthread_mutex_lock(&_dmaLock);
+    _channels[channel].mConfig = *config;
+    if(trigger) {
+        start_channel_locked(channel);
+    }
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    pthread_once(&_engineOnce, start_engine);
+
+    pthread_mutex_lock(&_dmaLock);
+    _channels[channel].mConfig = *config;
+    dma_hw->ch[channel].write_addr = (uintptr_t) write_addr;
+    dma_hw->ch[channel].read_addr = (uintptr_t) read_addr;
+    dma_hw->ch[channel].transfer_count = transfer_count;
+    if(trigger) {
+        start_channel_locked(channel);
+    }
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    pthread_mutex_lock(&_dmaLock);
+    set_register_locked(channel, &dma_hw->ch[channel].read_addr, (uintptr_t) read_addr, trigger);
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    pthread_mutex_lock(&_dmaLock);
+    set_register_locked(channel, &dma_hw->ch[channel].write_addr, (uintptr_t) write_addr, trigger);
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    pthread_mutex_lock(&_dmaLock);
+    dma_hw->ch[channel].transfer_count = trans_count;
+    if(trigger) {
+        start_channel_locked(channel);
+    }
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+void dma_channel_start(uint channel) {
+    pthread_mutex_lock(&_dmaLock);
+    start_channel_locked(channel);
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+void dma_channel_abort(uint channel) {
+    pthread_mutex_lock(&_dmaLock);
+    dma_hw->ch[channel].ctrl_trig &= ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+bool dma_channel_is_busy(uint channel) {
+    return (dma_hw->ch[channel].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) != 0;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    while(dma_channel_is_busy(channel)) {
+        sim_sleep_until_ns(sim_time_ns() + ENGINE_IDLE_POLL_NS);
+    }
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    pthread_mutex_lock(&_dmaLock);
+    if(enabled) {
+        dma_hw->inte0 |= (1u << channel);
+    } else {
+        dma_hw->inte0 &= ~(1u << channel);
+    }
+    dma_hw->ints0 = dma_hw->intr & dma_hw->inte0;
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+    return (dma_hw->ints0 & (1u << channel)) != 0;
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+    pthread_mutex_lock(&_dmaLock);
+    dma_hw->intr &= ~(1u << channel);
+    dma_hw->ints0 = dma_hw->intr & dma_hw->inte0;
+    pthread_mutex_unlock(&_dmaLock);
+}
+
+
+        // Simulation internals //
+
+void sim_dma_get_totals(uint64_t *transfers, uint64_t *bytes) {
+    *transfers = 0;
+    *bytes = 0;
+
+    pthread_mutex_lock(&_dmaLock);
+    for(uint i = 0; i < NUM_DMA_CHANNELS; ++i) {
+        *transfers += _channels[i].mTransfers;
+        *bytes += _channels[i].mBytes;
+    }
+    pthread_mutex_unlock(&_dmaLock);
+}
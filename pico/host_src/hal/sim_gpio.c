@@ -0,0 +1,132 @@
+#include "sim_internal.h"
+
+#include "hardware/gpio.h"
+
+#define MAX_OUTPUT_LISTENERS_PER_PIN        (4)
+
+
+typedef struct {
+    enum gpio_function mFunction;
+    bool mIsOutput;
+    bool mOutputLevel;
+    bool mPullUp;
+    bool mPullDown;
+    SimGPIOInputDriver mInputDriver;
+    void *mInputDriverContext;
+    SimGPIOOutputListener mListeners[MAX_OUTPUT_LISTENERS_PER_PIN];
+    void *mListenerContexts[MAX_OUTPUT_LISTENERS_PER_PIN];
+    int mNumListeners;
+} SimGPIOPin;
+
+static SimGPIOPin _pins[NUM_BANK0_GPIOS];
+
+
+static SimGPIOPin* get_pin(uint gpio) {
+    return (gpio < NUM_BANK0_GPIOS) ? &_pins[gpio] : 0;
+}
+
+
+        // SDK GPIO API //
+
+void gpio_init(uint gpio) {
+    SimGPIOPin *pin = get_pin(gpio);
+    if(!pin) {
+        return;
+    }
+
+    pin->mFunction = GPIO_FUNC_SIO;
+    pin->mIsOutput = false;
+    gpio_put(gpio, false);
+}
+
+void gpio_deinit(uint gpio) {
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    SimGPIOPin *pin = get_pin(gpio);
+    if(pin) {
+        pin->mFunction = fn;
+    }
+}
+
+enum gpio_function gpio_get_function(uint gpio) {
+    SimGPIOPin *pin = get_pin(gpio);
+    return pin ? pin->mFunction : GPIO_FUNC_NULL;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    SimGPIOPin *pin = get_pin(gpio);
+    if(pin) {
+        pin->mIsOutput = out;
+    }
+}
+
+bool gpio_is_dir_out(uint gpio) {
+    SimGPIOPin *pin = get_pin(gpio);
+    return pin ? pin->mIsOutput : false;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    SimGPIOPin *pin = get_pin(gpio);
+    if(pin) {
+        pin->mPullUp = up;
+        pin->mPullDown = down;
+    }
+}
+
+void gpio_put(uint gpio, bool value) {
+    SimGPIOPin *pin = get_pin(gpio);
+    if(!pin) {
+        return;
+    }
+
+    pin->mOutputLevel = value;
+    for(int i = 0; i < pin->mNumListeners; ++i) {
+        pin->mListeners[i](pin->mListenerContexts[i], gpio, value);
+    }
+}
+
+bool gpio_get(uint gpio) {
+    SimGPIOPin *pin = get_pin(gpio);
+    if(!pin) {
+        return false;
+    }
+
+    if(pin->mIsOutput) {
+        return pin->mOutputLevel;
+    }
+
+    if(pin->mInputDriver) {
+        return pin->mInputDriver(pin->mInputDriverContext, gpio);
+    }
+
+    return pin->mPullUp;
+}
+
+
+        // Simulation API //
+
+void sim_gpio_add_output_listener(uint pin, SimGPIOOutputListener listener, void *context) {
+    SimGPIOPin *p = get_pin(pin);
+    if(!p || !listener || (p->mNumListeners >= MAX_OUTPUT_LISTENERS_PER_PIN)) {
+        return;
+    }
+
+    p->mListeners[p->mNumListeners] = listener;
+    p->mListenerContexts[p->mNumListeners] = context;
+    p->mNumListeners++;
+}
+
+void sim_gpio_set_input_driver(uint pin, SimGPIOInputDriver driver, void *context) {
+    SimGPIOPin *p = get_pin(pin);
+    if(p) {
+        p->mInputDriver = driver;
+        p->mInputDriverContext = context;
+    }
+}
+
+bool sim_gpio_get_output_level(uint pin) {
+    SimGPIOPin *p = get_pin(pin);
+    return p ? p->mOutputLevel : false;
+}
@@ -0,0 +1,453 @@
+#include "sim_internal.h"
+
+#include <pthread.h>
+
+#include "hardware/i2c.h"
+
+#define I2C_BITS_PER_BYTE           (9)         // 8 data bits + ACK
+#define I2C_START_STOP_BITS         (2)
+#define MAX_CONTROLLER_TRANSFER     (64)        // Longest write or read the command FIFO path will buffer
+
+// Registers are written by the controller thread but are read only to the firmware
+#define SET_REGISTER(reg, value)    (*((volatile uint32_t *) &(reg)) = (value))
+
+
+struct i2c_inst {
+    uint mIndex;
+    bool mEnabled;
+    uint mBaudrate;
+    uint8_t mActiveChannels;
+    SimI2CDevice *mDevices;
+    pthread_mutex_t mLock;
+    SimI2CStats mStats;
+
+    // Command FIFO path, run by the controller thread
+    i2c_hw_t *mHW;
+    pthread_cond_t mCommandsQueued;
+    pthread_once_t mControllerOnce;
+    uint16_t mCommandFIFO[I2C_FIFO_DEPTH];
+    uint mCommandHead;
+    uint mCommandCount;
+    uint8_t mRXFIFO[I2C_FIFO_DEPTH];
+    uint mRXHead;
+    uint mRXCount;
+    bool mDiscardCommands;                      // After an abort the TX FIFO stays flushed until cleared
+    bool mInTransfer;
+    bool mReading;
+    SimI2CDevice *mTarget;
+    uint8_t mTransferBuffer[MAX_CONTROLLER_TRANSFER];
+    size_t mTransferLen;
+    size_t mTransferPos;
+};
+
+static i2c_hw_t _i2cRegisters[2];
+
+i2c_inst_t sim_i2c0_inst = {
+    .mIndex = 0,
+    .mLock = PTHREAD_MUTEX_INITIALIZER,
+    .mHW = &_i2cRegisters[0],
+    .mCommandsQueued = PTHREAD_COND_INITIALIZER,
+    .mControllerOnce = PTHREAD_ONCE_INIT
+};
+
+i2c_inst_t sim_i2c1_inst = {
+    .mIndex = 1,
+    .mLock = PTHREAD_MUTEX_INITIALIZER,
+    .mHW = &_i2cRegisters[1],
+    .mCommandsQueued = PTHREAD_COND_INITIALIZER,
+    .mControllerOnce = PTHREAD_ONCE_INIT
+};
+
+
+static SimI2CDevice* find_device(i2c_inst_t *i2c, uint8_t addr) {
+    for(SimI2CDevice *device = i2c->mDevices; device; device = device->mNext) {
+        if(device->mAddress != addr) {
+            continue;
+        }
+
+        if((device->mChannel == SIM_I2C_NO_CHANNEL) || (i2c->mActiveChannels & (1 << device->mChannel))) {
+            return device;
+        }
+    }
+
+    return 0;
+}
+
+// Clocked faster than it can follow, a device misses bits. Its writes fail and what it sends back is garbled.
+static bool device_overclocked(i2c_inst_t *i2c, SimI2CDevice *device) {
+    return device->mMaxBaudrate && (i2c->mBaudrate > device->mMaxBaudrate);
+}
+
+static void garble_bytes(uint8_t *buffer, size_t len) {
+    for(size_t i = 0; i < len; ++i) {
+        buffer[i] ^= (uint8_t) (1 << (i % 8));
+    }
+}
+
+// Holds the bus for as long as the transfer takes on the wire. Returns false if the deadline passes first.
+static bool clock_bus(i2c_inst_t *i2c, size_t numBytes, absolute_time_t until) {
+    uint64_t startNS = sim_time_ns();
+    uint64_t bits = I2C_START_STOP_BITS + (numBytes * I2C_BITS_PER_BYTE);
+    uint64_t endNS = startNS + ((bits * 1000000000ull) / (i2c->mBaudrate ? i2c->mBaudrate : 1));
+    bool timedOut = false;
+
+    if((until != at_the_end_of_time) && (endNS > (until * 1000))) {
+        endNS = sim_max_u64(until * 1000, startNS);
+        timedOut = true;
+    }
+
+    sim_sleep_until_ns(endNS);
+
+    pthread_mutex_lock(&i2c->mLock);
+    i2c->mStats.mBusTimeUS += (endNS - startNS) / 1000;
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return !timedOut;
+}
+
+static int do_transfer(i2c_inst_t *i2c, uint8_t addr, uint8_t *buffer, size_t len, bool isRead, absolute_time_t until) {
+    // Like the hardware, a zero length transfer never makes it onto the bus
+    if(!i2c->mEnabled || !len) {
+        return i2c->mEnabled ? 0 : PICO_ERROR_GENERIC;
+    }
+
+    pthread_mutex_lock(&i2c->mLock);
+    i2c->mStats.mTransactions++;
+    SimI2CDevice *device = find_device(i2c, addr);
+    pthread_mutex_unlock(&i2c->mLock);
+
+    // No device to ACK the address byte
+    if(!device) {
+        clock_bus(i2c, 1, until);
+        pthread_mutex_lock(&i2c->mLock);
+        i2c->mStats.mNacks++;
+        pthread_mutex_unlock(&i2c->mLock);
+        return PICO_ERROR_GENERIC;
+    }
+
+    if(!clock_bus(i2c, len + 1, until)) {
+        return PICO_ERROR_TIMEOUT;
+    }
+
+    bool overclocked = device_overclocked(i2c, device);
+    bool acked = isRead ?
+        (device->mRead && device->mRead(device, buffer, len)) :
+        (!overclocked && device->mWrite && device->mWrite(device, buffer, len));
+
+    if(acked && isRead && overclocked) {
+        garble_bytes(buffer, len);
+    }
+
+    pthread_mutex_lock(&i2c->mLock);
+    if(acked) {
+        i2c->mStats.mBytes += len;
+    } else {
+        i2c->mStats.mNacks++;
+    }
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return acked ? (int) len : PICO_ERROR_GENERIC;
+}
+
+
+        // Command FIFO controller //
+
+static uint64_t bit_time_ns(i2c_inst_t *i2c) {
+    return 1000000000ull / (i2c->mBaudrate ? i2c->mBaudrate : 1);
+}
+
+// Spends numBits on the wire, accounting it as bus time
+static void clock_bits(i2c_inst_t *i2c, uint64_t numBits) {
+    uint64_t durationNS = numBits * bit_time_ns(i2c);
+
+    sim_sleep_until_ns(sim_time_ns() + durationNS);
+
+    pthread_mutex_lock(&i2c->mLock);
+    i2c->mStats.mBusTimeUS += durationNS / 1000;
+    pthread_mutex_unlock(&i2c->mLock);
+}
+
+// Ends the transfer with TX_ABRT raised and the TX FIFO flushed. Must be called with the lock held.
+static void abort_transfer_locked(i2c_inst_t *i2c, uint32_t source) {
+    SET_REGISTER(i2c->mHW->tx_abrt_source, source);
+    SET_REGISTER(i2c->mHW->raw_intr_stat, i2c->mHW->raw_intr_stat | I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS | I2C_IC_RAW_INTR_STAT_STOP_DET_BITS);
+    i2c->mCommandCount = 0;
+    i2c->mDiscardCommands = true;
+    i2c->mInTransfer = false;
+    i2c->mStats.mNacks++;
+}
+
+// Hands a finished write to the device. Returns false if the device NACKed it.
+static bool complete_write(i2c_inst_t *i2c) {
+    SimI2CDevice *device = i2c->mTarget;
+    bool acked = !device_overclocked(i2c, device) && device->mWrite && device->mWrite(device, i2c->mTransferBuffer, i2c->mTransferLen);
+
+    pthread_mutex_lock(&i2c->mLock);
+    if(acked) {
+        i2c->mStats.mBytes += i2c->mTransferLen;
+    } else {
+        abort_transfer_locked(i2c, I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS);
+    }
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return acked;
+}
+
+// START (or RESTART) and address byte. Reads fetch the device's whole response up front, like the blocking
+// path does, and hand it out a byte per read command.
+static bool start_transfer(i2c_inst_t *i2c, bool isRead) {
+    pthread_mutex_lock(&i2c->mLock);
+    i2c->mStats.mTransactions++;
+    SimI2CDevice *device = find_device(i2c, (uint8_t) i2c->mHW->tar);
+    pthread_mutex_unlock(&i2c->mLock);
+
+    clock_bits(i2c, 1 + I2C_BITS_PER_BYTE);
+
+    bool acked = device && (!isRead || (device->mRead && device->mRead(device, i2c->mTransferBuffer, MAX_CONTROLLER_TRANSFER)));
+
+    if(acked && isRead && device_overclocked(i2c, device)) {
+        garble_bytes(i2c->mTransferBuffer, MAX_CONTROLLER_TRANSFER);
+    }
+
+    pthread_mutex_lock(&i2c->mLock);
+    if(acked) {
+        i2c->mInTransfer = true;
+        i2c->mReading = isRead;
+        i2c->mTarget = device;
+        i2c->mTransferLen = 0;
+        i2c->mTransferPos = 0;
+    } else {
+        abort_transfer_locked(i2c, I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS);
+    }
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return acked;
+}
+
+static void run_command(i2c_inst_t *i2c, uint16_t command) {
+    bool isRead = (command & I2C_IC_DATA_CMD_CMD_BITS) != 0;
+    bool stop = (command & I2C_IC_DATA_CMD_STOP_BITS) != 0;
+
+    // A change of direction mid transfer is a repeated start
+    if(i2c->mInTransfer && (i2c->mReading != isRead)) {
+        if(!i2c->mReading && !complete_write(i2c)) {
+            return;
+        }
+        i2c->mInTransfer = false;
+    }
+
+    if(!i2c->mInTransfer && !start_transfer(i2c, isRead)) {
+        return;
+    }
+
+    clock_bits(i2c, I2C_BITS_PER_BYTE);
+
+    if(isRead) {
+        // The controller holds the clock while the RX FIFO is full
+        pthread_mutex_lock(&i2c->mLock);
+        while(i2c->mRXCount >= I2C_FIFO_DEPTH) {
+            pthread_mutex_unlock(&i2c->mLock);
+            sim_sleep_until_ns(sim_time_ns() + bit_time_ns(i2c));
+            pthread_mutex_lock(&i2c->mLock);
+        }
+
+        uint8_t b = (i2c->mTransferPos < MAX_CONTROLLER_TRANSFER) ? i2c->mTransferBuffer[i2c->mTransferPos++] : 0xFF;
+        i2c->mRXFIFO[(i2c->mRXHead + i2c->mRXCount) % I2C_FIFO_DEPTH] = b;
+        i2c->mRXCount++;
+        i2c->mStats.mBytes++;
+        pthread_mutex_unlock(&i2c->mLock);
+    } else if(i2c->mTransferLen < MAX_CONTROLLER_TRANSFER) {
+        i2c->mTransferBuffer[i2c->mTransferLen++] = (uint8_t) command;
+    }
+
+    if(stop) {
+        if(!i2c->mReading && !complete_write(i2c)) {
+            return;
+        }
+
+        clock_bits(i2c, 1);
+
+        pthread_mutex_lock(&i2c->mLock);
+        i2c->mInTransfer = false;
+        SET_REGISTER(i2c->mHW->raw_intr_stat, i2c->mHW->raw_intr_stat | I2C_IC_RAW_INTR_STAT_STOP_DET_BITS);
+        pthread_mutex_unlock(&i2c->mLock);
+    }
+}
+
+static void* i2c_controller(void *arg) {
+    i2c_inst_t *i2c = (i2c_inst_t *) arg;
+
+    while(1) {
+        pthread_mutex_lock(&i2c->mLock);
+        while(!i2c->mCommandCount) {
+            pthread_cond_wait(&i2c->mCommandsQueued, &i2c->mLock);
+        }
+
+        // The entry stays in the FIFO while it is on the wire, so the FIFO level reflects it
+        uint16_t command = i2c->mCommandFIFO[i2c->mCommandHead];
+        pthread_mutex_unlock(&i2c->mLock);
+
+        run_command(i2c, command);
+
+        pthread_mutex_lock(&i2c->mLock);
+        if(i2c->mCommandCount) {
+            i2c->mCommandHead = (i2c->mCommandHead + 1) % I2C_FIFO_DEPTH;
+            i2c->mCommandCount--;
+        }
+        pthread_mutex_unlock(&i2c->mLock);
+    }
+
+    return 0;
+}
+
+static void start_controller_thread(i2c_inst_t *i2c) {
+    pthread_t thread;
+
+    if(pthread_create(&thread, 0, i2c_controller, i2c)) {
+        sim_panic("Could not start I2C controller thread");
+    }
+    pthread_detach(thread);
+}
+
+static void start_i2c0_controller(void) {
+    start_controller_thread(i2c0);
+}
+
+static void start_i2c1_controller(void) {
+    start_controller_thread(i2c1);
+}
+
+
+        // SDK I2C API //
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    i2c->mEnabled = true;
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+void i2c_deinit(i2c_inst_t *i2c) {
+    i2c->mEnabled = false;
+}
+
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate) {
+    i2c->mBaudrate = baudrate;
+    return baudrate;
+}
+
+uint i2c_hw_index(i2c_inst_t *i2c) {
+    return i2c->mIndex;
+}
+
+i2c_hw_t* i2c_get_hw(i2c_inst_t *i2c) {
+    return i2c->mHW;
+}
+
+int i2c_write_blocking_until(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, absolute_time_t until) {
+    (void) nostop;
+    return do_transfer(i2c, addr, (uint8_t *) src, len, false, until);
+}
+
+int i2c_read_blocking_until(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop, absolute_time_t until) {
+    (void) nostop;
+    return do_transfer(i2c, addr, dst, len, true, until);
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    return i2c_write_blocking_until(i2c, addr, src, len, nostop, at_the_end_of_time);
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    return i2c_read_blocking_until(i2c, addr, dst, len, nostop, at_the_end_of_time);
+}
+
+
+        // DMA ports //
+
+i2c_inst_t* sim_i2c_from_data_register(uintptr_t address) {
+    if(address == (uintptr_t) &_i2cRegisters[0].data_cmd) {
+        return i2c0;
+    }
+    if(address == (uintptr_t) &_i2cRegisters[1].data_cmd) {
+        return i2c1;
+    }
+
+    return 0;
+}
+
+void sim_i2c_dma_started(i2c_inst_t *i2c) {
+    pthread_once(&i2c->mControllerOnce, (i2c == i2c0) ? start_i2c0_controller : start_i2c1_controller);
+
+    pthread_mutex_lock(&i2c->mLock);
+    if(!i2c->mCommandCount && !i2c->mInTransfer) {
+        SET_REGISTER(i2c->mHW->raw_intr_stat, 0);
+        SET_REGISTER(i2c->mHW->tx_abrt_source, 0);
+        i2c->mDiscardCommands = false;
+    }
+    pthread_mutex_unlock(&i2c->mLock);
+}
+
+bool sim_i2c_command_writable(i2c_inst_t *i2c) {
+    pthread_mutex_lock(&i2c->mLock);
+    bool writable = i2c->mDiscardCommands || (i2c->mCommandCount < I2C_FIFO_DEPTH);
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return writable;
+}
+
+void sim_i2c_write_command(i2c_inst_t *i2c, uint16_t command) {
+    pthread_mutex_lock(&i2c->mLock);
+    if(i2c->mEnabled && !i2c->mDiscardCommands && (i2c->mCommandCount < I2C_FIFO_DEPTH)) {
+        i2c->mCommandFIFO[(i2c->mCommandHead + i2c->mCommandCount) % I2C_FIFO_DEPTH] = command;
+        i2c->mCommandCount++;
+        pthread_cond_signal(&i2c->mCommandsQueued);
+    }
+    pthread_mutex_unlock(&i2c->mLock);
+}
+
+bool sim_i2c_data_readable(i2c_inst_t *i2c) {
+    pthread_mutex_lock(&i2c->mLock);
+    bool readable = (i2c->mRXCount != 0);
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return readable;
+}
+
+uint8_t sim_i2c_read_data(i2c_inst_t *i2c) {
+    uint8_t b = 0;
+
+    pthread_mutex_lock(&i2c->mLock);
+    if(i2c->mRXCount) {
+        b = i2c->mRXFIFO[i2c->mRXHead];
+        i2c->mRXHead = (i2c->mRXHead + 1) % I2C_FIFO_DEPTH;
+        i2c->mRXCount--;
+    }
+    pthread_mutex_unlock(&i2c->mLock);
+
+    return b;
+}
+
+
+        // Simulation API //
+
+void sim_i2c_attach_device(i2c_inst_t *i2c, SimI2CDevice *device) {
+    pthread_mutex_lock(&i2c->mLock);
+    device->mNext = i2c->mDevices;
+    i2c->mDevices = device;
+    pthread_mutex_unlock(&i2c->mLock);
+}
+
+void sim_i2c_set_active_channels(i2c_inst_t *i2c, uint8_t channelMask) {
+    pthread_mutex_lock(&i2c->mLock);
+    i2c->mActiveChannels = channelMask;
+    pthread_mutex_unlock(&i2c->mLock);
+}
+
+uint8_t sim_i2c_get_active_channels(i2c_inst_t *i2c) {
+    return i2c->mActiveChannels;
+}
+
+void sim_i2c_get_stats(i2c_inst_t *i2c, SimI2CStats *stats) {
+    pthread_mutex_lock(&i2c->mLock);
+    *stats = i2c->mStats;
+    pthread_mutex_unlock(&i2c->mLock);
+}
@@ -0,0 +1,38 @@
+#ifndef _SIM_INTERNAL_H_
+#define _SIM_INTERNAL_H_
+
+#include "host_sim.h"
+
+// Shared helpers for the HAL simulation translation units
+
+uint64_t sim_time_ns(void);
+void sim_sleep_until_ns(uint64_t targetNS);
+void sim_panic(const char *message) __attribute__((noreturn));
+
+// Makes get_core_num() report coreNum on the calling thread, returning the previous value
+uint sim_set_core_num(uint coreNum);
+
+// Runs the handlers for an interrupt, if it is enabled. Must not be called with any peripheral lock held.
+void sim_irq_raise(uint num);
+
+uint64_t sim_pio_get_rx_overflows(void);
+void sim_dma_get_totals(uint64_t *transfers, uint64_t *bytes);
+
+// Finds the peripheral behind a register address, for the DMA engine
+uart_inst_t* sim_uart_from_data_register(uintptr_t address);
+bool sim_pio_from_fifo_register(uintptr_t address, PIO *pio, uint *sm, bool *isRX);
+i2c_inst_t* sim_i2c_from_data_register(uintptr_t address);
+
+// I2C command FIFO access for the DMA engine. Starting a channel on the controller stands in for the
+// firmware's read-to-clear of the interrupt status.
+void sim_i2c_dma_started(i2c_inst_t *i2c);
+bool sim_i2c_command_writable(i2c_inst_t *i2c);
+void sim_i2c_write_command(i2c_inst_t *i2c, uint16_t command);
+bool sim_i2c_data_readable(i2c_inst_t *i2c);
+uint8_t sim_i2c_read_data(i2c_inst_t *i2c);
+
+static inline uint64_t sim_max_u64(uint64_t a, uint64_t b) {
+    return (a > b) ? a : b;
+}
+
+#endif      // _SIM_INTERNAL_H_
@@ -0,0 +1,136 @@
+#include "sim_internal.h"
+
+#include <pthread.h>
+
+#include "hardware/irq.h"
+
+#define MAX_HANDLERS_PER_IRQ        (4)
+
+
+typedef struct {
+    irq_handler_t mHandlers[MAX_HANDLERS_PER_IRQ];
+    uint mNumHandlers;
+    bool mEnabled;
+    uint mCore;                                 // Core which enabled the interrupt, and so services it
+} SimIRQ;
+
+static SimIRQ _irqs[NUM_IRQS];
+static pthread_mutex_t _irqLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Held while a handler runs, so handlers never overlap
+static pthread_mutex_t _handlerLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void add_handler(uint num, irq_handler_t handler) {
+    if(num >= NUM_IRQS) {
+        sim_panic("Invalid IRQ number");
+    }
+
+    pthread_mutex_lock(&_irqLock);
+    SimIRQ *irq = &_irqs[num];
+    if(irq->mNumHandlers >= MAX_HANDLERS_PER_IRQ) {
+        pthread_mutex_unlock(&_irqLock);
+        sim_panic("Too many IRQ handlers");
+    }
+    irq->mHandlers[irq->mNumHandlers++] = handler;
+    pthread_mutex_unlock(&_irqLock);
+}
+
+
+        // SDK IRQ API //
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    if((num < NUM_IRQS) && _irqs[num].mNumHandlers) {
+        sim_panic("IRQ handler already set");
+    }
+    add_handler(num, handler);
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    (void) order_priority;
+    add_handler(num, handler);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    if(num >= NUM_IRQS) {
+        return;
+    }
+
+    pthread_mutex_lock(&_irqLock);
+    SimIRQ *irq = &_irqs[num];
+    for(uint i = 0; i < irq->mNumHandlers; ++i) {
+        if(irq->mHandlers[i] == handler) {
+            irq->mHandlers[i] = irq->mHandlers[--irq->mNumHandlers];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_irqLock);
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    if(num >= NUM_IRQS) {
+        return;
+    }
+
+    pthread_mutex_lock(&_irqLock);
+    _irqs[num].mEnabled = enabled;
+    _irqs[num].mCore = get_core_num();
+    pthread_mutex_unlock(&_irqLock);
+}
+
+bool irq_is_enabled(uint num) {
+    if(num >= NUM_IRQS) {
+        return false;
+    }
+
+    pthread_mutex_lock(&_irqLock);
+    bool enabled = _irqs[num].mEnabled;
+    pthread_mutex_unlock(&_irqLock);
+
+    return enabled;
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority) {
+    (void) num;
+    (void) hardware_priority;
+}
+
+
+        // SDK sync API //
+
+uint32_t save_and_disable_interrupts(void) {
+    pthread_mutex_lock(&_handlerLock);
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {
+    (void) status;
+    pthread_mutex_unlock(&_handlerLock);
+}
+
+
+        // Simulation internals //
+
+void sim_irq_raise(uint num) {
+    SimIRQ irq;
+
+    if(num >= NUM_IRQS) {
+        return;
+    }
+
+    pthread_mutex_lock(&_irqLock);
+    irq = _irqs[num];
+    pthread_mutex_unlock(&_irqLock);
+
+    if(!irq.mEnabled || !irq.mNumHandlers) {
+        return;
+    }
+
+    pthread_mutex_lock(&_handlerLock);
+    uint previousCore = sim_set_core_num(irq.mCore);
+    for(uint i = 0; i < irq.mNumHandlers; ++i) {
+        irq.mHandlers[i]();
+    }
+    sim_set_core_num(previousCore);
+    pthread_mutex_unlock(&_handlerLock);
+}
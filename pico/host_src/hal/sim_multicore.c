@@ -0,0 +1,118 @@
+#include "sim_internal.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "pico/multicore.h"
+
+
+#define LOCKOUT_SIGNAL              (SIGUSR1)
+#define LOCKOUT_POLL_NS             (20 * 1000)
+
+
+static __thread uint _coreNum = 0;
+static void (*_core1Entry)(void);
+static pthread_t _coreThreads[2];
+
+// Lockout handshake, shared with the signal handler so only lock-free atomics are used
+static volatile bool _lockoutVictim[2];
+static volatile bool _lockoutRequested;
+static volatile bool _lockoutParked;
+
+
+static void lockout_pause(void) {
+    struct timespec ts = {
+        .tv_sec = 0,
+        .tv_nsec = LOCKOUT_POLL_NS
+    };
+    nanosleep(&ts, 0);
+}
+
+static void lockout_signal_handler(int signal) {
+    (void) signal;
+
+    __atomic_store_n(&_lockoutParked, true, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&_lockoutRequested, __ATOMIC_SEQ_CST)) {
+        lockout_pause();
+    }
+    __atomic_store_n(&_lockoutParked, false, __ATOMIC_SEQ_CST);
+}
+
+
+static void* core1_thread(void *arg) {
+    (void) arg;
+
+    _coreNum = 1;
+    _coreThreads[1] = pthread_self();
+    _core1Entry();
+
+    return 0;
+}
+
+
+        // SDK multicore API //
+
+uint get_core_num(void) {
+    return _coreNum;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    pthread_t thread;
+
+    _core1Entry = entry;
+    if(pthread_create(&thread, 0, core1_thread, 0)) {
+        sim_panic("Could not start core 1 thread");
+    }
+    pthread_detach(thread);
+}
+
+void multicore_reset_core1(void) {
+    // There's no safe way to stop a host thread mid-flight; core 1 simply keeps running
+}
+
+void multicore_lockout_victim_init(void) {
+    struct sigaction action = {0};
+
+    action.sa_handler = lockout_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(LOCKOUT_SIGNAL, &action, 0);
+
+    _coreThreads[_coreNum] = pthread_self();
+    __atomic_store_n(&_lockoutVictim[_coreNum], true, __ATOMIC_SEQ_CST);
+}
+
+bool multicore_lockout_victim_is_initialized(uint core_num) {
+    return (core_num < 2) && __atomic_load_n(&_lockoutVictim[core_num], __ATOMIC_SEQ_CST);
+}
+
+void multicore_lockout_start_blocking(void) {
+    uint victim = _coreNum ^ 1;
+
+    if(!multicore_lockout_victim_is_initialized(victim)) {
+        sim_panic("Lockout victim core not initialized");
+    }
+
+    __atomic_store_n(&_lockoutRequested, true, __ATOMIC_SEQ_CST);
+    pthread_kill(_coreThreads[victim], LOCKOUT_SIGNAL);
+    while(!__atomic_load_n(&_lockoutParked, __ATOMIC_SEQ_CST)) {
+        lockout_pause();
+    }
+}
+
+void multicore_lockout_end_blocking(void) {
+    __atomic_store_n(&_lockoutRequested, false, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&_lockoutParked, __ATOMIC_SEQ_CST)) {
+        lockout_pause();
+    }
+}
+
+
+        // Simulation internals //
+
+uint sim_set_core_num(uint coreNum) {
+    uint previous = _coreNum;
+    _coreNum = coreNum;
+    return previous;
+}
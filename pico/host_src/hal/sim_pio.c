@@ -0,0 +1,478 @@
+#include "sim_internal.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "hardware/pio.h"
+
+#define MAX_PIO_FIFO_DEPTH          (PIO_FIFO_DEPTH * 2)
+#define SERIAL_FETCH_CHUNK          (MAX_PIO_FIFO_DEPTH * 4)      // Enough bytes to fill the FIFO with packed frames
+
+
+typedef struct {
+    uint32_t mWords[MAX_PIO_FIFO_DEPTH];
+    uint mHead;
+    uint mCount;
+    uint mDepth;
+} SimPIOFIFO;
+
+typedef struct {
+    bool mClaimed;
+    bool mEnabled;
+    pio_sm_config mConfig;
+    SimPIOProgramModel mModel;
+    uint mPin;
+    uint mBaudrate;
+    uint64_t mLastPollNS;
+    uint32_t mISR;                              // Frame being assembled by the sonar receiver
+    uint mISRBytes;
+    SimPIOFIFO mRXFIFO;
+    SimPIOFIFO mTXFIFO;
+    uint64_t mRXOverflows;
+} SimPIOStateMachine;
+
+typedef struct {
+    uint32_t mUsedInstructionMask;
+    SimPIOStateMachine mStateMachines[NUM_PIO_STATE_MACHINES];
+} SimPIOBlock;
+
+pio_hw_t sim_pio0_inst;
+pio_hw_t sim_pio1_inst;
+
+static SimPIOBlock _blocks[NUM_PIOS];
+static SimSerialSource *_serialSources[NUM_BANK0_GPIOS];
+static pthread_mutex_t _pioLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static SimPIOStateMachine* get_sm(PIO pio, uint sm) {
+    return &_blocks[pio_get_index(pio)].mStateMachines[sm % NUM_PIO_STATE_MACHINES];
+}
+
+static bool fifo_push(SimPIOFIFO *fifo, uint32_t word) {
+    if(fifo->mCount >= fifo->mDepth) {
+        return false;
+    }
+
+    fifo->mWords[(fifo->mHead + fifo->mCount) % MAX_PIO_FIFO_DEPTH] = word;
+    fifo->mCount++;
+    return true;
+}
+
+static uint32_t fifo_pop(SimPIOFIFO *fifo) {
+    if(!fifo->mCount) {
+        return 0;
+    }
+
+    uint32_t word = fifo->mWords[fifo->mHead];
+    fifo->mHead = (fifo->mHead + 1) % MAX_PIO_FIFO_DEPTH;
+    fifo->mCount--;
+    return word;
+}
+
+static void reset_fifos(SimPIOStateMachine *s) {
+    uint rxDepth = (s->mConfig.fifo_join == PIO_FIFO_JOIN_RX) ? MAX_PIO_FIFO_DEPTH :
+                   (s->mConfig.fifo_join == PIO_FIFO_JOIN_TX) ? 0 : PIO_FIFO_DEPTH;
+    uint txDepth = (s->mConfig.fifo_join == PIO_FIFO_JOIN_TX) ? MAX_PIO_FIFO_DEPTH :
+                   (s->mConfig.fifo_join == PIO_FIFO_JOIN_RX) ? 0 : PIO_FIFO_DEPTH;
+
+    memset(&s->mRXFIFO, 0, sizeof(SimPIOFIFO));
+    memset(&s->mTXFIFO, 0, sizeof(SimPIOFIFO));
+    s->mRXFIFO.mDepth = rxDepth;
+    s->mTXFIFO.mDepth = txDepth;
+}
+
+// Sonar receiver: bytes are ignored until a 0xFF sync byte, then shifted in LSB first and pushed four at a time
+static void receive_sonar_byte_locked(SimPIOStateMachine *s, uint8_t byte) {
+    if(!s->mISRBytes && (byte != 0xFF)) {
+        return;
+    }
+
+    s->mISR |= ((uint32_t) byte) << (8 * s->mISRBytes);
+    if(++s->mISRBytes < 4) {
+        return;
+    }
+
+    if(!fifo_push(&s->mRXFIFO, s->mISR)) {
+        s->mRXOverflows++;
+    }
+    s->mISR = 0;
+    s->mISRBytes = 0;
+}
+
+// PISO register reader: latches through the SET pin, then samples the IN pin and clocks the side-set pin once per
+// bit, first bit most significant. Reads are done as soon as they are asked for
+static void read_shift_register_locked(SimPIOStateMachine *s) {
+    while(s->mTXFIFO.mCount && (s->mRXFIFO.mCount < s->mRXFIFO.mDepth)) {
+        uint numBits = fifo_pop(&s->mTXFIFO) + 1;
+        uint32_t value = 0;
+
+        gpio_put(s->mConfig.set_base, false);
+        gpio_put(s->mConfig.set_base, true);
+
+        for(uint i = 0; i < numBits; ++i) {
+            value = (value << 1) | (gpio_get(s->mConfig.in_base) ? 1 : 0);
+            gpio_put(s->mConfig.sideset_base, true);
+            gpio_put(s->mConfig.sideset_base, false);
+        }
+
+        fifo_push(&s->mRXFIFO, value);
+    }
+}
+
+// SIPO register writer: shifts each word's bits out on the OUT pin, clocking the side-set pin once per bit, then
+// latches them through the SET pin. Writes are done as soon as they are asked for
+static void write_shift_register_locked(SimPIOStateMachine *s) {
+    while(s->mTXFIFO.mCount) {
+        uint32_t word = fifo_pop(&s->mTXFIFO);
+        uint numBits = (word >> 27) + 1;
+
+        gpio_put(s->mConfig.set_base, false);
+
+        for(uint i = 0; i < numBits; ++i) {
+            gpio_put(s->mConfig.out_base, (word >> (26 - i)) & 1);
+            gpio_put(s->mConfig.sideset_base, false);
+            gpio_put(s->mConfig.sideset_base, true);
+        }
+
+        gpio_put(s->mConfig.sideset_base, false);
+        gpio_put(s->mConfig.set_base, true);
+    }
+}
+
+// Runs the state machine's program model up to the current time. A receive program stalls on "push" while
+// the RX FIFO is full, so anything that arrives on the pin during that time is lost.
+static void poll_sm_locked(SimPIOStateMachine *s) {
+    uint64_t now = sim_time_ns();
+
+    if(s->mEnabled && ((s->mModel == SIM_PIO_MODEL_UART_RX) || (s->mModel == SIM_PIO_MODEL_SONAR_RX))) {
+        SimSerialSource *source = (s->mPin < NUM_BANK0_GPIOS) ? _serialSources[s->mPin] : 0;
+        uint8_t bytes[SERIAL_FETCH_CHUNK];
+
+        if(source && (s->mLastPollNS < now)) {
+            size_t numArrived = source->mFetch(source, s->mLastPollNS / 1000, now / 1000, bytes, SERIAL_FETCH_CHUNK);
+
+            for(size_t i = 0; i < numArrived; ++i) {
+                if(i >= SERIAL_FETCH_CHUNK) {
+                    s->mRXOverflows++;
+                } else if(s->mModel == SIM_PIO_MODEL_SONAR_RX) {
+                    receive_sonar_byte_locked(s, bytes[i]);
+                } else if(!fifo_push(&s->mRXFIFO, ((uint32_t) bytes[i]) << 24)) {
+                    s->mRXOverflows++;
+                }
+            }
+        }
+    }
+
+    if(s->mEnabled && (s->mModel == SIM_PIO_MODEL_SHIFT_REGISTER_IN)) {
+        read_shift_register_locked(s);
+    }
+
+    if(s->mEnabled && (s->mModel == SIM_PIO_MODEL_SHIFT_REGISTER_OUT)) {
+        write_shift_register_locked(s);
+    }
+
+    s->mLastPollNS = now;
+}
+
+
+        // SDK PIO API //
+
+pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config c;
+    memset(&c, 0, sizeof(c));
+
+    c.clkdiv = 1.f;
+    c.wrap = PIO_INSTRUCTION_COUNT - 1;
+    c.in_shift_right = true;
+    c.out_shift_right = true;
+    c.push_threshold = 32;
+    c.pull_threshold = 32;
+
+    return c;
+}
+
+static int find_program_slot(SimPIOBlock *block, const pio_program_t *program) {
+    uint32_t programMask = (program->length >= 32) ? 0xFFFFFFFFu : ((1u << program->length) - 1);
+
+    if(program->origin >= 0) {
+        uint32_t mask = programMask << program->origin;
+        return (((program->origin + program->length) <= PIO_INSTRUCTION_COUNT) && !(block->mUsedInstructionMask & mask)) ?
+            program->origin : -1;
+    }
+
+    // The SDK packs programs from the top of instruction memory down
+    for(int offset = PIO_INSTRUCTION_COUNT - program->length; offset >= 0; --offset) {
+        if(!(block->mUsedInstructionMask & (programMask << offset))) {
+            return offset;
+        }
+    }
+
+    return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+    pthread_mutex_lock(&_pioLock);
+    bool canAdd = (find_program_slot(&_blocks[pio_get_index(pio)], program) >= 0);
+    pthread_mutex_unlock(&_pioLock);
+
+    return canAdd;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+    pthread_mutex_lock(&_pioLock);
+
+    SimPIOBlock *block = &_blocks[pio_get_index(pio)];
+    int offset = find_program_slot(block, program);
+    if(offset < 0) {
+        pthread_mutex_unlock(&_pioLock);
+        sim_panic("No program space");
+    }
+
+    uint32_t programMask = (program->length >= 32) ? 0xFFFFFFFFu : ((1u << program->length) - 1);
+    block->mUsedInstructionMask |= (programMask << offset);
+
+    pthread_mutex_unlock(&_pioLock);
+    return (uint) offset;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+    pthread_mutex_lock(&_pioLock);
+    uint32_t programMask = (program->length >= 32) ? 0xFFFFFFFFu : ((1u << program->length) - 1);
+    _blocks[pio_get_index(pio)].mUsedInstructionMask &= ~(programMask << loaded_offset);
+    pthread_mutex_unlock(&_pioLock);
+}
+
+void pio_clear_instruction_memory(PIO pio) {
+    pthread_mutex_lock(&_pioLock);
+    _blocks[pio_get_index(pio)].mUsedInstructionMask = 0;
+    pthread_mutex_unlock(&_pioLock);
+}
+
+void pio_sm_claim(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    bool alreadyClaimed = s->mClaimed;
+    s->mClaimed = true;
+    pthread_mutex_unlock(&_pioLock);
+
+    if(alreadyClaimed) {
+        sim_panic("PIO state machine already claimed");
+    }
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    pthread_mutex_lock(&_pioLock);
+    for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; ++sm) {
+        SimPIOStateMachine *s = get_sm(pio, sm);
+        if(!s->mClaimed) {
+            s->mClaimed = true;
+            pthread_mutex_unlock(&_pioLock);
+            return (int) sm;
+        }
+    }
+    pthread_mutex_unlock(&_pioLock);
+
+    if(required) {
+        sim_panic("No PIO state machines are available");
+    }
+    return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    get_sm(pio, sm)->mClaimed = false;
+    pthread_mutex_unlock(&_pioLock);
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    bool claimed = get_sm(pio, sm)->mClaimed;
+    pthread_mutex_unlock(&_pioLock);
+
+    return claimed;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+    gpio_set_function(pin, (pio == pio0) ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1);
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    (void) pio;
+    (void) sm;
+
+    for(uint i = 0; i < pin_count; ++i) {
+        gpio_set_dir(pin_base + i, is_out);
+    }
+    return PICO_OK;
+}
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    (void) initial_pc;
+
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    s->mEnabled = false;
+    s->mConfig = config ? *config : pio_get_default_sm_config();
+    s->mISR = 0;
+    s->mISRBytes = 0;
+    reset_fifos(s);
+    pthread_mutex_unlock(&_pioLock);
+
+    return PICO_OK;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    s->mEnabled = enabled;
+    pthread_mutex_unlock(&_pioLock);
+}
+
+void pio_sm_restart(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    s->mISR = 0;
+    s->mISRBytes = 0;
+    pthread_mutex_unlock(&_pioLock);
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    reset_fifos(get_sm(pio, sm));
+    pthread_mutex_unlock(&_pioLock);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    return (pio_sm_get_rx_fifo_level(pio, sm) == 0);
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    bool full = (s->mRXFIFO.mCount >= s->mRXFIFO.mDepth);
+    pthread_mutex_unlock(&_pioLock);
+
+    return full;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    uint level = s->mRXFIFO.mCount;
+    pthread_mutex_unlock(&_pioLock);
+
+    return level;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+    return (pio_sm_get_tx_fifo_level(pio, sm) >= get_sm(pio, sm)->mTXFIFO.mDepth);
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+    return (pio_sm_get_tx_fifo_level(pio, sm) == 0);
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    uint level = s->mTXFIFO.mCount;
+    pthread_mutex_unlock(&_pioLock);
+
+    return level;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    fifo_push(&s->mTXFIFO, data);
+    // Programs that only act on what they are given run straight away, rather than at the next FIFO access
+    poll_sm_locked(s);
+    pthread_mutex_unlock(&_pioLock);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    poll_sm_locked(s);
+    uint32_t word = fifo_pop(&s->mRXFIFO);
+    pthread_mutex_unlock(&_pioLock);
+
+    return word;
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+    while(pio_sm_is_tx_fifo_full(pio, sm)) {
+        sleep_us(10);
+    }
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+    while(pio_sm_is_rx_fifo_empty(pio, sm)) {
+        sleep_us(10);
+    }
+    return pio_sm_get(pio, sm);
+}
+
+
+        // Simulation API //
+
+void sim_pio_sm_set_model(PIO pio, uint sm, SimPIOProgramModel model, uint pin, uint baud) {
+    pthread_mutex_lock(&_pioLock);
+    SimPIOStateMachine *s = get_sm(pio, sm);
+    s->mModel = model;
+    s->mPin = pin;
+    s->mBaudrate = baud;
+    s->mLastPollNS = sim_time_ns();
+    pthread_mutex_unlock(&_pioLock);
+}
+
+void sim_serial_attach_source(uint pin, SimSerialSource *source) {
+    if(pin < NUM_BANK0_GPIOS) {
+        _serialSources[pin] = source;
+    }
+}
+
+SimSerialSource* sim_serial_get_source(uint pin) {
+    return (pin < NUM_BANK0_GPIOS) ? _serialSources[pin] : 0;
+}
+
+bool sim_pio_from_fifo_register(uintptr_t address, PIO *pio, uint *sm, bool *isRX) {
+    // Narrow accesses can address any byte lane of the FIFO register
+    address &= ~((uintptr_t) 3);
+
+    for(uint p = 0; p < NUM_PIOS; ++p) {
+        PIO instance = pio_get_instance(p);
+
+        for(uint i = 0; i < NUM_PIO_STATE_MACHINES; ++i) {
+            if((address == (uintptr_t) &instance->rxf[i]) || (address == (uintptr_t) &instance->txf[i])) {
+                *pio = instance;
+                *sm = i;
+                *isRX = (address == (uintptr_t) &instance->rxf[i]);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+uint64_t sim_pio_get_rx_overflows(void) {
+    uint64_t overflows = 0;
+
+    pthread_mutex_lock(&_pioLock);
+    for(int p = 0; p < NUM_PIOS; ++p) {
+        for(int sm = 0; sm < NUM_PIO_STATE_MACHINES; ++sm) {
+            overflows += _blocks[p].mStateMachines[sm].mRXOverflows;
+        }
+    }
+    pthread_mutex_unlock(&_pioLock);
+
+    return overflows;
+}
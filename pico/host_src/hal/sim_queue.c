@@ -0,0 +1,126 @@
+#include "sim_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/util/queue.h"
+
+
+static uint inc_index(queue_t *q, uint index) {
+    return (++index > q->element_count) ? 0 : index;
+}
+
+static void* element_ptr(queue_t *q, uint index) {
+    return q->data + (index * q->element_size);
+}
+
+
+        // SDK queue API //
+
+void queue_init_with_spinlock(queue_t *q, uint element_size, uint element_count, uint spinlock_num) {
+    (void) spinlock_num;
+
+    pthread_mutex_init(&q->mLock, 0);
+    pthread_cond_init(&q->mChanged, 0);
+
+    // One spare slot so that full and empty can be told apart
+    q->data = calloc(element_count + 1, element_size);
+    q->element_count = (uint16_t) element_count;
+    q->element_size = (uint16_t) element_size;
+    q->wptr = 0;
+    q->rptr = 0;
+}
+
+void queue_init(queue_t *q, uint element_size, uint element_count) {
+    queue_init_with_spinlock(q, element_size, element_count, 0);
+}
+
+void queue_free(queue_t *q) {
+    free(q->data);
+    q->data = 0;
+    pthread_cond_destroy(&q->mChanged);
+    pthread_mutex_destroy(&q->mLock);
+}
+
+uint queue_get_level_unsafe(queue_t *q) {
+    int32_t rc = (int32_t) q->wptr - (int32_t) q->rptr;
+    if(rc < 0) {
+        rc += q->element_count + 1;
+    }
+    return (uint) rc;
+}
+
+uint queue_get_level(queue_t *q) {
+    pthread_mutex_lock(&q->mLock);
+    uint level = queue_get_level_unsafe(q);
+    pthread_mutex_unlock(&q->mLock);
+
+    return level;
+}
+
+static bool queue_add_internal(queue_t *q, const void *data, bool block) {
+    pthread_mutex_lock(&q->mLock);
+
+    while(queue_get_level_unsafe(q) == q->element_count) {
+        if(!block) {
+            pthread_mutex_unlock(&q->mLock);
+            return false;
+        }
+        pthread_cond_wait(&q->mChanged, &q->mLock);
+    }
+
+    memcpy(element_ptr(q, q->wptr), data, q->element_size);
+    q->wptr = (uint16_t) inc_index(q, q->wptr);
+
+    pthread_cond_broadcast(&q->mChanged);
+    pthread_mutex_unlock(&q->mLock);
+    return true;
+}
+
+static bool queue_remove_internal(queue_t *q, void *data, bool block, bool remove) {
+    pthread_mutex_lock(&q->mLock);
+
+    while(queue_get_level_unsafe(q) == 0) {
+        if(!block) {
+            pthread_mutex_unlock(&q->mLock);
+            return false;
+        }
+        pthread_cond_wait(&q->mChanged, &q->mLock);
+    }
+
+    if(data) {
+        memcpy(data, element_ptr(q, q->rptr), q->element_size);
+    }
+
+    if(remove) {
+        q->rptr = (uint16_t) inc_index(q, q->rptr);
+        pthread_cond_broadcast(&q->mChanged);
+    }
+
+    pthread_mutex_unlock(&q->mLock);
+    return true;
+}
+
+bool queue_try_add(queue_t *q, const void *data) {
+    return queue_add_internal(q, data, false);
+}
+
+bool queue_try_remove(queue_t *q, void *data) {
+    return queue_remove_internal(q, data, false, true);
+}
+
+bool queue_try_peek(queue_t *q, void *data) {
+    return queue_remove_internal(q, data, false, false);
+}
+
+void queue_add_blocking(queue_t *q, const void *data) {
+    queue_add_internal(q, data, true);
+}
+
+void queue_remove_blocking(queue_t *q, void *data) {
+    queue_remove_internal(q, data, true, true);
+}
+
+void queue_peek_blocking(queue_t *q, void *data) {
+    queue_remove_internal(q, data, true, false);
+}
@@ -0,0 +1,187 @@
+#include "sim_internal.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/clocks.h"
+#include "hardware/flash.h"
+#include "hardware/watchdog.h"
+
+#define SIM_SYS_CLOCK_HZ                (125 * 1000 * 1000)
+#define SIM_FLASH_SECTOR_ERASE_US       (45 * 1000)         // Typical W25Q16JV sector erase time
+#define SIM_FLASH_PAGE_PROGRAM_US       (400)               // Typical W25Q16JV page program time
+
+
+uint8_t sim_flash_memory[PICO_FLASH_SIZE_BYTES];
+
+static pthread_mutex_t _loopStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static SimLoopStats _loopStats;
+static uint64_t _lastWatchdogUpdateUS;
+
+
+__attribute__((constructor))
+static void init_sim_flash(void) {
+    // Blank flash reads as all ones
+    memset(sim_flash_memory, 0xFF, sizeof(sim_flash_memory));
+}
+
+void sim_panic(const char *message) {
+    fprintf(stderr, "\n*** PANIC: %s\n", message);
+    abort();
+}
+
+
+        // SDK clocks API //
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    switch(clk_index) {
+        case clk_ref:
+        case clk_rtc:
+            return 12 * 1000 * 1000;
+        case clk_usb:
+        case clk_adc:
+            return 48 * 1000 * 1000;
+        default:
+            return SIM_SYS_CLOCK_HZ;
+    }
+}
+
+
+        // SDK watchdog API //
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) {
+    (void) delay_ms;
+    (void) pause_on_debug;
+
+    pthread_mutex_lock(&_loopStatsLock);
+    _lastWatchdogUpdateUS = sim_time_us();
+    pthread_mutex_unlock(&_loopStatsLock);
+}
+
+void watchdog_update(void) {
+    uint64_t now = sim_time_us();
+
+    // The firmware pets the watchdog once per core 0 loop, which makes this the natural place to measure
+    // the loop period
+    pthread_mutex_lock(&_loopStatsLock);
+    if(_lastWatchdogUpdateUS) {
+        uint64_t period = now - _lastWatchdogUpdateUS;
+
+        if(!_loopStats.mLoopCount || (period < _loopStats.mLoopPeriodMinUS)) {
+            _loopStats.mLoopPeriodMinUS = period;
+        }
+        if(period > _loopStats.mLoopPeriodMaxUS) {
+            _loopStats.mLoopPeriodMaxUS = period;
+        }
+        _loopStats.mLoopPeriodTotalUS += period;
+        _loopStats.mLoopCount++;
+    }
+    _lastWatchdogUpdateUS = now;
+    pthread_mutex_unlock(&_loopStatsLock);
+}
+
+bool watchdog_caused_reboot(void) {
+    return false;
+}
+
+bool watchdog_enable_caused_reboot(void) {
+    return false;
+}
+
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms) {
+    (void) pc;
+    (void) sp;
+    (void) delay_ms;
+
+    sim_panic("Watchdog reboot requested");
+}
+
+
+        // SDK flash API //
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if((flash_offs % FLASH_SECTOR_SIZE) || (count % FLASH_SECTOR_SIZE) || ((flash_offs + count) > PICO_FLASH_SIZE_BYTES)) {
+        sim_panic("Misaligned or out of range flash erase");
+    }
+
+    memset(&sim_flash_memory[flash_offs], 0xFF, count);
+    sleep_us((count / FLASH_SECTOR_SIZE) * SIM_FLASH_SECTOR_ERASE_US);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if((flash_offs % FLASH_PAGE_SIZE) || (count % FLASH_PAGE_SIZE) || ((flash_offs + count) > PICO_FLASH_SIZE_BYTES)) {
+        sim_panic("Misaligned or out of range flash program");
+    }
+
+    // NOR flash programming can only clear bits
+    for(size_t i = 0; i < count; ++i) {
+        sim_flash_memory[flash_offs + i] &= data[i];
+    }
+    sleep_us((count / FLASH_PAGE_SIZE) * SIM_FLASH_PAGE_PROGRAM_US);
+}
+
+void flash_get_unique_id(uint8_t *id_out) {
+    static const uint8_t SIM_UNIQUE_ID[FLASH_UNIQUE_ID_SIZE_BYTES] = {
+        0xE6, 0x60, 0x58, 0x38, 0x83, 0x3C, 0x5A, 0x2D
+    };
+
+    memcpy(id_out, SIM_UNIQUE_ID, FLASH_UNIQUE_ID_SIZE_BYTES);
+}
+
+
+        // Simulation API //
+
+void sim_get_loop_stats(SimLoopStats *stats) {
+    pthread_mutex_lock(&_loopStatsLock);
+    *stats = _loopStats;
+    pthread_mutex_unlock(&_loopStatsLock);
+}
+
+static void print_uart_stats(const char *name, uart_inst_t *uart) {
+    SimUARTStats stats;
+    sim_uart_get_stats(uart, &stats);
+
+    fprintf(stderr, "  %s: tx %" PRIu64 " bytes (stalled %" PRIu64 " us), rx %" PRIu64 " bytes (%" PRIu64 " overruns)\n",
+        name, stats.mBytesTransmitted, stats.mTXStallTimeUS, stats.mBytesReceived, stats.mRXOverruns);
+
+    if(stats.mResponseCount) {
+        fprintf(stderr, "         response latency min/avg/max: %" PRIu64 "/%" PRIu64 "/%" PRIu64 " us over %" PRIu64 " responses\n",
+            stats.mResponseLatencyMinUS,
+            stats.mResponseLatencyTotalUS / stats.mResponseCount,
+            stats.mResponseLatencyMaxUS,
+            stats.mResponseCount);
+    }
+}
+
+void sim_print_stats(void) {
+    SimLoopStats loopStats;
+    SimI2CStats i2cStats;
+    uint64_t dmaTransfers;
+    uint64_t dmaBytes;
+
+    sim_get_loop_stats(&loopStats);
+    sim_i2c_get_stats(i2c1, &i2cStats);
+
+    fprintf(stderr, "\n---- Host simulation statistics (%" PRIu64 " ms) ----\n", sim_time_us() / 1000);
+
+    if(loopStats.mLoopCount) {
+        fprintf(stderr, "  core 0 loop period min/avg/max: %" PRIu64 "/%" PRIu64 "/%" PRIu64 " us over %" PRIu64 " loops\n",
+            loopStats.mLoopPeriodMinUS,
+            loopStats.mLoopPeriodTotalUS / loopStats.mLoopCount,
+            loopStats.mLoopPeriodMaxUS,
+            loopStats.mLoopCount);
+    }
+
+    print_uart_stats("uart0", uart0);
+    print_uart_stats("uart1", uart1);
+
+    fprintf(stderr, "  i2c1: %" PRIu64 " transactions, %" PRIu64 " bytes, %" PRIu64 " NACKs, bus busy %" PRIu64 " us\n",
+        i2cStats.mTransactions, i2cStats.mBytes, i2cStats.mNacks, i2cStats.mBusTimeUS);
+    fprintf(stderr, "  pio: %" PRIu64 " RX FIFO overflows\n", sim_pio_get_rx_overflows());
+
+    sim_dma_get_totals(&dmaTransfers, &dmaBytes);
+    fprintf(stderr, "  dma: %" PRIu64 " transfers, %" PRIu64 " bytes\n", dmaTransfers, dmaBytes);
+}
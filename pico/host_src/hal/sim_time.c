@@ -0,0 +1,79 @@
+#include "sim_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "pico/time.h"
+#include "hardware/timer.h"
+
+
+static pthread_once_t _bootTimeOnce = PTHREAD_ONCE_INIT;
+static uint64_t _bootTimeNS;
+
+
+static uint64_t read_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((uint64_t) ts.tv_sec) * 1000000000ull) + ts.tv_nsec;
+}
+
+static void init_boot_time(void) {
+    _bootTimeNS = read_monotonic_ns();
+}
+
+uint64_t sim_time_ns(void) {
+    pthread_once(&_bootTimeOnce, init_boot_time);
+    return read_monotonic_ns() - _bootTimeNS;
+}
+
+uint64_t sim_time_us(void) {
+    return sim_time_ns() / 1000;
+}
+
+void sim_sleep_until_ns(uint64_t targetNS) {
+    pthread_once(&_bootTimeOnce, init_boot_time);
+
+    uint64_t absoluteNS = _bootTimeNS + targetNS;
+    struct timespec ts = {
+        .tv_sec = (time_t) (absoluteNS / 1000000000ull),
+        .tv_nsec = (long) (absoluteNS % 1000000000ull)
+    };
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {
+    }
+}
+
+
+        // SDK time API //
+
+absolute_time_t get_absolute_time(void) {
+    return sim_time_us();
+}
+
+uint64_t time_us_64(void) {
+    return sim_time_us();
+}
+
+void sleep_until(absolute_time_t target) {
+    if(target == at_the_end_of_time) {
+        target = UINT64_MAX / 1000;
+    }
+    sim_sleep_until_ns(target * 1000);
+}
+
+void sleep_us(uint64_t us) {
+    sleep_until(make_timeout_time_us(us));
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_until(make_timeout_time_ms(ms));
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp) {
+    // Stand in for a WFE with a short nap so spinning callers don't burn a host core
+    absolute_time_t napEnd = make_timeout_time_us(10);
+    sleep_until((napEnd < timeout_timestamp) ? napEnd : timeout_timestamp);
+
+    return time_reached(timeout_timestamp);
+}
@@ -0,0 +1,340 @@
+#include "sim_internal.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/uart.h"
+
+#define UART_BITS_PER_FRAME         (10)        // 8n1: start + 8 data + stop
+#define NO_PENDING_REQUEST          (UINT64_MAX)
+
+
+typedef struct {
+    uint8_t mByte;
+    uint64_t mArrivalNS;
+} SimUARTByte;
+
+struct uart_inst {
+    uint mIndex;
+    bool mEnabled;
+    uint mBaudrate;
+    uint mRemoteBaudrate;
+    pthread_mutex_t mLock;
+
+    // Transmit side: time at which the last byte written into the TX FIFO leaves the wire
+    uint64_t mTXLineFreeNS;
+    SimUARTSink mSink;
+    void *mSinkContext;
+
+    // Receive side: bytes in flight from the remote end, plus the RX FIFO they land in
+    SimUARTByte *mInFlight;
+    size_t mInFlightCapacity;
+    size_t mInFlightHead;
+    size_t mInFlightCount;
+    uint64_t mRXLineFreeNS;
+    SimUARTByte mRXFIFO[UART_FIFO_DEPTH];
+    uint mRXFIFOHead;
+    uint mRXFIFOCount;
+
+    uint64_t mPendingRequestNS;
+    SimUARTStats mStats;
+};
+
+uart_inst_t sim_uart0_inst = {
+    .mIndex = 0,
+    .mLock = PTHREAD_MUTEX_INITIALIZER,
+    .mPendingRequestNS = NO_PENDING_REQUEST
+};
+
+uart_inst_t sim_uart1_inst = {
+    .mIndex = 1,
+    .mLock = PTHREAD_MUTEX_INITIALIZER,
+    .mPendingRequestNS = NO_PENDING_REQUEST
+};
+
+static uart_hw_t _uartRegisters[2];
+
+
+static uint64_t byte_time_ns(uint baudrate) {
+    return baudrate ? ((UART_BITS_PER_FRAME * 1000000000ull) / baudrate) : 0;
+}
+
+static bool line_rates_match(uart_inst_t *uart) {
+    return !uart->mRemoteBaudrate || (uart->mRemoteBaudrate == uart->mBaudrate);
+}
+
+// Deterministically mangle a byte sampled at the wrong baud rate
+static uint8_t corrupt_byte(uint8_t b) {
+    return (uint8_t) ((b * 37) ^ 0xA5);
+}
+
+// Moves every in-flight byte which has arrived by now into the RX FIFO, dropping bytes that find the FIFO
+// full. Nothing reads the FIFO between calls, so doing this lazily gives the same result as doing it as
+// each byte lands. Must be called with the lock held.
+static void pump_rx_locked(uart_inst_t *uart, uint64_t nowNS) {
+    while(uart->mInFlightCount) {
+        SimUARTByte *next = &uart->mInFlight[uart->mInFlightHead];
+        if(next->mArrivalNS > nowNS) {
+            break;
+        }
+
+        if(uart->mEnabled && (uart->mRXFIFOCount < UART_FIFO_DEPTH)) {
+            uart->mRXFIFO[(uart->mRXFIFOHead + uart->mRXFIFOCount) % UART_FIFO_DEPTH] = *next;
+            uart->mRXFIFOCount++;
+        } else {
+            uart->mStats.mRXOverruns++;
+        }
+        uart->mStats.mBytesReceived++;
+
+        uart->mInFlightHead = (uart->mInFlightHead + 1) % uart->mInFlightCapacity;
+        uart->mInFlightCount--;
+    }
+}
+
+static uint tx_fifo_level_locked(uart_inst_t *uart, uint64_t nowNS) {
+    uint64_t byteTime = byte_time_ns(uart->mBaudrate);
+    if(!byteTime || (uart->mTXLineFreeNS <= nowNS)) {
+        return 0;
+    }
+
+    return (uint) (((uart->mTXLineFreeNS - nowNS) + byteTime - 1) / byteTime);
+}
+
+
+        // SDK UART API //
+
+uint uart_init(uart_inst_t *uart, uint baudrate) {
+    pthread_mutex_lock(&uart->mLock);
+    uart->mEnabled = true;
+    uart->mBaudrate = baudrate;
+    uart->mRXFIFOCount = 0;
+    pthread_mutex_unlock(&uart->mLock);
+
+    return baudrate;
+}
+
+void uart_deinit(uart_inst_t *uart) {
+    pthread_mutex_lock(&uart->mLock);
+    uart->mEnabled = false;
+    uart->mRXFIFOCount = 0;
+    pthread_mutex_unlock(&uart->mLock);
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate) {
+    pthread_mutex_lock(&uart->mLock);
+    uart->mBaudrate = baudrate;
+    pthread_mutex_unlock(&uart->mLock);
+
+    return baudrate;
+}
+
+uint uart_get_index(uart_inst_t *uart) {
+    return uart->mIndex;
+}
+
+uart_hw_t* uart_get_hw(uart_inst_t *uart) {
+    return &_uartRegisters[uart->mIndex];
+}
+
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity) {
+    (void) uart;
+    (void) data_bits;
+    (void) stop_bits;
+    (void) parity;
+}
+
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts) {
+    (void) uart;
+    (void) cts;
+    (void) rts;
+}
+
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled) {
+    (void) uart;
+    (void) enabled;
+}
+
+bool uart_is_writable(uart_inst_t *uart) {
+    pthread_mutex_lock(&uart->mLock);
+    bool writable = (tx_fifo_level_locked(uart, sim_time_ns()) < UART_FIFO_DEPTH);
+    pthread_mutex_unlock(&uart->mLock);
+
+    return writable;
+}
+
+bool uart_is_readable(uart_inst_t *uart) {
+    pthread_mutex_lock(&uart->mLock);
+    pump_rx_locked(uart, sim_time_ns());
+    bool readable = (uart->mRXFIFOCount > 0);
+    pthread_mutex_unlock(&uart->mLock);
+
+    return readable;
+}
+
+void uart_tx_wait_blocking(uart_inst_t *uart) {
+    pthread_mutex_lock(&uart->mLock);
+    uint64_t lineFree = uart->mTXLineFreeNS;
+    pthread_mutex_unlock(&uart->mLock);
+
+    sim_sleep_until_ns(lineFree);
+}
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
+    for(size_t i = 0; i < len; ++i) {
+        pthread_mutex_lock(&uart->mLock);
+        uint64_t byteTime = byte_time_ns(uart->mBaudrate);
+        uint64_t now = sim_time_ns();
+
+        // Wait for space in the TX FIFO
+        if(tx_fifo_level_locked(uart, now) >= UART_FIFO_DEPTH) {
+            uint64_t spaceAt = uart->mTXLineFreeNS - ((UART_FIFO_DEPTH - 1) * byteTime);
+            pthread_mutex_unlock(&uart->mLock);
+            sim_sleep_until_ns(spaceAt);
+            pthread_mutex_lock(&uart->mLock);
+
+            uint64_t resumed = sim_time_ns();
+            uart->mStats.mTXStallTimeUS += (resumed - now) / 1000;
+            now = resumed;
+        }
+
+        // Only a byte which starts a new burst on an idle line counts as the start of a response
+        bool lineIdle = (uart->mTXLineFreeNS <= now);
+        uart->mTXLineFreeNS = sim_max_u64(uart->mTXLineFreeNS, now) + byteTime;
+        uart->mStats.mBytesTransmitted++;
+
+        if(!lineIdle) {
+            uart->mPendingRequestNS = NO_PENDING_REQUEST;
+        } else if(uart->mPendingRequestNS != NO_PENDING_REQUEST) {
+            uint64_t latencyUS = (now - uart->mPendingRequestNS) / 1000;
+            if(!uart->mStats.mResponseCount || (latencyUS < uart->mStats.mResponseLatencyMinUS)) {
+                uart->mStats.mResponseLatencyMinUS = latencyUS;
+            }
+            if(latencyUS > uart->mStats.mResponseLatencyMaxUS) {
+                uart->mStats.mResponseLatencyMaxUS = latencyUS;
+            }
+            uart->mStats.mResponseLatencyTotalUS += latencyUS;
+            uart->mStats.mResponseCount++;
+            uart->mPendingRequestNS = NO_PENDING_REQUEST;
+        }
+
+        uint8_t b = line_rates_match(uart) ? src[i] : corrupt_byte(src[i]);
+        SimUARTSink sink = uart->mSink;
+        void *sinkContext = uart->mSinkContext;
+        pthread_mutex_unlock(&uart->mLock);
+
+        if(sink) {
+            sink(sinkContext, &b, 1);
+        }
+    }
+}
+
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len) {
+    for(size_t i = 0; i < len; ++i) {
+        pthread_mutex_lock(&uart->mLock);
+        pump_rx_locked(uart, sim_time_ns());
+
+        while(!uart->mRXFIFOCount) {
+            // Sleep until the next byte lands, or poll if nothing is on its way
+            uint64_t wakeAt = uart->mInFlightCount ?
+                uart->mInFlight[uart->mInFlightHead].mArrivalNS :
+                (sim_time_ns() + 100000);
+
+            pthread_mutex_unlock(&uart->mLock);
+            sim_sleep_until_ns(wakeAt);
+            pthread_mutex_lock(&uart->mLock);
+            pump_rx_locked(uart, sim_time_ns());
+        }
+
+        SimUARTByte *b = &uart->mRXFIFO[uart->mRXFIFOHead];
+        dst[i] = b->mByte;
+        uart->mPendingRequestNS = b->mArrivalNS;
+        uart->mRXFIFOHead = (uart->mRXFIFOHead + 1) % UART_FIFO_DEPTH;
+        uart->mRXFIFOCount--;
+        pthread_mutex_unlock(&uart->mLock);
+    }
+}
+
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us) {
+    absolute_time_t timeout = make_timeout_time_us(us);
+    do {
+        if(uart_is_readable(uart)) {
+            return true;
+        }
+    } while(!best_effort_wfe_or_timeout(timeout));
+
+    return uart_is_readable(uart);
+}
+
+
+        // Simulation internals //
+
+uart_inst_t* sim_uart_from_data_register(uintptr_t address) {
+    if(address == (uintptr_t) &_uartRegisters[0].dr) {
+        return uart0;
+    }
+    if(address == (uintptr_t) &_uartRegisters[1].dr) {
+        return uart1;
+    }
+
+    return 0;
+}
+
+
+        // Simulation API //
+
+void sim_uart_set_sink(uart_inst_t *uart, SimUARTSink sink, void *context) {
+    pthread_mutex_lock(&uart->mLock);
+    uart->mSink = sink;
+    uart->mSinkContext = context;
+    pthread_mutex_unlock(&uart->mLock);
+}
+
+void sim_uart_send_to_device(uart_inst_t *uart, const uint8_t *data, size_t len) {
+    pthread_mutex_lock(&uart->mLock);
+
+    if((uart->mInFlightCount + len) > uart->mInFlightCapacity) {
+        size_t newCapacity = uart->mInFlightCapacity ? uart->mInFlightCapacity : 256;
+        while(newCapacity < (uart->mInFlightCount + len)) {
+            newCapacity *= 2;
+        }
+
+        SimUARTByte *newBuffer = malloc(newCapacity * sizeof(SimUARTByte));
+        for(size_t i = 0; i < uart->mInFlightCount; ++i) {
+            newBuffer[i] = uart->mInFlight[(uart->mInFlightHead + i) % uart->mInFlightCapacity];
+        }
+        free(uart->mInFlight);
+
+        uart->mInFlight = newBuffer;
+        uart->mInFlightCapacity = newCapacity;
+        uart->mInFlightHead = 0;
+    }
+
+    uint remoteBaudrate = uart->mRemoteBaudrate ? uart->mRemoteBaudrate : uart->mBaudrate;
+    uint64_t byteTime = byte_time_ns(remoteBaudrate);
+    uint64_t now = sim_time_ns();
+
+    for(size_t i = 0; i < len; ++i) {
+        uart->mRXLineFreeNS = sim_max_u64(uart->mRXLineFreeNS, now) + byteTime;
+
+        SimUARTByte *b = &uart->mInFlight[(uart->mInFlightHead + uart->mInFlightCount) % uart->mInFlightCapacity];
+        b->mByte = line_rates_match(uart) ? data[i] : corrupt_byte(data[i]);
+        b->mArrivalNS = uart->mRXLineFreeNS;
+        uart->mInFlightCount++;
+    }
+
+    pthread_mutex_unlock(&uart->mLock);
+}
+
+void sim_uart_set_remote_baudrate(uart_inst_t *uart, uint baudrate) {
+    pthread_mutex_lock(&uart->mLock);
+    uart->mRemoteBaudrate = baudrate;
+    pthread_mutex_unlock(&uart->mLock);
+}
+
+void sim_uart_get_stats(uart_inst_t *uart, SimUARTStats *stats) {
+    pthread_mutex_lock(&uart->mLock);
+    pump_rx_locked(uart, sim_time_ns());
+    *stats = uart->mStats;
+    pthread_mutex_unlock(&uart->mLock);
+}
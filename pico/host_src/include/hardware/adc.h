@@ -0,0 +1,12 @@
+#ifndef _HOST_HARDWARE_ADC_H
+#define _HOST_HARDWARE_ADC_H
+
+#include "pico.h"
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint adc_get_selected_input(void);
+uint16_t adc_read(void);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef _HOST_HARDWARE_DMA_H
+#define _HOST_HARDWARE_DMA_H
+
+#include "pico.h"
+#include "hardware/regs/dreq.h"
+
+// Simulated DMA controller. Triggered channels are run by a simulation thread standing in for the DMA
+// engine, paced by the peripheral they read from or write to (UART data registers and PIO FIFOs), so the
+// channel registers can be polled by the firmware exactly as they are on the device.
+
+#define NUM_DMA_CHANNELS                    (12)
+
+#define DMA_CH0_CTRL_TRIG_EN_BITS           (0x00000001u)
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS         (0x01000000u)
+
+// Addresses are pointer sized on the host, so the address registers are wider than on the device
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    io_rw_32 transfer_count;
+    io_rw_32 ctrl_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    io_rw_32 intr;
+    io_rw_32 inte0;
+    io_rw_32 ints0;
+    io_rw_32 inte1;
+    io_rw_32 ints1;
+} dma_hw_t;
+
+extern dma_hw_t sim_dma_hw_inst;
+
+#define dma_hw                              (&sim_dma_hw_inst)
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8  = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool read_increment;
+    bool write_increment;
+    uint dreq;
+    uint chain_to;
+    bool ring_write;
+    uint ring_size_bits;
+    bool irq_quiet;
+    bool enable;
+} dma_channel_config;
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+    c->chain_to = chain_to;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_size_bits = size_bits;
+}
+
+static inline void channel_config_set_irq_quiet(dma_channel_config *c, bool irq_quiet) {
+    c->irq_quiet = irq_quiet;
+}
+
+static inline void channel_config_set_enable(dma_channel_config *c, bool enable) {
+    c->enable = enable;
+}
+
+static inline dma_channel_hw_t* dma_channel_hw_addr(uint channel) {
+    return &dma_hw->ch[channel];
+}
+
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+int dma_claim_unused_channel(bool required);
+bool dma_channel_is_claimed(uint channel);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq0_status(uint channel);
+void dma_channel_acknowledge_irq0(uint channel);
+
+static inline void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+static inline void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count) {
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _HOST_HARDWARE_FLASH_H
+#define _HOST_HARDWARE_FLASH_H
+
+#include "pico.h"
+
+#define FLASH_PAGE_SIZE             (1u << 8)
+#define FLASH_SECTOR_SIZE           (1u << 12)
+#define FLASH_BLOCK_SIZE            (1u << 16)
+#define FLASH_UNIQUE_ID_SIZE_BYTES  (8)
+
+// Simulated flash contents. On the device flash is read through the XIP window at XIP_BASE; on the host
+// the window is just the backing array.
+extern uint8_t sim_flash_memory[PICO_FLASH_SIZE_BYTES];
+
+#define XIP_BASE                    ((uintptr_t) sim_flash_memory)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+void flash_get_unique_id(uint8_t *id_out);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _HOST_HARDWARE_GPIO_H
+#define _HOST_HARDWARE_GPIO_H
+
+#include "pico.h"
+
+#define NUM_BANK0_GPIOS         (30)
+
+#define GPIO_OUT                (1)
+#define GPIO_IN                 (0)
+
+enum gpio_function {
+    GPIO_FUNC_XIP   = 0,
+    GPIO_FUNC_SPI   = 1,
+    GPIO_FUNC_UART  = 2,
+    GPIO_FUNC_I2C   = 3,
+    GPIO_FUNC_PWM   = 4,
+    GPIO_FUNC_SIO   = 5,
+    GPIO_FUNC_PIO0  = 6,
+    GPIO_FUNC_PIO1  = 7,
+    GPIO_FUNC_GPCK  = 8,
+    GPIO_FUNC_USB   = 9,
+    GPIO_FUNC_NULL  = 0x1f
+};
+
+void gpio_init(uint gpio);
+void gpio_deinit(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+enum gpio_function gpio_get_function(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+bool gpio_is_dir_out(uint gpio);
+void gpio_set_pulls(uint gpio, bool up, bool down);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+
+static inline void gpio_pull_up(uint gpio) {
+    gpio_set_pulls(gpio, true, false);
+}
+
+static inline void gpio_pull_down(uint gpio) {
+    gpio_set_pulls(gpio, false, true);
+}
+
+static inline void gpio_disable_pulls(uint gpio) {
+    gpio_set_pulls(gpio, false, false);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _HOST_HARDWARE_I2C_H
+#define _HOST_HARDWARE_I2C_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/regs/dreq.h"
+#include "hardware/regs/i2c.h"
+
+// Simulated I2C controllers. Transfers are routed to the devices registered with the simulation
+// (see host_sim.h) and take as long as they would on the wire at the configured baud rate.
+//
+// Besides the blocking SDK calls, the controller can be driven through its command FIFO by DMA. Command
+// words written to data_cmd by a DMA channel are clocked out by a simulation thread standing in for the
+// controller, received bytes are read back from data_cmd the same way, and raw_intr_stat/tx_abrt_source
+// report the outcome. Read-to-clear registers can't be modelled in memory, so the interrupt status is
+// cleared whenever a DMA channel is started on the controller instead.
+typedef struct i2c_inst i2c_inst_t;
+
+#define I2C_FIFO_DEPTH          (16)
+
+typedef struct {
+    io_rw_32 enable;
+    io_rw_32 tar;
+    io_rw_32 data_cmd;
+    io_ro_32 raw_intr_stat;
+    io_ro_32 clr_tx_abrt;
+    io_ro_32 clr_stop_det;
+    io_ro_32 tx_abrt_source;
+} i2c_hw_t;
+
+extern i2c_inst_t sim_i2c0_inst;
+extern i2c_inst_t sim_i2c1_inst;
+
+#define i2c0                    (&sim_i2c0_inst)
+#define i2c1                    (&sim_i2c1_inst)
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t *i2c);
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate);
+uint i2c_hw_index(i2c_inst_t *i2c);
+i2c_hw_t* i2c_get_hw(i2c_inst_t *i2c);
+
+static inline uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx) {
+    return DREQ_I2C0_TX + (2 * i2c_hw_index(i2c)) + (is_tx ? 0 : 1);
+}
+
+int i2c_write_blocking_until(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, absolute_time_t until);
+int i2c_read_blocking_until(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop, absolute_time_t until);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+static inline int i2c_write_timeout_us(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, uint timeout_us) {
+    return i2c_write_blocking_until(i2c, addr, src, len, nostop, make_timeout_time_us(timeout_us));
+}
+
+static inline int i2c_read_timeout_us(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop, uint timeout_us) {
+    return i2c_read_blocking_until(i2c, addr, dst, len, nostop, make_timeout_time_us(timeout_us));
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef _HOST_HARDWARE_PIO_H
+#define _HOST_HARDWARE_PIO_H
+
+#include "pico.h"
+#include "hardware/gpio.h"
+#include "hardware/regs/dreq.h"
+
+#define NUM_PIOS                    (2)
+#define NUM_PIO_STATE_MACHINES      (4)
+#define PIO_INSTRUCTION_COUNT       (32)
+#define PIO_FIFO_DEPTH              (4)
+
+// Simulated PIO blocks. The register block only exists so that FIFO addresses can be handed around
+// (e.g. as DMA targets) - the state machines themselves are modelled in host_src/hal/sim_pio.c.
+typedef struct pio_hw {
+    io_wo_32 txf[NUM_PIO_STATE_MACHINES];
+    io_ro_32 rxf[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t sim_pio0_inst;
+extern pio_hw_t sim_pio1_inst;
+
+#define pio0                        (&sim_pio0_inst)
+#define pio1                        (&sim_pio1_inst)
+
+typedef struct {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE  = 0,
+    PIO_FIFO_JOIN_TX    = 1,
+    PIO_FIFO_JOIN_RX    = 2
+};
+
+typedef struct {
+    float clkdiv;
+    uint wrap_target;
+    uint wrap;
+    uint in_base;
+    uint jmp_pin;
+    uint out_base;
+    uint out_count;
+    uint set_base;
+    uint set_count;
+    uint sideset_base;
+    uint sideset_bit_count;
+    bool sideset_optional;
+    bool in_shift_right;
+    bool autopush;
+    uint push_threshold;
+    bool out_shift_right;
+    bool autopull;
+    uint pull_threshold;
+    enum pio_fifo_join fifo_join;
+} pio_sm_config;
+
+static inline uint pio_get_index(PIO pio) {
+    return (pio == pio1) ? 1 : 0;
+}
+
+static inline PIO pio_get_instance(uint instance) {
+    return instance ? pio1 : pio0;
+}
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    return (is_tx ? DREQ_PIO0_TX0 : DREQ_PIO0_RX0) + (pio_get_index(pio) * 8) + sm;
+}
+
+static inline uint pio_encode_delay(uint cycles) {
+    return cycles << 8;
+}
+
+pio_sm_config pio_get_default_sm_config(void);
+
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+
+static inline void sm_config_set_in_pins(pio_sm_config *c, uint in_base) {
+    c->in_base = in_base;
+}
+
+static inline void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+    c->jmp_pin = pin;
+}
+
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) {
+    c->out_base = out_base;
+    c->out_count = out_count;
+}
+
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) {
+    c->set_base = set_base;
+    c->set_count = set_count;
+}
+
+static inline void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) {
+    c->sideset_base = sideset_base;
+}
+
+static inline void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+    c->sideset_bit_count = bit_count;
+    c->sideset_optional = optional;
+    (void) pindirs;
+}
+
+static inline void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    c->in_shift_right = shift_right;
+    c->autopush = autopush;
+    c->push_threshold = push_threshold;
+}
+
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    c->out_shift_right = shift_right;
+    c->autopull = autopull;
+    c->pull_threshold = pull_threshold;
+}
+
+static inline void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+    c->fifo_join = join;
+}
+
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+    c->clkdiv = div;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+void pio_clear_instruction_memory(PIO pio);
+
+void pio_sm_claim(PIO pio, uint sm);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+bool pio_sm_is_claimed(PIO pio, uint sm);
+
+void pio_gpio_init(PIO pio, uint pin);
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get(PIO pio, uint sm);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+
+
+// -- Host simulation hooks --
+//
+// pioasm output can't be executed on the host, so each program's host header (host_src/pio) tells the
+// simulation which behaviour the state machine should model once it has been initialised.
+typedef enum {
+    SIM_PIO_MODEL_NONE = 0,
+    SIM_PIO_MODEL_UART_RX,                  // 8n1 receiver, one byte per FIFO word, left-justified
+    SIM_PIO_MODEL_SONAR_RX,                 // 8n1 receiver packing 0xFF-synced 4 byte frames into a FIFO word, LSB first
+    SIM_PIO_MODEL_SHIFT_REGISTER_IN,        // PISO register reader, one read of (TX word + 1) bits per TX word. Drives the SET and side-set pins
+    SIM_PIO_MODEL_SHIFT_REGISTER_OUT        // SIPO register writer, one write per TX word (bit count less one in the top 5 bits, then the bits). Drives the OUT, SET and side-set pins
+} SimPIOProgramModel;
+
+void sim_pio_sm_set_model(PIO pio, uint sm, SimPIOProgramModel model, uint pin, uint baud);
+
+#endif
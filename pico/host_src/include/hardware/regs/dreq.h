@@ -0,0 +1,19 @@
+#ifndef _HOST_HARDWARE_REGS_DREQ_H
+#define _HOST_HARDWARE_REGS_DREQ_H
+
+// DMA data request signals (same numbering as the RP2040)
+#define DREQ_PIO0_TX0               (0)
+#define DREQ_PIO0_RX0               (4)
+#define DREQ_PIO1_TX0               (8)
+#define DREQ_PIO1_RX0               (12)
+#define DREQ_UART0_TX               (20)
+#define DREQ_UART0_RX               (21)
+#define DREQ_UART1_TX               (22)
+#define DREQ_UART1_RX               (23)
+#define DREQ_I2C0_TX                (32)
+#define DREQ_I2C0_RX                (33)
+#define DREQ_I2C1_TX                (34)
+#define DREQ_I2C1_RX                (35)
+#define DREQ_FORCE                  (63)
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _HOST_HARDWARE_REGS_I2C_H
+#define _HOST_HARDWARE_REGS_I2C_H
+
+// The DW_apb_i2c register bits the firmware drives directly (same values as the RP2040)
+#define I2C_IC_DATA_CMD_CMD_BITS                        (0x00000100u)
+#define I2C_IC_DATA_CMD_STOP_BITS                       (0x00000200u)
+#define I2C_IC_DATA_CMD_RESTART_BITS                    (0x00000400u)
+
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS               (0x00000040u)
+#define I2C_IC_RAW_INTR_STAT_STOP_DET_BITS              (0x00000200u)
+
+#define I2C_IC_ENABLE_ENABLE_BITS                       (0x00000001u)
+#define I2C_IC_ENABLE_ABORT_BITS                        (0x00000002u)
+
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS   (0x00000001u)
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS    (0x00000008u)
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_USER_ABRT_BITS       (0x00010000u)
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _HOST_HARDWARE_SYNC_H
+#define _HOST_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+// Memory barriers. The cores are threads on the host, so a full fence stands in for the DMB instruction
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __mem_fence_acquire(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void __mem_fence_release(void) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Masks interrupts on every core, as simulated handlers run on the peripherals' threads rather than a core's.
+// Must not be called from a handler
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _HOST_HARDWARE_TIMER_H
+#define _HOST_HARDWARE_TIMER_H
+
+#include "pico.h"
+
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t) time_us_64();
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _HOST_HARDWARE_UART_H
+#define _HOST_HARDWARE_UART_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/regs/dreq.h"
+
+// Simulated PL011s. TX drains and RX fills at the configured baud rate, with the same 32 byte FIFOs as
+// the hardware, so blocking writes and RX overruns behave as they do on the device.
+typedef struct uart_inst uart_inst_t;
+
+// Register block. Only the data register's address means anything - it identifies the UART to the DMA
+typedef struct {
+    io_rw_32 dr;
+    io_rw_32 rsr;
+} uart_hw_t;
+
+extern uart_inst_t sim_uart0_inst;
+extern uart_inst_t sim_uart1_inst;
+
+#define uart0                   (&sim_uart0_inst)
+#define uart1                   (&sim_uart1_inst)
+
+#define UART_FIFO_DEPTH         (32)
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+uint uart_get_index(uart_inst_t *uart);
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts);
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled);
+
+uart_hw_t* uart_get_hw(uart_inst_t *uart);
+
+static inline uint uart_get_dreq(uart_inst_t *uart, bool is_tx) {
+    return DREQ_UART0_TX + (2 * uart_get_index(uart)) + (is_tx ? 0 : 1);
+}
+
+bool uart_is_writable(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len);
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us);
+
+static inline void uart_putc_raw(uart_inst_t *uart, char c) {
+    uart_write_blocking(uart, (const uint8_t *) &c, 1);
+}
+
+static inline void uart_putc(uart_inst_t *uart, char c) {
+    if(c == '\n') {
+        uart_putc_raw(uart, '\r');
+    }
+    uart_putc_raw(uart, c);
+}
+
+static inline void uart_puts(uart_inst_t *uart, const char *s) {
+    while(*s) {
+        uart_putc(uart, *s++);
+    }
+}
+
+static inline char uart_getc(uart_inst_t *uart) {
+    uint8_t c;
+    uart_read_blocking(uart, &c, 1);
+    return (char) c;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _HOST_HARDWARE_WATCHDOG_H
+#define _HOST_HARDWARE_WATCHDOG_H
+
+#include "pico.h"
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+void watchdog_update(void);
+bool watchdog_caused_reboot(void);
+bool watchdog_enable_caused_reboot(void);
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms);
+
+#endif
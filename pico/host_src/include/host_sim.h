@@ -0,0 +1,135 @@
+#ifndef _HOST_SIM_H_
+#define _HOST_SIM_H_
+
+#include "pico.h"
+#include "hardware/i2c.h"
+#include "hardware/pio.h"
+#include "hardware/uart.h"
+
+// Simulation-side API for the host build. Firmware code never includes this; it is used by the simulated
+// devices in host_src/sim and by host-only tools to wire up, drive and inspect the simulated board.
+
+
+                        //////////
+                        // GPIO //
+                        //////////
+
+// Called whenever the firmware drives an output pin
+typedef void (*SimGPIOOutputListener)(void *context, uint pin, bool value);
+
+// Called whenever the firmware samples an input pin which a simulated device is driving
+typedef bool (*SimGPIOInputDriver)(void *context, uint pin);
+
+void sim_gpio_add_output_listener(uint pin, SimGPIOOutputListener listener, void *context);
+void sim_gpio_set_input_driver(uint pin, SimGPIOInputDriver driver, void *context);
+bool sim_gpio_get_output_level(uint pin);
+
+
+                        //////////
+                        // UART //
+                        //////////
+
+// Receives every byte the firmware transmits, at the point it is written into the TX FIFO
+typedef void (*SimUARTSink)(void *context, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint64_t mBytesTransmitted;
+    uint64_t mBytesReceived;                    // Bytes which arrived at the RX FIFO (including dropped bytes)
+    uint64_t mRXOverruns;                       // Bytes lost because the RX FIFO was full when they arrived
+    uint64_t mTXStallTimeUS;                    // Time the firmware spent blocked waiting for TX FIFO space
+    uint64_t mResponseCount;                    // Number of request/response latency samples
+    uint64_t mResponseLatencyMinUS;             // Time from a request byte being read to the next byte sent on an idle line
+    uint64_t mResponseLatencyMaxUS;
+    uint64_t mResponseLatencyTotalUS;
+} SimUARTStats;
+
+void sim_uart_set_sink(uart_inst_t *uart, SimUARTSink sink, void *context);
+
+// Sends bytes from the remote end of the link. They arrive at the RX FIFO at the current line rate,
+// after anything already in flight.
+void sim_uart_send_to_device(uart_inst_t *uart, const uint8_t *data, size_t len);
+
+// Sets the baud rate of the remote end of the link. 0 (the default) follows whatever rate the firmware
+// configures; any other mismatching rate corrupts every byte in both directions.
+void sim_uart_set_remote_baudrate(uart_inst_t *uart, uint baudrate);
+
+void sim_uart_get_stats(uart_inst_t *uart, SimUARTStats *stats);
+
+
+                        /////////
+                        // I2C //
+                        /////////
+
+#define SIM_I2C_NO_CHANNEL          (-1)
+
+typedef struct SimI2CDevice SimI2CDevice;
+
+struct SimI2CDevice {
+    uint8_t mAddress;
+    int8_t mChannel;                                                // Multiplexer channel, or SIM_I2C_NO_CHANNEL
+    bool (*mWrite)(SimI2CDevice *device, const uint8_t *src, size_t len);  // Returns false to NACK
+    bool (*mRead)(SimI2CDevice *device, uint8_t *dst, size_t len);         // Returns false to NACK
+    uint mMaxBaudrate;                                              // Fastest clock the device and its cabling keep up with, 0 for any
+    void *mContext;
+    SimI2CDevice *mNext;
+};
+
+typedef struct {
+    uint64_t mTransactions;
+    uint64_t mBytes;
+    uint64_t mNacks;
+    uint64_t mBusTimeUS;
+} SimI2CStats;
+
+void sim_i2c_attach_device(i2c_inst_t *i2c, SimI2CDevice *device);
+
+// Multiplexer channels currently routed to the downstream bus (bit per channel)
+void sim_i2c_set_active_channels(i2c_inst_t *i2c, uint8_t channelMask);
+uint8_t sim_i2c_get_active_channels(i2c_inst_t *i2c);
+
+void sim_i2c_get_stats(i2c_inst_t *i2c, SimI2CStats *stats);
+
+
+                        ////////////////////
+                        // Serial sources //
+                        ////////////////////
+
+// A simulated device transmitting 8n1 serial data on a GPIO, sampled by a PIO state machine. Sources are
+// polled lazily: fetch() returns how many bytes finish arriving within (fromUS, toUS] and copies the first
+// maxBytes of them into dst.
+typedef struct SimSerialSource SimSerialSource;
+
+struct SimSerialSource {
+    size_t (*mFetch)(SimSerialSource *source, uint64_t fromUS, uint64_t toUS, uint8_t *dst, size_t maxBytes);
+    void *mContext;
+};
+
+void sim_serial_attach_source(uint pin, SimSerialSource *source);
+SimSerialSource* sim_serial_get_source(uint pin);
+
+
+                        /////////
+                        // ADC //
+                        /////////
+
+void sim_adc_set_input(uint input, uint16_t rawValue);
+
+
+                        /////////////
+                        // General //
+                        /////////////
+
+typedef struct {
+    uint64_t mLoopCount;                        // Number of watchdog_update() calls (one per core 0 loop)
+    uint64_t mLoopPeriodMinUS;
+    uint64_t mLoopPeriodMaxUS;
+    uint64_t mLoopPeriodTotalUS;
+} SimLoopStats;
+
+uint64_t sim_time_us(void);
+void sim_get_loop_stats(SimLoopStats *stats);
+
+// Prints the simulation statistics for the board peripherals to stderr
+void sim_print_stats(void);
+
+#endif      // _HOST_SIM_H_
@@ -0,0 +1,20 @@
+#ifndef _HOST_PICO_H
+#define _HOST_PICO_H
+
+// Host stand-in for the Pico SDK base header. Only the parts of the SDK the firmware actually touches are
+// provided; everything is backed by the simulation in host_src/hal and host_src/sim.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/types.h"
+#include "pico/error.h"
+#include "pico/platform.h"
+
+#define PICO_ON_DEVICE                  0
+
+// Raspberry Pi Pico board values
+#define PICO_FLASH_SIZE_BYTES           (2 * 1024 * 1024)
+
+#endif
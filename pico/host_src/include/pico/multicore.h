@@ -0,0 +1,17 @@
+#ifndef _HOST_PICO_MULTICORE_H
+#define _HOST_PICO_MULTICORE_H
+
+#include "pico.h"
+
+// Core 1 is simulated by a host thread
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+
+// Lockout parks the other core's thread in a signal handler, the way the SIO FIFO interrupt parks it on the
+// device. The victim core has to have called multicore_lockout_victim_init() first
+void multicore_lockout_victim_init(void);
+bool multicore_lockout_victim_is_initialized(uint core_num);
+void multicore_lockout_start_blocking(void);
+void multicore_lockout_end_blocking(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _HOST_PICO_PLATFORM_H
+#define _HOST_PICO_PLATFORM_H
+
+#include "pico/types.h"
+
+#define __not_in_flash_func(func_name)          func_name
+#define __time_critical_func(func_name)         func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+
+static inline void tight_loop_contents(void) {}
+
+// Returns 0 on the thread running main() and 1 on the thread started by multicore_launch_core1()
+uint get_core_num(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _HOST_PICO_STDLIB_H
+#define _HOST_PICO_STDLIB_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#define PICO_DEFAULT_LED_PIN        25
+
+static inline bool stdio_init_all(void) {
+    return true;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _HOST_PICO_TIME_H
+#define _HOST_PICO_TIME_H
+
+#include "pico.h"
+
+// Simulated time is the host monotonic clock, measured from process start
+
+absolute_time_t get_absolute_time(void);
+
+static const absolute_time_t at_the_end_of_time = UINT64_MAX;
+static const absolute_time_t nil_time = 0;
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t) (t / 1000);
+}
+
+static inline absolute_time_t delayed_by_us(const absolute_time_t t, uint64_t us) {
+    return ((UINT64_MAX - t) < us) ? at_the_end_of_time : (t + us);
+}
+
+static inline absolute_time_t delayed_by_ms(const absolute_time_t t, uint32_t ms) {
+    return delayed_by_us(t, ((uint64_t) ms) * 1000);
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return delayed_by_us(get_absolute_time(), us);
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return delayed_by_ms(get_absolute_time(), ms);
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t) (to - from);
+}
+
+static inline bool is_nil_time(absolute_time_t t) {
+    return (t == nil_time);
+}
+
+static inline bool time_reached(absolute_time_t t) {
+    return (get_absolute_time() >= t);
+}
+
+void sleep_until(absolute_time_t target);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp);
+
+#endif
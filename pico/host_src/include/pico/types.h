@@ -0,0 +1,20 @@
+#ifndef _HOST_PICO_TYPES_H
+#define _HOST_PICO_TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+// Microseconds since (simulated) boot
+typedef uint64_t absolute_time_t;
+
+// Register access types
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+typedef volatile uint16_t io_rw_16;
+typedef volatile uint8_t io_rw_8;
+
+#endif
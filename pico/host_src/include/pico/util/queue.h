@@ -0,0 +1,42 @@
+#ifndef _HOST_PICO_UTIL_QUEUE_H
+#define _HOST_PICO_UTIL_QUEUE_H
+
+#include <pthread.h>
+
+#include "pico.h"
+
+// Multi-core safe queue, matching the pico_util queue API. The SDK guards the queue with a hardware spin
+// lock and uses WFE/SEV for the blocking calls; here a mutex/condition variable pair plays both parts.
+typedef struct {
+    pthread_mutex_t mLock;
+    pthread_cond_t mChanged;
+    uint8_t *data;
+    uint16_t wptr;
+    uint16_t rptr;
+    uint16_t element_size;
+    uint16_t element_count;
+} queue_t;
+
+void queue_init_with_spinlock(queue_t *q, uint element_size, uint element_count, uint spinlock_num);
+void queue_init(queue_t *q, uint element_size, uint element_count);
+void queue_free(queue_t *q);
+
+uint queue_get_level_unsafe(queue_t *q);
+uint queue_get_level(queue_t *q);
+
+static inline bool queue_is_empty(queue_t *q) {
+    return queue_get_level(q) == 0;
+}
+
+static inline bool queue_is_full(queue_t *q) {
+    return queue_get_level(q) == q->element_count;
+}
+
+bool queue_try_add(queue_t *q, const void *data);
+bool queue_try_remove(queue_t *q, void *data);
+bool queue_try_peek(queue_t *q, void *data);
+void queue_add_blocking(queue_t *q, const void *data);
+void queue_remove_blocking(queue_t *q, void *data);
+void queue_peek_blocking(queue_t *q, void *data);
+
+#endif
@@ -0,0 +1,67 @@
+// -------------------------------------------------------------------------- //
+// Host stand-in for the pioasm output of pico_src/pio/shift_register_in.pio. //
+// Keep the program and c-sdk block in step with the .pio source.             //
+// -------------------------------------------------------------------------- //
+
+#pragma once
+
+#include "hardware/pio.h"
+
+// ----------------- //
+// shift_register_in //
+// ----------------- //
+
+#define shift_register_in_wrap_target 0
+#define shift_register_in_wrap 6
+
+static const uint16_t shift_register_in_program_instructions[] = {
+            //     .wrap_target
+    0x90a0, //  0: pull   block           side 0
+    0x6020, //  1: out    x, 32
+    0xe100, //  2: set    pins, 0                [1]
+    0xe101, //  3: set    pins, 1                [1]
+    0x5101, //  4: in     pins, 1         side 0 [1]
+    0x1944, //  5: jmp    x--, 4          side 1 [1]
+    0x9020, //  6: push   block           side 0
+            //     .wrap
+};
+
+static const pio_program_t shift_register_in_program = {
+    .instructions = shift_register_in_program_instructions,
+    .length = 7,
+    .origin = -1,
+};
+
+static inline pio_sm_config shift_register_in_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + shift_register_in_wrap_target, offset + shift_register_in_wrap);
+    sm_config_set_sideset(&c, 2, true, false);
+    return c;
+}
+
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+
+static inline void shift_register_in_program_init(PIO pio, uint sm, uint offset, uint dataPin, uint latchPin, uint clockPin, uint bitRate) {
+    pio_gpio_init(pio, dataPin);
+    pio_gpio_init(pio, latchPin);
+    pio_gpio_init(pio, clockPin);
+    pio_sm_set_consecutive_pindirs(pio, sm, dataPin, 1, false);
+    pio_sm_set_consecutive_pindirs(pio, sm, latchPin, 1, true);
+    pio_sm_set_consecutive_pindirs(pio, sm, clockPin, 1, true);
+
+    pio_sm_config c = shift_register_in_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, dataPin);         // for IN
+    sm_config_set_set_pins(&c, latchPin, 1);    // for SET
+    sm_config_set_sideset_pins(&c, clockPin);
+    // Shift to left, so the first bit read ends up most significant. Pushed by the program once a read is done
+    sm_config_set_in_shift(&c, false, false, 32);
+    sm_config_set_out_shift(&c, true, false, 32);
+    // SM shifts 1 bit per 4 execution cycles
+    float div = (float)clock_get_hz(clk_sys) / (4 * bitRate);
+    sm_config_set_clkdiv(&c, div);
+
+    pio_sm_init(pio, sm, offset, &c);
+    sim_pio_sm_set_model(pio, sm, SIM_PIO_MODEL_SHIFT_REGISTER_IN, dataPin, bitRate);
+    pio_sm_set_enabled(pio, sm, true);
+}
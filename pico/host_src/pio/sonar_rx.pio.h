@@ -0,0 +1,75 @@
+// ------------------------------------------------------------------ //
+// Host stand-in for the pioasm output of pico_src/pio/sonar_rx.pio.   //
+// Keep the program and c-sdk block in step with the .pio source.     //
+// ------------------------------------------------------------------ //
+
+#pragma once
+
+#include "hardware/pio.h"
+
+// -------- //
+// sonar_rx //
+// -------- //
+
+#define sonar_rx_wrap_target 0
+#define sonar_rx_wrap 18
+
+static const uint16_t sonar_rx_program_instructions[] = {
+            //     .wrap_target
+    0xa0c3, //  0: mov    isr, null
+    0x2020, //  1: wait   0 pin, 0
+    0xea27, //  2: set    x, 7                   [10]
+    0x00c5, //  3: jmp    pin, 5
+    0x0009, //  4: jmp    9
+    0x4001, //  5: in     pins, 1
+    0x0543, //  6: jmp    x--, 3                 [5]
+    0x00cb, //  7: jmp    pin, 11
+    0xc014, //  8: irq    nowait 4 rel
+    0x20a0, //  9: wait   1 pin, 0
+    0x0000, // 10: jmp    0
+    0xe042, // 11: set    y, 2
+    0x2020, // 12: wait   0 pin, 0
+    0xea27, // 13: set    x, 7                   [10]
+    0x4001, // 14: in     pins, 1
+    0x064e, // 15: jmp    x--, 14                [6]
+    0x00d2, // 16: jmp    pin, 18
+    0x0008, // 17: jmp    8
+    0x008c, // 18: jmp    y--, 12
+            //     .wrap
+};
+
+static const pio_program_t sonar_rx_program = {
+    .instructions = sonar_rx_program_instructions,
+    .length = 19,
+    .origin = -1,
+};
+
+static inline pio_sm_config sonar_rx_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sonar_rx_wrap_target, offset + sonar_rx_wrap);
+    return c;
+}
+
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+
+static inline void sonar_rx_program_init(PIO pio, uint sm, uint offset, uint pin, uint baud) {
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
+    pio_gpio_init(pio, pin);
+    gpio_pull_up(pin);
+
+    pio_sm_config c = sonar_rx_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, pin); // for WAIT, IN
+    sm_config_set_jmp_pin(&c, pin); // for JMP
+    // Shift to right, autopush a whole frame at a time
+    sm_config_set_in_shift(&c, true, true, 32);
+    // Deeper FIFO as we're not doing any TX, holding 8 frames
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    // SM receives 1 bit per 8 execution cycles.
+    float div = (float)clock_get_hz(clk_sys) / (8 * baud);
+    sm_config_set_clkdiv(&c, div);
+
+    pio_sm_init(pio, sm, offset, &c);
+    sim_pio_sm_set_model(pio, sm, SIM_PIO_MODEL_SONAR_RX, pin, baud);
+    pio_sm_set_enabled(pio, sm, true);
+}
@@ -0,0 +1,59 @@
+#include "sim_board.h"
+
+#include "hardware_definitions.h"
+#include "hardware/sensors/sensor_i2c_interface.h"
+#include "hardware/sensors/sensor_pod.h"
+
+#define SIM_BATTERY_ADC_RAW             (1885)          // ~3.0v through the battery sense divider
+
+static SimBoard _board;
+
+
+void sim_board_init(void) {
+    // I2C multiplexer and the two sensor pods behind it
+    sim_tca9548a_init(&_board.mMultiplexer, SENSOR_I2C, DEFAULT_MULTIPLEXER_ADDRESS, SENSOR_I2C_MULTIPLEXER_RESET_PIN);
+
+    sim_scd30_init(&_board.mSCD30s[0], SENSOR_I2C, I2C_CHANNEL_0, SCD30_I2C_ADDRESS);
+    sim_seesaw_soil_sensor_init(&_board.mSoilSensors[0], SENSOR_I2C, I2C_CHANNEL_0, SOIL_SENSOR_3_ADDRESS, 612);
+
+    sim_scd30_init(&_board.mSCD30s[1], SENSOR_I2C, I2C_CHANNEL_7, SCD30_I2C_ADDRESS);
+    sim_seesaw_soil_sensor_init(&_board.mSoilSensors[1], SENSOR_I2C, I2C_CHANNEL_7, SOIL_SENSOR_1_ADDRESS, 845);
+
+    // The second pod is on a long cable that will not carry more than a slow clock
+    _board.mSCD30s[1].mDevice.mMaxBaudrate = 50 * 1000;
+    _board.mSoilSensors[1].mDevice.mMaxBaudrate = 50 * 1000;
+
+    // Feed level sonars
+    sim_sonar_init(&_board.mSonars[0], SONAR_SENSOR_L1_RX_PIN, SONAR_SENSOR_L1_TX_PIN, 412);
+    sim_sonar_init(&_board.mSonars[1], SONAR_SENSOR_L2_RX_PIN, SONAR_SENSOR_L2_TX_PIN, 655);
+    sim_sonar_init(&_board.mSonars[2], SONAR_SENSOR_R1_RX_PIN, SONAR_SENSOR_R1_TX_PIN, 1280);
+    sim_sonar_init(&_board.mSonars[3], SONAR_SENSOR_R2_RX_PIN, SONAR_SENSOR_R2_TX_PIN, 930);
+
+    // Connected hardware register reads low for attached hardware
+    sim_piso_register_init(
+        &_board.mConnectedHardwareRegister,
+        HARDWARE_CONNECT_SR_LATCH_PIN,
+        HARDWARE_CONNECT_SR_CLOCK_PIN,
+        HARDWARE_CONNECT_SR_DATA_PIN,
+        16
+    );
+    sim_piso_register_set_inputs(
+        &_board.mConnectedHardwareRegister,
+        ~((1 << FEED_SENSOR_L1_CONNECT_ID) |
+          (1 << FEED_SENSOR_R1_CONNECT_ID) |
+          (1 << FEED_SENSOR_L2_CONNECT_ID) |
+          (1 << FEED_SENSOR_R2_CONNECT_ID) |
+          (1 << I2C_DEVICE_0_CONNECT_ID) |
+          (1 << I2C_DEVICE_7_CONNECT_ID)) & 0xFFFF
+    );
+
+    // Sensor status LEDs
+    sim_sipo_register_init(&_board.mLEDRegister, LED_SR_LATCH_PIN, LED_SR_CLOCK_PIN, LED_SR_DATA_PIN);
+
+    // RTC battery
+    sim_adc_set_input(RTC_BATTERY_ADC_PORT, SIM_BATTERY_ADC_RAW);
+}
+
+SimBoard* sim_board_get(void) {
+    return &_board;
+}
@@ -0,0 +1,25 @@
+#ifndef _SIM_BOARD_H_
+#define _SIM_BOARD_H_
+
+#include "sim_devices.h"
+
+// The simulated Hardware Interface Board, wired up as described in hardware_definitions.h
+
+#define SIM_BOARD_NUM_SONARS            (4)
+#define SIM_BOARD_NUM_SENSOR_PODS       (2)
+
+typedef struct {
+    SimTCA9548A mMultiplexer;
+    SimSCD30 mSCD30s[SIM_BOARD_NUM_SENSOR_PODS];
+    SimSeesawSoilSensor mSoilSensors[SIM_BOARD_NUM_SENSOR_PODS];
+    SimSonar mSonars[SIM_BOARD_NUM_SONARS];
+    SimPISORegister mConnectedHardwareRegister;
+    SimSIPORegister mLEDRegister;
+} SimBoard;
+
+// Attaches every simulated device to the HAL. Must be called before the firmware starts.
+void sim_board_init(void);
+
+SimBoard* sim_board_get(void);
+
+#endif      // _SIM_BOARD_H_
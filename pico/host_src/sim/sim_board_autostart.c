@@ -0,0 +1,81 @@
+#include "sim_board.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hardware_definitions.h"
+
+// Brings the simulated board up before the firmware's main() runs, so the firmware sources build for the
+// host unmodified. The controller UART is bridged to stdin/stdout and debug output goes to stderr. Setting
+// PIFEEDER_HOST_RUN_MS limits the run time, after which the simulation statistics are printed.
+//
+// The stdin/stdout end of the controller link follows whatever baud rate the firmware sets, like a remote end
+// which always completes a baud rate change. Setting PIFEEDER_HOST_CONTROLLER_BAUD pins it to a fixed rate
+// instead, so bytes sent at any other rate are garbled in both directions and a baud rate change falls back.
+
+#define STDIN_READ_CHUNK_SIZE           (64)
+
+
+static void write_to_fd(void *context, const uint8_t *data, size_t len) {
+    int fd = (int) (intptr_t) context;
+
+    while(len) {
+        ssize_t written = write(fd, data, len);
+        if(written <= 0) {
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+static void* stdin_reader(void *arg) {
+    uint8_t buffer[STDIN_READ_CHUNK_SIZE];
+    ssize_t bytesRead;
+    (void) arg;
+
+    while((bytesRead = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+        sim_uart_send_to_device(SENSOR_CONTROLLER_UART, buffer, bytesRead);
+    }
+
+    return NULL;
+}
+
+static void* run_timer(void *arg) {
+    uint32_t runMS = (uint32_t) (uintptr_t) arg;
+
+    sleep_ms(runMS);
+    sim_print_stats();
+    fflush(stderr);
+    _exit(0);
+
+    return NULL;
+}
+
+__attribute__((constructor))
+static void sim_board_autostart(void) {
+    pthread_t thread;
+    const char *runMS = getenv("PIFEEDER_HOST_RUN_MS");
+    const char *controllerBaud = getenv("PIFEEDER_HOST_CONTROLLER_BAUD");
+
+    sim_board_init();
+
+    sim_uart_set_sink(STDIO_UART, write_to_fd, (void *) (intptr_t) STDERR_FILENO);
+    sim_uart_set_sink(SENSOR_CONTROLLER_UART, write_to_fd, (void *) (intptr_t) STDOUT_FILENO);
+
+    if(controllerBaud && (atoi(controllerBaud) > 0)) {
+        sim_uart_set_remote_baudrate(SENSOR_CONTROLLER_UART, (uint) atoi(controllerBaud));
+    }
+
+    if(pthread_create(&thread, NULL, stdin_reader, NULL) == 0) {
+        pthread_detach(thread);
+    }
+
+    if(runMS && (atoi(runMS) > 0)) {
+        if(pthread_create(&thread, NULL, run_timer, (void *) (uintptr_t) atoi(runMS)) == 0) {
+            pthread_detach(thread);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef _SIM_DEVICES_H_
+#define _SIM_DEVICES_H_
+
+#include "host_sim.h"
+
+// Behavioural models of the devices attached to the Hardware Interface Board
+
+
+                        ///////////////////////////////////
+                        // TCA9548A I2C multiplexer      //
+                        ///////////////////////////////////
+
+typedef struct {
+    SimI2CDevice mDevice;
+    i2c_inst_t *mI2C;
+    uint8_t mControl;
+} SimTCA9548A;
+
+void sim_tca9548a_init(SimTCA9548A *mux, i2c_inst_t *i2c, uint8_t address, uint resetPin);
+
+
+                        ///////////////////////////////////
+                        // Sensirion SCD30 CO2/T/RH      //
+                        ///////////////////////////////////
+
+#define SIM_SCD30_MAX_RESPONSE_WORDS        (16)
+
+typedef struct {
+    SimI2CDevice mDevice;
+
+    bool mMeasuring;
+    uint16_t mMeasurementIntervalS;
+    uint64_t mMeasurementStartUS;
+    uint64_t mLastReadMeasurement;              // Index of the last measurement read out (0 = none)
+    uint16_t mSettings[4];                      // ASC, FRC, temperature offset, altitude
+
+    uint8_t mResponse[SIM_SCD30_MAX_RESPONSE_WORDS * 3];
+    size_t mResponseLen;
+    uint64_t mResponseReadyUS;                  // The SCD30 needs 3ms between a command and reading the response
+
+    float mCO2;
+    float mTemperature;
+    float mHumidity;
+} SimSCD30;
+
+void sim_scd30_init(SimSCD30 *scd30, i2c_inst_t *i2c, int8_t channel, uint8_t address);
+
+
+                        ///////////////////////////////////
+                        // Adafruit STEMMA soil sensor   //
+                        ///////////////////////////////////
+
+typedef struct {
+    SimI2CDevice mDevice;
+    uint8_t mRegisterBase;
+    uint8_t mRegisterFunction;
+    uint16_t mMoisture;
+} SimSeesawSoilSensor;
+
+void sim_seesaw_soil_sensor_init(SimSeesawSoilSensor *sensor, i2c_inst_t *i2c, int8_t channel, uint8_t address, uint16_t moisture);
+
+
+                        ///////////////////////////////////
+                        // A02YYUW UART sonar            //
+                        ///////////////////////////////////
+
+typedef struct {
+    SimSerialSource mSource;
+    uint mModePin;                              // Sonar only reports processed frames while this is driven high
+    uint mBaudrate;
+    uint64_t mFramePeriodUS;
+    uint64_t mPhaseUS;
+    uint16_t mDistanceMM;
+    uint16_t mNoiseMM;                          // Peak jitter applied to each frame
+    uint mOutlierEvery;                         // Every Nth frame reports a spurious echo (0 = never)
+} SimSonar;
+
+void sim_sonar_init(SimSonar *sonar, uint rxPin, uint modePin, uint16_t distanceMM);
+
+// The distance reported in frame number frameIndex
+uint16_t sim_sonar_frame_distance(SimSonar *sonar, uint64_t frameIndex);
+
+
+                        ///////////////////////////////////
+                        // 74HC165 PISO shift register   //
+                        ///////////////////////////////////
+
+typedef struct {
+    uint mLatchPin;
+    uint mClockPin;
+    uint mDataPin;
+    uint mNumBits;
+    bool mClockLevel;
+    uint32_t mInputs;
+    uint32_t mShiftRegister;
+} SimPISORegister;
+
+void sim_piso_register_init(SimPISORegister *reg, uint latchPin, uint clockPin, uint dataPin, uint numBits);
+void sim_piso_register_set_inputs(SimPISORegister *reg, uint32_t inputs);
+
+
+                        ///////////////////////////////////
+                        // 74HC595 SIPO shift register   //
+                        ///////////////////////////////////
+
+typedef struct {
+    uint mLatchPin;
+    uint mClockPin;
+    uint mDataPin;
+    bool mClockLevel;
+    bool mLatchLevel;
+    uint32_t mShiftRegister;
+    uint32_t mOutputs;
+    uint64_t mLatchCount;
+} SimSIPORegister;
+
+void sim_sipo_register_init(SimSIPORegister *reg, uint latchPin, uint clockPin, uint dataPin);
+
+#endif      // _SIM_DEVICES_H_
@@ -0,0 +1,179 @@
+#include "sim_devices.h"
+
+#include <string.h>
+
+#include "hardware/gpio.h"
+
+#define SONAR_FRAME_SIZE            (4)
+#define SONAR_FRAME_PERIOD_US       (100 * 1000)
+#define SONAR_BAUDRATE              (9600)
+#define SONAR_OUTLIER_DISTANCE_MM   (250)
+
+
+                        ///////////
+                        // Sonar //
+                        ///////////
+
+// Cheap deterministic hash so every run of the simulation produces the same frames
+static uint32_t hash_frame(uint64_t frameIndex) {
+    uint32_t h = (uint32_t) (frameIndex * 2654435761u);
+    h ^= h >> 15;
+    h *= 2246822519u;
+    h ^= h >> 13;
+    return h;
+}
+
+uint16_t sim_sonar_frame_distance(SimSonar *sonar, uint64_t frameIndex) {
+    if(sonar->mOutlierEvery && (frameIndex % sonar->mOutlierEvery) == (sonar->mOutlierEvery - 1)) {
+        return SONAR_OUTLIER_DISTANCE_MM;
+    }
+
+    if(!sonar->mNoiseMM) {
+        return sonar->mDistanceMM;
+    }
+
+    int noise = (int) (hash_frame(frameIndex) % ((2 * sonar->mNoiseMM) + 1)) - sonar->mNoiseMM;
+    return (uint16_t) (sonar->mDistanceMM + noise);
+}
+
+static size_t sonar_fetch(SimSerialSource *source, uint64_t fromUS, uint64_t toUS, uint8_t *dst, size_t maxBytes) {
+    SimSonar *sonar = (SimSonar *) source->mContext;
+    uint64_t byteTimeUS = (10 * 1000000ull) / sonar->mBaudrate;
+    size_t numBytes = 0;
+
+    if(!sim_gpio_get_output_level(sonar->mModePin) || (toUS <= sonar->mPhaseUS)) {
+        return 0;
+    }
+
+    // Frames start at mPhaseUS + (k * mFramePeriodUS) and take four byte times to arrive
+    uint64_t firstFrame = (fromUS > sonar->mPhaseUS) ? ((fromUS - sonar->mPhaseUS) / sonar->mFramePeriodUS) : 0;
+    uint64_t lastFrame = (toUS - sonar->mPhaseUS) / sonar->mFramePeriodUS;
+
+    for(uint64_t frame = firstFrame; frame <= lastFrame; ++frame) {
+        uint64_t frameStart = sonar->mPhaseUS + (frame * sonar->mFramePeriodUS);
+        uint16_t distance = sim_sonar_frame_distance(sonar, frame);
+        uint8_t bytes[SONAR_FRAME_SIZE] = {
+            0xFF,
+            (uint8_t) (distance >> 8),
+            (uint8_t) (distance & 0xFF),
+            0
+        };
+        bytes[3] = (uint8_t) (bytes[0] + bytes[1] + bytes[2]);
+
+        for(int i = 0; i < SONAR_FRAME_SIZE; ++i) {
+            uint64_t arrival = frameStart + ((i + 1) * byteTimeUS);
+
+            if((arrival > fromUS) && (arrival <= toUS)) {
+                if(numBytes < maxBytes) {
+                    dst[numBytes] = bytes[i];
+                }
+                numBytes++;
+            }
+        }
+    }
+
+    return numBytes;
+}
+
+void sim_sonar_init(SimSonar *sonar, uint rxPin, uint modePin, uint16_t distanceMM) {
+    memset(sonar, 0, sizeof(SimSonar));
+
+    sonar->mModePin = modePin;
+    sonar->mBaudrate = SONAR_BAUDRATE;
+    sonar->mFramePeriodUS = SONAR_FRAME_PERIOD_US;
+    sonar->mPhaseUS = (rxPin * 7919) % SONAR_FRAME_PERIOD_US;
+    sonar->mDistanceMM = distanceMM;
+    sonar->mNoiseMM = 3;
+    sonar->mOutlierEvery = 50;
+    sonar->mSource.mFetch = sonar_fetch;
+    sonar->mSource.mContext = sonar;
+
+    sim_serial_attach_source(rxPin, &sonar->mSource);
+}
+
+
+                        /////////////
+                        // 74HC165 //
+                        /////////////
+
+static void piso_latch_listener(void *context, uint pin, bool value) {
+    SimPISORegister *reg = (SimPISORegister *) context;
+    (void) pin;
+
+    // Parallel load is active low
+    if(!value) {
+        reg->mShiftRegister = reg->mInputs;
+    }
+}
+
+static void piso_clock_listener(void *context, uint pin, bool value) {
+    SimPISORegister *reg = (SimPISORegister *) context;
+    (void) pin;
+
+    if(value && !reg->mClockLevel && sim_gpio_get_output_level(reg->mLatchPin)) {
+        reg->mShiftRegister <<= 1;
+    }
+    reg->mClockLevel = value;
+}
+
+static bool piso_data_driver(void *context, uint pin) {
+    SimPISORegister *reg = (SimPISORegister *) context;
+    (void) pin;
+
+    uint32_t value = sim_gpio_get_output_level(reg->mLatchPin) ? reg->mShiftRegister : reg->mInputs;
+    return (value >> (reg->mNumBits - 1)) & 1;
+}
+
+void sim_piso_register_init(SimPISORegister *reg, uint latchPin, uint clockPin, uint dataPin, uint numBits) {
+    memset(reg, 0, sizeof(SimPISORegister));
+
+    reg->mLatchPin = latchPin;
+    reg->mClockPin = clockPin;
+    reg->mDataPin = dataPin;
+    reg->mNumBits = numBits;
+
+    sim_gpio_add_output_listener(latchPin, piso_latch_listener, reg);
+    sim_gpio_add_output_listener(clockPin, piso_clock_listener, reg);
+    sim_gpio_set_input_driver(dataPin, piso_data_driver, reg);
+}
+
+void sim_piso_register_set_inputs(SimPISORegister *reg, uint32_t inputs) {
+    reg->mInputs = inputs;
+}
+
+
+                        /////////////
+                        // 74HC595 //
+                        /////////////
+
+static void sipo_clock_listener(void *context, uint pin, bool value) {
+    SimSIPORegister *reg = (SimSIPORegister *) context;
+    (void) pin;
+
+    if(value && !reg->mClockLevel) {
+        reg->mShiftRegister = (reg->mShiftRegister << 1) | (sim_gpio_get_output_level(reg->mDataPin) ? 1 : 0);
+    }
+    reg->mClockLevel = value;
+}
+
+static void sipo_latch_listener(void *context, uint pin, bool value) {
+    SimSIPORegister *reg = (SimSIPORegister *) context;
+    (void) pin;
+
+    if(value && !reg->mLatchLevel) {
+        reg->mOutputs = reg->mShiftRegister;
+        reg->mLatchCount++;
+    }
+    reg->mLatchLevel = value;
+}
+
+void sim_sipo_register_init(SimSIPORegister *reg, uint latchPin, uint clockPin, uint dataPin) {
+    memset(reg, 0, sizeof(SimSIPORegister));
+
+    reg->mLatchPin = latchPin;
+    reg->mClockPin = clockPin;
+    reg->mDataPin = dataPin;
+
+    sim_gpio_add_output_listener(clockPin, sipo_clock_listener, reg);
+    sim_gpio_add_output_listener(latchPin, sipo_latch_listener, reg);
+}
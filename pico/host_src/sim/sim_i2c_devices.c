@@ -0,0 +1,306 @@
+#include "sim_devices.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/gpio.h"
+
+#define SCD30_COMMAND_DELAY_US          (3000)
+#define SCD30_MAX_BAUDRATE              (100 * 1000)
+#define SCD30_DEFAULT_INTERVAL_S        (2)
+
+#define SEESAW_STATUS_BASE              (0x00)
+#define SEESAW_STATUS_HW_ID             (0x01)
+#define SEESAW_STATUS_VERSION           (0x02)
+#define SEESAW_STATUS_SWRST             (0x7F)
+#define SEESAW_TOUCH_BASE               (0x0F)
+#define SEESAW_HW_ID_CODE               (0x55)
+
+
+                        //////////////
+                        // TCA9548A //
+                        //////////////
+
+static bool tca9548a_write(SimI2CDevice *device, const uint8_t *src, size_t len) {
+    SimTCA9548A *mux = (SimTCA9548A *) device->mContext;
+
+    mux->mControl = src[len - 1];
+    sim_i2c_set_active_channels(mux->mI2C, mux->mControl);
+    return true;
+}
+
+static bool tca9548a_read(SimI2CDevice *device, uint8_t *dst, size_t len) {
+    SimTCA9548A *mux = (SimTCA9548A *) device->mContext;
+
+    memset(dst, mux->mControl, len);
+    return true;
+}
+
+static void tca9548a_reset_listener(void *context, uint pin, bool value) {
+    SimTCA9548A *mux = (SimTCA9548A *) context;
+    (void) pin;
+
+    // Active low reset deselects every channel
+    if(!value) {
+        mux->mControl = 0;
+        sim_i2c_set_active_channels(mux->mI2C, 0);
+    }
+}
+
+void sim_tca9548a_init(SimTCA9548A *mux, i2c_inst_t *i2c, uint8_t address, uint resetPin) {
+    memset(mux, 0, sizeof(SimTCA9548A));
+
+    mux->mI2C = i2c;
+    mux->mDevice.mAddress = address;
+    mux->mDevice.mChannel = SIM_I2C_NO_CHANNEL;
+    mux->mDevice.mWrite = tca9548a_write;
+    mux->mDevice.mRead = tca9548a_read;
+    mux->mDevice.mContext = mux;
+
+    sim_i2c_attach_device(i2c, &mux->mDevice);
+    sim_gpio_add_output_listener(resetPin, tca9548a_reset_listener, mux);
+}
+
+
+                        ///////////
+                        // SCD30 //
+                        ///////////
+
+static uint8_t scd30_crc(const uint8_t *data, size_t len) {
+    uint8_t crc = 0xFF;
+
+    for(size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for(int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x31) : (uint8_t) (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static void scd30_respond_words(SimSCD30 *scd30, const uint16_t *words, size_t numWords) {
+    scd30->mResponseLen = 0;
+
+    for(size_t i = 0; (i < numWords) && (i < SIM_SCD30_MAX_RESPONSE_WORDS); ++i) {
+        uint8_t *dst = &scd30->mResponse[scd30->mResponseLen];
+        dst[0] = (uint8_t) (words[i] >> 8);
+        dst[1] = (uint8_t) (words[i] & 0xFF);
+        dst[2] = scd30_crc(dst, 2);
+        scd30->mResponseLen += 3;
+    }
+
+    scd30->mResponseReadyUS = sim_time_us() + SCD30_COMMAND_DELAY_US;
+}
+
+static uint64_t scd30_latest_measurement(SimSCD30 *scd30) {
+    if(!scd30->mMeasuring) {
+        return 0;
+    }
+
+    uint64_t intervalUS = ((uint64_t) scd30->mMeasurementIntervalS) * 1000000;
+    return (sim_time_us() - scd30->mMeasurementStartUS) / intervalUS;
+}
+
+static void float_to_words(float value, uint16_t *words) {
+    uint32_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+
+    words[0] = (uint16_t) (raw >> 16);
+    words[1] = (uint16_t) (raw & 0xFFFF);
+}
+
+static bool scd30_write(SimI2CDevice *device, const uint8_t *src, size_t len) {
+    SimSCD30 *scd30 = (SimSCD30 *) device->mContext;
+
+    if(len < 2) {
+        return false;
+    }
+
+    uint16_t command = (uint16_t) ((src[0] << 8) | src[1]);
+    bool hasArgument = (len >= 5) && (scd30_crc(&src[2], 2) == src[4]);
+    uint16_t argument = hasArgument ? (uint16_t) ((src[2] << 8) | src[3]) : 0;
+    uint16_t words[SIM_SCD30_MAX_RESPONSE_WORDS];
+    int settingIndex = -1;
+
+    scd30->mResponseLen = 0;
+
+    switch(command) {
+        case 0x0010:            // Start continuous measurement
+            if(!scd30->mMeasuring) {
+                scd30->mMeasuring = true;
+                scd30->mMeasurementStartUS = sim_time_us();
+                scd30->mLastReadMeasurement = 0;
+            }
+            break;
+
+        case 0x0104:            // Stop continuous measurement
+            scd30->mMeasuring = false;
+            break;
+
+        case 0x4600:            // Measurement interval
+            if(hasArgument && (argument >= 2) && (argument <= 1800)) {
+                scd30->mMeasurementIntervalS = argument;
+            } else if(!hasArgument) {
+                scd30_respond_words(scd30, &scd30->mMeasurementIntervalS, 1);
+            }
+            break;
+
+        case 0x0202:            // Data ready
+            words[0] = (scd30_latest_measurement(scd30) > scd30->mLastReadMeasurement) ? 1 : 0;
+            scd30_respond_words(scd30, words, 1);
+            break;
+
+        case 0x0300: {          // Read measurement
+            uint64_t latest = scd30_latest_measurement(scd30);
+            if(latest > scd30->mLastReadMeasurement) {
+                // Slow drift so consecutive readings differ
+                double t = sim_time_us() / 1000000.0;
+                scd30->mCO2 = 620.f + (float) (40.0 * sin(t / 30.0));
+                scd30->mTemperature = 23.5f + (float) (0.8 * sin(t / 90.0));
+                scd30->mHumidity = 48.f + (float) (3.0 * cos(t / 60.0));
+                scd30->mLastReadMeasurement = latest;
+            }
+
+            float_to_words(scd30->mCO2, &words[0]);
+            float_to_words(scd30->mTemperature, &words[2]);
+            float_to_words(scd30->mHumidity, &words[4]);
+            scd30_respond_words(scd30, words, 6);
+            break;
+        }
+
+        case 0x5306:            // Automatic self calibration
+            settingIndex = 0;
+            break;
+        case 0x5204:            // Forced recalibration value
+            settingIndex = 1;
+            break;
+        case 0x5403:            // Temperature offset
+            settingIndex = 2;
+            break;
+        case 0x5102:            // Altitude compensation
+            settingIndex = 3;
+            break;
+
+        case 0xD100:            // Firmware version
+            words[0] = 0x0342;
+            scd30_respond_words(scd30, words, 1);
+            break;
+
+        case 0xD033: {          // Serial number
+            static const char SERIAL[] = "SIMSCD30000001\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
+            for(int i = 0; i < SIM_SCD30_MAX_RESPONSE_WORDS; ++i) {
+                words[i] = (uint16_t) ((SERIAL[i * 2] << 8) | SERIAL[(i * 2) + 1]);
+            }
+            scd30_respond_words(scd30, words, SIM_SCD30_MAX_RESPONSE_WORDS);
+            break;
+        }
+
+        case 0xD304:            // Soft reset - continuous measurement state survives a reset
+            scd30->mLastReadMeasurement = scd30_latest_measurement(scd30);
+            break;
+
+        default:
+            return false;
+    }
+
+    if(settingIndex >= 0) {
+        if(hasArgument) {
+            scd30->mSettings[settingIndex] = argument;
+        } else {
+            scd30_respond_words(scd30, &scd30->mSettings[settingIndex], 1);
+        }
+    }
+
+    return true;
+}
+
+static bool scd30_read(SimI2CDevice *device, uint8_t *dst, size_t len) {
+    SimSCD30 *scd30 = (SimSCD30 *) device->mContext;
+
+    // Reading before the response has been prepared is NACKed
+    if(!scd30->mResponseLen || (sim_time_us() < scd30->mResponseReadyUS)) {
+        return false;
+    }
+
+    for(size_t i = 0; i < len; ++i) {
+        dst[i] = (i < scd30->mResponseLen) ? scd30->mResponse[i] : 0xFF;
+    }
+
+    return true;
+}
+
+void sim_scd30_init(SimSCD30 *scd30, i2c_inst_t *i2c, int8_t channel, uint8_t address) {
+    memset(scd30, 0, sizeof(SimSCD30));
+
+    scd30->mMeasurementIntervalS = SCD30_DEFAULT_INTERVAL_S;
+    scd30->mDevice.mAddress = address;
+    scd30->mDevice.mChannel = channel;
+    scd30->mDevice.mWrite = scd30_write;
+    scd30->mDevice.mRead = scd30_read;
+    scd30->mDevice.mMaxBaudrate = SCD30_MAX_BAUDRATE;
+    scd30->mDevice.mContext = scd30;
+
+    sim_i2c_attach_device(i2c, &scd30->mDevice);
+}
+
+
+                        ///////////////////
+                        // Seesaw (soil) //
+                        ///////////////////
+
+static bool seesaw_write(SimI2CDevice *device, const uint8_t *src, size_t len) {
+    SimSeesawSoilSensor *sensor = (SimSeesawSoilSensor *) device->mContext;
+
+    if(len < 2) {
+        return false;
+    }
+
+    sensor->mRegisterBase = src[0];
+    sensor->mRegisterFunction = src[1];
+
+    return true;
+}
+
+static bool seesaw_read(SimI2CDevice *device, uint8_t *dst, size_t len) {
+    SimSeesawSoilSensor *sensor = (SimSeesawSoilSensor *) device->mContext;
+    uint8_t response[4] = {0};
+
+    if(sensor->mRegisterBase == SEESAW_STATUS_BASE) {
+        switch(sensor->mRegisterFunction) {
+            case SEESAW_STATUS_HW_ID:
+                response[0] = SEESAW_HW_ID_CODE;
+                break;
+            case SEESAW_STATUS_VERSION:
+                response[0] = 0x0F;
+                response[1] = 0xA3;
+                response[2] = 0x00;
+                response[3] = 0x01;
+                break;
+        }
+    } else if(sensor->mRegisterBase == SEESAW_TOUCH_BASE) {
+        uint16_t moisture = sensor->mMoisture + (uint16_t) ((sim_time_us() / 1000000) % 7);
+        response[0] = (uint8_t) (moisture >> 8);
+        response[1] = (uint8_t) (moisture & 0xFF);
+    }
+
+    for(size_t i = 0; i < len; ++i) {
+        dst[i] = (i < sizeof(response)) ? response[i] : 0;
+    }
+
+    return true;
+}
+
+void sim_seesaw_soil_sensor_init(SimSeesawSoilSensor *sensor, i2c_inst_t *i2c, int8_t channel, uint8_t address, uint16_t moisture) {
+    memset(sensor, 0, sizeof(SimSeesawSoilSensor));
+
+    sensor->mMoisture = moisture;
+    sensor->mDevice.mAddress = address;
+    sensor->mDevice.mChannel = channel;
+    sensor->mDevice.mWrite = seesaw_write;
+    sensor->mDevice.mRead = seesaw_read;
+    sensor->mDevice.mContext = sensor;
+
+    sim_i2c_attach_device(i2c, &sensor->mDevice);
+}
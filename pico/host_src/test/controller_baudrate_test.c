@@ -0,0 +1,227 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_sim.h"
+#include "hardware_definitions.h"
+#include "sensor_definitions.h"
+#include "utils.h"
+#include "mpack/mpack.h"
+#include "uart_controller/uart_sensor_controller.h"
+
+// Host test for the controller link baud rate handshake. The test is the remote end of the simulated controller
+// UART: it sends commands into the RX side, decodes whatever the controller transmits and chooses whether to
+// follow a baud rate change, so both the acknowledged and the fallback paths can be driven.
+//
+//      PiFeederControllerBaudrateTest
+//
+// Registered with ctest. Exits non-zero on the first failed check.
+
+#define REMOTE_BUFFER_SIZE              (64 * 1024)
+#define MAX_HEADER_PACKET_SIZE          (64)            // Anything shorter that fails to decode may just be incomplete
+#define PACKET_WAIT_MS                  (1000)
+#define NO_PACKET_WAIT_MS               (300)           // How long to wait for a response that should never come
+
+#define ACKED_BAUDRATE                  (921600)
+#define UNACKED_BAUDRATE                (1000000)
+
+#define CHECK(condition, ...)                                   \
+    if(!(condition)) {                                          \
+        fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);    \
+        fprintf(stderr, __VA_ARGS__);                           \
+        fprintf(stderr, "\n");                                  \
+        return 1;                                               \
+    }
+
+
+// Remote end of the link. The sink is called from the simulated TX DMA, so the buffer is locked
+typedef struct {
+    pthread_mutex_t mLock;
+    uint8_t mBytes[REMOTE_BUFFER_SIZE];
+    size_t mCount;
+    size_t mParsePos;
+} LoopbackRemote;
+
+typedef struct {
+    uint8_t mCommandID;
+    uint8_t mResponseCode;
+} ReceivedHeader;
+
+
+static ControllerInterface _controller = {
+    .mUART = SENSOR_CONTROLLER_UART,
+    .mMsgPackSensors = sensorPackets,
+    .mNumMsgPackSensors = NUM_SENSORS
+};
+
+static LoopbackRemote _remote = {
+    .mLock = PTHREAD_MUTEX_INITIALIZER
+};
+
+
+static void remote_receive(void *context, const uint8_t *data, size_t len) {
+    LoopbackRemote *remote = (LoopbackRemote *) context;
+
+    pthread_mutex_lock(&remote->mLock);
+    size_t copied = MIN(len, (REMOTE_BUFFER_SIZE - remote->mCount));
+    memcpy(&remote->mBytes[remote->mCount], data, copied);
+    remote->mCount += copied;
+    pthread_mutex_unlock(&remote->mLock);
+}
+
+// Sends a command frame, optionally without its start byte, as bytes garbled around a rate switch can look
+static void remote_send_command_frame(SensorCommandIdentifier command, uint32_t argument, bool withStartByte) {
+    uint8_t frame[COMMAND_LENGTH + 1] = { COMMAND_START_BYTE, command };
+    uint16_t checksum = 0;
+
+    frame[2] = (uint8_t) (argument >> 24);
+    frame[3] = (uint8_t) (argument >> 16);
+    frame[4] = (uint8_t) (argument >> 8);
+    frame[5] = (uint8_t) argument;
+    for(int i = 1; i < COMMAND_LENGTH; ++i) {
+        checksum += frame[i];
+    }
+    frame[COMMAND_LENGTH] = (uint8_t) (checksum & 0xFF);
+
+    if(withStartByte) {
+        sim_uart_send_to_device(_controller.mUART, frame, sizeof(frame));
+    } else {
+        sim_uart_send_to_device(_controller.mUART, &frame[1], COMMAND_LENGTH);
+    }
+}
+
+static void remote_send_command(SensorCommandIdentifier command, uint32_t argument) {
+    remote_send_command_frame(command, argument, true);
+}
+
+static uint8_t* find_bytes(uint8_t *bytes, size_t numBytes, const char *pattern, size_t patternLength) {
+    for(size_t i = 0; (i + patternLength) <= numBytes; ++i) {
+        if(!memcmp(&bytes[i], pattern, patternLength)) {
+            return &bytes[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Decodes the next header packet the controller has sent, skipping other packets. Bytes sent at a rate the
+// remote end was not listening at decode as garbage, so packets are found by their leading packet ID key
+static bool remote_take_header(LoopbackRemote *remote, ReceivedHeader *header) {
+    static const char packetIDKey[] = "\xa9" "packet_id";
+    bool found = false;
+
+    pthread_mutex_lock(&remote->mLock);
+    while(!found) {
+        uint8_t *key = find_bytes(&remote->mBytes[remote->mParsePos], remote->mCount - remote->mParsePos, packetIDKey, sizeof(packetIDKey) - 1);
+        if(!key || (key == remote->mBytes)) {
+            break;
+        }
+
+        size_t start = (size_t) (key - remote->mBytes) - 1;
+        mpack_tree_t tree;
+        mpack_tree_init_data(&tree, (const char *) &remote->mBytes[start], remote->mCount - start);
+        mpack_tree_parse(&tree);
+
+        if(mpack_tree_error(&tree) != mpack_ok) {
+            mpack_tree_destroy(&tree);
+            if((remote->mCount - start) < MAX_HEADER_PACKET_SIZE) {
+                break;
+            }
+
+            remote->mParsePos = start + 2;
+            continue;
+        }
+
+        mpack_node_t root = mpack_tree_root(&tree);
+        if(mpack_node_u8(mpack_node_map_cstr(root, "packet_id")) == HEADER_PACKET) {
+            header->mCommandID = mpack_node_u8(mpack_node_map_cstr(root, "command_id"));
+            header->mResponseCode = mpack_node_u8(mpack_node_map_cstr(root, "response_code"));
+            found = true;
+        }
+        remote->mParsePos = start + mpack_tree_size(&tree);
+        mpack_tree_destroy(&tree);
+    }
+    pthread_mutex_unlock(&remote->mLock);
+
+    return found;
+}
+
+// Runs the controller until it sends the given header packet, or the timeout passes
+static bool run_until_header(uint8_t commandID, uint8_t responseCode, uint32_t timeoutMS) {
+    uint32_t deadline = MILLIS() + timeoutMS;
+    ReceivedHeader header;
+
+    while(MILLIS() < deadline) {
+        update_uart_sensor_controller(&_controller);
+
+        while(remote_take_header(&_remote, &header)) {
+            if((header.mCommandID == commandID) && (header.mResponseCode == responseCode)) {
+                return true;
+            }
+        }
+        sleep_us(100);
+    }
+
+    return false;
+}
+
+static void run_for(uint32_t durationMS) {
+    uint32_t end = MILLIS() + durationMS;
+
+    while(MILLIS() < end) {
+        update_uart_sensor_controller(&_controller);
+        sleep_us(100);
+    }
+}
+
+
+// SET_CONTROLLER_BAUDRATE, the remote end follows, CONTROLLER_READY at the new rate, HEARTBEAT_ACK. The new
+// rate has to outlive the acknowledgement deadline, and nothing without a start byte may run after the switch
+static int test_acknowledged_change(void) {
+    remote_send_command(SET_CONTROLLER_BAUDRATE, ACKED_BAUDRATE);
+    CHECK(run_until_header(SET_CONTROLLER_BAUDRATE, COMMAND_OK, PACKET_WAIT_MS), "no SET_CONTROLLER_BAUDRATE response");
+
+    sim_uart_set_remote_baudrate(_controller.mUART, ACKED_BAUDRATE);
+    CHECK(run_until_header(NO_COMMAND, CONTROLLER_READY, PACKET_WAIT_MS), "no CONTROLLER_READY at %u baud", ACKED_BAUDRATE);
+    CHECK(_controller.mBaudrateState == BAUDRATE_AWAITING_ACK, "not waiting for an ack (state %d)", _controller.mBaudrateState);
+
+    remote_send_command_frame(GET_ALL_SENSOR_VALUES, 0, false);
+    CHECK(!run_until_header(GET_ALL_SENSOR_VALUES, COMMAND_OK, NO_PACKET_WAIT_MS), "ran a command sent without a start byte");
+
+    remote_send_command(HEARTBEAT_ACK, 0);
+    run_for(BAUDRATE_ACK_TIMEOUT_MS + 500);
+    CHECK(_controller.mBaudrateState == BAUDRATE_CONFIRMED, "change not confirmed (state %d)", _controller.mBaudrateState);
+    CHECK(_controller.mBaudrate == ACKED_BAUDRATE, "running at %u baud, expected %u", _controller.mBaudrate, ACKED_BAUDRATE);
+    CHECK(_controller.mFallbackBaudrate == SENSOR_CONTROLLER_BAUDRATE, "fallback moved to %u baud", _controller.mFallbackBaudrate);
+
+    printf("PASS acknowledged change to %u baud\n", ACKED_BAUDRATE);
+    return 0;
+}
+
+// SET_CONTROLLER_BAUDRATE, the remote end stays where it is and never acknowledges. The controller has to come
+// back to the last confirmed rate once the deadline passes and say it is ready there
+static int test_unacknowledged_change(void) {
+    remote_send_command(SET_CONTROLLER_BAUDRATE, UNACKED_BAUDRATE);
+    CHECK(run_until_header(SET_CONTROLLER_BAUDRATE, COMMAND_OK, PACKET_WAIT_MS), "no SET_CONTROLLER_BAUDRATE response");
+    uint32_t switchTime = MILLIS();
+
+    CHECK(run_until_header(NO_COMMAND, CONTROLLER_READY, BAUDRATE_ACK_TIMEOUT_MS + PACKET_WAIT_MS), "no CONTROLLER_READY after the fallback");
+    CHECK((MILLIS() - switchTime) >= BAUDRATE_ACK_TIMEOUT_MS, "fell back after %u ms, before the deadline", (uint) (MILLIS() - switchTime));
+    CHECK(_controller.mBaudrateState == BAUDRATE_CONFIRMED, "fallback not confirmed (state %d)", _controller.mBaudrateState);
+    CHECK(_controller.mBaudrate == ACKED_BAUDRATE, "running at %u baud, expected %u", _controller.mBaudrate, ACKED_BAUDRATE);
+
+    printf("PASS unacknowledged change to %u baud fell back to %u\n", UNACKED_BAUDRATE, ACKED_BAUDRATE);
+    return 0;
+}
+
+int main(void) {
+    sim_uart_set_sink(_controller.mUART, remote_receive, &_remote);
+    sim_uart_set_remote_baudrate(_controller.mUART, SENSOR_CONTROLLER_BAUDRATE);
+    init_sensor_controller(&_controller, SENSOR_CONTROLLER_TX_PIN, SENSOR_CONTROLLER_RX_PIN, SENSOR_CONTROLLER_BAUDRATE);
+
+    if(test_acknowledged_change() || test_unacknowledged_change()) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "sensor_definitions.h"
+#include "sensor_multicore/sensor_multicore_utils.h"
+
+// Host stress test for the cross-core sensor data snapshot. Core 0 and core 1 are run as threads: one publishes
+// sensor data in a tight loop, the other consumes it into the sensor packets as fast as it can. Every publish
+// gives all the sensors readings derived from one generation number, so anything applied from a torn copy (two
+// generations mixed in one sensor, or across sensors) or out of order shows up in the packets. A fast interval
+// timer makes whichever thread is running sleep at arbitrary points, so the copies interleave even on a single
+// CPU host.
+//
+//      PiFeederSnapshotStressTest
+//
+// Registered with ctest. Exits non-zero on the first inconsistent snapshot.
+
+#define PUBLISH_GENERATIONS             (2000000)       // Below 2^24, so every generation is exact as a float
+#define PREEMPT_INTERVAL_US             (100)
+
+
+typedef struct {
+    uint32_t mConsumes;                                 // Calls which applied new data
+    const char *mFailure;
+    uint32_t mFailedGeneration;
+} ConsumerResult;
+
+
+static SensorDataSnapshot _snapshot;
+static volatile bool _publishingDone = false;
+
+
+// Sleeping rather than yielding, so the other thread is sure to be switched in
+static void preempt_handler(int signal) {
+    struct timespec pause = { .tv_nsec = 1000 };
+
+    (void) signal;
+    nanosleep(&pause, NULL);
+}
+
+static void set_preempt_interval(uint32_t intervalUS) {
+    struct itimerval timer = {
+        .it_interval = { .tv_usec = intervalUS },
+        .it_value = { .tv_usec = intervalUS }
+    };
+
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+// Readings for one generation. Each sensor's readings can be checked against each other, and against the
+// generation every other sensor shows
+static void set_generation(Sensor *sensor, uint32_t generation) {
+    SensorData *data = &sensor->mCurrentSensorData;
+
+    data->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
+    switch(sensor->mSensorDefinition.mSensorType) {
+        case SONAR_SENSOR:
+            data->mSensorReading.mSonarSensorData.mDistance = (uint16_t) generation;
+            data->mSensorReading.mSonarSensorData.mConfidence = (uint8_t) (generation % 101);
+            break;
+
+        case SENSOR_POD:
+            data->mSensorReading.mSensorPodData.mCO2Level = (float) generation;
+            data->mSensorReading.mSensorPodData.mTemperature = (float) generation + 0.5f;
+            data->mSensorReading.mSensorPodData.mHumidity = (float) generation + 0.25f;
+            data->mSensorReading.mSensorPodData.mSoilSensorData = (uint16_t) generation;
+            break;
+
+        case BATTERY_SENSOR:
+            data->mSensorReading.mBatteryVoltage = (float) generation;
+            break;
+    }
+}
+
+// Whether every reading in a sensor packet comes from the given generation. The 16 bit readings only hold its
+// low bits, the float readings all of it
+static bool packet_matches_generation(const MsgPackSensorPacket *sensorPacket, uint32_t generation) {
+    const MsgPackReadingValue *values[MAX_CACHED_SENSOR_READINGS];
+
+    for(int i = 0; i < sensorPacket->mCurrentSensorData.mNumReadings; ++i) {
+        values[i] = &sensorPacket->mCurrentSensorData.mSensorReadings[i].mValue;
+    }
+
+    switch(sensorPacket->mSensorType) {
+        case SONAR_SENSOR:
+            return (values[SONAR_SENSOR_READING_INDEX]->mIntValue == (uint16_t) generation) &&
+                   (values[SONAR_SENSOR_CONFIDENCE_READING_INDEX]->mIntValue == (generation % 101));
+
+        case SENSOR_POD:
+            return (values[SENSOR_POD_SOIL_MOISTURE_READING_INDEX]->mIntValue == (uint16_t) generation) &&
+                   (values[SENSOR_POD_CO2_READING_INDEX]->mFloatValue == (float) generation) &&
+                   (values[SENSOR_POD_TEMPERATURE_READING_INDEX]->mFloatValue == ((float) generation + 0.5f)) &&
+                   (values[SENSOR_POD_RH_READING_INDEX]->mFloatValue == ((float) generation + 0.25f));
+
+        case BATTERY_SENSOR:
+            return values[BATTERY_LEVEL_READING_INDEX]->mFloatValue == (float) generation;
+    }
+
+    return false;
+}
+
+// Core 0: every publish changes every sensor, so each one moves the snapshot on by exactly one sequence step
+static void* core0_publisher(void *arg) {
+    (void) arg;
+
+    for(uint32_t generation = 1; generation <= PUBLISH_GENERATIONS; ++generation) {
+        for(int i = 0; i < NUM_SENSORS; ++i) {
+            set_generation(&sensorsList[i], generation);
+        }
+        publish_sensor_data(&_snapshot, sensorsList);
+    }
+
+    __atomic_store_n(&_publishingDone, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Core 1: after every consume, all the packets have to show the same generation, matching the sequence the
+// consume returned, and never one older than the last
+static void* core1_consumer(void *arg) {
+    ConsumerResult *result = (ConsumerResult *) arg;
+    uint32_t lastSequence = 0;
+    bool done = false;
+
+    while(!done) {
+        // Read before consuming, so the last consume is guaranteed to see the final publish
+        done = __atomic_load_n(&_publishingDone, __ATOMIC_ACQUIRE);
+
+        uint32_t sequence = consume_sensor_data_snapshot(&_snapshot, sensorPackets);
+        if(sequence == lastSequence) {
+            continue;
+        }
+
+        uint32_t generation = sequence / 2;
+        if((sequence & 1) || (sequence < lastSequence)) {
+            result->mFailure = "consume returned an odd or older sequence";
+            result->mFailedGeneration = generation;
+            return NULL;
+        }
+
+        for(int i = 0; i < NUM_SENSORS; ++i) {
+            if(!packet_matches_generation(&sensorPackets[i], generation)) {
+                result->mFailure = "sensor packet readings torn, or not from the consumed sequence";
+                result->mFailedGeneration = generation;
+                return NULL;
+            }
+        }
+
+        lastSequence = sequence;
+        result->mConsumes++;
+    }
+
+    if(lastSequence != (PUBLISH_GENERATIONS * 2)) {
+        result->mFailure = "final publish never applied";
+        result->mFailedGeneration = lastSequence / 2;
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    pthread_t core0;
+    pthread_t core1;
+    ConsumerResult result = { 0 };
+    struct sigaction preempt = { .sa_handler = preempt_handler, .sa_flags = SA_RESTART };
+
+    initialize_sensor_data_snapshot(&_snapshot);
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        build_sensor_packet_cache(&sensorPackets[i]);
+    }
+
+    sigaction(SIGALRM, &preempt, NULL);
+    set_preempt_interval(PREEMPT_INTERVAL_US);
+
+    pthread_create(&core1, NULL, core1_consumer, &result);
+    pthread_create(&core0, NULL, core0_publisher, NULL);
+    pthread_join(core0, NULL);
+    pthread_join(core1, NULL);
+    set_preempt_interval(0);
+
+    if(result.mFailure) {
+        fprintf(stderr, "FAIL at generation %u: %s\n", result.mFailedGeneration, result.mFailure);
+        return 1;
+    }
+
+    printf("PASS %u publishes, %u consumes applied new data\n", PUBLISH_GENERATIONS, result.mConsumes);
+    return 0;
+}
@@ -1,25 +1,110 @@
 #include "connected_hardware_monitor.h"
 
+
+// Internal functions
+uint32_t get_scanned_connections_internal(ConnectedHardwareMonitor *monitor);
+void apply_scan_internal(ConnectedHardwareMonitor *monitor, uint32_t scan);
+// -- End internal functions
+
+
 void init_connected_hardware_monitor(ConnectedHardwareMonitor *monitor) {
     if(!monitor) {
         return;
     }
 
     init_shift_register(&monitor->mConnectedHardwareRegister);
+
+    // Wait out the first read, so sensors can be brought up without waiting for the connections to settle
+    while(!read_shift_register_states(&monitor->mConnectedHardwareRegister)) {
+        tight_loop_contents();
+    }
+
+    uint32_t scan = get_scanned_connections_internal(monitor);
+    for(int i = 0; i < CONNECTED_HARDWARE_DEBOUNCE_SCANS; ++i) {
+        monitor->mScans[i] = scan;
+    }
+    monitor->mScanPos = 0;
+    monitor->mConnectedMask = scan;
+    monitor->mConnectedEvents = scan;
+    monitor->mDisconnectedEvents = 0;
+    monitor->mNextScanTime = make_timeout_time_ms(CONNECTED_HARDWARE_SCAN_PERIOD_MS);
 }
 
-void update_connected_hardware_monitor(ConnectedHardwareMonitor *monitor) {
+bool update_connected_hardware_monitor(ConnectedHardwareMonitor *monitor) {
     if(!monitor) {
-        return;
+        return false;
     }
 
-    read_shift_register_states(&monitor->mConnectedHardwareRegister);
+    if(absolute_time_diff_us(get_absolute_time(), monitor->mNextScanTime) <= 0) {
+        monitor->mNextScanTime = make_timeout_time_ms(CONNECTED_HARDWARE_SCAN_PERIOD_MS);
+
+        // A PIO read still in progress just counts as a skipped scan
+        if(read_shift_register_states(&monitor->mConnectedHardwareRegister)) {
+            apply_scan_internal(monitor, get_scanned_connections_internal(monitor));
+        }
+    }
+
+    return (monitor->mConnectedEvents || monitor->mDisconnectedEvents);
 }
 
-bool is_hardware_connected(ConnectedHardwareMonitor *monitor, uint8_t id) {
+absolute_time_t get_next_connected_hardware_scan_time(ConnectedHardwareMonitor *monitor) {
     if(!monitor) {
+        return at_the_end_of_time;
+    }
+
+    return monitor->mNextScanTime;
+}
+
+bool is_hardware_connected(ConnectedHardwareMonitor *monitor, uint8_t id) {
+    if(!monitor || (id >= monitor->mConnectedHardwareRegister.mNumBits)) {
         return false;
     }
 
-    return get_shift_register_state(&monitor->mConnectedHardwareRegister, id);
+    return (monitor->mConnectedMask & (1u << id));
+}
+
+bool take_connected_hardware_events(ConnectedHardwareMonitor *monitor, uint32_t *connected, uint32_t *disconnected) {
+    if(!monitor || !connected || !disconnected) {
+        return false;
+    }
+
+    *connected = monitor->mConnectedEvents;
+    *disconnected = monitor->mDisconnectedEvents;
+    monitor->mConnectedEvents = 0;
+    monitor->mDisconnectedEvents = 0;
+
+    return (*connected || *disconnected);
+}
+
+
+// The register reads low for attached hardware
+uint32_t get_scanned_connections_internal(ConnectedHardwareMonitor *monitor) {
+    ShiftRegister *shiftRegister = &monitor->mConnectedHardwareRegister;
+    uint32_t bitMask = (shiftRegister->mNumBits >= 32) ? UINT32_MAX : ((1u << shiftRegister->mNumBits) - 1);
+
+    return ~shiftRegister->mCurrentValue & bitMask;
+}
+
+// A connection only changes once it has read the same over the last CONNECTED_HARDWARE_DEBOUNCE_SCANS scans, so
+// a connector still being seated can't bounce its sensor up and down. Each connection settles on its own
+void apply_scan_internal(ConnectedHardwareMonitor *monitor, uint32_t scan) {
+    uint32_t alwaysSet = UINT32_MAX;
+    uint32_t alwaysClear = UINT32_MAX;
+
+    monitor->mScans[monitor->mScanPos] = scan;
+    monitor->mScanPos = (monitor->mScanPos + 1) % CONNECTED_HARDWARE_DEBOUNCE_SCANS;
+
+    for(int i = 0; i < CONNECTED_HARDWARE_DEBOUNCE_SCANS; ++i) {
+        alwaysSet &= monitor->mScans[i];
+        alwaysClear &= ~monitor->mScans[i];
+    }
+
+    uint32_t settledMask = (monitor->mConnectedMask | alwaysSet) & ~alwaysClear;
+    uint32_t changedMask = settledMask ^ monitor->mConnectedMask;
+
+    if(changedMask) {
+        monitor->mConnectedEvents |= (changedMask & settledMask);
+        monitor->mDisconnectedEvents |= (changedMask & ~settledMask);
+        monitor->mConnectedMask = settledMask;
+    }
 }
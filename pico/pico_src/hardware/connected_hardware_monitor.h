@@ -4,16 +4,36 @@
 #include "shift_register.h"
 #include "hardware_definitions.h"
 
-// It's basically just a convenience wrapper around a shift register
+#define CONNECTED_HARDWARE_SCAN_PERIOD_MS       (25)
+#define CONNECTED_HARDWARE_DEBOUNCE_SCANS       (3)         // Consecutive scans a connection has to read the same for a change to be accepted
+
+// Watches the hardware connect register, turning plugs and unplugs into events once they have settled
 typedef struct {
     ShiftRegister mConnectedHardwareRegister;
+
+    uint32_t mConnectedMask;                                // Settled connection state, bit per connection ID (set = connected)
+    uint32_t mScans[CONNECTED_HARDWARE_DEBOUNCE_SCANS];     // Most recent scans, as connection masks
+    uint8_t mScanPos;                                       // Where the next scan goes in mScans
+    uint32_t mConnectedEvents;                              // Connection IDs connected since the events were last taken
+    uint32_t mDisconnectedEvents;                           // Connection IDs disconnected since the events were last taken
+    absolute_time_t mNextScanTime;
 } ConnectedHardwareMonitor;
 
 
+// Reads the register straight away, and reports everything found connected as connect events
 void init_connected_hardware_monitor(ConnectedHardwareMonitor *monitor);
-void update_connected_hardware_monitor(ConnectedHardwareMonitor *monitor);
+
+// Scans the register if a scan is due. Returns true if there are connect or disconnect events waiting to be taken
+bool update_connected_hardware_monitor(ConnectedHardwareMonitor *monitor);
+
+// Time the next scan is due, for callers sleeping between updates
+absolute_time_t get_next_connected_hardware_scan_time(ConnectedHardwareMonitor *monitor);
+
 bool is_hardware_connected(ConnectedHardwareMonitor *monitor, uint8_t id);
 
+// Takes the connection IDs connected and disconnected since the last call, as bit masks. An ID can be in both if
+// it was unplugged and plugged back in; is_hardware_connected() gives where it ended up
+bool take_connected_hardware_events(ConnectedHardwareMonitor *monitor, uint32_t *connected, uint32_t *disconnected);
 
-#endif      // _CONNECTED_HARDWARE_MONITOR_H_
 
+#endif      // _CONNECTED_HARDWARE_MONITOR_H_
@@ -23,6 +23,7 @@ const uint8_t CRC_LOOKUP[] = {
 };
 
 const uint8_t READ_DELAY_MS                             = 10;
+const uint16_t DATA_READY_POLL_INTERVAL_MS              = 250;  // Measurements take seconds, no need to ask more often
 
 const uint8_t MAX_SCD30_RESPONSE_WORDS                  = 16;   // Doesn't look like we'll ever receive more than 16 words in a single response
 const uint8_t SCD30_RESPONSE_WORD_SIZE                  = 2;
@@ -51,8 +52,10 @@ bool validate_bytes(uint8_t *data, size_t len, uint8_t checksum);
 float bytes_to_float(uint8_t *data);
 I2CResponse write_scd30_cmd(I2CInterface *i2cInterface, uint8_t address, uint16_t commandCode, uint16_t *args, uint8_t numArgs);
 I2CResponse write_scd30_cmd_no_args(I2CInterface *i2cInterface, uint8_t address, uint16_t commandCode);
+I2CResponse unpack_scd30_response_words(uint8_t *src, uint8_t numWords, uint8_t *dst);
 I2CResponse read_scd30_response_words_into_bytes(I2CInterface *i2cInterface, uint8_t address, uint8_t numWords, uint8_t *dst);
-bool get_scd30_data_ready_status(I2CInterface *i2cInterface, uint8_t address);
+void convert_scd30_measurement(uint8_t *words, SCD30SensorData *data);
+I2CResponse read_scd30_measurement(I2CInterface *i2cInterface, uint8_t address, SCD30SensorData *data);
 // -- End internal functions
 
 uint8_t calc_crc(uint8_t *data, size_t len) {
@@ -122,6 +125,21 @@ I2CResponse write_scd30_cmd_no_args(I2CInterface *i2cInterface, uint8_t address,
     return write_scd30_cmd(i2cInterface, address, commandCode, 0, 0);
 }
 
+// Validates the CRC on each response word and copies out the word bytes
+I2CResponse unpack_scd30_response_words(uint8_t *src, uint8_t numWords, uint8_t *dst) {
+    uint16_t numBytes = (numWords * SCD30_RESPONSE_WORD_BYTE_COUNT);
+
+    for(int root = 0, dstIndex = 0; root < numBytes; root += SCD30_RESPONSE_WORD_BYTE_COUNT) {
+        if(!validate_bytes(&src[root], SCD30_RESPONSE_WORD_SIZE, src[root + SCD30_RESPONSE_WORD_SIZE])) {
+            return I2C_RESPONSE_MALFORMED;
+        }
+        dst[dstIndex++] = src[root];
+        dst[dstIndex++] = src[root + 1];
+    }
+
+    return I2C_RESPONSE_OK;
+}
+
 I2CResponse read_scd30_response_words_into_bytes(I2CInterface *i2cInterface, uint8_t address, uint8_t numWords, uint8_t *dst) {
     uint8_t incomingBuffer[MAX_SCD30_RESPONSE_WORDS * SCD30_RESPONSE_WORD_BYTE_COUNT];
     uint16_t bytesToRead = (numWords * SCD30_RESPONSE_WORD_BYTE_COUNT);
@@ -131,16 +149,12 @@ I2CResponse read_scd30_response_words_into_bytes(I2CInterface *i2cInterface, uin
         return readResponse;
     }
 
-    // Validate the CRC on each word
-    for(int root = 0, dstIndex = 0; root < bytesToRead; root += SCD30_RESPONSE_WORD_BYTE_COUNT) {
-        if(!validate_bytes(&incomingBuffer[root], SCD30_RESPONSE_WORD_SIZE, incomingBuffer[root + SCD30_RESPONSE_WORD_SIZE])) {
-            return I2C_RESPONSE_MALFORMED;
-        }
-        dst[dstIndex++] = incomingBuffer[root];
-        dst[dstIndex++] = incomingBuffer[root + 1];
+    readResponse = unpack_scd30_response_words(incomingBuffer, numWords, dst);
+    if(readResponse == I2C_RESPONSE_MALFORMED) {
+        record_i2c_crc_failure(i2cInterface, get_selected_i2c_channel(i2cInterface), address);
     }
 
-    return I2C_RESPONSE_OK;
+    return readResponse;
 }
 
 I2CResponse write_and_confirm_cmd_args(I2CInterface *i2cInterface, uint8_t address, uint16_t commandCode, uint16_t commandParam) {
@@ -174,6 +188,100 @@ I2CResponse write_and_confirm_cmd_args(I2CInterface *i2cInterface, uint8_t addre
     return valuesMatch ? I2C_RESPONSE_OK : I2C_RESPONSE_COMMAND_FAILED;
 }
 
+// Converts the unpacked words of a SCD30_CMD_READ_MEASUREMENT response
+void convert_scd30_measurement(uint8_t *words, SCD30SensorData *data) {
+    data->mValidReading = true;
+    data->mCO2Reading = bytes_to_float(&words[0]);
+    data->mTemperatureReading = bytes_to_float(&words[4]);
+    data->mHumidityReading = bytes_to_float(&words[8]);
+}
+
+// Reads and converts the response to a SCD30_CMD_READ_MEASUREMENT command
+I2CResponse read_scd30_measurement(I2CInterface *i2cInterface, uint8_t address, SCD30SensorData *data) {
+    const int NUM_READING_RESPONSE_WORDS = 6;
+    uint8_t dataBuffer[MAX_SCD30_RESPONSE_WORDS * SCD30_RESPONSE_WORD_SIZE];
+
+    data->mValidReading = false;
+
+    I2CResponse readResponse = read_scd30_response_words_into_bytes(i2cInterface, address, NUM_READING_RESPONSE_WORDS, dataBuffer);
+    if(readResponse != I2C_RESPONSE_OK) {
+        return readResponse;
+    }
+
+    convert_scd30_measurement(dataBuffer, data);
+    return I2C_RESPONSE_OK;
+}
+
+// Queues a command followed, once the sensor has had time to prepare it, by a read of its response
+bool submit_scd30_reader_command(SCD30Reader *reader, uint16_t commandCode, uint8_t numResponseWords, I2CTransactionCallback callback) {
+    I2CChannel channel = reader->mTransaction.mChannel;
+    uint8_t address = reader->mTransaction.mAddress;
+
+    reader->mCommand[0] = (commandCode & 0xFF00) >> 8;
+    reader->mCommand[1] = (commandCode & 0x00FF);
+
+    init_i2c_transaction(&reader->mTransaction, channel, address, callback, reader);
+    add_i2c_write_step(&reader->mTransaction, reader->mCommand, 2);
+    add_i2c_delay_step(&reader->mTransaction, READ_DELAY_MS);
+    add_i2c_read_step(&reader->mTransaction, reader->mResponse, numResponseWords * SCD30_RESPONSE_WORD_BYTE_COUNT);
+
+    return (submit_i2c_transaction(reader->mInterface, &reader->mTransaction) == I2C_RESPONSE_OK);
+}
+
+void scd30_measurement_callback(void *context, I2CResponse response) {
+    SCD30Reader *reader = (SCD30Reader *) context;
+    uint8_t words[6 * SCD30_RESPONSE_WORD_SIZE];
+
+    if(response == I2C_RESPONSE_OK) {
+        response = unpack_scd30_response_words(reader->mResponse, 6, words);
+        if(response == I2C_RESPONSE_MALFORMED) {
+            record_i2c_crc_failure(reader->mInterface, reader->mTransaction.mChannel, reader->mTransaction.mAddress);
+        }
+    }
+
+    if(response != I2C_RESPONSE_OK) {
+        reader->mFailure = response;
+        reader->mState = SCD30_READER_FAILED;
+        return;
+    }
+
+    convert_scd30_measurement(words, &reader->mData);
+    reader->mState = SCD30_READER_MEASUREMENT_READY;
+}
+
+void scd30_data_ready_callback(void *context, I2CResponse response) {
+    SCD30Reader *reader = (SCD30Reader *) context;
+    uint8_t word[SCD30_RESPONSE_WORD_SIZE];
+
+    if(response == I2C_RESPONSE_OK) {
+        response = unpack_scd30_response_words(reader->mResponse, 1, word);
+        if(response == I2C_RESPONSE_MALFORMED) {
+            record_i2c_crc_failure(reader->mInterface, reader->mTransaction.mChannel, reader->mTransaction.mAddress);
+        }
+    }
+
+    if(response != I2C_RESPONSE_OK) {
+        reader->mFailure = response;
+        reader->mState = SCD30_READER_FAILED;
+        return;
+    }
+
+    // Nothing yet, ask again later
+    if(bytes_to_uint16(word) != 1) {
+        reader->mNextPollTime = make_timeout_time_ms(DATA_READY_POLL_INTERVAL_MS);
+        reader->mState = SCD30_READER_IDLE;
+        return;
+    }
+
+    // The data ready answer is all we need, request the measurement straight away
+    if(!submit_scd30_reader_command(reader, SCD30_CMD_READ_MEASUREMENT, 6, scd30_measurement_callback)) {
+        reader->mFailure = I2C_RESPONSE_BUSY;
+        reader->mState = SCD30_READER_FAILED;
+        return;
+    }
+    reader->mState = SCD30_READER_AWAITING_MEASUREMENT;
+}
+
 
         // Public functions
 
@@ -196,14 +304,14 @@ bool get_scd30_data_ready_status(I2CInterface *i2cInterface, uint8_t address) {
 
     writeResponse = write_scd30_cmd_no_args(i2cInterface, address, SCD30_CMD_GET_DATA_READY);
     if(writeResponse != I2C_RESPONSE_OK) {
-        return writeResponse;
+        return false;
     }
 
     sleep_ms(READ_DELAY_MS);
 
     readResponse = read_scd30_response_words_into_bytes(i2cInterface, address, numResponseWords, response);
     if(readResponse != I2C_RESPONSE_OK) {
-        return readResponse;
+        return false;
     }
 
     uint16_t dataReady = bytes_to_uint16(response);
@@ -211,10 +319,9 @@ bool get_scd30_data_ready_status(I2CInterface *i2cInterface, uint8_t address) {
     return (dataReady == 1);
 }
 
+// Reads the current measurement. Only valid once get_scd30_data_ready_status() has reported data
 SCD30SensorData get_scd30_reading(I2CInterface *i2cInterface, uint8_t address) {
-    const int NUM_READING_RESPONSE_WORDS = 6;
-    uint8_t dataBuffer[MAX_SCD30_RESPONSE_WORDS * SCD30_RESPONSE_WORD_SIZE];
-    I2CResponse writeResponse, readResponse;
+    I2CResponse writeResponse;
 
     SCD30SensorData returnData = {
         .mValidReading          = false,
@@ -223,11 +330,6 @@ SCD30SensorData get_scd30_reading(I2CInterface *i2cInterface, uint8_t address) {
         .mHumidityReading       = -1.f
     };
 
-    // Check whether there is a reading available
-    if(!get_scd30_data_ready_status(i2cInterface, address)) {
-        return returnData;
-    }
-
     // Request reading
     writeResponse = write_scd30_cmd_no_args(i2cInterface, address, SCD30_CMD_READ_MEASUREMENT);
     if(writeResponse != I2C_RESPONSE_OK) {
@@ -237,18 +339,58 @@ SCD30SensorData get_scd30_reading(I2CInterface *i2cInterface, uint8_t address) {
     sleep_ms(READ_DELAY_MS);
 
     // Get byte response
-    readResponse = read_scd30_response_words_into_bytes(i2cInterface, address, NUM_READING_RESPONSE_WORDS, dataBuffer);
-    if(readResponse != I2C_RESPONSE_OK) {
-        return returnData;
+    read_scd30_measurement(i2cInterface, address, &returnData);
+    return returnData;
+}
+
+void reset_scd30_reader(SCD30Reader *reader, I2CInterface *i2cInterface) {
+    if(!reader) {
+        return;
     }
 
-    // Convert and store bytes
-    returnData.mValidReading = true;
-    returnData.mCO2Reading = bytes_to_float(&dataBuffer[0]);
-    returnData.mTemperatureReading = bytes_to_float(&dataBuffer[4]);
-    returnData.mHumidityReading = bytes_to_float(&dataBuffer[8]);
+    // Any transaction still queued belongs to the old connection
+    cancel_i2c_transaction(i2cInterface, &reader->mTransaction);
 
-    return returnData;
+    reader->mState = SCD30_READER_IDLE;
+    reader->mNextPollTime = get_absolute_time();
+}
+
+SCD30ReadResult update_scd30_reader(SCD30Reader *reader, I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, SCD30SensorData *data) {
+    if(!reader || !data) {
+        return SCD30_READ_FAILED;
+    }
+
+    switch(reader->mState) {
+        case SCD30_READER_IDLE:
+            if(!time_reached(reader->mNextPollTime)) {
+                return SCD30_READ_PENDING;
+            }
+
+            // Ask whether a measurement is ready. The callback takes it from there
+            reader->mInterface = i2cInterface;
+            reader->mTransaction.mChannel = channel;
+            reader->mTransaction.mAddress = address;
+            if(submit_scd30_reader_command(reader, SCD30_CMD_GET_DATA_READY, 1, scd30_data_ready_callback)) {
+                reader->mState = SCD30_READER_AWAITING_DATA_READY;
+            }
+            return SCD30_READ_PENDING;
+
+        case SCD30_READER_MEASUREMENT_READY:
+            *data = reader->mData;
+            reader->mNextPollTime = make_timeout_time_ms(DATA_READY_POLL_INTERVAL_MS);
+            reader->mState = SCD30_READER_IDLE;
+            return SCD30_READ_COMPLETE;
+
+        case SCD30_READER_FAILED:
+            // Start again from the top on the next poll
+            data->mValidReading = false;
+            reader->mNextPollTime = make_timeout_time_ms(DATA_READY_POLL_INTERVAL_MS);
+            reader->mState = SCD30_READER_IDLE;
+            return SCD30_READ_FAILED;
+
+        default:
+            return SCD30_READ_PENDING;
+    }
 }
 
 I2CResponse set_scd30_automatic_self_calibration(I2CInterface *i2cInterface, uint8_t address, bool selfCalibrationOn) {
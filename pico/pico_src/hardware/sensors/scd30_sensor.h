@@ -14,12 +14,45 @@ typedef struct {
     float mHumidityReading;
 } SCD30SensorData;
 
+// Outcome of a single step of an SCD30Reader
+typedef enum {
+    SCD30_READ_PENDING,                         // Waiting on the sensor, step again later
+    SCD30_READ_COMPLETE,                        // A new measurement has been read
+    SCD30_READ_FAILED                           // The sensor did not respond properly. The next step starts over
+} SCD30ReadResult;
+
+#define SCD30_MEASUREMENT_RESPONSE_SIZE         (18)    // 6 words, each followed by its CRC
+
+// States of the non-blocking measurement reader
+typedef enum {
+    SCD30_READER_IDLE,                          // Waiting until the next data ready poll is due
+    SCD30_READER_AWAITING_DATA_READY,           // Data ready transaction queued on the bus
+    SCD30_READER_AWAITING_MEASUREMENT,          // Measurement transaction queued on the bus
+    SCD30_READER_MEASUREMENT_READY,             // Holding a measurement for the next step
+    SCD30_READER_FAILED                         // The last transaction failed
+} SCD30ReaderState;
+
+// Non-blocking measurement reader. Commands and their responses go through the interface's transaction
+// queue, and the completion callbacks move the reader along, so stepping it never waits on the bus
+typedef struct {
+    SCD30ReaderState mState;
+    I2CResponse mFailure;                       // Why the last read failed
+    absolute_time_t mNextPollTime;              // When to next ask whether a measurement is ready
+    I2CInterface *mInterface;
+    uint8_t mCommand[2];
+    uint8_t mResponse[SCD30_MEASUREMENT_RESPONSE_SIZE];
+    I2CTransaction mTransaction;
+    SCD30SensorData mData;
+} SCD30Reader;
+
 
 I2CResponse trigger_scd30_continuous_measurement(I2CInterface *i2cInterface, uint8_t address, uint16_t pressureCompensation);
 I2CResponse stop_scd30_continuous_measurement(I2CInterface *i2cInterface, uint8_t address);
 I2CResponse set_scd30_measurement_interval(I2CInterface *i2cInterface, uint8_t address, uint16_t measurementInterval);
 bool get_scd30_data_ready_status(I2CInterface *i2cInterface, uint8_t address);
 SCD30SensorData get_scd30_reading(I2CInterface *i2cInterface, uint8_t address);
+void reset_scd30_reader(SCD30Reader *reader, I2CInterface *i2cInterface);
+SCD30ReadResult update_scd30_reader(SCD30Reader *reader, I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, SCD30SensorData *data);
 I2CResponse set_scd30_automatic_self_calibration(I2CInterface *i2cInterface, uint8_t address, bool selfCalibrationOn);
 I2CResponse set_scd30_forced_recalibration_value(I2CInterface *i2cInterface, uint8_t address, uint16_t referenceValue);
 I2CResponse set_scd30_temperature_offset(I2CInterface *i2cInterface, uint8_t address, uint16_t temperatureOffset);
@@ -4,12 +4,17 @@
 #include <string.h>
 
 #include "debug_io.h"
+#include "perf_stats.h"
 
 bool is_sensor_connected(Sensor *sensor, ConnectedHardwareMonitor *monitor);
 bool initialize_sensor_hardware(Sensor *sensor);
+void shutdown_sensor_hardware(Sensor *sensor);
+void apply_connected_hardware_events(Sensor *sensors, uint8_t numSensors, ConnectedHardwareMonitor *monitor);
 void initialize_sensor_data(Sensor *sensor);
 void debug_sensors(Sensor *sensors, uint8_t numSensors, ConnectedHardwareMonitor *monitor);
 I2CInterface* get_sensor_i2c(Sensor *sensor);
+void update_sensor(Sensor *sensor, ConnectedHardwareMonitor *monitor);
+absolute_time_t get_next_sensor_update_time(Sensor *sensor);
 
 
 bool is_sensor_connected(Sensor *sensor, ConnectedHardwareMonitor *monitor) {
@@ -42,8 +47,7 @@ bool initialize_sensor_hardware(Sensor *sensor) {
     // Initialize underlying sensor hardware
     switch(sensor->mSensorDefinition.mSensorType) {
         case SONAR_SENSOR:
-            initialize_sonar_sensor(&sensor->mSensorDefinition.mSensor.mSonarSensor);
-            initialized = true;
+            initialized = initialize_sonar_sensor(&sensor->mSensorDefinition.mSensor.mSonarSensor);
             break;
         
         case SENSOR_POD:
@@ -59,6 +63,56 @@ bool initialize_sensor_hardware(Sensor *sensor) {
     return initialized;
 }
 
+// Releases whatever a sensor was using once it has been unplugged. Pods and the battery sensor hold nothing
+// that outlives them
+void shutdown_sensor_hardware(Sensor *sensor) {
+    switch(sensor->mSensorDefinition.mSensorType) {
+        case SONAR_SENSOR:
+            stop_sonar_sensor(&sensor->mSensorDefinition.mSensor.mSonarSensor);
+            break;
+
+        default:
+            break;
+    }
+
+    sensor->mHardwareInitialized = false;
+    memset(&sensor->mCurrentSensorData, 0, sizeof(SensorData));
+    initialize_sensor_data(sensor);
+}
+
+// Brings up sensors that have just been plugged in and shuts down those just unplugged, leaving the rest alone.
+// Each one affected is made due straight away, so its new status goes out without waiting for its poll period
+void apply_connected_hardware_events(Sensor *sensors, uint8_t numSensors, ConnectedHardwareMonitor *monitor) {
+    uint32_t connected;
+    uint32_t disconnected;
+
+    if(!take_connected_hardware_events(monitor, &connected, &disconnected)) {
+        return;
+    }
+
+    for(int i = 0; i < numSensors; ++i) {
+        Sensor *sensor = &sensors[i];
+        int8_t connectionID = sensor->mSensorDefinition.mHardwareConnectionID;
+
+        if((connectionID < 0) || !((connected | disconnected) & (1u << connectionID))) {
+            continue;
+        }
+
+        // Something unplugged and plugged straight back in is brought up from scratch
+        if(sensor->mHardwareInitialized || (disconnected & (1u << connectionID))) {
+            DEBUG_PRINT("Sensor %d disconnected\n", sensor->mSensorDefinition.mSensorID);
+            shutdown_sensor_hardware(sensor);
+        }
+
+        if(is_hardware_connected(monitor, connectionID)) {
+            sensor->mHardwareInitialized = initialize_sensor_hardware(sensor);
+            DEBUG_PRINT("Sensor %d connected, initializing: %s\n", sensor->mSensorDefinition.mSensorID, sensor->mHardwareInitialized ? "SUCCESS" : "FAILED");
+        }
+
+        sensor->mNextUpdateTime = get_absolute_time();
+    }
+}
+
 void initialize_sensor_data(Sensor *sensor) {
     if(!sensor) {
         return;
@@ -86,7 +140,7 @@ void debug_sensors(Sensor *sensors, uint8_t numSensors, ConnectedHardwareMonitor
                             DEBUG_PRINT("Awaiting sonar data\n");
                             break;
                         case VALID_SONAR_DATA:
-                            DEBUG_PRINT("%dmm\n", sensorData->mSensorReading.mSonarSensorDistance);
+                            DEBUG_PRINT("%dmm (%d%%)\n", sensorData->mSensorReading.mSonarSensorData.mDistance, sensorData->mSensorReading.mSonarSensorData.mConfidence);
                             break;
                         case INVALID_SONAR_CHECKSUM:
                             DEBUG_PRINT("Invalid checksum\n");
@@ -132,78 +186,130 @@ I2CInterface* get_sensor_i2c(Sensor *sensor) {
 }
 
 
-void update_sensors(Sensor *sensors, uint8_t numSensors, bool debugOutput, ConnectedHardwareMonitor *monitor) {
-    float val;
+void update_sensor(Sensor *sensor, ConnectedHardwareMonitor *monitor) {
+    // First we should check to see if the I2C Interface for this sensor has gotten stuck
+    check_interface_watchdog(get_sensor_i2c(sensor));
 
-    DEBUG_PRINT("Sensor update:\n");
+    // After a (potential) reset we should be good to try the sensor
+    SensorData *sensorData = &sensor->mCurrentSensorData;
+    memset(sensorData, 0, sizeof(SensorData));
 
-    for(int i = 0; i < numSensors; ++i) {
-        Sensor *sensor = &sensors[i];
+    // Check connection
+    if(is_sensor_connected(sensor, monitor)) {
+        // If the sensor has just been connected, initialize its hardware
+        if(!sensor->mHardwareInitialized) {
+            sensor->mHardwareInitialized = initialize_sensor_hardware(sensor);
+            DEBUG_PRINT("    +- Initializing: %s\n", sensor->mHardwareInitialized ? "SUCCESS" : "FAILED");
+        }
 
-        // First we should check to see if the I2C Interface for this sensor has gotten stuck
-        check_interface_watchdog(get_sensor_i2c(sensor));
+        // If the sensor is still in an invalid hardware state, it's probably non-functional.
+        // There is no point in proceeding here.
+        if(!sensor->mHardwareInitialized) {
+            sensorData->mSensorStatus = SENSOR_CONNECTED_MALFUNCTIONING;
+            return;
+        }
 
-        // After a (potential) reset we should be good to try the sensor
-        SensorData *sensorData = &sensor->mCurrentSensorData;
-        DEBUG_PRINT("  +- Updating sensor %d (type: %d)\n", sensor->mSensorDefinition.mSensorID, sensor->mSensorDefinition.mSensorType);
-        memset(sensorData, 0, sizeof(SensorData));
+        switch(sensor->mSensorDefinition.mSensorType) {
+            case SONAR_SENSOR:
+                update_sonar_sensor(&sensor->mSensorDefinition.mSensor.mSonarSensor);
+                if(sensor->mSensorDefinition.mSensor.mSonarSensor.mState == VALID_SONAR_DATA) {
+                    sensorData->mSensorReading.mSonarSensorData = sensor->mSensorDefinition.mSensor.mSonarSensor.mCurrentData;
+                    sensorData->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
+                } else {
+                    sensorData->mSensorStatus = SENSOR_CONNECTED_MALFUNCTIONING;
+                }
+                break;
+
+            case SENSOR_POD:
+                update_sensor_pod(&sensor->mSensorDefinition.mSensor.mSensorPod);
+                if(sensor_pod_has_valid_data(&sensor->mSensorDefinition.mSensor.mSensorPod)) {
+                    sensorData->mSensorReading.mSensorPodData = sensor->mSensorDefinition.mSensor.mSensorPod.mCurrentData;
+                    sensorData->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
+                } else {
+                    sensorData->mSensorStatus = SENSOR_CONNECTED_MALFUNCTIONING;
+                }
+                break;
+
+            case BATTERY_SENSOR:
+                battery_sensor_update(&sensor->mSensorDefinition.mSensor.mBatterySensor);
+                sensorData->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
+                sensorData->mSensorReading.mBatteryVoltage = sensor->mSensorDefinition.mSensor.mBatterySensor.mCurrentVoltage;
+        }
+    } else {
+        // Sensor is disconnected, make sure all flags are in the invalid state
+        sensor->mHardwareInitialized = false;
+        sensorData->mSensorStatus = SENSOR_DISCONNECTED;
+    }
+}
 
-        // Check connection
-        if(is_sensor_connected(sensor, monitor)) {
-            DEBUG_PRINT("    +- Connected\n");
+absolute_time_t get_next_sensor_update_time(Sensor *sensor) {
+    absolute_time_t nextUpdateTime = make_timeout_time_ms(sensor->mSensorDefinition.mPollPeriodMS);
+    absolute_time_t hardwareTime = nextUpdateTime;
+
+    // Sensors in the middle of a timed exchange want to be back as soon as their wait is over,
+    // rather than a whole poll period later. Pods wait on the I2C transaction queue instead
+    if(sensor->mHardwareInitialized) {
+        switch(sensor->mSensorDefinition.mSensorType) {
+            case BATTERY_SENSOR:
+                if(sensor->mSensorDefinition.mSensor.mBatterySensor.mCurrentState == BATTERY_SENSOR_CHARGING) {
+                    hardwareTime = sensor->mSensorDefinition.mSensor.mBatterySensor.mSensorTransitionTime;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
 
-            // If the sensor has just been connected, initialize its hardware
-            if(!sensor->mHardwareInitialized) {
-                sensor->mHardwareInitialized = initialize_sensor_hardware(sensor);
-                DEBUG_PRINT("    +- Initializing: %s\n", sensor->mHardwareInitialized ? "SUCCESS" : "FAILED");
-            }
+    return (absolute_time_diff_us(hardwareTime, nextUpdateTime) > 0) ? hardwareTime : nextUpdateTime;
+}
 
-            // If the sensor is still in an invalid hardware state, it's probably non-functional.
-            // There is no point in proceeding here.
-            if(!sensor->mHardwareInitialized) {
-                sensorData->mSensorStatus = SENSOR_CONNECTED_MALFUNCTIONING;
-                continue;
-            }
+absolute_time_t update_due_sensors(Sensor *sensors, uint8_t numSensors, bool debugOutput, ConnectedHardwareMonitor *monitor) {
+    bool updated = false;
+    absolute_time_t nextDeadline = make_timeout_time_ms(BATTERY_SENSOR_POLL_PERIOD_MS);
 
-            switch(sensor->mSensorDefinition.mSensorType) {
-                case SONAR_SENSOR:
-                    DEBUG_PRINT("    +- Sonar sensor update running...\n");
-                    update_sonar_sensor(&sensor->mSensorDefinition.mSensor.mSonarSensor);
-                    if(sensor->mSensorDefinition.mSensor.mSonarSensor.mState == VALID_SONAR_DATA) {
-                        sensorData->mSensorReading.mSonarSensorDistance = sensor->mSensorDefinition.mSensor.mSonarSensor.mCurrentDistance;
-                        sensorData->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
-                    } else {
-                        sensorData->mSensorStatus = SENSOR_CONNECTED_MALFUNCTIONING;
-                    }
-                    break;
+    // Plugs and unplugs are dealt with before anything is polled
+    apply_connected_hardware_events(sensors, numSensors, monitor);
 
-                case SENSOR_POD:
-                    DEBUG_PRINT("    +- Sensor pod update running...\n");
-                    update_sensor_pod(&sensor->mSensorDefinition.mSensor.mSensorPod);
-                    if(sensor_pod_has_valid_data(&sensor->mSensorDefinition.mSensor.mSensorPod)) {
-                        sensorData->mSensorReading.mSensorPodData = sensor->mSensorDefinition.mSensor.mSensorPod.mCurrentData;
-                        sensorData->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
-                    } else {
-                        sensorData->mSensorStatus = SENSOR_CONNECTED_MALFUNCTIONING;
-                    }
-                    break;
+    while(1) {
+        // Run the most overdue sensor first. Each one is rescheduled into the future once it has
+        // run, so a single pass can never run the same sensor twice
+        Sensor *dueSensor = 0;
+        absolute_time_t now = get_absolute_time();
 
-                case BATTERY_SENSOR:
-                    DEBUG_PRINT("    +- Battery sensor update running...\n");
-                    battery_sensor_update(&sensor->mSensorDefinition.mSensor.mBatterySensor);
-                    sensorData->mSensorStatus = SENSOR_CONNECTED_VALID_DATA;
-                    sensorData->mSensorReading.mBatteryVoltage = sensor->mSensorDefinition.mSensor.mBatterySensor.mCurrentVoltage;
+        for(int i = 0; i < numSensors; ++i) {
+            if((absolute_time_diff_us(sensors[i].mNextUpdateTime, now) >= 0) &&
+               (!dueSensor || (absolute_time_diff_us(sensors[i].mNextUpdateTime, dueSensor->mNextUpdateTime) > 0))) {
+                dueSensor = &sensors[i];
             }
-        } else {
-            // Sensor is disconnected, make sure all flags are in the invalid state
-            DEBUG_PRINT("    +- Not connected\n");
-            sensor->mHardwareInitialized = false;
-            sensorData->mSensorStatus = SENSOR_DISCONNECTED;
+        }
+
+        if(!dueSensor) {
+            break;
+        }
+
+        // Per pass output goes over the debug UART with core 0 blocked, so it is only there when asked for
+        if(!updated && debugOutput) {
+            DEBUG_PRINT("Sensor update:\n");
+        }
+        updated = true;
+
+        PERF_PROBE_START(sensor);
+        update_sensor(dueSensor, monitor);
+        PERF_PROBE_END(sensor, PERF_STAGE_SONAR_UPDATE + dueSensor->mSensorDefinition.mSensorType);
+        dueSensor->mNextUpdateTime = get_next_sensor_update_time(dueSensor);
+    }
+
+    for(int i = 0; i < numSensors; ++i) {
+        if(absolute_time_diff_us(sensors[i].mNextUpdateTime, nextDeadline) > 0) {
+            nextDeadline = sensors[i].mNextUpdateTime;
         }
     }
-    DEBUG_PRINT("--------------------------------\n\n");
 
-    if(debugOutput) {
+    if(updated && debugOutput) {
+        DEBUG_PRINT("--------------------------------\n\n");
         debug_sensors(sensors, numSensors, monitor);
     }
+
+    return nextDeadline;
 }
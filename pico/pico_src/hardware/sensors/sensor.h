@@ -28,7 +28,7 @@ typedef enum {
 } SensorStatus;
 
 typedef union {
-    uint16_t                mSonarSensorDistance;
+    SonarSensorData         mSonarSensorData;
     SensorPodData           mSensorPodData;
     float                   mBatteryVoltage;
 } SensorReading;
@@ -44,12 +44,14 @@ typedef struct {
     uint8_t                 mSensorID;
     int8_t                  mSensorConnectLEDPosition;
     int8_t                  mHardwareConnectionID;
+    uint16_t                mPollPeriodMS;
 } SensorDefinition;
 
 typedef struct {
     SensorDefinition        mSensorDefinition;
     bool                    mHardwareInitialized;
     SensorData              mCurrentSensorData;
+    absolute_time_t         mNextUpdateTime;
 } Sensor;
 
 // Max reading values
@@ -57,6 +59,12 @@ static const uint16_t SONAR_SENSOR_MAX_VALUE    = 16000;
 static const float TEMP_SENSOR_MAX_VALUE        = 100.f;
 static const float RH_SENSOR_MAX_VALUE          = 100.f;
 
-void update_sensors(Sensor *sensors, uint8_t numSensors, bool debugOutput, ConnectedHardwareMonitor *monitor);
+// Poll periods, matched to how often each sensor actually produces new data
+#define SONAR_SENSOR_POLL_PERIOD_MS     (50)        // Frames arrive every ~100ms, each update filters all of them since the last
+#define SENSOR_POD_POLL_PERIOD_MS       (250)       // SCD30 measures every 2s, soil moisture changes slowly
+#define BATTERY_SENSOR_POLL_PERIOD_MS   (2000)
+
+// Runs every sensor whose poll deadline has passed and returns the time the next one is due
+absolute_time_t update_due_sensors(Sensor *sensors, uint8_t numSensors, bool debugOutput, ConnectedHardwareMonitor *monitor);
 
 #endif      // SENSOR_H
@@ -1,10 +1,34 @@
 #include "sensor_i2c_interface.h"
+
+#include <string.h>
+
 #include "hardware/gpio.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "debug_io.h"
+#include "utils.h"
 
 #define DEFAULT_I2C_TIMEOUT_MS      (100)
 #define I2C_WATCHDOG_TIMEOUT_MS     (5000)
+#define I2C_BITS_PER_BYTE           (9)             // 8 data bits + ACK
+#define I2C_NEGOTIATION_PROBES      (3)             // Consecutive good probes before a rate is trusted
 const bool I2C_NOSTOP = false;
+const uint I2C_NEGOTIATION_BAUDRATES[] = {
+    I2C_FAST_MODE_BAUDRATE,
+    I2C_STANDARD_MODE_BAUDRATE
+};
+
+
+// Internal functions
+I2CResponse i2c_bus_error_internal(I2CInterface *i2cInterface, I2CResponse response);
+void apply_selected_channel_baud_internal(I2CInterface *i2cInterface);
+void fail_i2c_transactions_internal(I2CInterface *i2cInterface, I2CResponse response);
+void complete_active_i2c_transaction_internal(I2CInterface *i2cInterface);
+I2CResponse finish_blocking_i2c_transfer_internal(I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, int result, size_t length, uint32_t startUS);
+void record_i2c_transaction_internal(I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, I2CResponse response, uint32_t bytes, uint32_t latencyUS);
+void apply_i2c_stats_reset_internal(I2CInterface *i2cInterface);
+// -- End internal functions
 
 
 // Multiplexer functions
@@ -19,6 +43,7 @@ void init_i2c_multiplexer_internal(I2CMultiplexer *multiplexer) {
 
     // Set reset HIGH to enable multiplexer
     gpio_put(multiplexer->mResetPin, 1);
+    multiplexer->mSelectedChannel = UNKNOWN_I2C_CHANNEL;
 }
 
 void reset_i2c_multiplexer_internal(I2CMultiplexer *multiplexer) {
@@ -30,6 +55,9 @@ void reset_i2c_multiplexer_internal(I2CMultiplexer *multiplexer) {
     gpio_put(multiplexer->mResetPin, 0);
     sleep_ms(2);
     gpio_put(multiplexer->mResetPin, 1);
+
+    // Reset deselects every channel, but there is no telling what a half finished select left behind
+    multiplexer->mSelectedChannel = UNKNOWN_I2C_CHANNEL;
 }
 
 I2CResponse select_i2c_channel_internal(I2CInterface *i2cInterface, I2CMultiplexer *multiplexer, I2CChannel channel) {
@@ -41,14 +69,39 @@ I2CResponse select_i2c_channel_internal(I2CInterface *i2cInterface, I2CMultiplex
         return I2C_RESPONSE_COMMAND_FAILED;
     }
 
+    // Each select is a full bus transaction, so skip it if the multiplexer is already there
+    if(channel == multiplexer->mSelectedChannel) {
+        i2cInterface->mChannelSelectsSkipped++;
+        apply_selected_channel_baud_internal(i2cInterface);
+        return I2C_RESPONSE_OK;
+    }
+
     uint8_t data = (channel == NO_I2C_CHANNEL) ? 0 : (uint8_t) (1 << channel);
 
-    return write_i2c_data(
+    // The devices on the channel being left see the select too, so it goes at that channel's rate
+    apply_selected_channel_baud_internal(i2cInterface);
+
+    i2cInterface->mChannelSelectsIssued++;
+    I2CResponse response = write_i2c_data(
         i2cInterface,
         multiplexer->mMultiplexerAddress,
         &data,
         1
     );
+
+    multiplexer->mSelectedChannel = (response == I2C_RESPONSE_OK) ? channel : UNKNOWN_I2C_CHANNEL;
+    apply_selected_channel_baud_internal(i2cInterface);
+
+    return response;
+}
+
+// Failed transfers can leave the multiplexer in any state, so the next select has to be written
+I2CResponse i2c_bus_error_internal(I2CInterface *i2cInterface, I2CResponse response) {
+    if(i2cInterface->mMultiplexer) {
+        i2cInterface->mMultiplexer->mSelectedChannel = UNKNOWN_I2C_CHANNEL;
+    }
+
+    return response;
 }
 
 
@@ -59,6 +112,7 @@ void init_sensor_bus(I2CInterface *i2cInterface) {
     }
 
     i2c_init(i2cInterface->mI2C, i2cInterface->mBaud);
+    i2cInterface->mCurrentBaud = i2cInterface->mBaud;
     gpio_set_function(i2cInterface->mSDA, GPIO_FUNC_I2C);
     gpio_set_function(i2cInterface->mSCL, GPIO_FUNC_I2C);
 
@@ -67,6 +121,14 @@ void init_sensor_bus(I2CInterface *i2cInterface) {
 
     init_i2c_multiplexer_internal(i2cInterface->mMultiplexer);
     i2cInterface->mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
+
+    // Bus resets come back through here, the DMA channels only need claiming once
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+    if(!queue->mInitialized) {
+        queue->mTXDMAChannel = dma_claim_unused_channel(true);
+        queue->mRXDMAChannel = dma_claim_unused_channel(true);
+        queue->mInitialized = true;
+    }
 }
 
 void shutdown_sensor_bus(I2CInterface *i2cInterface) {
@@ -82,6 +144,15 @@ void reset_sensor_bus(I2CInterface *i2cInterface, bool fullReset) {
         return;
     }
 
+    // Nothing queued survives a reset
+    fail_i2c_transactions_internal(i2cInterface, I2C_RESPONSE_ERROR);
+
+    i2cInterface->mStats.mSequence++;
+    __dmb();
+    i2cInterface->mStats.mBusResets++;
+    __dmb();
+    i2cInterface->mStats.mSequence++;
+
     if(fullReset) {
         shutdown_sensor_bus(i2cInterface);
     }
@@ -97,6 +168,15 @@ I2CResponse select_i2c_channel(I2CInterface *i2cInterface, I2CChannel channel) {
     return select_i2c_channel_internal(i2cInterface, i2cInterface->mMultiplexer, channel);
 }
 
+// Channel the blocking functions are talking on
+I2CChannel get_selected_i2c_channel(I2CInterface *i2cInterface) {
+    if(!i2cInterface || !i2cInterface->mMultiplexer) {
+        return NO_I2C_CHANNEL;
+    }
+
+    return i2cInterface->mMultiplexer->mSelectedChannel;
+}
+
 void reset_interface_watchdog(I2CInterface *i2cInterface) {
     if(i2cInterface) {
         i2cInterface->mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
@@ -112,7 +192,11 @@ void check_interface_watchdog(I2CInterface *i2cInterface) {
 
 
 I2CResponse check_i2c_address(I2CInterface *i2cInterface, const uint8_t address) {
+    complete_active_i2c_transaction_internal(i2cInterface);
+
     absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
+    I2CChannel channel = get_selected_i2c_channel(i2cInterface);
+    uint32_t startUS = time_us_32();
 
     int response = i2c_write_blocking_until(
         i2cInterface->mI2C, 
@@ -124,13 +208,17 @@ I2CResponse check_i2c_address(I2CInterface *i2cInterface, const uint8_t address)
     );
 
     switch(response) {
+        // No device at the address is the answer being asked for, not a bus error
         case PICO_ERROR_GENERIC:
+            record_i2c_transaction_internal(i2cInterface, channel, address, I2C_RESPONSE_ERROR, 0, time_us_32() - startUS);
             return I2C_RESPONSE_ERROR;
 
         case PICO_ERROR_TIMEOUT:
-            return I2C_RESPONSE_TIMEOUT;
+            record_i2c_transaction_internal(i2cInterface, channel, address, I2C_RESPONSE_TIMEOUT, 0, time_us_32() - startUS);
+            return i2c_bus_error_internal(i2cInterface, I2C_RESPONSE_TIMEOUT);
 
         default:
+            record_i2c_transaction_internal(i2cInterface, channel, address, I2C_RESPONSE_OK, 0, time_us_32() - startUS);
             return I2C_RESPONSE_OK;
     }
 }
@@ -141,22 +229,17 @@ I2CResponse write_i2c_data(
     const uint8_t *buffer, 
     size_t bufferLen 
 ) {
+    complete_active_i2c_transaction_internal(i2cInterface);
+
     absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
 
     // Write the data itself, if we have any
     if(buffer && bufferLen) {
+        I2CChannel channel = get_selected_i2c_channel(i2cInterface);
+        uint32_t startUS = time_us_32();
         int response = i2c_write_blocking_until(i2cInterface->mI2C, address, buffer, bufferLen, I2C_NOSTOP, timeout);
 
-        switch(response) {
-            case PICO_ERROR_GENERIC:
-                return I2C_RESPONSE_ERROR;
-
-            case PICO_ERROR_TIMEOUT:
-                return I2C_RESPONSE_TIMEOUT;
-
-            default:
-                return (response == bufferLen) ? I2C_RESPONSE_OK : I2C_RESPONSE_INCOMPLETE;
-        }
+        return finish_blocking_i2c_transfer_internal(i2cInterface, channel, address, response, bufferLen, startUS);
     }
 
     return I2C_RESPONSE_OK;
@@ -170,21 +253,19 @@ I2CResponse write_prefixed_i2c_data(
     const uint8_t *buffer, 
     size_t bufferLen 
 ) {
+    complete_active_i2c_transaction_internal(i2cInterface);
+
     // Write the prefix data (usually an address)
     if ((prefixLen != 0) && (prefixBuffer != NULL)) {
         // Again, since we don't want to relinquish the I2C bus we won't bother with the STOP
         absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
+        I2CChannel channel = get_selected_i2c_channel(i2cInterface);
+        uint32_t startUS = time_us_32();
         int response = i2c_write_blocking_until(i2cInterface->mI2C, address, prefixBuffer, prefixLen, I2C_NOSTOP, timeout);
 
-        switch(response) {
-            case PICO_ERROR_GENERIC:
-                return I2C_RESPONSE_ERROR;
-
-            case PICO_ERROR_TIMEOUT:
-                return I2C_RESPONSE_TIMEOUT;
-
-            default:
-                if(response != prefixLen) return I2C_RESPONSE_INCOMPLETE;
+        I2CResponse prefixResponse = finish_blocking_i2c_transfer_internal(i2cInterface, channel, address, response, prefixLen, startUS);
+        if(prefixResponse != I2C_RESPONSE_OK) {
+            return prefixResponse;
         }
     }
 
@@ -217,19 +298,14 @@ I2CResponse read_from_i2c(
     uint8_t *buffer, 
     const uint8_t amountToRead
 ) {
+    complete_active_i2c_transaction_internal(i2cInterface);
+
     absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
+    I2CChannel channel = get_selected_i2c_channel(i2cInterface);
+    uint32_t startUS = time_us_32();
     int response = i2c_read_blocking_until(i2cInterface->mI2C, address, buffer, amountToRead, I2C_NOSTOP, timeout);
 
-    switch(response) {
-        case PICO_ERROR_GENERIC:
-            return I2C_RESPONSE_ERROR;
-
-        case PICO_ERROR_TIMEOUT:
-            return I2C_RESPONSE_TIMEOUT;
-
-        default:
-            return I2C_RESPONSE_OK;
-    }
+    return finish_blocking_i2c_transfer_internal(i2cInterface, channel, address, response, amountToRead, startUS);
 }
 
 I2CResponse read_from_i2c_register(
@@ -255,3 +331,628 @@ I2CResponse read_from_i2c_register(
     // Read response
     return read_from_i2c(i2cInterface, address, buffer, amountToRead);
 }
+
+
+// Transaction queue functions
+void start_i2c_transfer_internal(I2CInterface *i2cInterface, uint8_t address, bool read, uint8_t *buffer, uint16_t length) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+    i2c_hw_t *hw = i2c_get_hw(i2cInterface->mI2C);
+
+    // Address the device and clear whatever the last transfer left behind
+    hw->enable = 0;
+    hw->tar = address;
+    hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+    (void) hw->clr_tx_abrt;
+    (void) hw->clr_stop_det;
+
+    // One command word per byte, with a STOP after the last so the bus is released
+    for(int i = 0; i < length; ++i) {
+        queue->mCommandBuffer[i] = read ? I2C_IC_DATA_CMD_CMD_BITS : buffer[i];
+    }
+    queue->mCommandBuffer[length - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    if(read) {
+        dma_channel_config rxConfig = dma_channel_get_default_config(queue->mRXDMAChannel);
+        channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_8);
+        channel_config_set_read_increment(&rxConfig, false);
+        channel_config_set_write_increment(&rxConfig, true);
+        channel_config_set_dreq(&rxConfig, i2c_get_dreq(i2cInterface->mI2C, false));
+        dma_channel_configure(queue->mRXDMAChannel, &rxConfig, buffer, &hw->data_cmd, length, true);
+    }
+
+    dma_channel_config txConfig = dma_channel_get_default_config(queue->mTXDMAChannel);
+    channel_config_set_transfer_data_size(&txConfig, DMA_SIZE_32);
+    channel_config_set_read_increment(&txConfig, true);
+    channel_config_set_write_increment(&txConfig, false);
+    channel_config_set_dreq(&txConfig, i2c_get_dreq(i2cInterface->mI2C, true));
+    dma_channel_configure(queue->mTXDMAChannel, &txConfig, &hw->data_cmd, queue->mCommandBuffer, length, true);
+
+    // Address byte, data bytes and a bit either side for START/STOP
+    uint64_t transferUS = (((uint64_t) (length + 1) * I2C_BITS_PER_BYTE + 2) * 1000000) / i2cInterface->mCurrentBaud;
+
+    queue->mTransferIsRead = read;
+    queue->mExpectedCompletion = make_timeout_time_us(transferUS);
+    queue->mStepDeadline = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
+}
+
+void abort_i2c_transfer_internal(I2CInterface *i2cInterface) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+
+    dma_channel_abort(queue->mTXDMAChannel);
+    dma_channel_abort(queue->mRXDMAChannel);
+}
+
+// Returns I2C_RESPONSE_BUSY until the transfer has finished one way or another
+I2CResponse service_i2c_transfer_internal(I2CInterface *i2cInterface) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+    i2c_hw_t *hw = i2c_get_hw(i2cInterface->mI2C);
+
+    // NACKs abort the transfer and flush the rest of the commands
+    if(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+        abort_i2c_transfer_internal(i2cInterface);
+        (void) hw->clr_tx_abrt;
+        (void) hw->clr_stop_det;
+        return i2c_bus_error_internal(i2cInterface, I2C_RESPONSE_ERROR);
+    }
+
+    bool finished = !dma_channel_is_busy(queue->mTXDMAChannel) &&
+                    (!queue->mTransferIsRead || !dma_channel_is_busy(queue->mRXDMAChannel)) &&
+                    (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS);
+
+    if(!finished) {
+        if(time_reached(queue->mStepDeadline)) {
+            abort_i2c_transfer_internal(i2cInterface);
+            hw->enable = I2C_IC_ENABLE_ABORT_BITS | I2C_IC_ENABLE_ENABLE_BITS;
+            return i2c_bus_error_internal(i2cInterface, I2C_RESPONSE_TIMEOUT);
+        }
+
+        return I2C_RESPONSE_BUSY;
+    }
+
+    (void) hw->clr_stop_det;
+    return I2C_RESPONSE_OK;
+}
+
+// Starts (on the first call) and services the active transaction's current step
+I2CResponse run_i2c_transaction_step_internal(I2CInterface *i2cInterface, I2CTransaction *transaction) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+
+    if(queue->mCurrentStep < 0) {
+        // Transactions for devices behind the multiplexer select their channel first
+        I2CMultiplexer *multiplexer = i2cInterface->mMultiplexer;
+        if(!multiplexer || (transaction->mChannel == NO_I2C_CHANNEL)) {
+            return I2C_RESPONSE_OK;
+        }
+
+        // Same as select_i2c_channel_internal, a multiplexer without an address can't be selected through
+        if(multiplexer->mMultiplexerAddress < 0) {
+            return I2C_RESPONSE_COMMAND_FAILED;
+        }
+
+        if(!queue->mStepStarted) {
+            if(transaction->mChannel == multiplexer->mSelectedChannel) {
+                i2cInterface->mChannelSelectsSkipped++;
+                apply_selected_channel_baud_internal(i2cInterface);
+                return I2C_RESPONSE_OK;
+            }
+
+            apply_selected_channel_baud_internal(i2cInterface);
+            queue->mChannelSelectByte = (uint8_t) (1 << transaction->mChannel);
+            start_i2c_transfer_internal(i2cInterface, multiplexer->mMultiplexerAddress, false, &queue->mChannelSelectByte, 1);
+            queue->mStepStarted = true;
+            i2cInterface->mChannelSelectsIssued++;
+        }
+
+        I2CResponse response = service_i2c_transfer_internal(i2cInterface);
+        if(response == I2C_RESPONSE_OK) {
+            multiplexer->mSelectedChannel = transaction->mChannel;
+            apply_selected_channel_baud_internal(i2cInterface);
+        }
+
+        return response;
+    }
+
+    I2CTransactionStep *step = &transaction->mSteps[queue->mCurrentStep];
+
+    if(step->mType == I2C_STEP_DELAY) {
+        if(!queue->mStepStarted) {
+            queue->mStepDeadline = make_timeout_time_ms(step->mLength);
+            queue->mStepStarted = true;
+        }
+
+        return time_reached(queue->mStepDeadline) ? I2C_RESPONSE_OK : I2C_RESPONSE_BUSY;
+    }
+
+    if(!queue->mStepStarted) {
+        start_i2c_transfer_internal(i2cInterface, transaction->mAddress, (step->mType == I2C_STEP_READ), step->mBuffer, step->mLength);
+        queue->mStepStarted = true;
+    }
+
+    return service_i2c_transfer_internal(i2cInterface);
+}
+
+void finish_i2c_transaction_internal(I2CInterface *i2cInterface, I2CResponse response) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+    I2CTransaction *transaction = queue->mTransactions[queue->mHead];
+
+    // Off the queue before the callback, which is free to submit the transaction again
+    queue->mHead = (queue->mHead + 1) % I2C_TRANSACTION_QUEUE_SIZE;
+    queue->mCount--;
+    queue->mActive = false;
+    transaction->mState = I2C_TRANSACTION_IDLE;
+
+    if(transaction->mCallback) {
+        transaction->mCallback(transaction->mContext, response);
+    }
+}
+
+// Runs queued transactions as far as they can go without waiting. Returns when they next need attention.
+absolute_time_t run_i2c_transactions_internal(I2CInterface *i2cInterface, bool activeOnly) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+
+    while(1) {
+        if(!queue->mActive) {
+            if(!queue->mCount || activeOnly) {
+                return at_the_end_of_time;
+            }
+
+            queue->mTransactions[queue->mHead]->mState = I2C_TRANSACTION_ACTIVE;
+            queue->mActive = true;
+            queue->mCurrentStep = -1;
+            queue->mStepStarted = false;
+            queue->mTransactionStartUS = time_us_32();
+            queue->mTransactionBytes = 0;
+        }
+
+        I2CTransaction *transaction = queue->mTransactions[queue->mHead];
+        I2CResponse response = run_i2c_transaction_step_internal(i2cInterface, transaction);
+
+        if(response == I2C_RESPONSE_BUSY) {
+            if((queue->mCurrentStep >= 0) && (transaction->mSteps[queue->mCurrentStep].mType == I2C_STEP_DELAY)) {
+                return queue->mStepDeadline;
+            }
+
+            // Check back when the transfer should be done, or a byte time from now if it is running late
+            absolute_time_t byteTime = make_timeout_time_us((I2C_BITS_PER_BYTE * 1000000) / i2cInterface->mCurrentBaud);
+            return time_reached(queue->mExpectedCompletion) ? byteTime : queue->mExpectedCompletion;
+        }
+
+        if((response == I2C_RESPONSE_OK) && (queue->mCurrentStep >= 0) && (transaction->mSteps[queue->mCurrentStep].mType != I2C_STEP_DELAY)) {
+            queue->mTransactionBytes += transaction->mSteps[queue->mCurrentStep].mLength;
+        }
+
+        if((response != I2C_RESPONSE_OK) || ((queue->mCurrentStep + 1) >= transaction->mNumSteps)) {
+            record_i2c_transaction_internal(
+                i2cInterface,
+                transaction->mChannel,
+                transaction->mAddress,
+                response,
+                queue->mTransactionBytes,
+                time_us_32() - queue->mTransactionStartUS
+            );
+            finish_i2c_transaction_internal(i2cInterface, response);
+            if(activeOnly) {
+                return at_the_end_of_time;
+            }
+            continue;
+        }
+
+        queue->mCurrentStep++;
+        queue->mStepStarted = false;
+    }
+}
+
+// The blocking functions share the bus with the queue, so they let the active transaction finish first
+void complete_active_i2c_transaction_internal(I2CInterface *i2cInterface) {
+    if(!i2cInterface) {
+        return;
+    }
+
+    while(i2cInterface->mTransactionQueue.mActive) {
+        sleep_until(run_i2c_transactions_internal(i2cInterface, true));
+    }
+}
+
+void fail_i2c_transactions_internal(I2CInterface *i2cInterface, I2CResponse response) {
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+
+    if(queue->mActive) {
+        abort_i2c_transfer_internal(i2cInterface);
+    }
+
+    while(queue->mCount) {
+        queue->mActive = true;
+        finish_i2c_transaction_internal(i2cInterface, response);
+    }
+}
+
+void init_i2c_transaction(I2CTransaction *transaction, I2CChannel channel, uint8_t address, I2CTransactionCallback callback, void *context) {
+    if(!transaction) {
+        return;
+    }
+
+    transaction->mChannel = channel;
+    transaction->mAddress = address;
+    transaction->mNumSteps = 0;
+    transaction->mCallback = callback;
+    transaction->mContext = context;
+    transaction->mState = I2C_TRANSACTION_IDLE;
+}
+
+bool add_i2c_transaction_step_internal(I2CTransaction *transaction, I2CTransactionStepType type, uint8_t *buffer, uint16_t length) {
+    if(!transaction || (transaction->mNumSteps >= MAX_I2C_TRANSACTION_STEPS)) {
+        return false;
+    }
+
+    I2CTransactionStep *step = &transaction->mSteps[transaction->mNumSteps++];
+    step->mType = type;
+    step->mBuffer = buffer;
+    step->mLength = length;
+
+    return true;
+}
+
+bool add_i2c_write_step(I2CTransaction *transaction, const uint8_t *buffer, uint16_t length) {
+    if(!buffer || !length || (length > MAX_I2C_TRANSFER_SIZE)) {
+        return false;
+    }
+
+    return add_i2c_transaction_step_internal(transaction, I2C_STEP_WRITE, (uint8_t *) buffer, length);
+}
+
+bool add_i2c_read_step(I2CTransaction *transaction, uint8_t *buffer, uint16_t length) {
+    if(!buffer || !length || (length > MAX_I2C_TRANSFER_SIZE)) {
+        return false;
+    }
+
+    return add_i2c_transaction_step_internal(transaction, I2C_STEP_READ, buffer, length);
+}
+
+bool add_i2c_delay_step(I2CTransaction *transaction, uint16_t delayMS) {
+    return add_i2c_transaction_step_internal(transaction, I2C_STEP_DELAY, 0, delayMS);
+}
+
+I2CResponse submit_i2c_transaction(I2CInterface *i2cInterface, I2CTransaction *transaction) {
+    if(!i2cInterface || !transaction || !transaction->mNumSteps || !i2cInterface->mTransactionQueue.mInitialized) {
+        return I2C_RESPONSE_INVALID_REQUEST;
+    }
+
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+
+    if((transaction->mState != I2C_TRANSACTION_IDLE) || (queue->mCount >= I2C_TRANSACTION_QUEUE_SIZE)) {
+        return I2C_RESPONSE_BUSY;
+    }
+
+    transaction->mState = I2C_TRANSACTION_QUEUED;
+    queue->mTransactions[(queue->mHead + queue->mCount) % I2C_TRANSACTION_QUEUE_SIZE] = transaction;
+    queue->mCount++;
+
+    return I2C_RESPONSE_OK;
+}
+
+void cancel_i2c_transaction(I2CInterface *i2cInterface, I2CTransaction *transaction) {
+    if(!i2cInterface || !transaction) {
+        return;
+    }
+
+    I2CTransactionQueue *queue = &i2cInterface->mTransactionQueue;
+
+    switch(transaction->mState) {
+        case I2C_TRANSACTION_ACTIVE:
+            // Already on the bus, let it finish quietly
+            transaction->mCallback = 0;
+            complete_active_i2c_transaction_internal(i2cInterface);
+            break;
+
+        case I2C_TRANSACTION_QUEUED:
+            // Close the gap it leaves in the queue
+            for(int i = 0, removed = 0; i < queue->mCount; ++i) {
+                uint8_t index = (queue->mHead + i) % I2C_TRANSACTION_QUEUE_SIZE;
+
+                if(queue->mTransactions[index] == transaction) {
+                    removed = 1;
+                } else if(removed) {
+                    queue->mTransactions[(index + I2C_TRANSACTION_QUEUE_SIZE - 1) % I2C_TRANSACTION_QUEUE_SIZE] = queue->mTransactions[index];
+                }
+            }
+            queue->mCount--;
+            transaction->mState = I2C_TRANSACTION_IDLE;
+            break;
+
+        default:
+            break;
+    }
+}
+
+absolute_time_t update_i2c_transactions(I2CInterface *i2cInterface) {
+    if(!i2cInterface || !i2cInterface->mTransactionQueue.mInitialized) {
+        return at_the_end_of_time;
+    }
+
+    if(i2cInterface->mStats.mResetRequested) {
+        apply_i2c_stats_reset_internal(i2cInterface);
+    }
+
+    return run_i2c_transactions_internal(i2cInterface, false);
+}
+
+
+// Bus speed functions
+void apply_i2c_baud_internal(I2CInterface *i2cInterface, uint baud) {
+    if(baud != i2cInterface->mCurrentBaud) {
+        i2c_set_baudrate(i2cInterface->mI2C, baud);
+        i2cInterface->mCurrentBaud = baud;
+    }
+}
+
+void apply_selected_channel_baud_internal(I2CInterface *i2cInterface) {
+    I2CChannel channel = i2cInterface->mMultiplexer ? i2cInterface->mMultiplexer->mSelectedChannel : NO_I2C_CHANNEL;
+    apply_i2c_baud_internal(i2cInterface, get_i2c_channel_baud(i2cInterface, channel));
+}
+
+// Channels without a negotiated rate, and a multiplexer in an unknown state, run at the interface's base rate
+uint get_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel) {
+    if(!i2cInterface) {
+        return 0;
+    }
+
+    if((channel < I2C_CHANNEL_0) || (channel >= NUM_I2C_CHANNELS) || !i2cInterface->mChannelBaud[channel]) {
+        return i2cInterface->mBaud;
+    }
+
+    return i2cInterface->mChannelBaud[channel];
+}
+
+void set_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel, uint baud) {
+    if(!i2cInterface || (channel < I2C_CHANNEL_0) || (channel >= NUM_I2C_CHANNELS)) {
+        return;
+    }
+
+    i2cInterface->mChannelBaud[channel] = baud;
+
+    // A transfer in flight keeps its rate, the next select on the channel picks up the new one
+    if(!i2cInterface->mTransactionQueue.mActive) {
+        apply_selected_channel_baud_internal(i2cInterface);
+    }
+}
+
+// Tries the channel at each faster rate in turn, keeping the first one the probe passes at every time
+uint negotiate_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel, I2CSpeedProbe probe, void *context) {
+    if(!i2cInterface || !probe || !i2cInterface->mMultiplexer || (channel < I2C_CHANNEL_0) || (channel >= NUM_I2C_CHANNELS)) {
+        return i2cInterface ? i2cInterface->mBaud : 0;
+    }
+
+    if(!i2cInterface->mNegotiateSpeed) {
+        return get_i2c_channel_baud(i2cInterface, channel);
+    }
+
+    for(int i = 0; i < (sizeof(I2C_NEGOTIATION_BAUDRATES) / sizeof(I2C_NEGOTIATION_BAUDRATES[0])); ++i) {
+        uint baud = I2C_NEGOTIATION_BAUDRATES[i];
+        if(baud <= i2cInterface->mBaud) {
+            continue;
+        }
+
+        set_i2c_channel_baud(i2cInterface, channel, baud);
+
+        I2CResponse response = select_i2c_channel(i2cInterface, channel);
+        for(int probes = 0; (response == I2C_RESPONSE_OK) && (probes < I2C_NEGOTIATION_PROBES); ++probes) {
+            response = probe(i2cInterface, context);
+        }
+
+        if(response == I2C_RESPONSE_OK) {
+            return baud;
+        }
+
+        // Whatever the devices made of the failed attempt, the multiplexer may have seen it too
+        i2c_bus_error_internal(i2cInterface, response);
+    }
+
+    set_i2c_channel_baud(i2cInterface, channel, 0);
+    select_i2c_channel(i2cInterface, channel);
+
+    return i2cInterface->mBaud;
+}
+
+// Steps a channel down to the next slower rate (or the base rate) once it has shown errors at its current one
+uint lower_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel) {
+    if(!i2cInterface) {
+        return 0;
+    }
+
+    uint currentBaud = get_i2c_channel_baud(i2cInterface, channel);
+    uint lowerBaud = 0;
+
+    for(int i = 0; i < (sizeof(I2C_NEGOTIATION_BAUDRATES) / sizeof(I2C_NEGOTIATION_BAUDRATES[0])); ++i) {
+        uint baud = I2C_NEGOTIATION_BAUDRATES[i];
+        if((baud < currentBaud) && (baud > i2cInterface->mBaud)) {
+            lowerBaud = baud;
+            break;
+        }
+    }
+
+    set_i2c_channel_baud(i2cInterface, channel, lowerBaud);
+
+    return get_i2c_channel_baud(i2cInterface, channel);
+}
+
+
+// Statistics functions
+I2CStats *get_channel_stats_internal(I2CBusStats *stats, I2CChannel channel) {
+    if((channel < I2C_CHANNEL_0) || (channel >= NUM_I2C_CHANNELS)) {
+        return &stats->mChannels[I2C_STATS_DIRECT_CHANNEL];
+    }
+
+    return &stats->mChannels[channel];
+}
+
+// Finds the device's stats, adding them if there is room
+I2CStats *get_device_stats_internal(I2CBusStats *stats, I2CChannel channel, uint8_t address) {
+    if((channel < I2C_CHANNEL_0) || (channel >= NUM_I2C_CHANNELS)) {
+        channel = NO_I2C_CHANNEL;
+    }
+
+    for(int i = 0; i < stats->mNumDevices; ++i) {
+        if((stats->mDevices[i].mChannel == channel) && (stats->mDevices[i].mAddress == address)) {
+            return &stats->mDevices[i].mStats;
+        }
+    }
+
+    if(stats->mNumDevices >= I2C_STATS_MAX_DEVICES) {
+        return 0;
+    }
+
+    I2CDeviceStats *device = &stats->mDevices[stats->mNumDevices];
+    device->mChannel = channel;
+    device->mAddress = address;
+    __dmb();
+    stats->mNumDevices++;
+
+    return &device->mStats;
+}
+
+void add_i2c_transaction_stats_internal(I2CStats *stats, I2CResponse response, uint32_t bytes, uint32_t latencyUS) {
+    stats->mTransactions++;
+
+    switch(response) {
+        case I2C_RESPONSE_OK:
+            stats->mBytes += bytes;
+            break;
+
+        case I2C_RESPONSE_TIMEOUT:
+            stats->mTimeouts++;
+            break;
+
+        case I2C_RESPONSE_ERROR:
+            stats->mNACKs++;
+            break;
+
+        default:
+            stats->mOtherErrors++;
+            break;
+    }
+
+    stats->mMaxLatencyUS = MAX(stats->mMaxLatencyUS, latencyUS);
+    stats->mTotalLatencyUS += latencyUS;
+    stats->mLatencyHistogram[LOG2_BUCKET(latencyUS, I2C_STATS_LATENCY_BUCKETS)]++;
+}
+
+void record_i2c_transaction_internal(I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, I2CResponse response, uint32_t bytes, uint32_t latencyUS) {
+    I2CBusStats *stats = &i2cInterface->mStats;
+
+    stats->mSequence++;
+    __dmb();
+
+    add_i2c_transaction_stats_internal(get_channel_stats_internal(stats, channel), response, bytes, latencyUS);
+
+    I2CStats *deviceStats = get_device_stats_internal(stats, channel, address);
+    if(deviceStats) {
+        add_i2c_transaction_stats_internal(deviceStats, response, bytes, latencyUS);
+    } else {
+        stats->mUntrackedTransactions++;
+    }
+
+    __dmb();
+    stats->mSequence++;
+}
+
+// Turns the result of a blocking SDK transfer into a response, recording it against the channel it went out on
+I2CResponse finish_blocking_i2c_transfer_internal(I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, int result, size_t length, uint32_t startUS) {
+    I2CResponse response;
+
+    switch(result) {
+        case PICO_ERROR_GENERIC:
+            response = i2c_bus_error_internal(i2cInterface, I2C_RESPONSE_ERROR);
+            break;
+
+        case PICO_ERROR_TIMEOUT:
+            response = i2c_bus_error_internal(i2cInterface, I2C_RESPONSE_TIMEOUT);
+            break;
+
+        default:
+            response = (result == length) ? I2C_RESPONSE_OK : I2C_RESPONSE_INCOMPLETE;
+            break;
+    }
+
+    record_i2c_transaction_internal(i2cInterface, channel, address, response, length, time_us_32() - startUS);
+
+    return response;
+}
+
+void apply_i2c_stats_reset_internal(I2CInterface *i2cInterface) {
+    I2CBusStats *stats = &i2cInterface->mStats;
+
+    stats->mSequence++;
+    __dmb();
+
+    memset(stats->mChannels, 0, sizeof(stats->mChannels));
+    memset(stats->mDevices, 0, sizeof(stats->mDevices));
+    stats->mNumDevices = 0;
+    stats->mUntrackedTransactions = 0;
+    stats->mBusResets = 0;
+    stats->mResetTime = MILLIS();
+    stats->mResetRequested = false;
+
+    __dmb();
+    stats->mSequence++;
+}
+
+// Copies part of the stats out, trying again if core 0 was updating them before or during the copy
+void copy_i2c_stats_internal(I2CBusStats *stats, void *dst, const void *src, size_t size) {
+    uint32_t sequence;
+
+    do {
+        sequence = stats->mSequence;
+        __dmb();
+        memcpy(dst, src, size);
+        __dmb();
+    } while((sequence & 1) || (sequence != stats->mSequence));
+}
+
+// Drivers know when a response fails its CRC, the bus only sees a good transfer
+void record_i2c_crc_failure(I2CInterface *i2cInterface, I2CChannel channel, uint8_t address) {
+    if(!i2cInterface) {
+        return;
+    }
+
+    I2CBusStats *stats = &i2cInterface->mStats;
+
+    stats->mSequence++;
+    __dmb();
+
+    get_channel_stats_internal(stats, channel)->mCRCFailures++;
+
+    I2CStats *deviceStats = get_device_stats_internal(stats, channel, address);
+    if(deviceStats) {
+        deviceStats->mCRCFailures++;
+    }
+
+    __dmb();
+    stats->mSequence++;
+}
+
+// The stats belong to the core running the bus, so it does the clearing
+void request_i2c_stats_reset(I2CInterface *i2cInterface) {
+    if(i2cInterface) {
+        i2cInterface->mStats.mResetRequested = true;
+    }
+}
+
+void get_i2c_channel_stats(I2CInterface *i2cInterface, uint8_t index, I2CStats *stats) {
+    if(!i2cInterface || !stats || (index > I2C_STATS_DIRECT_CHANNEL)) {
+        return;
+    }
+
+    copy_i2c_stats_internal(&i2cInterface->mStats, stats, &i2cInterface->mStats.mChannels[index], sizeof(I2CStats));
+}
+
+uint8_t get_i2c_device_stats_count(I2CInterface *i2cInterface) {
+    return i2cInterface ? i2cInterface->mStats.mNumDevices : 0;
+}
+
+void get_i2c_device_stats(I2CInterface *i2cInterface, uint8_t index, I2CDeviceStats *stats) {
+    if(!i2cInterface || !stats || (index >= I2C_STATS_MAX_DEVICES)) {
+        return;
+    }
+
+    copy_i2c_stats_internal(&i2cInterface->mStats, stats, &i2cInterface->mStats.mDevices[index], sizeof(I2CDeviceStats));
+}
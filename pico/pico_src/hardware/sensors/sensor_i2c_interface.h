@@ -5,6 +5,19 @@
 #include "hardware/i2c.h"
 
 #define DEFAULT_MULTIPLEXER_ADDRESS     (0x70)
+#define NUM_I2C_CHANNELS                (8)
+
+// Rates tried, fastest first, when negotiating a channel's bus speed
+#define I2C_FAST_MODE_BAUDRATE          (400 * 1000)
+#define I2C_STANDARD_MODE_BAUDRATE      (100 * 1000)
+
+#define MAX_I2C_TRANSACTION_STEPS       (4)
+#define MAX_I2C_TRANSFER_SIZE           (32)
+#define I2C_TRANSACTION_QUEUE_SIZE      (8)
+
+#define I2C_STATS_LATENCY_BUCKETS       (16)        // Bucket 0 is 0us, bucket n is [2^(n-1), 2^n) us, the last takes everything above
+#define I2C_STATS_MAX_DEVICES           (16)        // Channel/address pairs tracked individually
+#define I2C_STATS_DIRECT_CHANNEL        (NUM_I2C_CHANNELS)  // Stats slot for devices not behind the multiplexer (or an unknown channel)
 
 
 // I2C multiplexer channel definitions
@@ -18,26 +31,18 @@ typedef enum {
     I2C_CHANNEL_6 = 6,
     I2C_CHANNEL_7 = 7,
 
-    NO_I2C_CHANNEL = -1
+    NO_I2C_CHANNEL = -1,
+    UNKNOWN_I2C_CHANNEL = -2                    // Multiplexer state not known, the next select always writes
 } I2CChannel;
 
 
 typedef struct {
     int8_t mMultiplexerAddress;                 // I2C Address pf the multiplexer device
     int8_t mResetPin;                           // For resetting the TCA9548A chip
+    I2CChannel mSelectedChannel;                // Last channel written to the multiplexer
 } I2CMultiplexer;
 
 
-typedef struct {
-    i2c_inst_t *mI2C;                           // The underlying I2C access struct
-    int mBaud;                                  // I2C baud rate
-    int mSDA;                                   // I2C SDA pin
-    int mSCL;                                   // I2C SCL pin
-    I2CMultiplexer *mMultiplexer;               // NULL for no multiplexer (direct I2C connections)
-    absolute_time_t mInterfaceResetTimeout;     // Watchdog timer for multiplexer/interface
-} I2CInterface;
-
-
 typedef enum {
     I2C_RESPONSE_OK                 = 0,
     I2C_RESPONSE_ERROR              = 1,
@@ -46,16 +51,125 @@ typedef enum {
     I2C_RESPONSE_MALFORMED          = 4,
     I2C_RESPONSE_INCOMPLETE         = 5,
     I2C_RESPONSE_COMMAND_FAILED     = 6,
-    I2C_RESPONSE_DEVICE_NOT_FOUND   = 7
+    I2C_RESPONSE_DEVICE_NOT_FOUND   = 7,
+    I2C_RESPONSE_BUSY               = 8
 }  I2CResponse;
 
 
+// Queued transactions. A transaction is a short sequence of writes, reads and delays against one device
+// on one multiplexer channel. It is run by update_i2c_transactions() with the transfers themselves done by
+// DMA, so nothing waits on the bus, and its callback is called (from update_i2c_transactions()) once it
+// has finished. The transaction and every buffer it refers to must stay valid until then.
+typedef enum {
+    I2C_STEP_WRITE,
+    I2C_STEP_READ,
+    I2C_STEP_DELAY
+} I2CTransactionStepType;
+
+typedef struct {
+    I2CTransactionStepType mType;
+    uint8_t *mBuffer;                           // Source for writes, destination for reads
+    uint16_t mLength;                           // Bytes to transfer, or milliseconds to wait
+} I2CTransactionStep;
+
+typedef enum {
+    I2C_TRANSACTION_IDLE,
+    I2C_TRANSACTION_QUEUED,
+    I2C_TRANSACTION_ACTIVE
+} I2CTransactionState;
+
+typedef void (*I2CTransactionCallback)(void *context, I2CResponse response);
+
+typedef struct {
+    I2CChannel mChannel;                        // Selected on the multiplexer before the first step
+    uint8_t mAddress;
+    I2CTransactionStep mSteps[MAX_I2C_TRANSACTION_STEPS];
+    uint8_t mNumSteps;
+    I2CTransactionCallback mCallback;
+    void *mContext;
+    I2CTransactionState mState;
+} I2CTransaction;
+
+typedef struct {
+    bool mInitialized;
+    int mTXDMAChannel;
+    int mRXDMAChannel;
+    I2CTransaction *mTransactions[I2C_TRANSACTION_QUEUE_SIZE];
+    uint8_t mHead;                              // The active transaction, if mActive
+    uint8_t mCount;
+    bool mActive;
+    int8_t mCurrentStep;                        // -1 while the multiplexer channel is being selected
+    bool mStepStarted;
+    bool mTransferIsRead;
+    absolute_time_t mStepDeadline;              // End of a delay, or when a transfer times out
+    absolute_time_t mExpectedCompletion;        // When the current transfer should be off the wire
+    uint8_t mChannelSelectByte;
+    uint32_t mCommandBuffer[MAX_I2C_TRANSFER_SIZE];
+    uint32_t mTransactionStartUS;               // When the active transaction went on the bus, for its latency
+    uint16_t mTransactionBytes;                 // Bytes moved by the active transaction's finished transfers
+} I2CTransactionQueue;
+
+
+// Counters for transactions with a channel or device. A transaction is one blocking transfer, or one queued
+// transaction from channel select to last step
+typedef struct {
+    uint32_t mTransactions;
+    uint32_t mBytes;                            // Bytes written and read by successful transfers
+    uint32_t mTimeouts;
+    uint32_t mNACKs;                            // Transfers the device refused (or the bus aborted)
+    uint32_t mOtherErrors;                      // Short transfers and other failures
+    uint32_t mCRCFailures;                      // Responses which arrived but failed their CRC (reported by the device driver)
+    uint32_t mMaxLatencyUS;
+    uint64_t mTotalLatencyUS;
+    uint32_t mLatencyHistogram[I2C_STATS_LATENCY_BUCKETS];
+} I2CStats;
+
+typedef struct {
+    I2CChannel mChannel;
+    uint8_t mAddress;
+    I2CStats mStats;
+} I2CDeviceStats;
+
+// Written by core 0 as it runs transactions, read (and reset) by core 1, as a seqlock
+typedef struct {
+    volatile uint32_t mSequence;                // Odd while core 0 is updating the stats
+    volatile bool mResetRequested;              // Set by core 1, core 0 clears the stats at its next update
+    uint32_t mResetTime;                        // Time the stats were last cleared
+    uint32_t mBusResets;                        // Bus resets, including those from the interface watchdog
+    I2CStats mChannels[NUM_I2C_CHANNELS + 1];   // Indexed by channel, I2C_STATS_DIRECT_CHANNEL for the rest
+    I2CDeviceStats mDevices[I2C_STATS_MAX_DEVICES];
+    uint8_t mNumDevices;
+    uint32_t mUntrackedTransactions;            // Transactions with devices beyond the first I2C_STATS_MAX_DEVICES
+} I2CBusStats;
+
+
+typedef struct {
+    i2c_inst_t *mI2C;                           // The underlying I2C access struct
+    int mBaud;                                  // I2C baud rate, and the rate channels fall back to
+    bool mNegotiateSpeed;                       // Let negotiate_i2c_channel_baud() run channels faster than mBaud
+    uint mChannelBaud[NUM_I2C_CHANNELS];        // Negotiated rate per multiplexer channel, 0 for mBaud
+    uint mCurrentBaud;                          // Rate the controller is running at
+    int mSDA;                                   // I2C SDA pin
+    int mSCL;                                   // I2C SCL pin
+    I2CMultiplexer *mMultiplexer;               // NULL for no multiplexer (direct I2C connections)
+    absolute_time_t mInterfaceResetTimeout;     // Watchdog timer for multiplexer/interface
+    I2CTransactionQueue mTransactionQueue;
+    uint32_t mChannelSelectsIssued;             // Multiplexer writes made
+    uint32_t mChannelSelectsSkipped;            // Multiplexer writes avoided as the channel was already selected
+    I2CBusStats mStats;
+} I2CInterface;
+
+// Checks the devices on the selected channel still answer correctly, for bus speed negotiation
+typedef I2CResponse (*I2CSpeedProbe)(I2CInterface *i2cInterface, void *context);
+
+
 // Main interface functions
 void init_sensor_bus(I2CInterface *i2cInterface);
 void shutdown_sensor_bus(I2CInterface *i2cInterface);
 void reset_sensor_bus(I2CInterface *i2cInterface, bool fullReset);
 I2CResponse check_i2c_address(I2CInterface *i2cInterface, const uint8_t address);
 I2CResponse select_i2c_channel(I2CInterface *i2cInterface, I2CChannel channel);
+I2CChannel get_selected_i2c_channel(I2CInterface *i2cInterface);
 void reset_interface_watchdog(I2CInterface *i2cInterface);
 void check_interface_watchdog(I2CInterface *i2cInterface);
 I2CResponse write_i2c_data(
@@ -97,4 +211,29 @@ I2CResponse read_from_i2c_register(
 );
 
 
+// Transaction queue functions
+void init_i2c_transaction(I2CTransaction *transaction, I2CChannel channel, uint8_t address, I2CTransactionCallback callback, void *context);
+bool add_i2c_write_step(I2CTransaction *transaction, const uint8_t *buffer, uint16_t length);
+bool add_i2c_read_step(I2CTransaction *transaction, uint8_t *buffer, uint16_t length);
+bool add_i2c_delay_step(I2CTransaction *transaction, uint16_t delayMS);
+I2CResponse submit_i2c_transaction(I2CInterface *i2cInterface, I2CTransaction *transaction);
+void cancel_i2c_transaction(I2CInterface *i2cInterface, I2CTransaction *transaction);
+absolute_time_t update_i2c_transactions(I2CInterface *i2cInterface);
+
+
+// Bus speed functions. Each multiplexer channel runs at its own rate, switched to when it is selected
+uint get_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel);
+void set_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel, uint baud);
+uint negotiate_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel, I2CSpeedProbe probe, void *context);
+uint lower_i2c_channel_baud(I2CInterface *i2cInterface, I2CChannel channel);
+
+
+// Statistics functions. Recording happens on the core running the bus, the getters and reset are for the other
+void record_i2c_crc_failure(I2CInterface *i2cInterface, I2CChannel channel, uint8_t address);
+void request_i2c_stats_reset(I2CInterface *i2cInterface);
+void get_i2c_channel_stats(I2CInterface *i2cInterface, uint8_t index, I2CStats *stats);
+uint8_t get_i2c_device_stats_count(I2CInterface *i2cInterface);
+void get_i2c_device_stats(I2CInterface *i2cInterface, uint8_t index, I2CDeviceStats *stats);
+
+
 #endif
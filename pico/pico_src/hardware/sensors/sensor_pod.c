@@ -7,6 +7,11 @@
 #define SENSOR_POD_TIMEOUT_MS                   (5000)
 
 
+// Internal functions
+I2CResponse probe_sensor_pod_internal(I2CInterface *i2cInterface, void *context);
+// -- End internal functions
+
+
 I2CResponse select_sensor_pod(SensorPod *sensorPod) {
     if(!sensorPod) {
         return false;
@@ -16,6 +21,7 @@ I2CResponse select_sensor_pod(SensorPod *sensorPod) {
 }
 
 void initialize_soil_sensor_connection(SensorPod *sensorPod) {
+    reset_soil_sensor_reader(&sensorPod->mSoilSensorReader, sensorPod->mInterface);
     sensorPod->mSoilSensorActive = (init_soil_sensor(sensorPod->mInterface, sensorPod->mSoilSensorAddress) == I2C_RESPONSE_OK);
 }
 
@@ -30,6 +36,9 @@ void initialize_scd30_connection(SensorPod *sensorPod) {
         DEBUG_PRINT("        +- Could not read serial number (%s)\n", tmpSerial);
     }
 
+    // Any read in progress went with the previous connection
+    reset_scd30_reader(&sensorPod->mSCD30Reader, sensorPod->mInterface);
+
     if(sensorPod->mSCD30SensorActive) {
         I2CResponse readResponse = trigger_scd30_continuous_measurement(sensorPod->mInterface, sensorPod->mSCD30Address, 0);
         if(readResponse != I2C_RESPONSE_OK) {
@@ -58,6 +67,9 @@ bool initialize_sensor_pod(SensorPod *sensorPod) {
     sensorPod->mCurrentData.mSCD30SensorDataValid = false;
     sensorPod->mCurrentData.mSoilSensorDataValid = false;
 
+    uint baud = negotiate_i2c_channel_baud(sensorPod->mInterface, sensorPod->mI2CChannel, probe_sensor_pod_internal, sensorPod);
+    DEBUG_PRINT("        +- Bus speed: %u Hz\n", baud);
+
     return true;
 }
 
@@ -67,6 +79,12 @@ bool reset_sensor_pod(SensorPod *sensorPod) {
         return false;
     }
 
+    // Start over from the base bus rate, initialization negotiates it back up
+    set_i2c_channel_baud(sensorPod->mInterface, sensorPod->mI2CChannel, 0);
+
+    // Other pods' transactions may have moved the multiplexer on since we last used it
+    select_sensor_pod(sensorPod);
+
     I2CResponse resetSoilSensorResponse = reset_soil_sensor(sensorPod->mInterface, sensorPod->mSoilSensorAddress);
     I2CResponse resetSCDResponse = do_scd30_soft_reset(sensorPod->mInterface, sensorPod->mSCD30Address);
 
@@ -97,26 +115,37 @@ void update_sensor_pod(SensorPod *sensorPod) {
         return;
     }
 
-    DEBUG_PRINT("      +- Selecting pod channel: 0x%02X...", sensorPod->mI2CChannel);
-    I2CResponse selectResponse = select_sensor_pod(sensorPod);
-    DEBUG_PRINT("done {%d}\n", selectResponse);
-    if(selectResponse != I2C_RESPONSE_OK) {
-        return;
+    // Readings go through the transaction queue, which selects the pod's channel itself. Only the blocking
+    // (re)initialization below needs it selected up front
+    if(!sensorPod->mSoilSensorActive || !sensorPod->mSCD30SensorActive) {
+        DEBUG_PRINT("      +- Selecting pod channel: 0x%02X...", sensorPod->mI2CChannel);
+        I2CResponse selectResponse = select_sensor_pod(sensorPod);
+        DEBUG_PRINT("done {%d}\n", selectResponse);
+        if(selectResponse != I2C_RESPONSE_OK) {
+            return;
+        }
     }
 
-    // Read soil sensor
-    sensorPod->mCurrentData.mSoilSensorDataValid = false;
+    // Step the soil sensor reader
     if(sensorPod->mSoilSensorActive) {
-        DEBUG_PRINT("      +- Soil sensor active, reading...");
-        uint16_t capValue = get_soil_sensor_capacitive_value(sensorPod->mInterface, sensorPod->mSoilSensorAddress);
-        if(capValue != STEMMA_SOIL_SENSOR_INVALID_READING) {
-            sensorPod->mCurrentData.mSoilSensorData = capValue;
-            sensorPod->mCurrentData.mSoilSensorDataValid = true;
-
-            gotSoilReading = true;
-            DEBUG_PRINT("done\n");
-        } else {
-            DEBUG_PRINT("INVALID\n");
+        uint16_t capValue;
+
+        switch(update_soil_sensor_reader(&sensorPod->mSoilSensorReader, sensorPod->mInterface, sensorPod->mI2CChannel, sensorPod->mSoilSensorAddress, &capValue)) {
+            case SOIL_SENSOR_READ_COMPLETE:
+                sensorPod->mCurrentData.mSoilSensorData = capValue;
+                sensorPod->mCurrentData.mSoilSensorDataValid = true;
+
+                gotSoilReading = true;
+                break;
+
+            case SOIL_SENSOR_READ_FAILED:
+                sensorPod->mCurrentData.mSoilSensorDataValid = false;
+                DEBUG_PRINT("      +- Soil sensor reading INVALID\n");
+                break;
+
+            case SOIL_SENSOR_READ_PENDING:
+            default:
+                break;
         }
     } else {
         DEBUG_PRINT("      +- Soil sensor inactive, initializing...");
@@ -124,27 +153,34 @@ void update_sensor_pod(SensorPod *sensorPod) {
         DEBUG_PRINT("done\n");
     }
 
-    // Read SCD30 (if we have a valid reading)
+    // Step the SCD30 reader. It never waits on the bus, so most updates just find it still pending
     if(sensorPod->mSCD30SensorActive) {
-        DEBUG_PRINT("      +- SCD30 active\n");
-        if(get_scd30_data_ready_status(sensorPod->mInterface, sensorPod->mSCD30Address)) {
-            DEBUG_PRINT("        +- SCD30 data ready, reading...");
-            SCD30SensorData tmpData = get_scd30_reading(sensorPod->mInterface, sensorPod->mSCD30Address);
+        SCD30SensorData tmpData;
 
-            if(tmpData.mValidReading) {
+        switch(update_scd30_reader(&sensorPod->mSCD30Reader, sensorPod->mInterface, sensorPod->mI2CChannel, sensorPod->mSCD30Address, &tmpData)) {
+            case SCD30_READ_COMPLETE:
                 sensorPod->mCurrentData.mCO2Level = tmpData.mCO2Reading;
                 sensorPod->mCurrentData.mTemperature = tmpData.mTemperatureReading;
                 sensorPod->mCurrentData.mHumidity = tmpData.mHumidityReading;
                 sensorPod->mCurrentData.mSCD30SensorDataValid = true;
 
                 gotSCDReading = true;
-                DEBUG_PRINT("done\n");
-            } else {
+                break;
+
+            case SCD30_READ_FAILED:
                 sensorPod->mCurrentData.mSCD30SensorDataValid = false;
-                DEBUG_PRINT("INVALID\n");
-            }
-        } else {
-            DEBUG_PRINT("        +- SCD30 data not ready\n");
+                DEBUG_PRINT("      +- SCD30 reading INVALID\n");
+
+                // Bad CRCs and timeouts are how a marginal bus speed shows, so back the channel off a step
+                if((sensorPod->mSCD30Reader.mFailure == I2C_RESPONSE_MALFORMED) || (sensorPod->mSCD30Reader.mFailure == I2C_RESPONSE_TIMEOUT)) {
+                    uint baud = lower_i2c_channel_baud(sensorPod->mInterface, sensorPod->mI2CChannel);
+                    DEBUG_PRINT("      +- Bus speed lowered to %u Hz\n", baud);
+                }
+                break;
+
+            case SCD30_READ_PENDING:
+            default:
+                break;
         }
     } else {
         DEBUG_PRINT("      +- SCD30 inactive, initializing...\n");
@@ -158,7 +194,6 @@ void update_sensor_pod(SensorPod *sensorPod) {
         // Reset pod and interface timeouts
         sensorPod->mPodResetTimeout = make_timeout_time_ms(SENSOR_POD_TIMEOUT_MS);
         reset_interface_watchdog(sensorPod->mInterface);
-        DEBUG_PRINT("      +- Good data!\n");
     }
 
 }
@@ -166,3 +201,17 @@ void update_sensor_pod(SensorPod *sensorPod) {
 bool sensor_pod_has_valid_data(SensorPod *sensorPod) {
     return (sensorPod->mCurrentData.mSoilSensorDataValid || sensorPod->mCurrentData.mSCD30SensorDataValid);
 }
+
+
+// Both sensors have to answer, with good data, for the pod's channel to be trusted at a rate
+I2CResponse probe_sensor_pod_internal(I2CInterface *i2cInterface, void *context) {
+    SensorPod *sensorPod = (SensorPod *) context;
+    uint8_t firmwareVersion[2];
+
+    I2CResponse response = read_scd30_firmware_version(i2cInterface, sensorPod->mSCD30Address, firmwareVersion);
+    if(response != I2C_RESPONSE_OK) {
+        return response;
+    }
+
+    return check_soil_sensor_id(i2cInterface, sensorPod->mSoilSensorAddress);
+}
@@ -2,6 +2,8 @@
 #define _SENSOR_POD_H_
 
 #include "sensor_i2c_interface.h"
+#include "scd30_sensor.h"
+#include "stemma_soil_sensor.h"
 
 
 #define SCD30_I2C_ADDRESS                       (0x61)
@@ -31,6 +33,8 @@ typedef struct {
     bool mSoilSensorActive;
     bool mSCD30SensorActive;
     SensorPodData mCurrentData;
+    SCD30Reader mSCD30Reader;
+    SoilSensorReader mSoilSensorReader;
     absolute_time_t mPodResetTimeout;
 } SensorPod;
 
@@ -0,0 +1,154 @@
+#include "sonar_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensor.h"
+
+#define SONAR_FILTER_MIN_OUTLIER_SAMPLES        (3)         // Too few samples and the median means nothing
+
+
+// Internal functions
+uint8_t get_window_size_internal(const SonarFilterConfig *config);
+uint16_t get_median_internal(SonarFilter *filter);
+void record_input_internal(SonarFilter *filter, const SonarFilterConfig *config, bool accepted);
+// -- End internal functions
+
+
+void reset_sonar_filter(SonarFilter *filter) {
+    if(!filter) {
+        return;
+    }
+
+    memset(filter, 0, sizeof(SonarFilter));
+}
+
+void add_sonar_filter_sample(SonarFilter *filter, const SonarFilterConfig *config, uint16_t distance) {
+    if(!filter || !config) {
+        return;
+    }
+
+    uint8_t windowSize = get_window_size_internal(config);
+
+    // A zero distance is the sonar's "no echo", anything past the max is garbage
+    if((distance == 0) || (distance > SONAR_SENSOR_MAX_VALUE)) {
+        filter->mRejectedSamples++;
+        record_input_internal(filter, config, false);
+        return;
+    }
+
+    bool accepted = true;
+    if(filter->mSampleCount >= SONAR_FILTER_MIN_OUTLIER_SAMPLES) {
+        int deviation = (int) distance - (int) get_median_internal(filter);
+        if(abs(deviation) > config->mOutlierThresholdMM) {
+            filter->mOutlierSamples++;
+            accepted = false;
+        }
+    }
+
+    // Outliers still go into the window, so a real change in level takes the median over once it fills half of it.
+    // Until then the median (and so the output) ignores them
+    filter->mSamples[filter->mNextSample] = distance;
+    filter->mNextSample = (filter->mNextSample + 1) % windowSize;
+    if(filter->mSampleCount < windowSize) {
+        filter->mSampleCount++;
+    }
+
+    float median = get_median_internal(filter);
+    float smoothingFactor = ((config->mSmoothingFactor > 0.f) && (config->mSmoothingFactor <= 1.f)) ? config->mSmoothingFactor : 1.f;
+
+    if(filter->mHasOutput) {
+        filter->mAverage += smoothingFactor * (median - filter->mAverage);
+    } else {
+        filter->mAverage = median;
+        filter->mHasOutput = true;
+    }
+
+    record_input_internal(filter, config, accepted);
+}
+
+void add_sonar_filter_failure(SonarFilter *filter, const SonarFilterConfig *config) {
+    if(!filter || !config) {
+        return;
+    }
+
+    record_input_internal(filter, config, false);
+}
+
+bool sonar_filter_has_output(SonarFilter *filter) {
+    return filter && filter->mHasOutput;
+}
+
+uint16_t get_sonar_filter_distance(SonarFilter *filter) {
+    if(!sonar_filter_has_output(filter)) {
+        return 0;
+    }
+
+    return (uint16_t) (filter->mAverage + 0.5f);
+}
+
+uint8_t get_sonar_filter_confidence(SonarFilter *filter, const SonarFilterConfig *config) {
+    if(!filter || !config) {
+        return 0;
+    }
+
+    uint8_t windowSize = get_window_size_internal(config);
+    uint32_t windowMask = (1u << windowSize) - 1;
+
+    return (uint8_t) ((__builtin_popcount(filter->mInputHistory & windowMask) * 100) / windowSize);
+}
+
+
+uint8_t get_window_size_internal(const SonarFilterConfig *config) {
+    if(config->mWindowSize == 0) {
+        return 1;
+    }
+
+    return (config->mWindowSize > SONAR_FILTER_MAX_WINDOW) ? SONAR_FILTER_MAX_WINDOW : config->mWindowSize;
+}
+
+// Windows are small, so sorting a copy each time is cheaper than keeping a sorted structure up to date
+uint16_t get_median_internal(SonarFilter *filter) {
+    uint16_t sorted[SONAR_FILTER_MAX_WINDOW];
+    uint8_t count = filter->mSampleCount;
+
+    if(!count) {
+        return 0;
+    }
+
+    memcpy(sorted, filter->mSamples, count * sizeof(uint16_t));
+    for(int i = 1; i < count; ++i) {
+        uint16_t value = sorted[i];
+        int j = i - 1;
+        while((j >= 0) && (sorted[j] > value)) {
+            sorted[j + 1] = sorted[j];
+            --j;
+        }
+        sorted[j + 1] = value;
+    }
+
+    if(count & 1) {
+        return sorted[count / 2];
+    }
+
+    return (sorted[(count / 2) - 1] + sorted[count / 2]) / 2;
+}
+
+void record_input_internal(SonarFilter *filter, const SonarFilterConfig *config, bool accepted) {
+    uint8_t windowSize = get_window_size_internal(config);
+
+    filter->mInputHistory = (filter->mInputHistory << 1) | (accepted ? 1 : 0);
+    if(filter->mInputCount < windowSize) {
+        filter->mInputCount++;
+    }
+
+    // A whole window without a good input means the output no longer describes anything real. Start over,
+    // keeping the counters
+    if((filter->mInputCount == windowSize) && !(filter->mInputHistory & ((1u << windowSize) - 1))) {
+        filter->mSampleCount = 0;
+        filter->mNextSample = 0;
+        filter->mInputCount = 0;
+        filter->mHasOutput = false;
+        filter->mAverage = 0.f;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef _SONAR_FILTER_H
+#define _SONAR_FILTER_H
+
+#include "pico/stdlib.h"
+
+#define SONAR_FILTER_MAX_WINDOW     (15)
+
+// Per-sensor filter settings, fixed in the sensor definition
+typedef struct {
+    uint8_t mWindowSize;                                // Samples the running median is taken over (clamped to SONAR_FILTER_MAX_WINDOW)
+    uint16_t mOutlierThresholdMM;                       // Samples further than this from the median count as outliers
+    float mSmoothingFactor;                             // EMA weight given to each new median, 0 < factor <= 1
+} SonarFilterConfig;
+
+typedef struct {
+    uint16_t mSamples[SONAR_FILTER_MAX_WINDOW];         // Ring of the latest in-range samples
+    uint8_t mSampleCount;
+    uint8_t mNextSample;
+
+    uint32_t mInputHistory;                             // One bit per input, newest in bit 0, set when it was accepted
+    uint8_t mInputCount;
+
+    bool mHasOutput;
+    float mAverage;                                     // EMA of the running median
+
+    uint32_t mRejectedSamples;                          // Out-of-range samples dropped since reset
+    uint32_t mOutlierSamples;                           // In-range samples too far from the median since reset
+} SonarFilter;
+
+
+void reset_sonar_filter(SonarFilter *filter);
+
+// Runs a distance through the filter. Frames that arrived corrupt are added with add_sonar_filter_failure,
+// so they still count against confidence
+void add_sonar_filter_sample(SonarFilter *filter, const SonarFilterConfig *config, uint16_t distance);
+void add_sonar_filter_failure(SonarFilter *filter, const SonarFilterConfig *config);
+
+bool sonar_filter_has_output(SonarFilter *filter);
+uint16_t get_sonar_filter_distance(SonarFilter *filter);
+
+// Share of the last window's inputs that were accepted, 0 - 100. A filter that is still filling up
+// reports proportionally less
+uint8_t get_sonar_filter_confidence(SonarFilter *filter, const SonarFilterConfig *config);
+
+#endif      // _SONAR_FILTER_H
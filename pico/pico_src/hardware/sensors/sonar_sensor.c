@@ -1,16 +1,91 @@
 #include "sonar_sensor.h"
 
-#include "uart_rx.pio.h"
+#include "hardware/dma.h"
+#include "sonar_rx.pio.h"
+#include "utils.h"
 
+#define SONAR_FRAME_SYNC            (0xFF)
+#define SONAR_FRAME_PERIOD_MS       (100)           // The sonar sends a processed frame this often
+#define SONAR_FRAME_LATE_MS         (50)            // Slack before a frame that hasn't arrived counts as missed
 
-void initialize_sonar_pio(SonarPIOWrapper* pioWrapper) {
-    pioWrapper->mOffset = pio_add_program(pioWrapper->mPIO, &uart_rx_program);
+
+// Loads the receiver program once per PIO block, however many sonars share it
+bool initialize_sonar_pio(SonarPIOWrapper* pioWrapper) {
+    if(pioWrapper->mInitialized) {
+        return true;
+    }
+
+    if(!pio_can_add_program(pioWrapper->mPIO, &sonar_rx_program)) {
+        return false;
+    }
+
+    pioWrapper->mOffset = pio_add_program(pioWrapper->mPIO, &sonar_rx_program);
+    pioWrapper->mInitialized = true;
+
+    return true;
+}
+
+// Takes ownership of the sensor's state machine. Fails if something else (another sonar bound to the same
+// state machine, for one) already has it
+bool claim_sonar_state_machine(SonarSensor *sensor) {
+    if(sensor->mStateMachineClaimed) {
+        return true;
+    }
+
+    if(pio_sm_is_claimed(sensor->mPIOWrapper->mPIO, sensor->mStateMachineID)) {
+        return false;
+    }
+
+    pio_sm_claim(sensor->mPIOWrapper->mPIO, sensor->mStateMachineID);
+    sensor->mStateMachineClaimed = true;
+
+    return true;
 }
 
-void initialize_sonar_sensor(SonarSensor *sensor) {
-    if(!sensor->mPIOWrapper->mInitialized) {
-        initialize_sonar_pio(sensor->mPIOWrapper);
-        sensor->mPIOWrapper->mInitialized = true;
+// Sets the sonar's DMA channel streaming the state machine's RX FIFO into the ring. The write address wraps
+// around the ring, so the channel runs continuously and never lets the FIFO fill, whatever core 0 is doing
+void start_sonar_dma(SonarSensor *sensor) {
+    PIO pio = sensor->mPIOWrapper->mPIO;
+
+    if(!sensor->mDMAClaimed) {
+        sensor->mDMAChannel = dma_claim_unused_channel(true);
+        sensor->mDMAClaimed = true;
+    }
+
+    dma_channel_abort(sensor->mDMAChannel);
+
+    // The state machine pushes a whole frame per FIFO word
+    dma_channel_config config = dma_channel_get_default_config(sensor->mDMAChannel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, SONAR_RING_SIZE_BITS);
+    channel_config_set_dreq(&config, pio_get_dreq(pio, sensor->mStateMachineID, false));
+    dma_channel_configure(
+        sensor->mDMAChannel,
+        &config,
+        sensor->mRing,
+        &pio->rxf[sensor->mStateMachineID],
+        UINT32_MAX,
+        true
+    );
+
+    sensor->mRingReadCount = 0;
+    sensor->mNextFrameDeadline = make_timeout_time_ms(SONAR_FRAME_PERIOD_MS + SONAR_FRAME_LATE_MS);
+}
+
+// The channel counts down from its (very large) transfer count, so the difference is the frames it has written
+uint32_t get_sonar_frames_received(SonarSensor *sensor) {
+    return UINT32_MAX - dma_hw->ch[sensor->mDMAChannel].transfer_count;
+}
+
+bool initialize_sonar_sensor(SonarSensor *sensor) {
+    if(!sensor || !sensor->mPIOWrapper) {
+        return false;
+    }
+
+    if(!initialize_sonar_pio(sensor->mPIOWrapper) || !claim_sonar_state_machine(sensor)) {
+        return false;
     }
 
     // Set sonar pin high to generate processed value
@@ -18,8 +93,8 @@ void initialize_sonar_sensor(SonarSensor *sensor) {
     gpio_set_dir(sensor->mTXPin, GPIO_OUT);
     gpio_put(sensor->mTXPin, 1);
 
-    // Initialize sonar UART - sets up the state machine we're going to use to receive sonar uart characters.
-    uart_rx_program_init(
+    // Initialize sonar UART - sets up the state machine we're going to use to receive sonar frames.
+    sonar_rx_program_init(
         sensor->mPIOWrapper->mPIO, 
         sensor->mStateMachineID, 
         sensor->mPIOWrapper->mOffset,
@@ -28,37 +103,101 @@ void initialize_sonar_sensor(SonarSensor *sensor) {
     );
 
     sensor->mState = AWAITING_SONAR_DATA;
-    sensor->mCurrentBufferPos = 0;
-    sensor->mCurrentDistance = 0;
+    sensor->mCurrentData.mDistance = 0;
+    sensor->mCurrentData.mConfidence = 0;
+    reset_sonar_filter(&sensor->mFilter);
+
+    start_sonar_dma(sensor);
+
+    return true;
 }
 
+void stop_sonar_sensor(SonarSensor *sensor) {
+    if(!sensor || !sensor->mStateMachineClaimed) {
+        return;
+    }
+
+    pio_sm_set_enabled(sensor->mPIOWrapper->mPIO, sensor->mStateMachineID, false);
+    if(sensor->mDMAClaimed) {
+        dma_channel_abort(sensor->mDMAChannel);
+    }
+
+    sensor->mState = AWAITING_SONAR_DATA;
+}
+
+// A sonar that stops sending (dead unit, broken TX wire) still reads as connected, so every frame period that
+// passes without a frame is run through the filter as a failed frame, and confidence decays as it would for
+// corrupt ones. Returns whether any were
+bool add_missed_sonar_frames(SonarSensor *sensor) {
+    int64_t lateUS = absolute_time_diff_us(sensor->mNextFrameDeadline, get_absolute_time());
+    if(lateUS < 0) {
+        return false;
+    }
+
+    // Past a whole window of failures more of them change nothing, but the deadline still has to catch up
+    uint32_t missed = (uint32_t) (lateUS / (SONAR_FRAME_PERIOD_MS * 1000)) + 1;
+    for(uint32_t i = MIN(missed, SONAR_FILTER_MAX_WINDOW); i > 0; --i) {
+        add_sonar_filter_failure(&sensor->mFilter, &sensor->mFilterConfig);
+    }
+    sensor->mNextFrameDeadline = delayed_by_ms(sensor->mNextFrameDeadline, missed * SONAR_FRAME_PERIOD_MS);
+
+    return true;
+}
+
+// Runs everything the DMA has received since the last update through the filter, oldest first
 void update_sonar_sensor(SonarSensor *sensor) {
-    while(uart_rx_program_has_data(sensor->mPIOWrapper->mPIO, sensor->mStateMachineID)) {
-        char c = uart_rx_program_getc(sensor->mPIOWrapper->mPIO, sensor->mStateMachineID);
-        
-        if(c == 0xFF) {
-            sensor->mCurrentBufferPos = 0;
-        }
+    // The channel only stops if its transfer count ever runs out
+    if(!dma_channel_is_busy(sensor->mDMAChannel)) {
+        start_sonar_dma(sensor);
+        return;
+    }
 
-        sensor->mPacketBuffer[sensor->mCurrentBufferPos++] = c;
+    uint32_t received = get_sonar_frames_received(sensor);
+    uint32_t unread = received - sensor->mRingReadCount;
 
-        if(sensor->mCurrentBufferPos >= SONAR_SENSOR_PACKET_SIZE) {
-            // Full packet, compute checksum
-            char checksum = sensor->mPacketBuffer[0] + sensor->mPacketBuffer[1] + sensor->mPacketBuffer[2];
+    if(!unread) {
+        if(!add_missed_sonar_frames(sensor)) {
+            return;
+        }
+    }
 
-            // If checksum is valid calculate distance
-            if(checksum == sensor->mPacketBuffer[3]) {
-                sensor->mState = VALID_SONAR_DATA;
-                sensor->mCurrentDistance = ((sensor->mPacketBuffer[1] << 8) + sensor->mPacketBuffer[2]);
-            } else {
-                sensor->mState = INVALID_SONAR_CHECKSUM;
-                sensor->mCurrentDistance = 0;
-            }
+    // If the DMA has lapped the parser the oldest unread frames are gone
+    if(unread > SONAR_RING_FRAMES) {
+        sensor->mOverrunFrames += unread - SONAR_RING_FRAMES;
+        unread = SONAR_RING_FRAMES;
+    }
 
-            sensor->mCurrentBufferPos = 0;
+    // The state machine only pushes frames that start with the sync byte, so each word just needs its checksum
+    // checking
+    for(uint32_t i = unread; i > 0; --i) {
+        uint32_t frame = sensor->mRing[(received - i) & (SONAR_RING_FRAMES - 1)];
+        uint8_t sync = (uint8_t) frame;
+        uint8_t distanceHigh = (uint8_t) (frame >> 8);
+        uint8_t distanceLow = (uint8_t) (frame >> 16);
+        uint8_t checksum = (uint8_t) (frame >> 24);
 
-            // Only process a max of one packet per update
-            break;
+        if((sync == SONAR_FRAME_SYNC) && ((uint8_t) (sync + distanceHigh + distanceLow) == checksum)) {
+            add_sonar_filter_sample(&sensor->mFilter, &sensor->mFilterConfig, (distanceHigh << 8) + distanceLow);
+        } else {
+            add_sonar_filter_failure(&sensor->mFilter, &sensor->mFilterConfig);
         }
     }
+
+    sensor->mRingReadCount = received;
+    if(unread) {
+        sensor->mNextFrameDeadline = make_timeout_time_ms(SONAR_FRAME_PERIOD_MS + SONAR_FRAME_LATE_MS);
+    }
+
+    // Nothing good in a whole window of frames, whether they were corrupt or never came
+    uint8_t confidence = get_sonar_filter_confidence(&sensor->mFilter, &sensor->mFilterConfig);
+    if(!sonar_filter_has_output(&sensor->mFilter) || !confidence) {
+        sensor->mState = INVALID_SONAR_CHECKSUM;
+        sensor->mCurrentData.mDistance = 0;
+        sensor->mCurrentData.mConfidence = 0;
+        return;
+    }
+
+    sensor->mState = VALID_SONAR_DATA;
+    sensor->mCurrentData.mDistance = get_sonar_filter_distance(&sensor->mFilter);
+    sensor->mCurrentData.mConfidence = confidence;
 }
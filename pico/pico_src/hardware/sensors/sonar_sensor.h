@@ -3,7 +3,12 @@
 
 #include "hardware/pio.h"
 
+#include "sonar_filter.h"
+
 #define SONAR_SENSOR_PACKET_SIZE    (4)
+#define SONAR_RING_SIZE_BITS        (7)
+#define SONAR_RING_SIZE             (1 << SONAR_RING_SIZE_BITS)     // Bytes written by the sonar's DMA channel. Must be a power of two
+#define SONAR_RING_FRAMES           (SONAR_RING_SIZE / SONAR_SENSOR_PACKET_SIZE)
 
 typedef struct {
     PIO mPIO;
@@ -17,22 +22,37 @@ typedef enum {
     INVALID_SONAR_CHECKSUM
 } SonarSensorState;
 
+typedef struct {
+    uint16_t mDistance;                                 // Filtered distance (mm)
+    uint8_t mConfidence;                                // Share of recent frames that agreed with it, 0 - 100
+} SonarSensorData;
+
 typedef struct {
     const int mTXPin;
     const int mRXPin;
     const int mBaudrate;
     const uint mStateMachineID;
+    const SonarFilterConfig mFilterConfig;
 
     SonarPIOWrapper *mPIOWrapper;
+    bool mStateMachineClaimed;                          // Set once this sensor owns mStateMachineID on its PIO block
 
     SonarSensorState mState;
-    char mPacketBuffer[SONAR_SENSOR_PACKET_SIZE];
-    int mCurrentBufferPos;
-
-    uint16_t mCurrentDistance;
+    uint32_t mRing[SONAR_RING_FRAMES]
+        __attribute__((aligned(SONAR_RING_SIZE)));      // Ring of received frames, filled from the PIO RX FIFO by DMA (aligned for address wrapping)
+    int mDMAChannel;                                    // DMA channel draining the state machine's RX FIFO
+    bool mDMAClaimed;
+    uint32_t mRingReadCount;                            // Frames received that have been parsed (or skipped)
+    uint32_t mOverrunFrames;                            // Frames overwritten in the ring before they could be parsed
+    absolute_time_t mNextFrameDeadline;                 // Each frame period after this without a frame counts as a failed frame
+
+    SonarFilter mFilter;
+    SonarSensorData mCurrentData;
 } SonarSensor;
 
-void initialize_sonar_sensor(SonarSensor *sensor);
+bool initialize_sonar_sensor(SonarSensor *sensor);
 void update_sonar_sensor(SonarSensor *sensor);
+// Stops receiving, keeping the state machine and DMA channel for when the sonar is initialized again
+void stop_sonar_sensor(SonarSensor *sensor);
 
 #endif      // _SONAR_SENSOR_H
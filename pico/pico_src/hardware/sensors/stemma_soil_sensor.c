@@ -79,6 +79,18 @@ uint32_t get_soil_sensor_version(I2CInterface *i2cInterface, uint8_t address) {
             (uint) buf[3]);
 }
 
+I2CResponse check_soil_sensor_id(I2CInterface *i2cInterface, uint8_t address) {
+    static const uint16_t READ_DELAY_MS = 4;
+    uint8_t hardwareID = 0;
+
+    I2CResponse response = read_from_i2c_register(i2cInterface, address, SEESAW_STATUS_BASE, SEESAW_STATUS_HW_ID, &hardwareID, 1, READ_DELAY_MS);
+    if(response != I2C_RESPONSE_OK) {
+        return response;
+    }
+
+    return (hardwareID == SEESAW_HW_ID_CODE) ? I2C_RESPONSE_OK : I2C_RESPONSE_MALFORMED;
+}
+
 uint16_t get_soil_sensor_capacitive_value(I2CInterface *i2cInterface, uint8_t address) {
     static const uint16_t READ_DELAY_MS = 5;
     static const uint16_t NUM_RETRIES = 3;
@@ -102,3 +114,58 @@ uint16_t get_soil_sensor_capacitive_value(I2CInterface *i2cInterface, uint8_t ad
     }
     return ret;
 }
+
+void soil_sensor_reader_callback(void *context, I2CResponse response) {
+    SoilSensorReader *reader = (SoilSensorReader *) context;
+
+    reader->mState = (response == I2C_RESPONSE_OK) ? SOIL_SENSOR_READER_READY : SOIL_SENSOR_READER_FAILED;
+}
+
+void reset_soil_sensor_reader(SoilSensorReader *reader, I2CInterface *i2cInterface) {
+    if(!reader) {
+        return;
+    }
+
+    cancel_i2c_transaction(i2cInterface, &reader->mTransaction);
+    reader->mState = SOIL_SENSOR_READER_IDLE;
+}
+
+SoilSensorReadResult update_soil_sensor_reader(SoilSensorReader *reader, I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, uint16_t *value) {
+    static const uint16_t READ_DELAY_MS = 5;
+    SoilSensorReadResult result = SOIL_SENSOR_READ_PENDING;
+
+    if(!reader || !value) {
+        return SOIL_SENSOR_READ_FAILED;
+    }
+
+    switch(reader->mState) {
+        case SOIL_SENSOR_READER_BUSY:
+            return SOIL_SENSOR_READ_PENDING;
+
+        case SOIL_SENSOR_READER_READY:
+            *value = ((uint16_t) reader->mResponse[0] << 8) | reader->mResponse[1];
+            result = SOIL_SENSOR_READ_COMPLETE;
+            break;
+
+        case SOIL_SENSOR_READER_FAILED:
+            result = SOIL_SENSOR_READ_FAILED;
+            break;
+
+        default:
+            break;
+    }
+
+    // Queue up the next reading so it is waiting for us on the next step
+    reader->mRegister[0] = SEESAW_TOUCH_BASE;
+    reader->mRegister[1] = SEESAW_TOUCH_CHANNEL_OFFSET;
+
+    init_i2c_transaction(&reader->mTransaction, channel, address, soil_sensor_reader_callback, reader);
+    add_i2c_write_step(&reader->mTransaction, reader->mRegister, 2);
+    add_i2c_delay_step(&reader->mTransaction, READ_DELAY_MS);
+    add_i2c_read_step(&reader->mTransaction, reader->mResponse, 2);
+
+    reader->mState = (submit_i2c_transaction(i2cInterface, &reader->mTransaction) == I2C_RESPONSE_OK) ?
+        SOIL_SENSOR_READER_BUSY : SOIL_SENSOR_READER_IDLE;
+
+    return result;
+}
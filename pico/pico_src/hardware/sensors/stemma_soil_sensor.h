@@ -6,11 +6,36 @@
 
 #define STEMMA_SOIL_SENSOR_INVALID_READING      (65535)
 
+// Outcome of a single step of a SoilSensorReader
+typedef enum {
+    SOIL_SENSOR_READ_PENDING,                   // Reading queued on the bus, step again later
+    SOIL_SENSOR_READ_COMPLETE,                  // A new reading is available
+    SOIL_SENSOR_READ_FAILED                     // The sensor did not respond. The next step tries again
+} SoilSensorReadResult;
+
+typedef enum {
+    SOIL_SENSOR_READER_IDLE,
+    SOIL_SENSOR_READER_BUSY,
+    SOIL_SENSOR_READER_READY,
+    SOIL_SENSOR_READER_FAILED
+} SoilSensorReaderState;
+
+// Non-blocking capacitive reading, done through the interface's transaction queue
+typedef struct {
+    SoilSensorReaderState mState;
+    uint8_t mRegister[2];
+    uint8_t mResponse[2];
+    I2CTransaction mTransaction;
+} SoilSensorReader;
+
 
 I2CResponse init_soil_sensor(I2CInterface *i2cInterface, uint8_t address);
 I2CResponse reset_soil_sensor(I2CInterface *i2cInterface, uint8_t address);
 uint32_t get_soil_sensor_version(I2CInterface *i2cInterface, uint8_t address);
+I2CResponse check_soil_sensor_id(I2CInterface *i2cInterface, uint8_t address);
 uint16_t get_soil_sensor_capacitive_value(I2CInterface *i2cInterface, uint8_t address);
+void reset_soil_sensor_reader(SoilSensorReader *reader, I2CInterface *i2cInterface);
+SoilSensorReadResult update_soil_sensor_reader(SoilSensorReader *reader, I2CInterface *i2cInterface, I2CChannel channel, uint8_t address, uint16_t *value);
 
 
 #endif
@@ -1,6 +1,28 @@
 #include "shift_register.h"
 
+#include "shift_register_in.pio.h"
+#include "shift_register_out.pio.h"
+
+#define PIO_WRITE_BIT_COUNT_BITS        (5)                                 // Top bits of a write word, holding its bit count less one
+#define PIO_WRITE_MAX_BITS              (32 - PIO_WRITE_BIT_COUNT_BITS)
+
+
+// Internal functions
+bool init_shift_register_pio_internal(ShiftRegister *shiftRegister);
+bool read_shift_register_states_pio_internal(ShiftRegister *shiftRegister);
+void write_shift_register_states_pio_internal(ShiftRegister *shiftRegister);
+// -- End internal functions
+
+
 void init_shift_register(ShiftRegister *shiftRegister) {
+    // Whatever the outputs hold at power up, the first write goes out
+    shiftRegister->mLatchedValueValid = false;
+
+    if((shiftRegister->mBackend == PIO_SHIFT_REGISTER_BACKEND) && init_shift_register_pio_internal(shiftRegister)) {
+        reset_shift_register(shiftRegister);
+        return;
+    }
+
     // Initialize pins
     gpio_init(shiftRegister->mLatchPin);
     gpio_set_dir(shiftRegister->mLatchPin, GPIO_OUT);
@@ -51,6 +73,16 @@ void write_shift_register_states(ShiftRegister *shiftRegister) {
         return;
     }
 
+    // Nothing has changed since the last latch
+    if(shiftRegister->mLatchedValueValid && (shiftRegister->mCurrentValue == shiftRegister->mLatchedValue)) {
+        return;
+    }
+
+    if(shiftRegister->mStateMachineClaimed) {
+        write_shift_register_states_pio_internal(shiftRegister);
+        return;
+    }
+
     // Set latch pin low while we are setting the data
     gpio_put(shiftRegister->mLatchPin, 0);
     sleep_us(1);
@@ -67,12 +99,19 @@ void write_shift_register_states(ShiftRegister *shiftRegister) {
 
     // Set latch high to store data
     gpio_put(shiftRegister->mLatchPin, 1);
+
+    shiftRegister->mLatchedValue = shiftRegister->mCurrentValue;
+    shiftRegister->mLatchedValueValid = true;
 }
 
 
-void read_shift_register_states(ShiftRegister *shiftRegister) {
+bool read_shift_register_states(ShiftRegister *shiftRegister) {
     if(!shiftRegister || (shiftRegister->mType != PISO_SHIFT_REGISTER)) {
-        return;
+        return false;
+    }
+
+    if(shiftRegister->mStateMachineClaimed) {
+        return read_shift_register_states_pio_internal(shiftRegister);
     }
 
     shiftRegister->mCurrentValue = 0;
@@ -95,6 +134,8 @@ void read_shift_register_states(ShiftRegister *shiftRegister) {
         gpio_put(shiftRegister->mClockPin, false);
         sleep_us(1);
     }    
+
+    return true;
 }
 
 
@@ -105,3 +146,84 @@ bool get_shift_register_state(ShiftRegister *shiftRegister, uint16_t pos) {
 
     return !(shiftRegister->mCurrentValue & (1 << pos));
 }
+
+
+// Loads the reader or writer program and binds the register to its state machine. Registers that can't have one
+// fall back to the GPIO backend
+bool init_shift_register_pio_internal(ShiftRegister *shiftRegister) {
+    const pio_program_t *program = (shiftRegister->mType == PISO_SHIFT_REGISTER) ? &shift_register_in_program : &shift_register_out_program;
+
+    // A write has to fit in one FIFO word alongside its bit count
+    if((shiftRegister->mType == SIPO_SHIFT_REGISTER) && (shiftRegister->mNumBits > PIO_WRITE_MAX_BITS)) {
+        return false;
+    }
+
+    if(pio_sm_is_claimed(shiftRegister->mPIO, shiftRegister->mStateMachineID) ||
+       !pio_can_add_program(shiftRegister->mPIO, program)) {
+        return false;
+    }
+
+    pio_sm_claim(shiftRegister->mPIO, shiftRegister->mStateMachineID);
+    shiftRegister->mStateMachineClaimed = true;
+    shiftRegister->mProgramOffset = pio_add_program(shiftRegister->mPIO, program);
+
+    switch(shiftRegister->mType) {
+        case PISO_SHIFT_REGISTER:
+            shift_register_in_program_init(
+                shiftRegister->mPIO,
+                shiftRegister->mStateMachineID,
+                shiftRegister->mProgramOffset,
+                shiftRegister->mDataPin,
+                shiftRegister->mLatchPin,
+                shiftRegister->mClockPin,
+                shiftRegister->mBitRate
+            );
+            break;
+        case SIPO_SHIFT_REGISTER:
+            shift_register_out_program_init(
+                shiftRegister->mPIO,
+                shiftRegister->mStateMachineID,
+                shiftRegister->mProgramOffset,
+                shiftRegister->mDataPin,
+                shiftRegister->mLatchPin,
+                shiftRegister->mClockPin,
+                shiftRegister->mBitRate
+            );
+            break;
+    }
+    shiftRegister->mReadPending = false;
+
+    return true;
+}
+
+bool read_shift_register_states_pio_internal(ShiftRegister *shiftRegister) {
+    bool updated = false;
+
+    if(shiftRegister->mReadPending && !pio_sm_is_rx_fifo_empty(shiftRegister->mPIO, shiftRegister->mStateMachineID)) {
+        shiftRegister->mCurrentValue = pio_sm_get(shiftRegister->mPIO, shiftRegister->mStateMachineID);
+        shiftRegister->mReadPending = false;
+        updated = true;
+    }
+
+    if(!shiftRegister->mReadPending) {
+        pio_sm_put(shiftRegister->mPIO, shiftRegister->mStateMachineID, shiftRegister->mNumBits - 1);
+        shiftRegister->mReadPending = true;
+    }
+
+    return updated;
+}
+
+// A full TX FIFO leaves the value unlatched, so it goes out with the next write instead
+void write_shift_register_states_pio_internal(ShiftRegister *shiftRegister) {
+    uint32_t bitMask = (1u << shiftRegister->mNumBits) - 1;
+    uint32_t word = ((uint32_t) (shiftRegister->mNumBits - 1) << PIO_WRITE_MAX_BITS) |
+                    ((shiftRegister->mCurrentValue & bitMask) << (PIO_WRITE_MAX_BITS - shiftRegister->mNumBits));
+
+    if(pio_sm_is_tx_fifo_full(shiftRegister->mPIO, shiftRegister->mStateMachineID)) {
+        return;
+    }
+
+    pio_sm_put(shiftRegister->mPIO, shiftRegister->mStateMachineID, word);
+    shiftRegister->mLatchedValue = shiftRegister->mCurrentValue;
+    shiftRegister->mLatchedValueValid = true;
+}
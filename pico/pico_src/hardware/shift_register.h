@@ -2,12 +2,18 @@
 #define _SHIFT_REGISTER_H_
 
 #include "pico/stdlib.h"
+#include "hardware/pio.h"
 
 typedef enum {
     PISO_SHIFT_REGISTER,        // Parallel-in-Serial-Out shift register (for more inputs)
     SIPO_SHIFT_REGISTER         // Serial-in-Parallel-Out shift register (for more outputs)
 } ShiftRegisterType;
 
+typedef enum {
+    GPIO_SHIFT_REGISTER_BACKEND,    // Bit-banged by the CPU
+    PIO_SHIFT_REGISTER_BACKEND      // Driven by a PIO state machine, leaving the CPU free
+} ShiftRegisterBackend;
+
 typedef struct {
     const uint8_t mDataPin;
     const uint8_t mLatchPin;
@@ -15,7 +21,18 @@ typedef struct {
     const ShiftRegisterType mType;
     const uint8_t mNumBits;
 
+    // PIO backend
+    const ShiftRegisterBackend mBackend;
+    PIO mPIO;
+    const uint mStateMachineID;
+    const uint mBitRate;                    // Shift clock, Hz
+    uint mProgramOffset;
+    bool mStateMachineClaimed;              // Set once the register is bound to its state machine, otherwise GPIO is used
+    bool mReadPending;                      // A read has been asked of the state machine and not yet collected
+
     uint32_t mCurrentValue;
+    uint32_t mLatchedValue;                 // SIPO: value the outputs were last latched with
+    bool mLatchedValueValid;
 } ShiftRegister;
 
 // Generic functions
@@ -25,10 +42,13 @@ void reset_shift_register(ShiftRegister *shiftRegister);
 // Write functions (SIPO shift register)
 void set_shift_register_state(ShiftRegister *shiftRegister, uint8_t pos, bool on);
 void set_shift_register_states(ShiftRegister *shiftRegister, uint32_t states);
+// Latches mCurrentValue onto the outputs, unless they already hold it. Through PIO this is a single FIFO push
 void write_shift_register_states(ShiftRegister *shiftRegister);
 
 // Read functions (PISO shift register)
-void read_shift_register_states(ShiftRegister *shiftRegister);
+// Refreshes mCurrentValue, returning false if it is unchanged because no read has finished. Through PIO the read
+// runs in the background, so this collects the last one asked for and asks for the next
+bool read_shift_register_states(ShiftRegister *shiftRegister);
 bool get_shift_register_state(ShiftRegister *shiftRegister, uint16_t pos);
 
 #endif
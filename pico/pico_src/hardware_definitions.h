@@ -21,9 +21,9 @@ typedef enum {
     SONAR_SENSOR_R1_ACTIVE_LED      = 4,
     SENSOR_POD_L_ACTIVE_LED         = 1,
     SENSOR_POD_R_ACTIVE_LED         = 5,
-    LED_L3_IDX                      = 2,
+    SONAR_SENSOR_L2_ACTIVE_LED      = 2,
     LED_L4_IDX                      = 3,
-    LED_R3_IDX                      = 6,
+    SONAR_SENSOR_R2_ACTIVE_LED      = 6,
     LED_R4_IDX                      = 7,
     NO_LED                          = -1
 } SensorActiveLEDPositions;
@@ -31,6 +31,8 @@ typedef enum {
 typedef enum {
     SONAR_SENSOR_L1_ACTIVE_LED_IDX      = LED_L1,
     SONAR_SENSOR_R1_ACTIVE_LED_IDX      = LED_R1,
+    SONAR_SENSOR_L2_ACTIVE_LED_IDX      = LED_L3,
+    SONAR_SENSOR_R2_ACTIVE_LED_IDX      = LED_R3,
     SENSOR_POD_L_ACTIVE_LED_IDX         = LED_L2,
     SENSOR_POD_R_ACTIVE_LED_IDX         = LED_R2,
     NO_LED_IDX                          = -1
@@ -98,7 +100,25 @@ static const uint SENSOR_I2C_BAUDRATE                   = (10 * 1000);
 
 // Sonar sensor values
 static const int SONAR_SENSOR_BAUDRATE                  = 9600;
-#define SONAR_SENSOR_PIO                                (pio0)
+// Default reading filter: median over ~1.5s of frames, then a gentle EMA. Feed levels change slowly
+#define SONAR_FILTER_WINDOW_SIZE                        (15)
+#define SONAR_FILTER_OUTLIER_THRESHOLD_MM               (100)
+#define SONAR_FILTER_SMOOTHING_FACTOR                   (0.25f)
+// Each PIO block runs sonar receivers, one per state machine. SM 3 on both blocks goes to a shift register
+// (below), so each side takes at most three sonars (SM 0-2), six in total
+#define SONAR_SENSOR_L_PIO                              (pio0)
+#define SONAR_SENSOR_R_PIO                              (pio1)
+
+// Hardware connect register values. Read by its own state machine, kept clear of those the sonars bind to.
+// One register per block, as putting both on one block would leave that side only two sonars
+#define HARDWARE_CONNECT_SR_PIO                         (pio0)
+#define HARDWARE_CONNECT_SR_STATE_MACHINE               (3)
+static const uint HARDWARE_CONNECT_SR_BIT_RATE          = (500 * 1000);
+
+// Sensor status LED register values. Written by its own state machine, on the other block to the connect register
+#define LED_SR_PIO                                      (pio1)
+#define LED_SR_STATE_MACHINE                            (3)
+static const uint LED_SR_BIT_RATE                       = (500 * 1000);
 
 // Main controller comms values (UART1)
 #define SENSOR_CONTROLLER_UART                          (uart1)
@@ -0,0 +1,80 @@
+#include "perf_stats.h"
+
+#include <string.h>
+
+#include "hardware/sync.h"
+
+#include "utils.h"
+
+
+static const char *PERF_STAGE_NAMES[NUM_PERF_STAGES] = {
+    [PERF_STAGE_CORE_0_LOOP]            = "Core 0 loop",
+    [PERF_STAGE_HARDWARE_MONITOR]       = "Hardware monitor",
+    [PERF_STAGE_SENSOR_UPDATES]         = "Sensor updates",
+    [PERF_STAGE_SONAR_UPDATE]           = "Sonar update",
+    [PERF_STAGE_SENSOR_POD_UPDATE]      = "Sensor pod update",
+    [PERF_STAGE_BATTERY_UPDATE]         = "Battery update",
+    [PERF_STAGE_STATUS_LEDS]            = "Status LEDs",
+    [PERF_STAGE_SNAPSHOT_PUBLISH]       = "Snapshot publish",
+    [PERF_STAGE_I2C_TRANSACTIONS]       = "I2C transactions",
+    [PERF_STAGE_FLASH_LOG]              = "Flash log",
+    [PERF_STAGE_CORE_1_LOOP]            = "Core 1 loop",
+    [PERF_STAGE_SNAPSHOT_CONSUME]       = "Snapshot consume",
+    [PERF_STAGE_HISTORY_RECORD]         = "History record",
+    [PERF_STAGE_UART_TX]                = "UART TX",
+    [PERF_STAGE_UART_COMMANDS]          = "UART commands",
+    [PERF_STAGE_UART_SUBSCRIPTIONS]     = "UART subscriptions"
+};
+
+
+const char *get_perf_stage_name(PerfStage stage) {
+    return (stage < NUM_PERF_STAGES) ? PERF_STAGE_NAMES[stage] : "";
+}
+
+
+#if PERF_STATS_ON
+// Shared between the cores. Each stage is written by one core and read by core 1, as a seqlock
+static PerfStats _perfStats;
+
+
+void record_perf_stage(PerfStage stage, uint32_t elapsedUS) {
+    if(stage >= NUM_PERF_STAGES) {
+        return;
+    }
+
+    PerfStageStats *stats = &_perfStats.mStages[stage];
+
+    uint32_t sequence = stats->mSequence;
+    stats->mSequence = sequence + 1;
+    __dmb();
+
+    if(!stats->mCount || (elapsedUS < stats->mMinUS)) {
+        stats->mMinUS = elapsedUS;
+    }
+    if(elapsedUS > stats->mMaxUS) {
+        stats->mMaxUS = elapsedUS;
+    }
+    stats->mCount++;
+    stats->mTotalUS += elapsedUS;
+    stats->mHistogram[LOG2_BUCKET(elapsedUS, PERF_HISTOGRAM_BUCKETS)]++;
+
+    __dmb();
+    stats->mSequence = sequence + 2;
+}
+
+void get_perf_stage_stats(PerfStage stage, PerfStageStats *stats) {
+    if(!stats || (stage >= NUM_PERF_STAGES)) {
+        return;
+    }
+
+    PerfStageStats *source = &_perfStats.mStages[stage];
+    uint32_t sequence;
+
+    do {
+        sequence = source->mSequence;
+        __dmb();
+        memcpy(stats, source, sizeof(PerfStageStats));
+        __dmb();
+    } while((sequence & 1) || (sequence != source->mSequence));
+}
+#endif
@@ -0,0 +1,72 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+
+
+// Hot path timing probes. Set PIFEEDER_PERF_STATS to OFF in CMake to compile every probe out
+#ifndef PERF_STATS_ON
+#define PERF_STATS_ON                   1
+#endif
+
+#define PERF_HISTOGRAM_BUCKETS          (16)        // Bucket 0 is 0us, bucket n is [2^(n-1), 2^n) us, the last takes everything above
+
+
+// Timed stages. Each one is only ever recorded by one core
+typedef enum {
+    // Core 0
+    PERF_STAGE_CORE_0_LOOP          = 0,            // One pass of the core 0 loop, not counting the sleep
+    PERF_STAGE_HARDWARE_MONITOR     = 1,
+    PERF_STAGE_SENSOR_UPDATES       = 2,            // Every due sensor, including those below
+    PERF_STAGE_SONAR_UPDATE         = 3,            // Sensor update stages are in SensorType order
+    PERF_STAGE_SENSOR_POD_UPDATE    = 4,
+    PERF_STAGE_BATTERY_UPDATE       = 5,
+    PERF_STAGE_STATUS_LEDS          = 6,
+    PERF_STAGE_SNAPSHOT_PUBLISH     = 7,
+    PERF_STAGE_I2C_TRANSACTIONS     = 8,
+    PERF_STAGE_FLASH_LOG            = 9,
+
+    // Core 1
+    PERF_STAGE_CORE_1_LOOP          = 10,
+    PERF_STAGE_SNAPSHOT_CONSUME     = 11,
+    PERF_STAGE_HISTORY_RECORD       = 12,
+    PERF_STAGE_UART_TX              = 13,           // Handing the TX ring to the DMA
+    PERF_STAGE_UART_COMMANDS        = 14,           // Parsing commands and packing their responses
+    PERF_STAGE_UART_SUBSCRIPTIONS   = 15,
+
+    NUM_PERF_STAGES
+} PerfStage;
+
+typedef struct {
+    volatile uint32_t mSequence;                    // Odd while the recording core is updating the stage
+    uint32_t mCount;
+    uint32_t mMinUS;
+    uint32_t mMaxUS;
+    uint64_t mTotalUS;
+    uint32_t mHistogram[PERF_HISTOGRAM_BUCKETS];
+} PerfStageStats;
+
+typedef struct {
+    PerfStageStats mStages[NUM_PERF_STAGES];
+} PerfStats;
+
+
+#if PERF_STATS_ON
+// Start timing under the given probe name, then record the time since against a stage
+#   define PERF_PROBE_START(probe)                  uint32_t perfProbe_##probe = time_us_32()
+#   define PERF_PROBE_END(probe, stage)             record_perf_stage((stage), time_us_32() - perfProbe_##probe)
+
+void record_perf_stage(PerfStage stage, uint32_t elapsedUS);
+
+// Copies a stage out, consistent even if its core is recording it at the time
+void get_perf_stage_stats(PerfStage stage, PerfStageStats *stats);
+#else
+// No-op all probes
+#   define PERF_PROBE_START(probe)                  {}
+#   define PERF_PROBE_END(probe, stage)             {}
+#endif
+
+const char *get_perf_stage_name(PerfStage stage);
+
+#endif  // PERF_STATS_H
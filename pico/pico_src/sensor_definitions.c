@@ -9,13 +9,20 @@ I2CMultiplexer sensorI2CMultiplexer = {
 I2CInterface sensorI2CInterface = {
     .mI2C = SENSOR_I2C,
     .mBaud = SENSOR_I2C_BAUDRATE,
+    .mNegotiateSpeed = true,
     .mSDA = SENSOR_I2C_SDA_PIN,
     .mSCL = SENSOR_I2C_SCL_PIN,
     .mMultiplexer = &sensorI2CMultiplexer
 };
 
-SonarPIOWrapper PIO_WRAPPER = {
-    .mPIO = pio0,
+// One wrapper per PIO block running sonar receivers. Each sensor binds to its own state machine on one of them
+SonarPIOWrapper SONAR_PIO_L = {
+    .mPIO = SONAR_SENSOR_L_PIO,
+    .mInitialized = false
+};
+
+SonarPIOWrapper SONAR_PIO_R = {
+    .mPIO = SONAR_SENSOR_R_PIO,
     .mInitialized = false
 };
 
@@ -28,13 +35,19 @@ Sensor sensorsList[NUM_SENSORS] = {
                     .mRXPin = SONAR_SENSOR_L1_RX_PIN,
                     .mBaudrate = SONAR_SENSOR_BAUDRATE,
                     .mStateMachineID = 0,
-                    .mPIOWrapper = &PIO_WRAPPER
+                    .mFilterConfig = {
+                        .mWindowSize = SONAR_FILTER_WINDOW_SIZE,
+                        .mOutlierThresholdMM = SONAR_FILTER_OUTLIER_THRESHOLD_MM,
+                        .mSmoothingFactor = SONAR_FILTER_SMOOTHING_FACTOR
+                    },
+                    .mPIOWrapper = &SONAR_PIO_L
                 }
             },
             .mSensorType = SONAR_SENSOR,
             .mSensorID = SONAR_SENSOR_L1_ID,
             .mSensorConnectLEDPosition = SONAR_SENSOR_L1_ACTIVE_LED,
-            .mHardwareConnectionID = FEED_SENSOR_L1_CONNECT_ID
+            .mHardwareConnectionID = FEED_SENSOR_L1_CONNECT_ID,
+            .mPollPeriodMS = SONAR_SENSOR_POLL_PERIOD_MS
         }
     },
     {
@@ -44,14 +57,20 @@ Sensor sensorsList[NUM_SENSORS] = {
                     .mTXPin = SONAR_SENSOR_R1_TX_PIN,
                     .mRXPin = SONAR_SENSOR_R1_RX_PIN,
                     .mBaudrate = SONAR_SENSOR_BAUDRATE,
-                    .mStateMachineID = 1,
-                    .mPIOWrapper = &PIO_WRAPPER
+                    .mStateMachineID = 0,
+                    .mFilterConfig = {
+                        .mWindowSize = SONAR_FILTER_WINDOW_SIZE,
+                        .mOutlierThresholdMM = SONAR_FILTER_OUTLIER_THRESHOLD_MM,
+                        .mSmoothingFactor = SONAR_FILTER_SMOOTHING_FACTOR
+                    },
+                    .mPIOWrapper = &SONAR_PIO_R
                 }
             },
             .mSensorType = SONAR_SENSOR,
             .mSensorID = SONAR_SENSOR_R1_ID,
             .mSensorConnectLEDPosition = SONAR_SENSOR_R1_ACTIVE_LED,
-            .mHardwareConnectionID = FEED_SENSOR_R1_CONNECT_ID
+            .mHardwareConnectionID = FEED_SENSOR_R1_CONNECT_ID,
+            .mPollPeriodMS = SONAR_SENSOR_POLL_PERIOD_MS
         }
     },
     {
@@ -67,7 +86,8 @@ Sensor sensorsList[NUM_SENSORS] = {
             .mSensorType = SENSOR_POD,
             .mSensorID = SENSOR_POD_L_ID,
             .mSensorConnectLEDPosition = SENSOR_POD_L_ACTIVE_LED,
-            .mHardwareConnectionID = I2C_DEVICE_0_CONNECT_ID
+            .mHardwareConnectionID = I2C_DEVICE_0_CONNECT_ID,
+            .mPollPeriodMS = SENSOR_POD_POLL_PERIOD_MS
         }
     },
     {
@@ -83,7 +103,8 @@ Sensor sensorsList[NUM_SENSORS] = {
             .mSensorType = SENSOR_POD,
             .mSensorID = SENSOR_POD_R_ID,
             .mSensorConnectLEDPosition = SENSOR_POD_R_ACTIVE_LED,
-            .mHardwareConnectionID = I2C_DEVICE_7_CONNECT_ID
+            .mHardwareConnectionID = I2C_DEVICE_7_CONNECT_ID,
+            .mPollPeriodMS = SENSOR_POD_POLL_PERIOD_MS
         }
     },
     {
@@ -98,7 +119,54 @@ Sensor sensorsList[NUM_SENSORS] = {
             .mSensorType = BATTERY_SENSOR,
             .mSensorID = RTC_BATTERY_SENSOR,
             .mSensorConnectLEDPosition = NO_LED,
-            .mHardwareConnectionID = ALWAYS_CONNECTED_CONNECT_ID
+            .mHardwareConnectionID = ALWAYS_CONNECTED_CONNECT_ID,
+            .mPollPeriodMS = BATTERY_SENSOR_POLL_PERIOD_MS
+        }
+    },
+    {
+        .mSensorDefinition = {                               
+            .mSensor = {
+                .mSonarSensor = {
+                    .mTXPin = SONAR_SENSOR_L2_TX_PIN,
+                    .mRXPin = SONAR_SENSOR_L2_RX_PIN,
+                    .mBaudrate = SONAR_SENSOR_BAUDRATE,
+                    .mStateMachineID = 1,
+                    .mFilterConfig = {
+                        .mWindowSize = SONAR_FILTER_WINDOW_SIZE,
+                        .mOutlierThresholdMM = SONAR_FILTER_OUTLIER_THRESHOLD_MM,
+                        .mSmoothingFactor = SONAR_FILTER_SMOOTHING_FACTOR
+                    },
+                    .mPIOWrapper = &SONAR_PIO_L
+                }
+            },
+            .mSensorType = SONAR_SENSOR,
+            .mSensorID = SONAR_SENSOR_L2_ID,
+            .mSensorConnectLEDPosition = SONAR_SENSOR_L2_ACTIVE_LED,
+            .mHardwareConnectionID = FEED_SENSOR_L2_CONNECT_ID,
+            .mPollPeriodMS = SONAR_SENSOR_POLL_PERIOD_MS
+        }
+    },
+    {
+        .mSensorDefinition = {                               
+            .mSensor = {
+                .mSonarSensor = {
+                    .mTXPin = SONAR_SENSOR_R2_TX_PIN,
+                    .mRXPin = SONAR_SENSOR_R2_RX_PIN,
+                    .mBaudrate = SONAR_SENSOR_BAUDRATE,
+                    .mStateMachineID = 1,
+                    .mFilterConfig = {
+                        .mWindowSize = SONAR_FILTER_WINDOW_SIZE,
+                        .mOutlierThresholdMM = SONAR_FILTER_OUTLIER_THRESHOLD_MM,
+                        .mSmoothingFactor = SONAR_FILTER_SMOOTHING_FACTOR
+                    },
+                    .mPIOWrapper = &SONAR_PIO_R
+                }
+            },
+            .mSensorType = SONAR_SENSOR,
+            .mSensorID = SONAR_SENSOR_R2_ID,
+            .mSensorConnectLEDPosition = SONAR_SENSOR_R2_ACTIVE_LED,
+            .mHardwareConnectionID = FEED_SENSOR_R2_CONNECT_ID,
+            .mPollPeriodMS = SONAR_SENSOR_POLL_PERIOD_MS
         }
     }
 };
@@ -117,6 +185,14 @@ MsgPackSensorReadingDescription MPACK_SONAR_READING_DESCRIPTION = {
     {.mIntValue=4500}                       // mMaxValue
 };
 
+MsgPackSensorReadingDescription MPACK_SONAR_CONFIDENCE_READING_DESCRIPTION = {
+    1,                                      // mReadingID
+    "Confidence (%)",                       // mReadingName
+    INT_READING,                            // mType   
+    {.mIntValue=0},                         // mMinValue
+    {.mIntValue=100}                        // mMaxValue
+};
+
 MsgPackSensorReadingDescription MPACK_CO2_READING_DESCRIPTION = {
     0,                                      // mReadingID
     "Carbon Dioxide (PPM)",                 // mReadingName
@@ -175,14 +251,20 @@ MsgPackSensorPacket sensorPackets[NUM_SENSORS] = {
         },
         .mCurrentSensorData = {
             .mStatus = SENSOR_DISCONNECTED,
-            .mNumReadings = 1,
-            .mSensorReadings = (MsgPackSensorReading[1]) {
+            .mNumReadings = 2,
+            .mSensorReadings = (MsgPackSensorReading[2]) {
                 {
                     .mDescription = &MPACK_SONAR_READING_DESCRIPTION,
                     .mValue = {
                         .mIntValue=0
                     }
-                }    
+                },
+                {
+                    .mDescription = &MPACK_SONAR_CONFIDENCE_READING_DESCRIPTION,
+                    .mValue = {
+                        .mIntValue=0
+                    }
+                }
             }
         }
     },
@@ -198,14 +280,20 @@ MsgPackSensorPacket sensorPackets[NUM_SENSORS] = {
         },
         .mCurrentSensorData = {
             .mStatus = SENSOR_DISCONNECTED,
-            .mNumReadings = 1,
-            .mSensorReadings = (MsgPackSensorReading[1]) {
+            .mNumReadings = 2,
+            .mSensorReadings = (MsgPackSensorReading[2]) {
                 {
                     .mDescription = &MPACK_SONAR_READING_DESCRIPTION,
                     .mValue = {
                         .mIntValue=0
                     }
-                }    
+                },
+                {
+                    .mDescription = &MPACK_SONAR_CONFIDENCE_READING_DESCRIPTION,
+                    .mValue = {
+                        .mIntValue=0
+                    }
+                }
             }
         }
     },
@@ -313,5 +401,63 @@ MsgPackSensorPacket sensorPackets[NUM_SENSORS] = {
                 }    
             }
         }
+    },
+    {
+        .mSensorID = SONAR_SENSOR_L2_ID,
+        .mSensorName = "Feed Level Sensor L2",
+        .mSensorType = SONAR_SENSOR,
+        .mCalibrationParams = {
+            .mIsCalibratable = false,
+            .mCalibrationValueType = FLOAT_READING,
+            .mCalibrationRangeMin = {.mFloatValue=0.f},
+            .mCalibrationRangeMax = {.mFloatValue=50.f}
+        },
+        .mCurrentSensorData = {
+            .mStatus = SENSOR_DISCONNECTED,
+            .mNumReadings = 2,
+            .mSensorReadings = (MsgPackSensorReading[2]) {
+                {
+                    .mDescription = &MPACK_SONAR_READING_DESCRIPTION,
+                    .mValue = {
+                        .mIntValue=0
+                    }
+                },
+                {
+                    .mDescription = &MPACK_SONAR_CONFIDENCE_READING_DESCRIPTION,
+                    .mValue = {
+                        .mIntValue=0
+                    }
+                }
+            }
+        }
+    },
+    {
+        .mSensorID = SONAR_SENSOR_R2_ID,
+        .mSensorName = "Feed Level Sensor R2",
+        .mSensorType = SONAR_SENSOR,
+        .mCalibrationParams = {
+            .mIsCalibratable = false,
+            .mCalibrationValueType = FLOAT_READING,
+            .mCalibrationRangeMin = {.mFloatValue=0.f},
+            .mCalibrationRangeMax = {.mFloatValue=50.f}
+        },
+        .mCurrentSensorData = {
+            .mStatus = SENSOR_DISCONNECTED,
+            .mNumReadings = 2,
+            .mSensorReadings = (MsgPackSensorReading[2]) {
+                {
+                    .mDescription = &MPACK_SONAR_READING_DESCRIPTION,
+                    .mValue = {
+                        .mIntValue=0
+                    }
+                },
+                {
+                    .mDescription = &MPACK_SONAR_CONFIDENCE_READING_DESCRIPTION,
+                    .mValue = {
+                        .mIntValue=0
+                    }
+                }
+            }
+        }
     }
 };
@@ -12,6 +12,8 @@ typedef enum {
     SENSOR_POD_L_ID         = 2,
     SENSOR_POD_R_ID         = 3,
     RTC_BATTERY_SENSOR      = 4,
+    SONAR_SENSOR_L2_ID      = 5,
+    SONAR_SENSOR_R2_ID      = 6,
 
     NUM_SENSORS
 } SensorID;
@@ -0,0 +1,541 @@
+#include "sensor_flash_log.h"
+
+#include <string.h>
+
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+
+#include "sensor_multicore_utils.h"
+#include "uart_controller/sensor_history.h"
+#include "debug_io.h"
+#include "utils.h"
+
+
+#define SENSOR_FLASH_LOG_MAGIC              (0x474F4C53)        // "SLOG"
+#define SENSOR_FLASH_LOG_PAYLOAD_SIZE       (sizeof(((SensorFlashLogRecord *) 0)->mPayload))
+#define SENSOR_FLASH_LOG_MAX_ROW_SIZE       (SENSOR_HISTORY_TIMESTAMP_SIZE + (NUM_SENSORS * (1 + (MAX_CACHED_SENSOR_READINGS * SENSOR_HISTORY_VALUE_SIZE))))
+#define MAX_SNAPSHOT_SIZE                   (5 + ((SENSOR_FLASH_LOG_MAX_FIELDS + 7) / 8) + (SENSOR_FLASH_LOG_MAX_FIELDS * 5))
+
+// Log packet keys
+const char *LOG_BOOT_KEY = "boot";
+const char *LOG_NEXT_SEQUENCE_KEY = "next_sequence";
+const char *LOG_RECORDS_KEY = "records";
+
+
+// Internal functions
+uint32_t calc_crc32_internal(uint32_t crc, const uint8_t *data, size_t len);
+uint32_t get_record_crc_internal(const SensorFlashLogRecord *record);
+bool read_log_record_internal(const SensorFlashLog *log, uint32_t page, SensorFlashLogRecord *record);
+bool is_log_page_blank_internal(uint32_t page);
+int get_snapshot_fields_internal(const SensorFlashLog *log, Sensor *sensors, int32_t *fields);
+size_t encode_snapshot_internal(SensorFlashLog *log, const int32_t *fields, int numFields, uint32_t timeMS, uint8_t *dst);
+void add_snapshot_internal(SensorFlashLog *log, Sensor *sensors);
+void start_commit_internal(SensorFlashLog *log);
+void service_flash_internal(SensorFlashLog *log, absolute_time_t idleUntil);
+bool run_flash_operation_internal(SensorFlashLog *log, bool erase);
+size_t write_varint_internal(uint8_t *dst, uint32_t value);
+const uint8_t *read_varint_internal(const uint8_t *src, const uint8_t *end, uint32_t *value);
+bool find_first_record_internal(SensorFlashLog *log, uint32_t fromSequence, uint32_t *firstPage);
+uint32_t count_records_internal(SensorFlashLog *log, uint32_t firstPage, uint8_t maxRecords, SensorFlashLogRecord *record);
+void pack_record_rows_internal(SensorFlashLog *log, const SensorFlashLogRecord *record, mpack_writer_t *writer);
+// -- End internal functions
+
+
+void init_sensor_flash_log(SensorFlashLog *log, const MsgPackSensorPacket *sensorPackets, uint8_t numSensors) {
+    SensorFlashLogRecord record;
+    bool found = false;
+    uint32_t lastPage = 0;
+    uint32_t lastSequence = 0;
+    uint16_t lastBootCount = 0;
+
+    if(!log || !sensorPackets) {
+        return;
+    }
+
+    memset(log, 0, sizeof(SensorFlashLog));
+    log->mSensorPackets = sensorPackets;
+    log->mNumSensors = numSensors;
+    log->mRowSize = get_sensor_history_row_size(sensorPackets, numSensors);
+
+    // The newest record is the one with the highest sequence, wherever the ring has got to
+    for(uint32_t page = 0; page < SENSOR_FLASH_LOG_PAGES; ++page) {
+        if(!read_log_record_internal(log, page, &record)) {
+            continue;
+        }
+
+        if(!found || ((int32_t) (record.mHeader.mSequence - lastSequence) > 0)) {
+            found = true;
+            lastPage = page;
+            lastSequence = record.mHeader.mSequence;
+            lastBootCount = record.mHeader.mBootCount;
+        }
+    }
+
+    log->mNextPage = found ? ((lastPage + 1) % SENSOR_FLASH_LOG_PAGES) : 0;
+    log->mNextSequence = lastSequence + 1;
+    log->mBootCount = lastBootCount + 1;
+
+    // A page part way through a sector should still be blank. If not, a write was cut short, so move on to
+    // the next sector rather than program over it
+    if((log->mNextPage % SENSOR_FLASH_LOG_PAGES_PER_SECTOR) && !is_log_page_blank_internal(log->mNextPage)) {
+        log->mNextPage = ((log->mNextPage / SENSOR_FLASH_LOG_PAGES_PER_SECTOR) + 1) * SENSOR_FLASH_LOG_PAGES_PER_SECTOR;
+        log->mNextPage %= SENSOR_FLASH_LOG_PAGES;
+    }
+    log->mEraseNeeded = !(log->mNextPage % SENSOR_FLASH_LOG_PAGES_PER_SECTOR);
+    log->mEraseNeededTime = MILLIS();
+
+    // Sensors have nothing to report straight after boot, so the first snapshot waits a whole interval
+    log->mNextSnapshotTime = MILLIS() + SENSOR_FLASH_LOG_SNAPSHOT_INTERVAL_MS;
+
+    DEBUG_PRINT("Sensor flash log: boot %u, next record %u at page %u\n", log->mBootCount, log->mNextSequence, log->mNextPage);
+}
+
+void update_sensor_flash_log(SensorFlashLog *log, Sensor *sensors, absolute_time_t idleUntil) {
+    if(!log || !sensors || !log->mSensorPackets) {
+        return;
+    }
+
+    uint32_t currentTimeMS = MILLIS();
+
+    if((int32_t) (currentTimeMS - log->mNextSnapshotTime) >= 0) {
+        add_snapshot_internal(log, sensors);
+
+        log->mNextSnapshotTime += SENSOR_FLASH_LOG_SNAPSHOT_INTERVAL_MS;
+        if((int32_t) (currentTimeMS - log->mNextSnapshotTime) >= 0) {
+            log->mNextSnapshotTime = currentTimeMS + SENSOR_FLASH_LOG_SNAPSHOT_INTERVAL_MS;
+        }
+    }
+
+    // Records are committed once they are full or old enough, whichever comes first
+    if(log->mBuildRecord.mHeader.mSnapshotCount && !log->mCommitPending &&
+        ((currentTimeMS - log->mBuildStartTime) >= SENSOR_FLASH_LOG_COMMIT_INTERVAL_MS)) {
+        start_commit_internal(log);
+    }
+
+    if(log->mEraseNeeded || log->mCommitPending) {
+        service_flash_internal(log, idleUntil);
+    }
+}
+
+PackResponse pack_sensor_flash_log_packet(
+    SensorFlashLog *log,
+    uint32_t fromSequence,
+    uint8_t maxRecords,
+    char *outBuf,
+    size_t outBufSize,
+    PackFlushFunction flush,
+    void *flushContext
+) {
+    PackResponse response = {0, mpack_error_bug};
+    PackFlushContext context = {
+        .mFlush = flush,
+        .mContext = flushContext
+    };
+    SensorFlashLogRecord record;
+    uint32_t firstPage = 0;
+    uint32_t numRecords = 0;
+
+    if(!log || !log->mSensorPackets || !flush) {
+        return response;
+    }
+
+    if(!maxRecords) {
+        maxRecords = SENSOR_FLASH_LOG_MAX_RECORDS_PER_PACKET;
+    }
+
+    // Keep core 0 off the flash until we are done reading it
+    log->mReaderActive = true;
+    __dmb();
+
+    if(find_first_record_internal(log, fromSequence, &firstPage)) {
+        numRecords = count_records_internal(log, firstPage, maxRecords, &record);
+    }
+
+    // Initialize writer
+    mpack_writer_t writer;
+    init_streamed_pack_writer(&writer, &context, outBuf, outBufSize);
+
+    // Write out packet data
+    mpack_start_map(&writer, 6);
+
+    // Pack packet ID
+    mpack_write_cstr(&writer, PACKET_ID_KEY);
+    mpack_write_u8(&writer, SENSOR_LOG_PACKET);
+
+    // Pack current time and boot, so records from this boot can be placed
+    mpack_write_cstr(&writer, HISTORY_TIME_KEY);
+    mpack_write_u32(&writer, MILLIS());
+
+    mpack_write_cstr(&writer, LOG_BOOT_KEY);
+    mpack_write_u16(&writer, log->mBootCount);
+
+    // Pack the layout of the rows
+    mpack_write_cstr(&writer, HISTORY_LAYOUT_KEY);
+    pack_sensor_history_layout(log->mSensorPackets, log->mNumSensors, &writer);
+
+    // Pack the records, each decompressed into rows
+    uint32_t nextSequence = fromSequence;
+    mpack_write_cstr(&writer, LOG_RECORDS_KEY);
+    mpack_start_array(&writer, numRecords);
+    for(uint32_t i = 0; i < numRecords; ++i) {
+        read_log_record_internal(log, (firstPage + i) % SENSOR_FLASH_LOG_PAGES, &record);
+        nextSequence = record.mHeader.mSequence + 1;
+
+        mpack_start_array(&writer, 3);
+        mpack_write_u32(&writer, record.mHeader.mSequence);
+        mpack_write_u16(&writer, record.mHeader.mBootCount);
+        pack_record_rows_internal(log, &record, &writer);
+        mpack_finish_array(&writer);
+    }
+    mpack_finish_array(&writer);
+
+    // Pack the sequence to ask for next time
+    mpack_write_cstr(&writer, LOG_NEXT_SEQUENCE_KEY);
+    mpack_write_u32(&writer, nextSequence);
+
+    // Finish building the map
+    mpack_finish_map(&writer);
+
+    __dmb();
+    log->mReaderActive = false;
+
+    // Finish writing the data, which flushes whatever is left in the buffer
+    response.mErrorCode = mpack_writer_destroy(&writer);
+    response.mBytesUsed = context.mBytesFlushed;
+
+    return response;
+}
+
+
+// Standard (reflected, 0xEDB88320) CRC32. Records are small and only checked at boot and when read out, so a
+// table is not worth the flash
+uint32_t calc_crc32_internal(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for(size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for(int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+uint32_t get_record_crc_internal(const SensorFlashLogRecord *record) {
+    SensorFlashLogRecordHeader header = record->mHeader;
+    header.mCRC = 0;
+
+    uint32_t crc = calc_crc32_internal(0, (const uint8_t *) &header, sizeof(header));
+    return calc_crc32_internal(crc, record->mPayload, record->mHeader.mPayloadSize);
+}
+
+// Copies a page out of flash, returning whether it holds a complete record written by this sensor table
+bool read_log_record_internal(const SensorFlashLog *log, uint32_t page, SensorFlashLogRecord *record) {
+    const uint8_t *src = (const uint8_t *) (XIP_BASE + SENSOR_FLASH_LOG_OFFSET + (page * FLASH_PAGE_SIZE));
+
+    // Most pages are either blank or fine, so check the magic before copying the rest
+    memcpy(&record->mHeader, src, sizeof(SensorFlashLogRecordHeader));
+    if((record->mHeader.mMagic != SENSOR_FLASH_LOG_MAGIC) ||
+        (record->mHeader.mRowSize != log->mRowSize) ||
+        (record->mHeader.mPayloadSize > SENSOR_FLASH_LOG_PAYLOAD_SIZE)) {
+        return false;
+    }
+
+    memcpy(record->mPayload, src + sizeof(SensorFlashLogRecordHeader), record->mHeader.mPayloadSize);
+    return get_record_crc_internal(record) == record->mHeader.mCRC;
+}
+
+bool is_log_page_blank_internal(uint32_t page) {
+    const uint8_t *src = (const uint8_t *) (XIP_BASE + SENSOR_FLASH_LOG_OFFSET + (page * FLASH_PAGE_SIZE));
+
+    for(int i = 0; i < FLASH_PAGE_SIZE; ++i) {
+        if(src[i] != 0xFF) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// A snapshot's fields are the values of a history row: each sensor's status then its readings in fixed point
+int get_snapshot_fields_internal(const SensorFlashLog *log, Sensor *sensors, int32_t *fields) {
+    int numFields = 0;
+
+    for(int i = 0; i < log->mNumSensors; ++i) {
+        const MsgPackSensorData *packetData = &log->mSensorPackets[i].mCurrentSensorData;
+        int numReadings = get_sensor_history_reading_count(&log->mSensorPackets[i]);
+        MsgPackReadingValue values[MAX_CACHED_SENSOR_READINGS] = {0};
+
+        sensor_data_to_reading_values(&sensors[i].mCurrentSensorData, sensors[i].mSensorDefinition.mSensorType, values);
+
+        fields[numFields++] = (uint8_t) sensors[i].mCurrentSensorData.mSensorStatus;
+        for(int j = 0; j < numReadings; ++j) {
+            fields[numFields++] = to_sensor_history_value(packetData->mSensorReadings[j].mDescription, values[j]);
+        }
+    }
+
+    return numFields;
+}
+
+// Encodes a snapshot against the last one added to the build record (or in full, if it is the first)
+size_t encode_snapshot_internal(SensorFlashLog *log, const int32_t *fields, int numFields, uint32_t timeMS, uint8_t *dst) {
+    uint8_t *start = dst;
+
+    if(!log->mBuildRecord.mHeader.mSnapshotCount) {
+        dst += write_varint_internal(dst, timeMS);
+        for(int i = 0; i < numFields; ++i) {
+            dst += write_varint_internal(dst, ((uint32_t) fields[i] << 1) ^ (uint32_t) (fields[i] >> 31));
+        }
+
+        return dst - start;
+    }
+
+    dst += write_varint_internal(dst, timeMS - log->mLastSnapshotTime);
+
+    uint8_t *changedMap = dst;
+    dst += (numFields + 7) / 8;
+    memset(changedMap, 0, dst - changedMap);
+
+    for(int i = 0; i < numFields; ++i) {
+        int32_t delta = fields[i] - log->mLastFields[i];
+        if(delta) {
+            changedMap[i / 8] |= (1 << (i % 8));
+            dst += write_varint_internal(dst, ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31));
+        }
+    }
+
+    return dst - start;
+}
+
+void add_snapshot_internal(SensorFlashLog *log, Sensor *sensors) {
+    int32_t fields[SENSOR_FLASH_LOG_MAX_FIELDS];
+    uint8_t snapshot[MAX_SNAPSHOT_SIZE];
+    uint32_t currentTimeMS = MILLIS();
+    SensorFlashLogRecordHeader *header = &log->mBuildRecord.mHeader;
+
+    int numFields = get_snapshot_fields_internal(log, sensors, fields);
+    size_t snapshotSize = encode_snapshot_internal(log, fields, numFields, currentTimeMS, snapshot);
+
+    // A full record has to make way for a new one. If the last one is still waiting for the flash, this
+    // snapshot is dropped rather than holding up the sensors
+    if(((header->mPayloadSize + snapshotSize) > SENSOR_FLASH_LOG_PAYLOAD_SIZE) || (header->mSnapshotCount == UINT8_MAX)) {
+        if(log->mCommitPending) {
+            return;
+        }
+
+        start_commit_internal(log);
+        snapshotSize = encode_snapshot_internal(log, fields, numFields, currentTimeMS, snapshot);
+    }
+
+    if(!header->mSnapshotCount) {
+        log->mBuildStartTime = currentTimeMS;
+    }
+
+    memcpy(&log->mBuildRecord.mPayload[header->mPayloadSize], snapshot, snapshotSize);
+    header->mPayloadSize += snapshotSize;
+    header->mSnapshotCount++;
+
+    memcpy(log->mLastFields, fields, numFields * sizeof(int32_t));
+    log->mLastSnapshotTime = currentTimeMS;
+}
+
+// Seals the build record and hands it over to be programmed, leaving an empty build record
+void start_commit_internal(SensorFlashLog *log) {
+    SensorFlashLogRecord *record = &log->mCommitRecord;
+
+    *record = log->mBuildRecord;
+    record->mHeader.mMagic = SENSOR_FLASH_LOG_MAGIC;
+    record->mHeader.mSequence = log->mNextSequence++;
+    record->mHeader.mBootCount = log->mBootCount;
+    record->mHeader.mRowSize = log->mRowSize;
+    record->mHeader.mReserved = 0xFF;
+    record->mHeader.mCRC = 0;
+
+    // Leave the unused tail erased, so it is never programmed
+    memset(&record->mPayload[record->mHeader.mPayloadSize], 0xFF, SENSOR_FLASH_LOG_PAYLOAD_SIZE - record->mHeader.mPayloadSize);
+    record->mHeader.mCRC = get_record_crc_internal(record);
+
+    log->mCommitPending = true;
+    log->mCommitPendingTime = MILLIS();
+
+    memset(&log->mBuildRecord, 0, sizeof(SensorFlashLogRecord));
+}
+
+// Performs at most one erase or program per call, when core 0 is quiet for long enough. If it never is, the
+// work goes ahead anyway once it has been put off for SENSOR_FLASH_LOG_MAX_DEFER_MS
+void service_flash_internal(SensorFlashLog *log, absolute_time_t idleUntil) {
+    int64_t idleUS = absolute_time_diff_us(get_absolute_time(), idleUntil);
+    uint32_t currentTimeMS = MILLIS();
+
+    // Core 1 has to be able to park before either core touches the flash
+    if(!multicore_lockout_victim_is_initialized(1) || log->mReaderActive) {
+        return;
+    }
+
+    if(log->mEraseNeeded) {
+        bool overdue = (currentTimeMS - log->mEraseNeededTime) >= SENSOR_FLASH_LOG_MAX_DEFER_MS;
+        if((overdue || (idleUS >= SENSOR_FLASH_LOG_ERASE_GAP_US)) && run_flash_operation_internal(log, true)) {
+            log->mEraseNeeded = false;
+            log->mSectorErases++;
+        }
+        return;
+    }
+
+    bool overdue = (currentTimeMS - log->mCommitPendingTime) >= SENSOR_FLASH_LOG_MAX_DEFER_MS;
+    if((overdue || (idleUS >= SENSOR_FLASH_LOG_PROGRAM_GAP_US)) && run_flash_operation_internal(log, false)) {
+        log->mCommitPending = false;
+        log->mPagePrograms++;
+
+        log->mNextPage = (log->mNextPage + 1) % SENSOR_FLASH_LOG_PAGES;
+        log->mEraseNeeded = !(log->mNextPage % SENSOR_FLASH_LOG_PAGES_PER_SECTOR);
+        log->mEraseNeededTime = currentTimeMS;
+    }
+}
+
+// Core 1 runs from flash too, so it is parked for the duration. Returns false if it had started reading the log
+// before it could be parked, in which case nothing was done
+bool run_flash_operation_internal(SensorFlashLog *log, bool erase) {
+    multicore_lockout_start_blocking();
+
+    __dmb();
+    if(log->mReaderActive) {
+        multicore_lockout_end_blocking();
+        return false;
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    if(erase) {
+        flash_range_erase(SENSOR_FLASH_LOG_OFFSET + ((log->mNextPage / SENSOR_FLASH_LOG_PAGES_PER_SECTOR) * FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE);
+    } else {
+        flash_range_program(SENSOR_FLASH_LOG_OFFSET + (log->mNextPage * FLASH_PAGE_SIZE), (const uint8_t *) &log->mCommitRecord, FLASH_PAGE_SIZE);
+    }
+    restore_interrupts(interrupts);
+
+    multicore_lockout_end_blocking();
+    return true;
+}
+
+size_t write_varint_internal(uint8_t *dst, uint32_t value) {
+    size_t length = 0;
+
+    while(value >= 0x80) {
+        dst[length++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    dst[length++] = (uint8_t) value;
+
+    return length;
+}
+
+// Returns the position after the varint, or NULL if it runs past end
+const uint8_t *read_varint_internal(const uint8_t *src, const uint8_t *end, uint32_t *value) {
+    *value = 0;
+
+    for(int shift = 0; (src < end) && (shift < 35); shift += 7) {
+        uint8_t byte = *src++;
+        *value |= (uint32_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) {
+            return src;
+        }
+    }
+
+    return NULL;
+}
+
+// The oldest record held at or after fromSequence
+bool find_first_record_internal(SensorFlashLog *log, uint32_t fromSequence, uint32_t *firstPage) {
+    SensorFlashLogRecord record;
+    bool found = false;
+    uint32_t firstSequence = 0;
+
+    for(uint32_t page = 0; page < SENSOR_FLASH_LOG_PAGES; ++page) {
+        if(!read_log_record_internal(log, page, &record) || ((int32_t) (record.mHeader.mSequence - fromSequence) < 0)) {
+            continue;
+        }
+
+        if(!found || ((int32_t) (record.mHeader.mSequence - firstSequence) < 0)) {
+            found = true;
+            firstSequence = record.mHeader.mSequence;
+            *firstPage = page;
+        }
+    }
+
+    return found;
+}
+
+// Records follow each other page by page. A gap in the sequence means the ring skipped a damaged sector there,
+// so the packet stops and the next request picks up after it
+uint32_t count_records_internal(SensorFlashLog *log, uint32_t firstPage, uint8_t maxRecords, SensorFlashLogRecord *record) {
+    uint32_t numRecords = 0;
+    uint32_t expectedSequence = 0;
+
+    while(numRecords < maxRecords) {
+        uint32_t page = (firstPage + numRecords) % SENSOR_FLASH_LOG_PAGES;
+        if(!read_log_record_internal(log, page, record) || (numRecords && (record->mHeader.mSequence != expectedSequence))) {
+            break;
+        }
+
+        expectedSequence = record->mHeader.mSequence + 1;
+        numRecords++;
+    }
+
+    return numRecords;
+}
+
+// Decompresses a record's snapshots into history rows, packed as one blob
+void pack_record_rows_internal(SensorFlashLog *log, const SensorFlashLogRecord *record, mpack_writer_t *writer) {
+    int32_t fields[SENSOR_FLASH_LOG_MAX_FIELDS] = {0};
+    uint8_t row[SENSOR_FLASH_LOG_MAX_ROW_SIZE];
+    const uint8_t *src = record->mPayload;
+    const uint8_t *end = src + record->mHeader.mPayloadSize;
+    uint32_t timeMS = 0;
+    uint32_t value;
+    int numFields = 0;
+
+    for(int i = 0; i < log->mNumSensors; ++i) {
+        numFields += 1 + get_sensor_history_reading_count(&log->mSensorPackets[i]);
+    }
+
+    mpack_start_bin(writer, record->mHeader.mSnapshotCount * log->mRowSize);
+    for(int snapshot = 0; snapshot < record->mHeader.mSnapshotCount; ++snapshot) {
+        src = src ? read_varint_internal(src, end, &value) : NULL;
+        timeMS = snapshot ? (timeMS + value) : value;
+
+        const uint8_t *changedMap = src;
+        if(snapshot && src) {
+            src = ((src + ((numFields + 7) / 8)) <= end) ? (src + ((numFields + 7) / 8)) : NULL;
+        }
+
+        for(int i = 0; (i < numFields) && src; ++i) {
+            if(snapshot && !(changedMap[i / 8] & (1 << (i % 8)))) {
+                continue;
+            }
+
+            src = read_varint_internal(src, end, &value);
+            int32_t decoded = (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+            fields[i] = snapshot ? (fields[i] + decoded) : decoded;
+        }
+
+        // The CRC passed, so a payload that does not decode was written wrong. Its rows still have to fill the
+        // bin, so they go out with the last good values
+        uint8_t *dst = row;
+        dst[0] = (uint8_t) timeMS;
+        dst[1] = (uint8_t) (timeMS >> 8);
+        dst[2] = (uint8_t) (timeMS >> 16);
+        dst[3] = (uint8_t) (timeMS >> 24);
+        dst += SENSOR_HISTORY_TIMESTAMP_SIZE;
+
+        int field = 0;
+        for(int i = 0; i < log->mNumSensors; ++i) {
+            *dst++ = (uint8_t) fields[field++];
+            for(int j = 0; j < get_sensor_history_reading_count(&log->mSensorPackets[i]); ++j) {
+                int16_t reading = (int16_t) fields[field++];
+                *dst++ = (uint8_t) reading;
+                *dst++ = (uint8_t) (reading >> 8);
+            }
+        }
+
+        mpack_write_bytes(writer, (const char *) row, log->mRowSize);
+    }
+    mpack_finish_bin(writer);
+}
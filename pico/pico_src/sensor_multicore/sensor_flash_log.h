@@ -0,0 +1,103 @@
+#ifndef SENSOR_FLASH_LOG_H
+#define SENSOR_FLASH_LOG_H
+
+#include "hardware/flash.h"
+#include "hardware/sensors/sensor.h"
+#include "sensor_definitions.h"
+#include "uart_controller/sensor_msgpack.h"
+
+
+// Flash at the very top of the chip given over to the log. Set PIFEEDER_FLASH_LOG_SECTORS in CMake to change it
+#ifndef SENSOR_FLASH_LOG_SECTORS
+#define SENSOR_FLASH_LOG_SECTORS                (64)
+#endif
+
+#define SENSOR_FLASH_LOG_OFFSET                 (PICO_FLASH_SIZE_BYTES - (SENSOR_FLASH_LOG_SECTORS * FLASH_SECTOR_SIZE))
+#define SENSOR_FLASH_LOG_PAGES_PER_SECTOR       (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define SENSOR_FLASH_LOG_PAGES                  (SENSOR_FLASH_LOG_SECTORS * SENSOR_FLASH_LOG_PAGES_PER_SECTOR)
+
+#define SENSOR_FLASH_LOG_SNAPSHOT_INTERVAL_MS   (60 * 1000)             // Time between snapshots of every sensor
+#define SENSOR_FLASH_LOG_COMMIT_INTERVAL_MS     (15 * 60 * 1000)        // Longest a snapshot waits in RAM before its record is committed
+#define SENSOR_FLASH_LOG_MAX_DEFER_MS           (60 * 1000)             // Longest an erase or program waits for a quiet moment before going anyway
+#define SENSOR_FLASH_LOG_ERASE_GAP_US           (20 * 1000)             // Idle time core 0 needs ahead of it to start a sector erase
+#define SENSOR_FLASH_LOG_PROGRAM_GAP_US         (2 * 1000)              // Idle time core 0 needs ahead of it to program a page
+#define SENSOR_FLASH_LOG_MAX_RECORDS_PER_PACKET (32)
+
+#define SENSOR_FLASH_LOG_MAX_FIELDS             (NUM_SENSORS * (1 + MAX_CACHED_SENSOR_READINGS))
+
+
+/**
+ * The log is a ring of records, one per flash page, written in sector order so every sector is erased equally
+ * often. A sector is erased as soon as the ring reaches it, taking its records with it, so that committing a record
+ * only ever needs the much quicker page program.
+ *
+ * A record holds a batch of snapshots. Each snapshot is a history row (see sensor_history.h) broken into fields,
+ * the status and readings of each sensor in turn, and compressed:
+ *
+ *      First snapshot:     varint timestamp, then every field as a zigzag varint
+ *      Later snapshots:    varint ms since the previous snapshot, a bitmap (one bit per field, LSB first) of the
+ *                          fields that changed, then the change in each of those as a zigzag varint
+ */
+typedef struct {
+    uint32_t mMagic;
+    uint32_t mSequence;                                 // Increments with every record written
+    uint16_t mBootCount;                                // Boot the record was written in. Timestamps restart each boot
+    uint16_t mRowSize;                                  // Row size of the sensor table which wrote it
+    uint16_t mPayloadSize;
+    uint8_t mSnapshotCount;
+    uint8_t mReserved;
+    uint32_t mCRC;                                      // CRC32 of the header (with this set to 0) and payload
+} SensorFlashLogRecordHeader;
+
+typedef struct {
+    SensorFlashLogRecordHeader mHeader;
+    uint8_t mPayload[FLASH_PAGE_SIZE - sizeof(SensorFlashLogRecordHeader)];
+} SensorFlashLogRecord;
+
+typedef struct {
+    const MsgPackSensorPacket *mSensorPackets;          // Reading layout. Only the descriptions are used, never the values
+    uint8_t mNumSensors;
+    size_t mRowSize;
+    uint16_t mBootCount;
+
+    // Core 0 (writer) state
+    uint32_t mNextPage;                                 // Page the next record is programmed to
+    uint32_t mNextSequence;
+    bool mEraseNeeded;                                  // mNextPage starts a sector which needs erasing first
+    uint32_t mEraseNeededTime;                          // Time the sector was found to need erasing
+    SensorFlashLogRecord mBuildRecord;                  // Record new snapshots are being added to
+    int32_t mLastFields[SENSOR_FLASH_LOG_MAX_FIELDS];   // Fields of the last snapshot added, for the next one's changes
+    uint32_t mLastSnapshotTime;
+    uint32_t mNextSnapshotTime;
+    uint32_t mBuildStartTime;                           // Time of the first snapshot in mBuildRecord
+    SensorFlashLogRecord mCommitRecord;                 // Complete record waiting to be programmed
+    bool mCommitPending;
+    uint32_t mCommitPendingTime;                        // Time mCommitRecord was completed
+    uint32_t mSectorErases;
+    uint32_t mPagePrograms;
+
+    // Set by core 1 while it reads records out of flash. Core 0 leaves the flash alone until it clears
+    volatile bool mReaderActive;
+} SensorFlashLog;
+
+
+// Core 0: finds the end of the log left by previous boots. Must be called before core 1 is launched
+void init_sensor_flash_log(SensorFlashLog *log, const MsgPackSensorPacket *sensorPackets, uint8_t numSensors);
+
+// Core 0: takes a snapshot of the sensors if one is due and moves any pending flash work along. Erasing and
+// programming park core 1, so they only happen if core 0 has nothing else to do before idleUntil
+void update_sensor_flash_log(SensorFlashLog *log, Sensor *sensors, absolute_time_t idleUntil);
+
+// Core 1: packs the records from fromSequence onwards (up to maxRecords of them), decompressed into history
+// rows, as a single log packet streamed through flush
+PackResponse pack_sensor_flash_log_packet(
+    SensorFlashLog *log,
+    uint32_t fromSequence,
+    uint8_t maxRecords,
+    char *outBuf,
+    size_t outBufSize,
+    PackFlushFunction flush,
+    void *flushContext
+);
+
+#endif  // SENSOR_FLASH_LOG_H
@@ -11,26 +11,35 @@
 #include "uart_controller/uart_sensor_controller.h"
 #include "sensor_uart_control_core_1.h"
 #include "sensor_multicore/sensor_multicore_utils.h"
+#include "sensor_multicore/sensor_flash_log.h"
 #include "sensor_definitions.h"
 #include "debug_io.h"
+#include "perf_stats.h"
 #include "utils.h"
 
 #include "pico/multicore.h"
-#include "pico/util/queue.h"
 
 
 const uint8_t ONBOARD_LED_PIN = 25;
 const bool DEBUG_SENSOR_UPDATE = false;
 
-// Queue used for sending sensor updates from core0 to core1
-queue_t sensorUpdateQueue;
+// Snapshot used for sending sensor updates from core0 to core1
+SensorDataSnapshot sensorDataSnapshot;
+
+// Readings recorded by core 1 for the controller to download
+SensorHistory sensorHistory;
+
+// Readings kept in flash by core 0 across reboots
+SensorFlashLog sensorFlashLog;
 
 // Controller interface for comms running on core 1
 ControllerInterface _sensorControllerInterface = {
     .mUART = SENSOR_CONTROLLER_UART,
     .mMsgPackSensors = sensorPackets,
     .mNumMsgPackSensors = NUM_SENSORS,
-    .mSensorUpdateQueue = &sensorUpdateQueue,
+    .mHistory = &sensorHistory,
+    .mLog = &sensorFlashLog,
+    .mSensorBus = &sensorI2CInterface,
     .mSerialLEDPin = ONBOARD_LED_PIN
 };
 
@@ -40,7 +49,11 @@ ShiftRegister _ledShifter = {
     .mLatchPin = LED_SR_LATCH_PIN,
     .mClockPin = LED_SR_CLOCK_PIN,
     .mType = SIPO_SHIFT_REGISTER,
-    .mNumBits = 8
+    .mNumBits = 8,
+    .mBackend = PIO_SHIFT_REGISTER_BACKEND,
+    .mPIO = LED_SR_PIO,
+    .mStateMachineID = LED_SR_STATE_MACHINE,
+    .mBitRate = LED_SR_BIT_RATE
 };
 
 ConnectedHardwareMonitor _connectedHardwareMonitor = {
@@ -49,7 +62,11 @@ ConnectedHardwareMonitor _connectedHardwareMonitor = {
         .mLatchPin = HARDWARE_CONNECT_SR_LATCH_PIN,
         .mClockPin = HARDWARE_CONNECT_SR_CLOCK_PIN,
         .mType = PISO_SHIFT_REGISTER,
-        .mNumBits = 16
+        .mNumBits = 16,
+        .mBackend = PIO_SHIFT_REGISTER_BACKEND,
+        .mPIO = HARDWARE_CONNECT_SR_PIO,
+        .mStateMachineID = HARDWARE_CONNECT_SR_STATE_MACHINE,
+        .mBitRate = HARDWARE_CONNECT_SR_BIT_RATE
     }
 };
 
@@ -97,10 +114,18 @@ int main() {
     // Initialize hardware connection monitor
     init_connected_hardware_monitor(&_connectedHardwareMonitor);
 
-    // Initialize cross-core queue
-    intitialize_sensor_data_queue(&sensorUpdateQueue,(NUM_SENSORS * 4));
+    // Initialize cross-core snapshot
+    initialize_sensor_data_snapshot(&sensorDataSnapshot);
+
+    DEBUG_PRINT("Sensor data snapshot ready\n");
+
+    // Initialize the reading history, before core 1 starts recording to it
+    init_sensor_history(&sensorHistory, sensorPackets, NUM_SENSORS);
+
+    DEBUG_PRINT("Sensor history ready (%u rows of %u bytes)\n", sensorHistory.mRowCapacity, (uint) sensorHistory.mRowSize);
 
-    DEBUG_PRINT("Sensor data queue ready\n");
+    // Find the end of the flash log, while core 1 is not yet running from flash
+    init_sensor_flash_log(&sensorFlashLog, sensorPackets, NUM_SENSORS);
 
     // Initialise UART controller comms interface
     init_sensor_controller(&_sensorControllerInterface, SENSOR_CONTROLLER_TX_PIN, SENSOR_CONTROLLER_RX_PIN, SENSOR_CONTROLLER_BAUDRATE);
@@ -116,25 +141,50 @@ int main() {
     // core0 execution loop
     DEBUG_PRINT("Sensor initialization complete\n");
     while(1) {
+        PERF_PROBE_START(loop);
+
+        PERF_PROBE_START(monitor);
         update_connected_hardware_monitor(&_connectedHardwareMonitor);
+        PERF_PROBE_END(monitor, PERF_STAGE_HARDWARE_MONITOR);
 
-        // Update sensor readings
-        DEBUG_PRINT("Update sensors\n");
+        // Update whichever sensors are due
         gpio_put(ONBOARD_LED_PIN, false);
-        update_sensors(sensorsList, NUM_SENSORS, DEBUG_SENSOR_UPDATE, &_connectedHardwareMonitor);
+        PERF_PROBE_START(sensors);
+        absolute_time_t nextSensorUpdate = update_due_sensors(sensorsList, NUM_SENSORS, DEBUG_SENSOR_UPDATE, &_connectedHardwareMonitor);
+        PERF_PROBE_END(sensors, PERF_STAGE_SENSOR_UPDATES);
         gpio_put(ONBOARD_LED_PIN, true);
 
         // Update sensor LED indicators
-        DEBUG_PRINT("Update LEDs\n");
+        PERF_PROBE_START(leds);
         update_sensor_status_indicators(&_ledShifter, sensorsList, NUM_SENSORS);
+        PERF_PROBE_END(leds, PERF_STAGE_STATUS_LEDS);
 
         // Push sensor updates to core 1
-        push_sensor_data_to_queue(&sensorUpdateQueue, sensorsList);
+        PERF_PROBE_START(publish);
+        publish_sensor_data(&sensorDataSnapshot, sensorsList);
+        PERF_PROBE_END(publish, PERF_STAGE_SNAPSHOT_PUBLISH);
 
         // Pet the watchdog
         watchdog_update();
 
-        // Chill
-        sleep_ms(1);
+        // Move queued I2C transactions along. Their callbacks feed the pods' next updates
+        PERF_PROBE_START(i2c);
+        absolute_time_t nextI2CUpdate = update_i2c_transactions(&sensorI2CInterface);
+        PERF_PROBE_END(i2c, PERF_STAGE_I2C_TRANSACTIONS);
+
+        // Nothing to do until the next sensor is due or the bus needs attention
+        absolute_time_t wakeTime = (absolute_time_diff_us(nextI2CUpdate, nextSensorUpdate) > 0) ? nextI2CUpdate : nextSensorUpdate;
+        absolute_time_t nextScan = get_next_connected_hardware_scan_time(&_connectedHardwareMonitor);
+        if(absolute_time_diff_us(nextScan, wakeTime) > 0) {
+            wakeTime = nextScan;
+        }
+
+        // Log a snapshot if one is due, and use the quiet time for any flash work
+        PERF_PROBE_START(flashLog);
+        update_sensor_flash_log(&sensorFlashLog, sensorsList, wakeTime);
+        PERF_PROBE_END(flashLog, PERF_STAGE_FLASH_LOG);
+
+        PERF_PROBE_END(loop, PERF_STAGE_CORE_0_LOOP);
+        sleep_until(wakeTime);
     }
 }
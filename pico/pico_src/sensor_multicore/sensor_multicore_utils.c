@@ -1,117 +1,145 @@
 #include "sensor_multicore_utils.h"
 
+#include <string.h>
 
-typedef struct {
-    uint8_t                 mSensorID;
-    SensorData              mSensorData;
-} SensorDataUpdate;
+#include "utils.h"
 
-typedef struct {
-    SensorDataUpdate        mSensorUpdates[NUM_SENSORS];
-} SensorDataUpdateMessage;
+#include "hardware/sync.h"
 
 
-void sensor_to_data_update(Sensor *sensor, SensorDataUpdate *dataUpdate) {
-    if(!sensor || !dataUpdate) {
-        return;
-    }
+// Core 1 side: the snapshot sequence applied so far, overall and for each sensor
+static uint32_t _appliedSequence = 0;
+static uint32_t _appliedSensorSequence[NUM_SENSORS];
 
-    dataUpdate->mSensorID = sensor->mSensorDefinition.mSensorID;
-    dataUpdate->mSensorData = sensor->mCurrentSensorData;
-}
-
-void data_update_entry_to_sensor_packet(SensorDataUpdate *dataUpdate, MsgPackSensorPacket *sensorPacket) {
-    // Sanity check
-    if(!dataUpdate || !sensorPacket || (dataUpdate->mSensorID != sensorPacket->mSensorID)) {
-        return;
-    }
-
-    // First, set the status
-    sensorPacket->mCurrentSensorData.mStatus = dataUpdate->mSensorData.mSensorStatus;
 
-    // Next set the actual readings
-    switch(sensorPacket->mSensorType) {
+void sensor_data_to_reading_values(const SensorData *sensorData, SensorType sensorType, MsgPackReadingValue *values) {
+    switch(sensorType) {
         case SONAR_SENSOR:
-            sensorPacket->mCurrentSensorData.mSensorReadings[SONAR_SENSOR_READING_INDEX].mValue.mIntValue = dataUpdate->mSensorData.mSensorReading.mSonarSensorDistance;
+            values[SONAR_SENSOR_READING_INDEX].mIntValue = sensorData->mSensorReading.mSonarSensorData.mDistance;
+            values[SONAR_SENSOR_CONFIDENCE_READING_INDEX].mIntValue = sensorData->mSensorReading.mSonarSensorData.mConfidence;
             break;
         
         case SENSOR_POD:
-            sensorPacket->mCurrentSensorData.mSensorReadings[SENSOR_POD_CO2_READING_INDEX].mValue.mFloatValue = dataUpdate->mSensorData.mSensorReading.mSensorPodData.mCO2Level;
-            sensorPacket->mCurrentSensorData.mSensorReadings[SENSOR_POD_TEMPERATURE_READING_INDEX].mValue.mFloatValue = dataUpdate->mSensorData.mSensorReading.mSensorPodData.mTemperature;
-            sensorPacket->mCurrentSensorData.mSensorReadings[SENSOR_POD_RH_READING_INDEX].mValue.mFloatValue = dataUpdate->mSensorData.mSensorReading.mSensorPodData.mHumidity;
-            sensorPacket->mCurrentSensorData.mSensorReadings[SENSOR_POD_SOIL_MOISTURE_READING_INDEX].mValue.mIntValue = dataUpdate->mSensorData.mSensorReading.mSensorPodData.mSoilSensorData;
+            values[SENSOR_POD_CO2_READING_INDEX].mFloatValue = sensorData->mSensorReading.mSensorPodData.mCO2Level;
+            values[SENSOR_POD_TEMPERATURE_READING_INDEX].mFloatValue = sensorData->mSensorReading.mSensorPodData.mTemperature;
+            values[SENSOR_POD_RH_READING_INDEX].mFloatValue = sensorData->mSensorReading.mSensorPodData.mHumidity;
+            values[SENSOR_POD_SOIL_MOISTURE_READING_INDEX].mIntValue = sensorData->mSensorReading.mSensorPodData.mSoilSensorData;
             break;
 
         case BATTERY_SENSOR:
-            sensorPacket->mCurrentSensorData.mSensorReadings[BATTERY_LEVEL_READING_INDEX].mValue.mFloatValue = dataUpdate->mSensorData.mSensorReading.mBatteryVoltage;
+            values[BATTERY_LEVEL_READING_INDEX].mFloatValue = sensorData->mSensorReading.mBatteryVoltage;
             break;
     }
 }
 
-void sensor_data_to_update_message(Sensor *sensors, SensorDataUpdateMessage *updateMessage) {
-    if(!sensors || !updateMessage) {
+void sensor_data_to_sensor_packet(const SensorData *sensorData, MsgPackSensorPacket *sensorPacket) {
+    // Sanity check
+    if(!sensorData || !sensorPacket) {
         return;
     }
 
-    for(int i = 0; i < NUM_SENSORS; ++i) {
-        sensor_to_data_update(&sensors[i], &updateMessage->mSensorUpdates[i]); 
+    // Keep the old data so we can tell whether anything actually changed
+    SensorStatus previousStatus = sensorPacket->mCurrentSensorData.mStatus;
+    MsgPackReadingValue previousValues[MAX_CACHED_SENSOR_READINGS];
+    int numReadings = MIN(sensorPacket->mCurrentSensorData.mNumReadings, MAX_CACHED_SENSOR_READINGS);
+    for(int i = 0; i < numReadings; ++i) {
+        previousValues[i] = sensorPacket->mCurrentSensorData.mSensorReadings[i].mValue;
     }
-}
 
-void update_message_to_sensor_packet(SensorDataUpdateMessage *updateMessage, MsgPackSensorPacket *sensorPacket) {
-    // Sanity check
-    if(!updateMessage || !sensorPacket) {
-        return;
+    // First, set the status
+    sensorPacket->mCurrentSensorData.mStatus = sensorData->mSensorStatus;
+
+    // Next set the actual readings
+    MsgPackReadingValue values[MAX_CACHED_SENSOR_READINGS] = {0};
+    sensor_data_to_reading_values(sensorData, sensorPacket->mSensorType, values);
+    for(int i = 0; i < numReadings; ++i) {
+        sensorPacket->mCurrentSensorData.mSensorReadings[i].mValue = values[i];
     }
 
-    for(int i = 0; i < NUM_SENSORS; ++i) {
-        data_update_entry_to_sensor_packet(&updateMessage->mSensorUpdates[i], &sensorPacket[i]);
+    // Then note any change, so the controller knows which subscribed sensors to push
+    bool changed = (previousStatus != sensorPacket->mCurrentSensorData.mStatus);
+    for(int i = 0; !changed && (i < numReadings); ++i) {
+        changed = (memcmp(&previousValues[i], &sensorPacket->mCurrentSensorData.mSensorReadings[i].mValue, sizeof(MsgPackReadingValue)) != 0);
+    }
+    if(changed) {
+        sensorPacket->mChangeCount++;
     }
+
+    // Finally, patch the new values into the pre-packed copy of this sensor's packet
+    update_sensor_packet_cache(sensorPacket);
 }
 
 
         // PUBLIC FUNCTIONS //
 
-void intitialize_sensor_data_queue(queue_t *sensorDataQueue, int numMessages) {
-    queue_init(sensorDataQueue, sizeof(SensorDataUpdateMessage), numMessages);
+void initialize_sensor_data_snapshot(SensorDataSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(SensorDataSnapshot));
 }
 
-void push_sensor_data_to_queue(queue_t *sensorDataQueue, Sensor *sensors) {
-    if(!sensors || !sensorDataQueue) {
+void publish_sensor_data(SensorDataSnapshot *snapshot, Sensor *sensors) {
+    static bool published = false;
+    bool changed[NUM_SENSORS];
+    bool anyChanged = false;
+
+    if(!sensors || !snapshot) {
         return;
     }
 
-    SensorDataUpdateMessage newData;
-    sensor_data_to_update_message(sensors, &newData);
+    // Core 0 is the only writer, so it can compare against the snapshot directly
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        changed[i] = !published || memcmp(&snapshot->mSensorData[i], &sensors[i].mCurrentSensorData, sizeof(SensorData));
+        anyChanged |= changed[i];
+    }
 
-    bool added = false;
-    do {
-        // We prefer new data to old data, so if the queue is full, pop off the oldest data to create space
-        if(queue_is_full(sensorDataQueue)) {
-            SensorDataUpdateMessage tmp;
-            queue_remove_blocking(sensorDataQueue, &tmp);
+    if(!anyChanged) {
+        return;
+    }
+
+    uint32_t sequence = snapshot->mSequence;
+    snapshot->mSequence = sequence + 1;
+    __dmb();
+
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        if(changed[i]) {
+            snapshot->mSensorData[i] = sensors[i].mCurrentSensorData;
+            snapshot->mSensorSequence[i] = sequence + 2;
         }
-        added = queue_try_add(sensorDataQueue, &newData);
+    }
 
-    } while(!added);
+    __dmb();
+    snapshot->mSequence = sequence + 2;
+    published = true;
 }
 
-void consume_update_queue_messages(queue_t *sensorUpdateQueue, MsgPackSensorPacket *sensorPackets) {
-    SensorDataUpdateMessage msgHolder;
-    bool msgRead = false;
-    bool haveMessage = false;
+uint32_t consume_sensor_data_snapshot(SensorDataSnapshot *snapshot, MsgPackSensorPacket *sensorPackets) {
+    uint32_t sensorSequence[NUM_SENSORS];
+    SensorData sensorData[NUM_SENSORS];
+    uint32_t sequence;
 
-    // Since updates are sent sequentially from core 0, we are really only interested in the latest update data and
-    // can discard any old messages since they contain stale sensor data. So we will just spin through the queue until
-    // there are no new messages
+    // Nothing published since we last looked
+    if(snapshot->mSequence == _appliedSequence) {
+        return _appliedSequence;
+    }
+
+    // Copy the snapshot out, trying again if core 0 was writing to it before or during the copy
     do {
-        msgRead = queue_try_remove(sensorUpdateQueue, &msgHolder);
-        if(msgRead) {
-            haveMessage = true;
+        sequence = snapshot->mSequence;
+        __dmb();
+        memcpy(sensorSequence, snapshot->mSensorSequence, sizeof(sensorSequence));
+        memcpy(sensorData, snapshot->mSensorData, sizeof(sensorData));
+        __dmb();
+    } while((sequence & 1) || (sequence != snapshot->mSequence));
+
+    // Only the sensors which changed since we last applied them need updating
+    for(int i = 0; i < NUM_SENSORS; ++i) {
+        if(sensorSequence[i] == _appliedSensorSequence[i]) {
+            continue;
         }
-    } while(msgRead);
 
-    if(haveMessage) {
-        update_message_to_sensor_packet(&msgHolder, sensorPackets);
+        sensor_data_to_sensor_packet(&sensorData[i], &sensorPackets[i]);
+        _appliedSensorSequence[i] = sensorSequence[i];
     }
+
+    _appliedSequence = sequence;
+    return _appliedSequence;
 }
@@ -4,13 +4,29 @@
 #include "hardware/sensors/sensor.h"
 #include "sensor_definitions.h"
 #include "uart_controller/sensor_msgpack.h"
-#include "pico/util/queue.h"
 
 
-// Queue management
-void intitialize_sensor_data_queue(queue_t *sensorDataQueue, int numMessages);
-void push_sensor_data_to_queue(queue_t *sensorDataQueue, Sensor *sensors);
-void consume_update_queue_messages(queue_t *sensorUpdateQueue, MsgPackSensorPacket *sensorPackets);
+// Latest data for every sensor, shared between the cores as a seqlock. Core 0 is the only writer and never
+// waits, core 1 copies the data out and retries if core 0 was part way through a publish
+typedef struct {
+    volatile uint32_t mSequence;                        // Odd while core 0 is writing, bumped twice per publish
+    uint32_t mSensorSequence[NUM_SENSORS];              // Sequence of the publish in which each sensor last changed
+    SensorData mSensorData[NUM_SENSORS];                // Latest data for each sensor
+} SensorDataSnapshot;
+
+
+// Flattens a sensor's data into its reading values, in the order of its sensor packet's readings
+void sensor_data_to_reading_values(const SensorData *sensorData, SensorType sensorType, MsgPackReadingValue *values);
+
+// Snapshot management
+void initialize_sensor_data_snapshot(SensorDataSnapshot *snapshot);
+
+// Core 0: publishes the sensors whose data changed since they were last published
+void publish_sensor_data(SensorDataSnapshot *snapshot, Sensor *sensors);
+
+// Core 1: applies the sensors changed since the last call to the sensor packets. Returns the sequence number
+// of the newest publish applied so far (0 = none yet)
+uint32_t consume_sensor_data_snapshot(SensorDataSnapshot *snapshot, MsgPackSensorPacket *sensorPackets);
 
 
 #endif
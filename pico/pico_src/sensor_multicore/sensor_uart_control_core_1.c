@@ -3,23 +3,43 @@
 #include "sensor_multicore_utils.h"
 #include "uart_controller/uart_sensor_controller.h"
 #include "debug_io.h"
+#include "perf_stats.h"
 
-#include "pico/util/queue.h"
+#include "pico/multicore.h"
 
 extern ControllerInterface _sensorControllerInterface;
+extern SensorDataSnapshot sensorDataSnapshot;
 
 void sensor_controller_core_update() {
-    // First thing to do is process any inter-core messages from the sensor update core
-    consume_update_queue_messages(
-        _sensorControllerInterface.mSensorUpdateQueue,
+    PERF_PROBE_START(loop);
+
+    // First thing to do is pick up any new data from the sensor update core
+    PERF_PROBE_START(consume);
+    consume_sensor_data_snapshot(
+        &sensorDataSnapshot,
         _sensorControllerInterface.mMsgPackSensors
     );
+    PERF_PROBE_END(consume, PERF_STAGE_SNAPSHOT_CONSUME);
+
+    // Record it, if a history row is due
+    PERF_PROBE_START(history);
+    update_sensor_history(
+        _sensorControllerInterface.mHistory,
+        _sensorControllerInterface.mMsgPackSensors,
+        _sensorControllerInterface.mNumMsgPackSensors
+    );
+    PERF_PROBE_END(history, PERF_STAGE_HISTORY_RECORD);
 
-    // Secondly, handle any incoming controller commands
+    // Then handle any incoming controller commands
     update_uart_sensor_controller(&_sensorControllerInterface);
+
+    PERF_PROBE_END(loop, PERF_STAGE_CORE_1_LOOP);
 }
 
 void sensor_controller_core_main() {
+    // Let core 0 park this core while it writes the flash log
+    multicore_lockout_victim_init();
+
     // Transmit "ready" message on core startup
     send_controller_ready(&_sensorControllerInterface);
 
@@ -8,14 +8,30 @@ typedef enum {
     GET_ALL_SENSOR_VALUES       = 0x01,
     GET_SENSOR_VALUE            = 0x02,
     GET_SENSORS_READY           = 0x03,
-    CALIBRATE_SENSOR            = 0x04
+    CALIBRATE_SENSOR            = 0x04,
+    GET_ALL_SENSOR_VALUES_COMPACT = 0x05,
+    SET_CONTROLLER_BAUDRATE     = 0x06,             // Arguments: proposed baud rate, big-endian 32-bit
+    HEARTBEAT_ACK               = 0x07,             // Confirms the link, required after a baud rate change
+    SUBSCRIBE_SENSOR_UPDATES    = 0x08,             // Arguments: sensor ID (or ALL_SENSORS_ID), 1 = subscribe/0 = unsubscribe, minimum interval ms as two 7-bit bytes (high first)
+    GET_SENSOR_HISTORY          = 0x09,             // Arguments: range start and end, seconds since boot as four 7-bit bytes each (high first). End 0 = up to now
+    GET_SENSOR_LOG              = 0x0A,             // Arguments: first record sequence as four 7-bit bytes (high first), maximum records (0 = default)
+    GET_PERF_STATS              = 0x0B,
+    GET_I2C_STATS               = 0x0C              // Arguments: 1 = clear the counters once they have been sent
 } SensorCommandIdentifier;
 
+// Sensor ID argument which addresses every sensor. Argument bytes can never be COMMAND_START_BYTE
+#define ALL_SENSORS_ID                  (0xFE)
+
 
 // Command response codes 
 typedef enum {
     COMMAND_OK                  = 0x00,
     SENSOR_NOT_FOUND            = 0x01,
+    BAUDRATE_NOT_SUPPORTED      = 0x02,
+    HISTORY_NOT_AVAILABLE       = 0x03,
+    PERF_STATS_NOT_AVAILABLE    = 0x04,             // Firmware built without PERF_STATS_ON
+    I2C_STATS_NOT_AVAILABLE     = 0x05,
+    SENSOR_UPDATE               = 0xFD,             // Unsolicited data for subscribed sensors
     HEARTBEAT                   = 0xFE,
     CONTROLLER_READY            = 0xFF
 } CommandResponseCode;
@@ -0,0 +1,237 @@
+#include "sensor_history.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "utils.h"
+
+
+#define MAX_HISTORY_DECIMAL_PLACES          (3)
+
+// History packet keys
+const char *HISTORY_TIME_KEY = "time_ms";
+const char *HISTORY_INTERVAL_KEY = "interval_ms";
+const char *HISTORY_LAYOUT_KEY = "layout";
+const char *HISTORY_ROWS_KEY = "rows";
+
+
+// Internal functions
+uint32_t get_history_row_slot_internal(const SensorHistory *history, uint32_t rowIndex);
+const uint8_t *get_history_row_internal(const SensorHistory *history, uint32_t rowIndex);
+uint32_t get_history_row_time_internal(const uint8_t *row);
+// -- End internal functions
+
+
+size_t get_sensor_history_row_size(const MsgPackSensorPacket *sensorPackets, uint8_t numSensors) {
+    size_t rowSize = SENSOR_HISTORY_TIMESTAMP_SIZE;
+
+    for(int i = 0; i < numSensors; ++i) {
+        rowSize += 1 + (get_sensor_history_reading_count(&sensorPackets[i]) * SENSOR_HISTORY_VALUE_SIZE);
+    }
+
+    return rowSize;
+}
+
+int get_sensor_history_reading_count(const MsgPackSensorPacket *sensorPacket) {
+    return MIN(sensorPacket->mCurrentSensorData.mNumReadings, MAX_CACHED_SENSOR_READINGS);
+}
+
+int16_t to_sensor_history_value(const MsgPackSensorReadingDescription *description, MsgPackReadingValue value) {
+    float scaledValue;
+
+    switch(description->mType) {
+        case INT_READING:
+            return (int16_t) MIN(value.mIntValue, INT16_MAX);
+
+        case BOOL_READING:
+            return value.mBoolValue;
+
+        case FLOAT_READING:
+            scaledValue = roundf(value.mFloatValue * powf(10.f, get_sensor_history_decimal_places(description)));
+            return (int16_t) MAX(MIN(scaledValue, INT16_MAX), INT16_MIN);
+
+        default:
+            return 0;
+    }
+}
+
+void pack_sensor_history_layout(const MsgPackSensorPacket *sensorPackets, uint8_t numSensors, mpack_writer_t *writer) {
+    mpack_start_array(writer, numSensors);
+    for(int i = 0; i < numSensors; ++i) {
+        int numReadings = get_sensor_history_reading_count(&sensorPackets[i]);
+
+        mpack_start_array(writer, 2);
+        mpack_write_u8(writer, sensorPackets[i].mSensorID);
+
+        mpack_start_array(writer, numReadings);
+        for(int j = 0; j < numReadings; ++j) {
+            mpack_write_u8(writer, get_sensor_history_decimal_places(sensorPackets[i].mCurrentSensorData.mSensorReadings[j].mDescription));
+        }
+        mpack_finish_array(writer);
+
+        mpack_finish_array(writer);
+    }
+    mpack_finish_array(writer);
+}
+
+void init_sensor_history(SensorHistory *history, const MsgPackSensorPacket *sensorPackets, uint8_t numSensors) {
+    if(!history || !sensorPackets) {
+        return;
+    }
+
+    history->mRowSize = get_sensor_history_row_size(sensorPackets, numSensors);
+
+    history->mRowCapacity = SENSOR_HISTORY_BUDGET_BYTES / history->mRowSize;
+    history->mNextRow = 0;
+    history->mRowCount = 0;
+    // Sensors have nothing to report straight after boot, so the first row waits a whole interval
+    history->mNextRecordTime = MILLIS() + SENSOR_HISTORY_INTERVAL_MS;
+}
+
+void update_sensor_history(SensorHistory *history, const MsgPackSensorPacket *sensorPackets, uint8_t numSensors) {
+    if(!history || !sensorPackets || !history->mRowCapacity) {
+        return;
+    }
+
+    uint32_t currentTimeMS = MILLIS();
+    if((int32_t) (currentTimeMS - history->mNextRecordTime) < 0) {
+        return;
+    }
+
+    uint8_t *row = &history->mRows[history->mNextRow * history->mRowSize];
+    uint8_t *dst = row;
+
+    dst[0] = (uint8_t) currentTimeMS;
+    dst[1] = (uint8_t) (currentTimeMS >> 8);
+    dst[2] = (uint8_t) (currentTimeMS >> 16);
+    dst[3] = (uint8_t) (currentTimeMS >> 24);
+    dst += SENSOR_HISTORY_TIMESTAMP_SIZE;
+
+    for(int i = 0; i < numSensors; ++i) {
+        const MsgPackSensorData *sensorData = &sensorPackets[i].mCurrentSensorData;
+        int numReadings = get_sensor_history_reading_count(&sensorPackets[i]);
+
+        *dst++ = (uint8_t) sensorData->mStatus;
+        for(int j = 0; j < numReadings; ++j) {
+            int16_t value = to_sensor_history_value(sensorData->mSensorReadings[j].mDescription, sensorData->mSensorReadings[j].mValue);
+            *dst++ = (uint8_t) value;
+            *dst++ = (uint8_t) (value >> 8);
+        }
+    }
+
+    history->mNextRow = (history->mNextRow + 1) % history->mRowCapacity;
+    if(history->mRowCount < history->mRowCapacity) {
+        history->mRowCount++;
+    }
+
+    // Stay on the interval grid, unless we have fallen a whole interval behind it
+    history->mNextRecordTime += SENSOR_HISTORY_INTERVAL_MS;
+    if((int32_t) (currentTimeMS - history->mNextRecordTime) >= 0) {
+        history->mNextRecordTime = currentTimeMS + SENSOR_HISTORY_INTERVAL_MS;
+    }
+}
+
+uint8_t get_sensor_history_decimal_places(const MsgPackSensorReadingDescription *description) {
+    if(!description || (description->mType != FLOAT_READING)) {
+        return 0;
+    }
+
+    float range = MAX(fabsf(description->mMinValue.mFloatValue), fabsf(description->mMaxValue.mFloatValue));
+    uint8_t decimalPlaces = 0;
+    while((decimalPlaces < MAX_HISTORY_DECIMAL_PLACES) && ((range * powf(10.f, decimalPlaces + 1)) <= INT16_MAX)) {
+        decimalPlaces++;
+    }
+
+    return decimalPlaces;
+}
+
+PackResponse pack_sensor_history_packet(
+    const SensorHistory *history,
+    const MsgPackSensorPacket *sensorPackets,
+    uint8_t numSensors,
+    uint32_t startMS,
+    uint32_t endMS,
+    char *outBuf,
+    size_t outBufSize,
+    PackFlushFunction flush,
+    void *flushContext
+) {
+    PackResponse response = {0, mpack_error_bug};
+    PackFlushContext context = {
+        .mFlush = flush,
+        .mContext = flushContext
+    };
+
+    if(!history || !sensorPackets || !flush) {
+        return response;
+    }
+
+    // Rows are in time order, so the range is a single run of them. Times are compared unsigned: a wrapped
+    // difference would put every row before a start of 0 once uptime passes 2^31 ms
+    uint32_t firstRow = 0;
+    while((firstRow < history->mRowCount) && (get_history_row_time_internal(get_history_row_internal(history, firstRow)) < startMS)) {
+        firstRow++;
+    }
+
+    uint32_t endRow = firstRow;
+    while((endRow < history->mRowCount) && (get_history_row_time_internal(get_history_row_internal(history, endRow)) <= endMS)) {
+        endRow++;
+    }
+
+    // Initialize writer
+    mpack_writer_t writer;
+    init_streamed_pack_writer(&writer, &context, outBuf, outBufSize);
+
+    // Write out packet data
+    mpack_start_map(&writer, 5);
+
+    // Pack packet ID
+    mpack_write_cstr(&writer, PACKET_ID_KEY);
+    mpack_write_u8(&writer, SENSOR_HISTORY_PACKET);
+
+    // Pack current time, so the rows' timestamps can be placed
+    mpack_write_cstr(&writer, HISTORY_TIME_KEY);
+    mpack_write_u32(&writer, MILLIS());
+
+    mpack_write_cstr(&writer, HISTORY_INTERVAL_KEY);
+    mpack_write_u32(&writer, SENSOR_HISTORY_INTERVAL_MS);
+
+    // Pack the layout of the rows
+    mpack_write_cstr(&writer, HISTORY_LAYOUT_KEY);
+    pack_sensor_history_layout(sensorPackets, numSensors, &writer);
+
+    // Pack the rows themselves as one blob, a contiguous run of the ring at a time
+    mpack_write_cstr(&writer, HISTORY_ROWS_KEY);
+    mpack_start_bin(&writer, (endRow - firstRow) * history->mRowSize);
+    for(uint32_t row = firstRow; row < endRow; ) {
+        uint32_t slot = get_history_row_slot_internal(history, row);
+        uint32_t run = MIN(endRow - row, history->mRowCapacity - slot);
+
+        mpack_write_bytes(&writer, (const char *) &history->mRows[slot * history->mRowSize], run * history->mRowSize);
+        row += run;
+    }
+    mpack_finish_bin(&writer);
+
+    // Finish building the map
+    mpack_finish_map(&writer);
+
+    // Finish writing the data, which flushes whatever is left in the buffer
+    response.mErrorCode = mpack_writer_destroy(&writer);
+    response.mBytesUsed = context.mBytesFlushed;
+
+    return response;
+}
+
+
+// Row 0 is the oldest held
+uint32_t get_history_row_slot_internal(const SensorHistory *history, uint32_t rowIndex) {
+    return (history->mNextRow + history->mRowCapacity - history->mRowCount + rowIndex) % history->mRowCapacity;
+}
+
+const uint8_t *get_history_row_internal(const SensorHistory *history, uint32_t rowIndex) {
+    return &history->mRows[get_history_row_slot_internal(history, rowIndex) * history->mRowSize];
+}
+
+uint32_t get_history_row_time_internal(const uint8_t *row) {
+    return (uint32_t) row[0] | ((uint32_t) row[1] << 8) | ((uint32_t) row[2] << 16) | ((uint32_t) row[3] << 24);
+}
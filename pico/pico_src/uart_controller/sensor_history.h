@@ -0,0 +1,77 @@
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include "sensor_msgpack.h"
+
+
+// SRAM given over to the history ring. Set PIFEEDER_HISTORY_BUDGET_BYTES in CMake to change it
+#ifndef SENSOR_HISTORY_BUDGET_BYTES
+#define SENSOR_HISTORY_BUDGET_BYTES         (48 * 1024)
+#endif
+
+#define SENSOR_HISTORY_INTERVAL_MS          (10 * 1000)         // Time between recorded rows
+#define SENSOR_HISTORY_TIMESTAMP_SIZE       (4)
+#define SENSOR_HISTORY_VALUE_SIZE           (2)
+
+
+/**
+ * The history is a ring of fixed-size rows, one recorded every SENSOR_HISTORY_INTERVAL_MS. Rows are kept in
+ * the same packed form they are sent in, so a range of them goes out as it is:
+ *
+ *      uint32      Timestamp (MILLIS()), little-endian
+ *      then for each sensor, in sensor packet order:
+ *      uint8       Sensor status
+ *      int16       Each reading value as fixed point, little-endian. See get_sensor_history_decimal_places()
+ */
+typedef struct {
+    uint8_t mRows[SENSOR_HISTORY_BUDGET_BYTES];             // Ring of packed rows
+    size_t mRowSize;                                        // Bytes per row, fixed by the sensors' reading counts
+    uint32_t mRowCapacity;                                  // Rows that fit in the budget
+    uint32_t mNextRow;                                      // Ring slot the next row is written to
+    uint32_t mRowCount;                                     // Rows held, up to mRowCapacity
+    uint32_t mNextRecordTime;                               // Time the next row is due
+} SensorHistory;
+
+
+// History packet keys, shared with the flash log packet which carries rows in the same form
+extern const char *HISTORY_TIME_KEY;
+extern const char *HISTORY_LAYOUT_KEY;
+
+
+// Bytes in a row for the given sensors
+size_t get_sensor_history_row_size(const MsgPackSensorPacket *sensorPackets, uint8_t numSensors);
+
+// Readings of a sensor that go into each row
+int get_sensor_history_reading_count(const MsgPackSensorPacket *sensorPacket);
+
+// A reading value in the row's fixed point form
+int16_t to_sensor_history_value(const MsgPackSensorReadingDescription *description, MsgPackReadingValue value);
+
+// Packs the [sensor ID, [decimal places of each reading]] layout array describing the rows
+void pack_sensor_history_layout(const MsgPackSensorPacket *sensorPackets, uint8_t numSensors, mpack_writer_t *writer);
+
+// Works out the row layout for the given sensors and empties the history
+void init_sensor_history(SensorHistory *history, const MsgPackSensorPacket *sensorPackets, uint8_t numSensors);
+
+// Records the current status and readings of every sensor if a row is due
+void update_sensor_history(SensorHistory *history, const MsgPackSensorPacket *sensorPackets, uint8_t numSensors);
+
+// Decimal places a reading's values are scaled by in the history. Floats keep as many as still fit their
+// maximum value into an int16, integers keep none
+uint8_t get_sensor_history_decimal_places(const MsgPackSensorReadingDescription *description);
+
+// Packs the rows recorded between startMS and endMS (inclusive) as a single history packet. The rows can be far
+// bigger than outBuf, so the packet is streamed through flush as it is built
+PackResponse pack_sensor_history_packet(
+    const SensorHistory *history,
+    const MsgPackSensorPacket *sensorPackets,
+    uint8_t numSensors,
+    uint32_t startMS,
+    uint32_t endMS,
+    char *outBuf,
+    size_t outBufSize,
+    PackFlushFunction flush,
+    void *flushContext
+);
+
+#endif  // SENSOR_HISTORY_H
@@ -1,5 +1,9 @@
 #include "sensor_msgpack.h"
-#include "mpack/mpack.h"
+
+#include <string.h>
+
+#include "perf_stats.h"
+#include "utils.h"
 
 
 // Generic keys
@@ -27,6 +31,18 @@ const char *SENSOR_DATA_NAME_KEY = "name";
 const char *SENSOR_DATA_STATUS_KEY = "sensor_status";
 const char *SENSOR_DATA_READINGS_KEY = "sensor_readings";
 const char *CURRENT_SENSOR_DATA_KEY = "current_sensor_data";
+const char *SENSOR_VALUES_KEY = "sensor_values";
+
+// Perf stats keys
+const char *PERF_STATS_TIME_KEY = "time_ms";
+const char *PERF_STATS_STAGES_KEY = "stages";
+
+// I2C stats keys
+const char *I2C_STATS_RESET_TIME_KEY = "reset_ms";
+const char *I2C_STATS_BUS_RESETS_KEY = "bus_resets";
+const char *I2C_STATS_UNTRACKED_KEY = "untracked";
+const char *I2C_STATS_CHANNELS_KEY = "channels";
+const char *I2C_STATS_DEVICES_KEY = "devices";
 
 
 // Calibration keys
@@ -165,6 +181,47 @@ void pack_reading_value(MsgPackReadingType type, MsgPackReadingValue value, mpac
     }
 }
 
+// Packs a placeholder which uses the widest encoding for the value type, so any value can be patched in later
+void pack_reading_value_placeholder(MsgPackReadingType type, mpack_writer_t *writer) {
+    switch(type) {
+        case INT_READING:
+            mpack_write_u16(writer, UINT16_MAX);
+            break;
+
+        case FLOAT_READING:
+            mpack_write_float(writer, 0.f);
+            break;
+
+        case BOOL_READING:
+            mpack_write_u8(writer, UINT8_MAX);
+            break;
+    }
+}
+
+// Overwrites a placeholder packed by pack_reading_value_placeholder() (dst points at its type byte)
+void patch_reading_value(MsgPackReadingType type, MsgPackReadingValue value, uint8_t *dst) {
+    uint32_t floatBits;
+
+    switch(type) {
+        case INT_READING:
+            dst[1] = (value.mIntValue >> 8);
+            dst[2] = (value.mIntValue & 0xFF);
+            break;
+
+        case FLOAT_READING:
+            memcpy(&floatBits, &value.mFloatValue, sizeof(floatBits));
+            dst[1] = (floatBits >> 24);
+            dst[2] = (floatBits >> 16) & 0xFF;
+            dst[3] = (floatBits >> 8) & 0xFF;
+            dst[4] = (floatBits & 0xFF);
+            break;
+
+        case BOOL_READING:
+            dst[1] = value.mBoolValue;
+            break;
+    }
+}
+
 void pack_reading_description(const MsgPackSensorReadingDescription* const description, mpack_writer_t *writer) {
     // Begin
     mpack_start_map(writer, 5);
@@ -193,7 +250,7 @@ void pack_reading_description(const MsgPackSensorReadingDescription* const descr
     mpack_finish_map(writer);
 }
 
-void pack_sensor_reading(const MsgPackSensorReading* const reading, mpack_writer_t *writer) {
+void pack_sensor_reading(const MsgPackSensorReading* const reading, mpack_writer_t *writer, size_t *valueOffset) {
     // Begin
     mpack_start_map(writer, 2);
 
@@ -201,9 +258,14 @@ void pack_sensor_reading(const MsgPackSensorReading* const reading, mpack_writer
     mpack_write_cstr(writer, READING_DESCRIPTION_KEY);
     pack_reading_description(reading->mDescription, writer);
     
-    // Pack reading value
+    // Pack reading value (or a placeholder for it, if we are building a packet cache)
     mpack_write_cstr(writer, READING_VALUE_KEY);
-    pack_reading_value(reading->mDescription->mType, reading->mValue, writer);
+    if(valueOffset) {
+        *valueOffset = mpack_writer_buffer_used(writer);
+        pack_reading_value_placeholder(reading->mDescription->mType, writer);
+    } else {
+        pack_reading_value(reading->mDescription->mType, reading->mValue, writer);
+    }
 
     // Done
     mpack_finish_map(writer);
@@ -233,19 +295,28 @@ void pack_calibration_parameters(const MsgPackSensorCalibrationParameters* const
     mpack_finish_map(writer);
 }
 
-void pack_sensor_data(const MsgPackSensorData * const sensorData, mpack_writer_t *writer) {
+void pack_sensor_data(const MsgPackSensorData * const sensorData, mpack_writer_t *writer, MsgPackSensorPacketCache *cache) {
     // Begin
     mpack_start_map(writer, 2);
 
     // Pack status
     mpack_write_cstr(writer, SENSOR_DATA_STATUS_KEY);
-    mpack_write_u8(writer, sensorData->mStatus);
+    if(cache) {
+        cache->mStatusOffset = mpack_writer_buffer_used(writer);
+        mpack_write_u8(writer, UINT8_MAX);
+    } else {
+        mpack_write_u8(writer, sensorData->mStatus);
+    }
 
     // Pack sensor readings
     mpack_write_cstr(writer, SENSOR_DATA_READINGS_KEY);
     mpack_start_array(writer, sensorData->mNumReadings);
     for(int i = 0; i < sensorData->mNumReadings; ++i) {
-        pack_sensor_reading(&(sensorData->mSensorReadings[i]), writer);
+        pack_sensor_reading(
+            &(sensorData->mSensorReadings[i]),
+            writer,
+            cache ? &cache->mReadingValueOffsets[i] : NULL
+        );
     }
     mpack_finish_array(writer);
 
@@ -253,7 +324,12 @@ void pack_sensor_data(const MsgPackSensorData * const sensorData, mpack_writer_t
     mpack_finish_map(writer);
 }
 
-PackResponse pack_sensor_packet(const MsgPackSensorPacket * const sensorPacket, char* outBuf, size_t outBufSize) {
+PackResponse pack_sensor_packet_data(
+    const MsgPackSensorPacket * const sensorPacket,
+    char* outBuf,
+    size_t outBufSize,
+    MsgPackSensorPacketCache *cache
+) {
     // Initialize writer
     PackResponse response;
     mpack_writer_t writer;
@@ -280,7 +356,56 @@ PackResponse pack_sensor_packet(const MsgPackSensorPacket * const sensorPacket,
 
     // Pack sensor readings
     mpack_write_cstr(&writer, CURRENT_SENSOR_DATA_KEY);
-    pack_sensor_data(&sensorPacket->mCurrentSensorData, &writer);
+    pack_sensor_data(&sensorPacket->mCurrentSensorData, &writer, cache);
+
+    // Finish building the map
+    mpack_finish_map(&writer);
+
+    // Get the amount of bytes used
+    response.mBytesUsed = mpack_writer_buffer_used(&writer);
+
+    // Finish writing the data
+    response.mErrorCode = mpack_writer_destroy(&writer);
+
+    return response;
+}
+
+PackResponse pack_sensor_packet(const MsgPackSensorPacket * const sensorPacket, char* outBuf, size_t outBufSize) {
+    return pack_sensor_packet_data(sensorPacket, outBuf, outBufSize, NULL);
+}
+
+PackResponse pack_sensor_values_packet(const MsgPackSensorPacket * const sensorPackets, uint8_t numSensors, char* outBuf, size_t outBufSize) {
+    // Initialize writer
+    PackResponse response;
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, outBuf, outBufSize);
+
+    // Write out packet data
+    mpack_start_map(&writer, 2);
+
+    // Pack packet ID
+    mpack_write_cstr(&writer, PACKET_ID_KEY);
+    mpack_write_u8(&writer, SENSOR_VALUES_PACKET);
+
+    // Pack [sensor ID, status, [values]] for each sensor
+    mpack_write_cstr(&writer, SENSOR_VALUES_KEY);
+    mpack_start_array(&writer, numSensors);
+    for(int i = 0; i < numSensors; ++i) {
+        const MsgPackSensorData *sensorData = &sensorPackets[i].mCurrentSensorData;
+
+        mpack_start_array(&writer, 3);
+        mpack_write_u8(&writer, sensorPackets[i].mSensorID);
+        mpack_write_u8(&writer, sensorData->mStatus);
+
+        mpack_start_array(&writer, sensorData->mNumReadings);
+        for(int j = 0; j < sensorData->mNumReadings; ++j) {
+            pack_reading_value(sensorData->mSensorReadings[j].mDescription->mType, sensorData->mSensorReadings[j].mValue, &writer);
+        }
+        mpack_finish_array(&writer);
+
+        mpack_finish_array(&writer);
+    }
+    mpack_finish_array(&writer);
 
     // Finish building the map
     mpack_finish_map(&writer);
@@ -294,6 +419,223 @@ PackResponse pack_sensor_packet(const MsgPackSensorPacket * const sensorPacket,
     return response;
 }
 
+#if PERF_STATS_ON
+PackResponse pack_perf_stats_packet(char* outBuf, size_t outBufSize, PackFlushFunction flush, void *flushContext) {
+    PackResponse response = {0, mpack_error_bug};
+    PackFlushContext context = {
+        .mFlush = flush,
+        .mContext = flushContext
+    };
+    PerfStageStats stats;
+
+    if(!flush) {
+        return response;
+    }
+
+    // Initialize writer
+    mpack_writer_t writer;
+    init_streamed_pack_writer(&writer, &context, outBuf, outBufSize);
+
+    // Write out packet data
+    mpack_start_map(&writer, 3);
+
+    // Pack packet ID
+    mpack_write_cstr(&writer, PACKET_ID_KEY);
+    mpack_write_u8(&writer, PERF_STATS_PACKET);
+
+    mpack_write_cstr(&writer, PERF_STATS_TIME_KEY);
+    mpack_write_u32(&writer, MILLIS());
+
+    // Pack [stage ID, name, count, min, average, max, [histogram]] for each stage
+    mpack_write_cstr(&writer, PERF_STATS_STAGES_KEY);
+    mpack_start_array(&writer, NUM_PERF_STAGES);
+    for(int i = 0; i < NUM_PERF_STAGES; ++i) {
+        get_perf_stage_stats(i, &stats);
+
+        mpack_start_array(&writer, 7);
+        mpack_write_u8(&writer, i);
+        mpack_write_cstr(&writer, get_perf_stage_name(i));
+        mpack_write_u32(&writer, stats.mCount);
+        mpack_write_u32(&writer, stats.mMinUS);
+        mpack_write_u32(&writer, stats.mCount ? (uint32_t) (stats.mTotalUS / stats.mCount) : 0);
+        mpack_write_u32(&writer, stats.mMaxUS);
+
+        mpack_start_array(&writer, PERF_HISTOGRAM_BUCKETS);
+        for(int j = 0; j < PERF_HISTOGRAM_BUCKETS; ++j) {
+            mpack_write_u32(&writer, stats.mHistogram[j]);
+        }
+        mpack_finish_array(&writer);
+
+        mpack_finish_array(&writer);
+    }
+    mpack_finish_array(&writer);
+
+    // Finish building the map
+    mpack_finish_map(&writer);
+
+    // Finish writing the data, which flushes whatever is left in the buffer
+    response.mErrorCode = mpack_writer_destroy(&writer);
+    response.mBytesUsed = context.mBytesFlushed;
+
+    return response;
+}
+#endif
+
+void pack_i2c_stats_internal(const I2CStats *stats, mpack_writer_t *writer) {
+    mpack_start_array(writer, 9);
+    mpack_write_u32(writer, stats->mTransactions);
+    mpack_write_u32(writer, stats->mBytes);
+    mpack_write_u32(writer, stats->mTimeouts);
+    mpack_write_u32(writer, stats->mNACKs);
+    mpack_write_u32(writer, stats->mOtherErrors);
+    mpack_write_u32(writer, stats->mCRCFailures);
+    mpack_write_u32(writer, stats->mTransactions ? (uint32_t) (stats->mTotalLatencyUS / stats->mTransactions) : 0);
+    mpack_write_u32(writer, stats->mMaxLatencyUS);
+
+    mpack_start_array(writer, I2C_STATS_LATENCY_BUCKETS);
+    for(int i = 0; i < I2C_STATS_LATENCY_BUCKETS; ++i) {
+        mpack_write_u32(writer, stats->mLatencyHistogram[i]);
+    }
+    mpack_finish_array(writer);
+
+    mpack_finish_array(writer);
+}
+
+PackResponse pack_i2c_stats_packet(I2CInterface *i2cInterface, char* outBuf, size_t outBufSize, PackFlushFunction flush, void *flushContext) {
+    PackResponse response = {0, mpack_error_bug};
+    PackFlushContext context = {
+        .mFlush = flush,
+        .mContext = flushContext
+    };
+    I2CStats stats;
+    I2CDeviceStats deviceStats;
+
+    if(!i2cInterface || !flush) {
+        return response;
+    }
+
+    // Initialize writer
+    mpack_writer_t writer;
+    init_streamed_pack_writer(&writer, &context, outBuf, outBufSize);
+
+    // Write out packet data
+    mpack_start_map(&writer, 7);
+
+    // Pack packet ID
+    mpack_write_cstr(&writer, PACKET_ID_KEY);
+    mpack_write_u8(&writer, I2C_STATS_PACKET);
+
+    mpack_write_cstr(&writer, PERF_STATS_TIME_KEY);
+    mpack_write_u32(&writer, MILLIS());
+
+    mpack_write_cstr(&writer, I2C_STATS_RESET_TIME_KEY);
+    mpack_write_u32(&writer, i2cInterface->mStats.mResetTime);
+
+    mpack_write_cstr(&writer, I2C_STATS_BUS_RESETS_KEY);
+    mpack_write_u32(&writer, i2cInterface->mStats.mBusResets);
+
+    mpack_write_cstr(&writer, I2C_STATS_UNTRACKED_KEY);
+    mpack_write_u32(&writer, i2cInterface->mStats.mUntrackedTransactions);
+
+    // Pack [channel, baud, [stats]] for each channel, direct devices last
+    mpack_write_cstr(&writer, I2C_STATS_CHANNELS_KEY);
+    mpack_start_array(&writer, NUM_I2C_CHANNELS + 1);
+    for(int i = 0; i <= I2C_STATS_DIRECT_CHANNEL; ++i) {
+        I2CChannel channel = (i == I2C_STATS_DIRECT_CHANNEL) ? NO_I2C_CHANNEL : (I2CChannel) i;
+        get_i2c_channel_stats(i2cInterface, i, &stats);
+
+        mpack_start_array(&writer, 3);
+        mpack_write_i8(&writer, channel);
+        mpack_write_u32(&writer, get_i2c_channel_baud(i2cInterface, channel));
+        pack_i2c_stats_internal(&stats, &writer);
+        mpack_finish_array(&writer);
+    }
+    mpack_finish_array(&writer);
+
+    // Pack [channel, address, [stats]] for each device
+    uint8_t numDevices = get_i2c_device_stats_count(i2cInterface);
+    mpack_write_cstr(&writer, I2C_STATS_DEVICES_KEY);
+    mpack_start_array(&writer, numDevices);
+    for(int i = 0; i < numDevices; ++i) {
+        get_i2c_device_stats(i2cInterface, i, &deviceStats);
+
+        mpack_start_array(&writer, 3);
+        mpack_write_i8(&writer, deviceStats.mChannel);
+        mpack_write_u8(&writer, deviceStats.mAddress);
+        pack_i2c_stats_internal(&deviceStats.mStats, &writer);
+        mpack_finish_array(&writer);
+    }
+    mpack_finish_array(&writer);
+
+    // Finish building the map
+    mpack_finish_map(&writer);
+
+    // Finish writing the data, which flushes whatever is left in the buffer
+    response.mErrorCode = mpack_writer_destroy(&writer);
+    response.mBytesUsed = context.mBytesFlushed;
+
+    return response;
+}
+
+void flush_streamed_pack_writer(mpack_writer_t *writer, const char *buffer, size_t count) {
+    PackFlushContext *flushContext = (PackFlushContext *) mpack_writer_context(writer);
+
+    flushContext->mFlush(flushContext->mContext, (const uint8_t *) buffer, count);
+    flushContext->mBytesFlushed += count;
+}
+
+void init_streamed_pack_writer(mpack_writer_t *writer, PackFlushContext *flushContext, char *outBuf, size_t outBufSize) {
+    flushContext->mBytesFlushed = 0;
+
+    mpack_writer_init(writer, outBuf, outBufSize);
+    mpack_writer_set_context(writer, flushContext);
+    mpack_writer_set_flush(writer, flush_streamed_pack_writer);
+}
+
+PackResponse build_sensor_packet_cache(MsgPackSensorPacket *sensorPacket) {
+    PackResponse response = {0, mpack_error_bug};
+    MsgPackSensorPacketCache *cache;
+
+    if(!sensorPacket) {
+        return response;
+    }
+
+    cache = &sensorPacket->mPacketCache;
+    cache->mPacketSize = 0;
+
+    if(sensorPacket->mCurrentSensorData.mNumReadings > MAX_CACHED_SENSOR_READINGS) {
+        response.mErrorCode = mpack_error_too_big;
+        return response;
+    }
+
+    response = pack_sensor_packet_data(sensorPacket, (char *) cache->mPacketBytes, SENSOR_PACKET_CACHE_SIZE, cache);
+    if(!response.mErrorCode) {
+        cache->mPacketSize = response.mBytesUsed;
+        update_sensor_packet_cache(sensorPacket);
+    }
+
+    return response;
+}
+
+void update_sensor_packet_cache(MsgPackSensorPacket *sensorPacket) {
+    if(!sensorPacket || !sensorPacket->mPacketCache.mPacketSize) {
+        return;
+    }
+
+    MsgPackSensorPacketCache *cache = &sensorPacket->mPacketCache;
+    const MsgPackSensorData *sensorData = &sensorPacket->mCurrentSensorData;
+
+    cache->mPacketBytes[cache->mStatusOffset + 1] = sensorData->mStatus;
+
+    for(int i = 0; i < sensorData->mNumReadings; ++i) {
+        patch_reading_value(
+            sensorData->mSensorReadings[i].mDescription->mType,
+            sensorData->mSensorReadings[i].mValue,
+            &cache->mPacketBytes[cache->mReadingValueOffsets[i]]
+        );
+    }
+}
+
 const char * error_to_string(mpack_error_t error) {
     switch(error) {
         case mpack_ok:
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include "hardware/sensors/sensor.h"
 #include "command_definitions.h"
+#include "mpack/mpack.h"
 
 /**
  *              /------------------------------------\
@@ -51,6 +52,72 @@
  *          ]
  *      }
  *      
+ *      // Sensor values packet (compact response, reading descriptions are fetched once via the sensor data packets)
+ *      {
+ *          "packet_id" : 3,                                    <- Packet type identifier. Set to SENSOR_VALUES_PACKET for this packet
+ *          "sensor_values" : [                                 <- One entry per sensor
+ *              [ 0, 3, [ 412 ] ],                              <- [sensor_id, sensor_status, [reading values, in reading ID order]]
+ *              [ 2, 3, [ 623.1, 23.5, 51.0, 614 ] ],
+ *              ....
+ *          ]
+ *      }
+ *      
+ *      // Sensor history packet (response to GET_SENSOR_HISTORY, see sensor_history.h for the row layout)
+ *      {
+ *          "packet_id" : 4,                                    <- Packet type identifier. Set to SENSOR_HISTORY_PACKET for this packet
+ *          "time_ms" : 123456,                                 <- Controller time (ms since boot) when the packet was built
+ *          "interval_ms" : 10000,                              <- Time between recorded rows
+ *          "layout" : [                                        <- One entry per sensor, in the order they appear in each row
+ *              [ 0, [ 0, 0 ] ],                                <- [sensor_id, [decimal places of each reading value]]
+ *              [ 2, [ 0, 2, 2, 0 ] ],
+ *              ....
+ *          ],
+ *          "rows" : <bin>                                      <- Packed rows, oldest first
+ *      }
+ *      
+ *      // Sensor log packet (response to GET_SENSOR_LOG, see sensor_flash_log.h)
+ *      {
+ *          "packet_id" : 5,                                    <- Packet type identifier. Set to SENSOR_LOG_PACKET for this packet
+ *          "time_ms" : 123456,                                 <- Controller time (ms since boot) when the packet was built
+ *          "boot" : 12,                                        <- Current boot count. Row timestamps are ms since the boot of their record
+ *          "layout" : [ ... ],                                 <- As in the history packet
+ *          "records" : [                                       <- Committed records, oldest first
+ *              [ 40, 11, <bin> ],                              <- [sequence, boot count, packed rows in the history packet form]
+ *              ....
+ *          ],
+ *          "next_sequence" : 41                                <- Sequence to ask for to carry on from here
+ *      }
+ *      
+ *      // Perf stats packet (response to GET_PERF_STATS, see perf_stats.h)
+ *      {
+ *          "packet_id" : 6,                                    <- Packet type identifier. Set to PERF_STATS_PACKET for this packet
+ *          "time_ms" : 123456,                                 <- Controller time (ms since boot) when the packet was built
+ *          "stages" : [                                        <- One entry per timed stage, since boot
+ *              [ 0, "Core 0 loop", 5120, 3, 41, 2210, [ ... ] ],   <- [stage_id, name, count, min us, average us, max us, [histogram]]
+ *              ....                                                   Histogram bucket 0 is 0us, bucket n is [2^(n-1), 2^n) us
+ *          ]
+ *      }
+ *      
+ *      // I2C stats packet (response to GET_I2C_STATS, counted since "reset_ms")
+ *      {
+ *          "packet_id" : 7,                                    <- Packet type identifier. Set to I2C_STATS_PACKET for this packet
+ *          "time_ms" : 123456,                                 <- Controller time (ms since boot) when the packet was built
+ *          "reset_ms" : 0,                                     <- Controller time the counters were last cleared
+ *          "bus_resets" : 0,                                   <- Bus resets, including interface watchdog resets
+ *          "untracked" : 0,                                    <- Transactions with devices beyond the device table
+ *          "channels" : [                                      <- One entry per multiplexer channel, then one (channel -1) for direct devices
+ *              [ 0, 400000, [ ... ] ],                         <- [channel, current baud rate, [stats]]
+ *              ....
+ *          ],
+ *          "devices" : [                                       <- One entry per device seen
+ *              [ 2, 97, [ ... ] ],                             <- [channel, address, [stats]]
+ *              ....
+ *          ]
+ *      }
+ *      
+ *      // I2C stats: [transactions, bytes, timeouts, NACKs, other errors, CRC failures, average latency us, max latency us,
+ *      //             [latency histogram]] with histogram buckets as in the perf stats packet
+ *      
  *      // Terminator packet
  *      {
  *          "packet_id" : 255,                                  <- Packet type identifier. Set to TERMINATOR for this packet
@@ -63,6 +130,11 @@ typedef enum {
     HEADER_PACKET               = 0x00,
     SENSOR_DATA_PACKET          = 0x01,
     SENSOR_DESCRIPTION_PACKET   = 0x02,
+    SENSOR_VALUES_PACKET        = 0x03,
+    SENSOR_HISTORY_PACKET       = 0x04,
+    SENSOR_LOG_PACKET           = 0x05,
+    PERF_STATS_PACKET           = 0x06,
+    I2C_STATS_PACKET            = 0x07,
     HEARTBEAT_PACKET            = 0xFD,
     CONTROLLER_READY_PACKET     = 0xFE,
     TERMINATOR_PACKET           = 0xFF
@@ -77,6 +149,7 @@ typedef enum {
 
 typedef enum {
     SONAR_SENSOR_READING_INDEX              = 0,
+    SONAR_SENSOR_CONFIDENCE_READING_INDEX   = 1,
     SENSOR_POD_CO2_READING_INDEX            = 0,
     SENSOR_POD_TEMPERATURE_READING_INDEX    = 1,
     SENSOR_POD_RH_READING_INDEX             = 2,
@@ -128,12 +201,26 @@ typedef struct {
     MsgPackSensorReading *mSensorReadings;                      // Each individual sensor reading
 } MsgPackSensorData;
 
+// Pre-serialized copy of a sensor data packet. Only the status and reading values ever change, so they are
+// packed at their widest msgpack encoding and patched in place rather than re-packing the whole packet
+#define SENSOR_PACKET_CACHE_SIZE            (768)
+#define MAX_CACHED_SENSOR_READINGS          (4)
+
+typedef struct {
+    uint8_t mPacketBytes[SENSOR_PACKET_CACHE_SIZE];             // Packed sensor data packet
+    size_t mPacketSize;                                         // Number of packed bytes (0 = cache not built)
+    size_t mStatusOffset;                                       // Offset of the packed status value
+    size_t mReadingValueOffsets[MAX_CACHED_SENSOR_READINGS];    // Offset of each packed reading value
+} MsgPackSensorPacketCache;
+
 typedef struct {
     uint8_t mSensorID;                                          // Unique sensor identification value
     const char *mSensorName;                                    // Sensor name/description
     SensorType mSensorType;                                     // The type of sensor this packet describes (is not transmitted)
     MsgPackSensorCalibrationParameters mCalibrationParams;      // Calibration type
     MsgPackSensorData mCurrentSensorData;                       // The current sensor data, plus reading definitions
+    MsgPackSensorPacketCache mPacketCache;                      // Ready-to-send copy of this packet (see build_sensor_packet_cache)
+    uint32_t mChangeCount;                                      // Bumped whenever the status or a reading value changes
 } MsgPackSensorPacket;
 
 typedef struct {
@@ -142,6 +229,20 @@ typedef struct {
 } HeaderPacket;
 
 
+// Receives the bytes of a packet which is streamed out as it is packed
+typedef void (*PackFlushFunction)(void *context, const uint8_t *data, size_t numBytes);
+
+// Where a streamed packet's bytes go, see init_streamed_pack_writer()
+typedef struct {
+    PackFlushFunction mFlush;
+    void *mContext;
+    size_t mBytesFlushed;                   // Bytes handed to mFlush so far
+} PackFlushContext;
+
+// Keys shared with packers outside sensor_msgpack.c
+extern const char *PACKET_ID_KEY;
+
+
 // msgpack packing status response
 typedef struct {        
     size_t mBytesUsed;                      // Number of bytes actually used by packing the data
@@ -166,4 +267,25 @@ PackResponse pack_terminator_packet(uint8_t terminatorCode, char* outBuf, size_t
 // Packs a data packet for a single sensor
 PackResponse pack_sensor_packet(const MsgPackSensorPacket * const sensorPacket, char* outBuf, size_t outBufSize);
 
+// Packs the current status and reading values of every sensor into a single compact packet
+PackResponse pack_sensor_values_packet(const MsgPackSensorPacket * const sensorPackets, uint8_t numSensors, char* outBuf, size_t outBufSize);
+
+// Packs the timing of every hot path stage (see perf_stats.h) as a single perf stats packet, streamed through flush
+PackResponse pack_perf_stats_packet(char* outBuf, size_t outBufSize, PackFlushFunction flush, void *flushContext);
+
+// Packs the transaction counters of a sensor bus, per channel and per device, as a single I2C stats packet streamed
+// through flush
+PackResponse pack_i2c_stats_packet(I2CInterface *i2cInterface, char* outBuf, size_t outBufSize, PackFlushFunction flush, void *flushContext);
+
+// Sets up a writer which uses outBuf as a staging buffer, passing its contents to flushContext->mFlush
+// whenever it fills and once the writer is destroyed. For packets of any size
+void init_streamed_pack_writer(mpack_writer_t *writer, PackFlushContext *flushContext, char *outBuf, size_t outBufSize);
+
+// Packs a sensor's data packet into its packet cache. Status and reading values are packed at a fixed width
+// so that update_sensor_packet_cache() can patch them without re-packing
+PackResponse build_sensor_packet_cache(MsgPackSensorPacket *sensorPacket);
+
+// Patches the current status and reading values of a sensor into its packet cache
+void update_sensor_packet_cache(MsgPackSensorPacket *sensorPacket);
+
 #endif  // SENSOR_MSGPACK_H
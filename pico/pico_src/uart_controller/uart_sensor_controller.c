@@ -7,15 +7,26 @@
 
 #include "sensor_definitions.h"
 #include "debug_io.h"
+#include "perf_stats.h"
 #include "utils.h"
 
+#include "hardware/dma.h"
+
 
 const uint32_t HEARTBEAT_TIMEOUT_MS = 5000;
+const uint32_t BAUDRATE_ACK_TIMEOUT_MS = 2000;          // How long the remote end has to acknowledge a baud rate change
+const uint32_t BAUDRATE_SWITCH_SETTLE_MS = 50;          // Gives the remote end time to switch before we talk at the new rate
+
+// Rates the remote end may move the controller link to
+const uint SUPPORTED_CONTROLLER_BAUDRATES[] = {
+    460800,
+    921600,
+    1000000
+};
 
 
 void reset_controller_interface(ControllerInterface *controllerInterface, bool resetHeartbeat);
 void send_heartbeat(ControllerInterface *controllerInterface);
-void handle_incoming_byte(ControllerInterface *controllerInterface, uint8_t b);
 void handle_sensor_controller_command(
     ControllerInterface *controllerInterface,
     MsgPackSensorPacket *sensorPackets,
@@ -32,11 +43,147 @@ void handle_send_sensor_data_command(
     MsgPackSensorPacket *sensorPackets,
     uint8_t numSensors
 );
+void handle_send_all_sensor_values_compact_command(
+    ControllerInterface *controllerInterface,
+    MsgPackSensorPacket *sensorPackets,
+    uint8_t numSensors
+);
+void handle_set_controller_baudrate_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+);
+void handle_heartbeat_ack_command(ControllerInterface *controllerInterface);
+void handle_subscribe_sensor_updates_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+);
+void handle_get_sensor_history_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+);
+void handle_get_sensor_log_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+);
+void handle_get_perf_stats_command(ControllerInterface *controllerInterface);
+void handle_get_i2c_stats_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+);
+
+// Releases the bytes sent by the last TX DMA transfer and hands the next contiguous span of the TX ring to
+// the DMA channel. Does nothing while a transfer is still running
+void service_tx_dma(ControllerInterface *controllerInterface) {
+    if(dma_channel_is_busy(controllerInterface->mTXDMAChannel)) {
+        return;
+    }
+
+    controllerInterface->mTXRingReadPos = (controllerInterface->mTXRingReadPos + controllerInterface->mTXInFlight) % TX_RING_SIZE;
+    controllerInterface->mTXRingCount -= controllerInterface->mTXInFlight;
+    controllerInterface->mTXInFlight = 0;
+
+    if(!controllerInterface->mTXRingCount) {
+        return;
+    }
+
+    size_t span = MIN(controllerInterface->mTXRingCount, (TX_RING_SIZE - controllerInterface->mTXRingReadPos));
+    controllerInterface->mTXInFlight = span;
+    dma_channel_transfer_from_buffer_now(
+        controllerInterface->mTXDMAChannel,
+        &controllerInterface->mTXRing[controllerInterface->mTXRingReadPos],
+        span
+    );
+}
+
+// Queues bytes for transmission and starts sending them. Only blocks if the TX ring is full
+void write_tx_bytes(
+    ControllerInterface *controllerInterface,
+    const uint8_t *data,
+    size_t numBytes
+) {
+    while(numBytes) {
+        size_t space = TX_RING_SIZE - controllerInterface->mTXRingCount;
+
+        if(!space) {
+            // Wait for the DMA to drain some of the ring. Long responses can keep us here for seconds, so keep
+            // up with incoming bytes too. Commands completed meanwhile wait in the pending commands
+            service_tx_dma(controllerInterface);
+            service_rx_dma(controllerInterface);
+            tight_loop_contents();
+            continue;
+        }
+
+        size_t writePos = (controllerInterface->mTXRingReadPos + controllerInterface->mTXRingCount) % TX_RING_SIZE;
+        size_t chunk = MIN(numBytes, MIN(space, (TX_RING_SIZE - writePos)));
+
+        memcpy(&controllerInterface->mTXRing[writePos], data, chunk);
+        controllerInterface->mTXRingCount += chunk;
+        data += chunk;
+        numBytes -= chunk;
+    }
+
+    service_tx_dma(controllerInterface);
+}
+
+// Waits until every queued outgoing byte has left the UART
+void flush_tx(ControllerInterface *controllerInterface) {
+    while(controllerInterface->mTXRingCount) {
+        service_tx_dma(controllerInterface);
+        service_rx_dma(controllerInterface);
+        tight_loop_contents();
+    }
+
+    uart_tx_wait_blocking(controllerInterface->mUART);
+}
+
+// Switches the controller link to a new baud rate, once everything queued at the current rate has been sent
+void set_controller_baudrate(ControllerInterface *controllerInterface, uint baudrate) {
+    flush_tx(controllerInterface);
+    uart_set_baudrate(controllerInterface->mUART, baudrate);
+    controllerInterface->mBaudrate = baudrate;
+
+    // Anything half received or still unparsed in the RX ring is from around the switch, and can't be trusted.
+    // Skip it, and only parse again from the next start byte
+    uint32_t received = UINT32_MAX - dma_hw->ch[controllerInterface->mRXDMAChannel].transfer_count;
+    uint32_t unread = received - controllerInterface->mRXRingReadCount;
+
+    controllerInterface->mRXRingReadPos = (controllerInterface->mRXRingReadPos + unread) % RX_RING_SIZE;
+    controllerInterface->mRXRingReadCount = received;
+    reset_controller_interface(controllerInterface, false);
+    controllerInterface->mCommandBufferState = AWAITING_START_BYTE;
+}
+
+// Flush target for packets streamed out as they are packed
+void write_streamed_msgpack_bytes(void *context, const uint8_t *data, size_t numBytes) {
+    write_tx_bytes((ControllerInterface *) context, data, numBytes);
+}
+
 void write_msgpack_bytes(
     ControllerInterface *controllerInterface,
     size_t numBytes
 ) {
-    uart_write_blocking(controllerInterface->mUART, controllerInterface->mMsgPackOutputBuffer, numBytes);
+    write_tx_bytes(controllerInterface, controllerInterface->mMsgPackOutputBuffer, numBytes);
+}
+
+// Sends a sensor's data packet, straight from its packet cache if it has been built
+void write_sensor_packet(
+    ControllerInterface *controllerInterface,
+    MsgPackSensorPacket *sensorPacket
+) {
+    if(sensorPacket->mPacketCache.mPacketSize) {
+        write_tx_bytes(controllerInterface, sensorPacket->mPacketCache.mPacketBytes, sensorPacket->mPacketCache.mPacketSize);
+        return;
+    }
+
+    PackResponse response = pack_sensor_packet(
+        sensorPacket,
+        controllerInterface->mMsgPackOutputBuffer,
+        MPACK_OUT_BUFFER_SIZE
+    );
+
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
 }
 
 // Resets the interface back to an initial state
@@ -53,20 +200,8 @@ void reset_controller_interface(
     }
 }
 
-// Process an incoming serial byte and create a response, if necessary
-void handle_incoming_byte(ControllerInterface *controllerInterface, uint8_t b) {
-    if(b == COMMAND_START_BYTE) {
-        reset_controller_interface(controllerInterface, false);
-        return;
-    }
-    
-    controllerInterface->mCommandBuffer[controllerInterface->mCurrentBufferPos++] = b;
-
-    if(controllerInterface->mCurrentBufferPos != COMMAND_LENGTH) {
-        controllerInterface->mCommandBufferState = PROCESSING_COMMAND_DATA;
-        return;
-    }
-    
+// Validates a command buffer holding COMMAND_LENGTH bytes and sets the buffer state accordingly
+void complete_command_buffer(ControllerInterface *controllerInterface) {
     // We have a complete command, reset the buffer position and process the command
     controllerInterface->mCurrentBufferPos = 0;
 
@@ -87,6 +222,128 @@ void handle_incoming_byte(ControllerInterface *controllerInterface, uint8_t b) {
     controllerInterface->mCurrentCommand = (SensorCommandIdentifier) controllerInterface->mCommandBuffer[0];
 }
 
+// Queues the command buffer once a command has been completed (or drops it if rejected) and readies it for the
+// next one. Commands are handled later by handle_pending_commands, never while bytes are being parsed
+void queue_command_buffer(ControllerInterface *controllerInterface) {
+    switch(controllerInterface->mCommandBufferState) {
+        case HAS_COMPLETE_COMMAND:
+            if(controllerInterface->mPendingCommandsCount < PENDING_COMMANDS_LENGTH) {
+                size_t writePos = (controllerInterface->mPendingCommandsReadPos + controllerInterface->mPendingCommandsCount) % PENDING_COMMANDS_LENGTH;
+                memcpy(controllerInterface->mPendingCommands[writePos], controllerInterface->mCommandBuffer, COMMAND_LENGTH);
+                controllerInterface->mPendingCommandsCount++;
+            } else {
+                controllerInterface->mDroppedCommands++;
+            }
+            reset_controller_interface(controllerInterface, false);
+            break;
+        case HAS_INVALID_COMMAND_DATA:
+            reset_controller_interface(controllerInterface, false);
+            break;
+        default:
+            break;
+    }
+}
+
+// Handles every pending command, oldest first. Responses can take long enough for more commands to arrive, and
+// they are handled in the same call. Commands after a baud rate change wait until it has settled
+void handle_pending_commands(ControllerInterface *controllerInterface) {
+    while(controllerInterface->mPendingCommandsCount && (controllerInterface->mBaudrateState != BAUDRATE_SETTLING)) {
+        memcpy(controllerInterface->mHandledCommand, controllerInterface->mPendingCommands[controllerInterface->mPendingCommandsReadPos], COMMAND_LENGTH);
+        controllerInterface->mPendingCommandsReadPos = (controllerInterface->mPendingCommandsReadPos + 1) % PENDING_COMMANDS_LENGTH;
+        controllerInterface->mPendingCommandsCount--;
+
+        handle_sensor_controller_command(
+            controllerInterface,
+            controllerInterface->mMsgPackSensors,
+            controllerInterface->mNumMsgPackSensors
+        );
+    }
+}
+
+// Runs a contiguous span of incoming bytes through the command parser, queueing every command completed within
+// it. A start byte begins a new command, discarding anything buffered, and the COMMAND_LENGTH bytes after it
+// are copied in as one run
+void handle_incoming_bytes(ControllerInterface *controllerInterface, const uint8_t *bytes, size_t numBytes) {
+    while(numBytes) {
+        // After lost bytes nothing can be trusted until the next start byte
+        if(controllerInterface->mCommandBufferState == AWAITING_START_BYTE) {
+            const uint8_t *startByte = memchr(bytes, COMMAND_START_BYTE, numBytes);
+            if(!startByte) {
+                return;
+            }
+
+            reset_controller_interface(controllerInterface, false);
+            numBytes -= (size_t) (startByte - bytes) + 1;
+            bytes = startByte + 1;
+            continue;
+        }
+
+        size_t needed = COMMAND_LENGTH - controllerInterface->mCurrentBufferPos;
+        size_t run = MIN(needed, numBytes);
+        const uint8_t *startByte = memchr(bytes, COMMAND_START_BYTE, run);
+
+        // A start byte discards anything buffered so far, including the bytes before it in this run
+        if(startByte) {
+            reset_controller_interface(controllerInterface, false);
+            numBytes -= (size_t) (startByte - bytes) + 1;
+            bytes = startByte + 1;
+            continue;
+        }
+
+        memcpy(&controllerInterface->mCommandBuffer[controllerInterface->mCurrentBufferPos], bytes, run);
+        controllerInterface->mCurrentBufferPos += run;
+        bytes += run;
+        numBytes -= run;
+
+        if(controllerInterface->mCurrentBufferPos != COMMAND_LENGTH) {
+            controllerInterface->mCommandBufferState = PROCESSING_COMMAND_DATA;
+            continue;
+        }
+
+        complete_command_buffer(controllerInterface);
+        queue_command_buffer(controllerInterface);
+    }
+}
+
+// Parses everything the RX DMA has written to the RX ring since the last call, one contiguous span at a time.
+// Only queues the commands it completes, so it can be called while a response is being sent
+void service_rx_dma(ControllerInterface *controllerInterface) {
+    bool countExhausted = !dma_channel_is_busy(controllerInterface->mRXDMAChannel);
+
+    // The channel counts down from its (very large) transfer count, so the difference is the bytes it has written
+    uint32_t received = UINT32_MAX - dma_hw->ch[controllerInterface->mRXDMAChannel].transfer_count;
+    uint32_t unread = received - controllerInterface->mRXRingReadCount;
+
+    // The DMA has lapped us and overwritten bytes we never parsed. Skip to the oldest byte still in the ring, and
+    // drop whatever command was half parsed, as it is missing bytes
+    if(unread > RX_RING_SIZE) {
+        uint32_t lost = unread - RX_RING_SIZE;
+
+        controllerInterface->mRXOverrunBytes += lost;
+        controllerInterface->mRXRingReadPos = (controllerInterface->mRXRingReadPos + lost) % RX_RING_SIZE;
+        unread = RX_RING_SIZE;
+        reset_controller_interface(controllerInterface, false);
+        controllerInterface->mCommandBufferState = AWAITING_START_BYTE;
+        DEBUG_PRINT("Controller RX ring overrun, %u bytes lost\n", (uint) lost);
+    }
+
+    while(unread) {
+        size_t span = MIN(unread, (RX_RING_SIZE - controllerInterface->mRXRingReadPos));
+        const uint8_t *bytes = &controllerInterface->mRXRing[controllerInterface->mRXRingReadPos];
+
+        controllerInterface->mRXRingReadPos = (controllerInterface->mRXRingReadPos + span) % RX_RING_SIZE;
+        unread -= span;
+        handle_incoming_bytes(controllerInterface, bytes, span);
+    }
+    controllerInterface->mRXRingReadCount = received;
+
+    // Only needs re-arming if the count ever runs out. The channel carries on around the ring from where it stopped
+    if(countExhausted) {
+        dma_channel_set_trans_count(controllerInterface->mRXDMAChannel, UINT32_MAX, true);
+        controllerInterface->mRXRingReadCount = 0;
+    }
+}
+
 void handle_calibrate_sensor_command(
     MsgPackSensorPacket *sensorPackets,
     int numSensors, 
@@ -126,11 +383,11 @@ void handle_sensor_controller_command(
     MsgPackSensorPacket *sensorPackets,
     uint8_t numSensors
 ) {
-    uint8_t *argumentBytes = &(controllerInterface->mCommandBuffer[1]);
+    uint8_t *argumentBytes = &(controllerInterface->mHandledCommand[1]);
 
     uint8_t sensorID = 0;
 
-    switch(controllerInterface->mCurrentCommand) {
+    switch((SensorCommandIdentifier) controllerInterface->mHandledCommand[0]) {
         case GET_ALL_SENSOR_VALUES:
             handle_send_all_sensor_data_command(
                 controllerInterface,
@@ -138,6 +395,13 @@ void handle_sensor_controller_command(
                 numSensors
             );
             break;
+        case GET_ALL_SENSOR_VALUES_COMPACT:
+            handle_send_all_sensor_values_compact_command(
+                controllerInterface,
+                sensorPackets,
+                numSensors
+            );
+            break;
         case GET_SENSOR_VALUE:
             sensorID = argumentBytes[0];
             // handle_send_sensor_data_command(sensorID);
@@ -148,6 +412,27 @@ void handle_sensor_controller_command(
         case CALIBRATE_SENSOR:
             handle_calibrate_sensor_command(sensorPackets, numSensors, argumentBytes);
             break;
+        case SET_CONTROLLER_BAUDRATE:
+            handle_set_controller_baudrate_command(controllerInterface, argumentBytes);
+            break;
+        case HEARTBEAT_ACK:
+            handle_heartbeat_ack_command(controllerInterface);
+            break;
+        case SUBSCRIBE_SENSOR_UPDATES:
+            handle_subscribe_sensor_updates_command(controllerInterface, argumentBytes);
+            break;
+        case GET_SENSOR_HISTORY:
+            handle_get_sensor_history_command(controllerInterface, argumentBytes);
+            break;
+        case GET_SENSOR_LOG:
+            handle_get_sensor_log_command(controllerInterface, argumentBytes);
+            break;
+        case GET_PERF_STATS:
+            handle_get_perf_stats_command(controllerInterface);
+            break;
+        case GET_I2C_STATS:
+            handle_get_i2c_stats_command(controllerInterface, argumentBytes);
+            break;
         case NO_COMMAND:
         default:
             break;
@@ -177,21 +462,42 @@ void handle_send_all_sensor_data_command(
 
     // Pack and send sensor data
     for(int i = 0; i < NUM_SENSORS; ++i) {
-        MsgPackSensorPacket *m = &controllerInterface->mMsgPackSensors[i];
+        write_sensor_packet(controllerInterface, &controllerInterface->mMsgPackSensors[i]);
+    }
 
-        response = pack_sensor_packet(
-            m,
-            controllerInterface->mMsgPackOutputBuffer,
-            MPACK_OUT_BUFFER_SIZE
-        );
+    // Pack and send terminator packet
+    response = pack_terminator_packet(GET_ALL_SENSOR_VALUES, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+}
 
-        if(!response.mErrorCode) {
-            write_msgpack_bytes(controllerInterface, response.mBytesUsed);
-        }
+// Send the status and values of all sensors in a single compact packet
+void handle_send_all_sensor_values_compact_command(
+    ControllerInterface *controllerInterface,
+    MsgPackSensorPacket *sensorPackets,
+    uint8_t numSensors
+) {
+    PackResponse response;
+    HeaderPacket headerPacket = {
+        GET_ALL_SENSOR_VALUES_COMPACT,
+        COMMAND_OK,
+    };
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    // Pack and send sensor values
+    response = pack_sensor_values_packet(sensorPackets, numSensors, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
     }
 
     // Pack and send terminator packet
-    response = pack_terminator_packet(GET_ALL_SENSOR_VALUES, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    response = pack_terminator_packet(GET_ALL_SENSOR_VALUES_COMPACT, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
     if(!response.mErrorCode) {
         write_msgpack_bytes(controllerInterface, response.mBytesUsed);
     }
@@ -223,24 +529,333 @@ void handle_send_sensor_data_command(
 
     // Pack and send sensor data
     if(headerPacket.mResponseCode == COMMAND_OK) {
-        response = pack_sensor_packet(
-            &controllerInterface->mMsgPackSensors[sensorID], 
-            controllerInterface->mMsgPackOutputBuffer, 
-            MPACK_OUT_BUFFER_SIZE
+        write_sensor_packet(controllerInterface, &controllerInterface->mMsgPackSensors[sensorID]);
+    }
+
+    // Pack and send terminator packet
+    response = pack_terminator_packet(GET_SENSOR_VALUE, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+}
+
+// Respond to a proposed baud rate and, if it is supported, switch to it. The response goes out at the current
+// rate. Once the switch has settled, update_uart_sensor_controller sends the controller ready packet and a
+// heartbeat at the new rate, and falls back if the remote end does not acknowledge with a HEARTBEAT_ACK in time
+void handle_set_controller_baudrate_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+) {
+    PackResponse response;
+    uint baudrate = ((uint) argumentBytes[0] << 24) | ((uint) argumentBytes[1] << 16) | ((uint) argumentBytes[2] << 8) | argumentBytes[3];
+    HeaderPacket headerPacket = {
+        SET_CONTROLLER_BAUDRATE,
+        BAUDRATE_NOT_SUPPORTED,
+    };
+
+    for(int i = 0; i < (sizeof(SUPPORTED_CONTROLLER_BAUDRATES) / sizeof(SUPPORTED_CONTROLLER_BAUDRATES[0])); ++i) {
+        if(SUPPORTED_CONTROLLER_BAUDRATES[i] == baudrate) {
+            headerPacket.mResponseCode = COMMAND_OK;
+        }
+    }
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    // Pack and send terminator packet
+    response = pack_terminator_packet(SET_CONTROLLER_BAUDRATE, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    if(headerPacket.mResponseCode != COMMAND_OK) {
+        return;
+    }
+
+    // A proposal made before the last one was acknowledged still falls back to the last confirmed rate
+    if(controllerInterface->mBaudrateState == BAUDRATE_CONFIRMED) {
+        controllerInterface->mFallbackBaudrate = controllerInterface->mBaudrate;
+    }
+
+    DEBUG_PRINT("Switching controller link from %u to %u baud\n", controllerInterface->mBaudrate, baudrate);
+    set_controller_baudrate(controllerInterface, baudrate);
+
+    controllerInterface->mBaudrateState = BAUDRATE_SETTLING;
+    controllerInterface->mBaudrateSettleTime = MILLIS() + BAUDRATE_SWITCH_SETTLE_MS;
+}
+
+// The remote end has heard us, so any baud rate change in progress is confirmed
+void handle_heartbeat_ack_command(ControllerInterface *controllerInterface) {
+    if(controllerInterface->mBaudrateState == BAUDRATE_AWAITING_ACK) {
+        DEBUG_PRINT("Controller link confirmed at %u baud\n", controllerInterface->mBaudrate);
+        controllerInterface->mBaudrateState = BAUDRATE_CONFIRMED;
+    }
+}
+
+// Subscribe to (or unsubscribe from) pushed updates for one sensor, or for all of them
+void handle_subscribe_sensor_updates_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+) {
+    PackResponse response;
+    uint8_t sensorID = argumentBytes[0];
+    bool subscribe = (argumentBytes[1] != 0);
+    uint16_t minIntervalMS = (uint16_t) (((argumentBytes[2] & 0x7F) << 7) | (argumentBytes[3] & 0x7F));
+    uint32_t currentTimeMS = MILLIS();
+    HeaderPacket headerPacket = {
+        SUBSCRIBE_SENSOR_UPDATES,
+        SENSOR_NOT_FOUND,
+    };
+
+    for(int i = 0; (i < controllerInterface->mNumMsgPackSensors) && (i < MAX_SUBSCRIBED_SENSORS); ++i) {
+        MsgPackSensorPacket *sensorPacket = &controllerInterface->mMsgPackSensors[i];
+        SensorSubscription *subscription = &controllerInterface->mSubscriptions[i];
+
+        if((sensorID != ALL_SENSORS_ID) && (sensorID != sensorPacket->mSensorID)) {
+            continue;
+        }
+
+        // New subscriptions are due straight away, so the remote end starts with the current data
+        subscription->mSubscribed = subscribe;
+        subscription->mMinIntervalMS = minIntervalMS;
+        subscription->mLastSentTime = currentTimeMS - minIntervalMS;
+        subscription->mLastSentChangeCount = sensorPacket->mChangeCount - 1;
+        headerPacket.mResponseCode = COMMAND_OK;
+    }
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    // Pack and send terminator packet
+    response = pack_terminator_packet(SUBSCRIBE_SENSOR_UPDATES, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+}
+
+// Seconds since boot as milliseconds, clamped to the range of millisecond times rather than wrapping
+uint32_t history_seconds_to_ms(uint32_t seconds) {
+    return (uint32_t) MIN((uint64_t) seconds * 1000, (uint64_t) UINT32_MAX);
+}
+
+// Send the recorded readings within the requested range in a single history packet, so the remote end can
+// catch up on anything it missed in one transfer
+void handle_get_sensor_history_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+) {
+    PackResponse response;
+    uint32_t startSeconds = ((argumentBytes[0] & 0x7F) << 21) | ((argumentBytes[1] & 0x7F) << 14) | ((argumentBytes[2] & 0x7F) << 7) | (argumentBytes[3] & 0x7F);
+    uint32_t endSeconds = ((argumentBytes[4] & 0x7F) << 21) | ((argumentBytes[5] & 0x7F) << 14) | ((argumentBytes[6] & 0x7F) << 7) | (argumentBytes[7] & 0x7F);
+    uint32_t startMS = history_seconds_to_ms(startSeconds);
+    uint32_t endMS = endSeconds ? history_seconds_to_ms(endSeconds) : MILLIS();
+    HeaderPacket headerPacket = {
+        GET_SENSOR_HISTORY,
+        controllerInterface->mHistory ? COMMAND_OK : HISTORY_NOT_AVAILABLE,
+    };
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    // Pack and stream the history packet. It can be far larger than the output buffer
+    if(headerPacket.mResponseCode == COMMAND_OK) {
+        response = pack_sensor_history_packet(
+            controllerInterface->mHistory,
+            controllerInterface->mMsgPackSensors,
+            controllerInterface->mNumMsgPackSensors,
+            startMS,
+            endMS,
+            controllerInterface->mMsgPackOutputBuffer,
+            MPACK_OUT_BUFFER_SIZE,
+            write_streamed_msgpack_bytes,
+            controllerInterface
         );
+        if(response.mErrorCode) {
+            DEBUG_PRINT("Sensor history packing failed (error %d)\n", response.mErrorCode);
+        }
+    }
 
-        if(!response.mErrorCode) {
-            write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    // Pack and send terminator packet
+    response = pack_terminator_packet(GET_SENSOR_HISTORY, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+}
+
+// Send the flash log records from the requested sequence onwards in a single log packet. The remote end keeps
+// asking with the returned next sequence until no more records come back
+void handle_get_sensor_log_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+) {
+    PackResponse response;
+    uint32_t fromSequence = ((argumentBytes[0] & 0x7F) << 21) | ((argumentBytes[1] & 0x7F) << 14) | ((argumentBytes[2] & 0x7F) << 7) | (argumentBytes[3] & 0x7F);
+    uint8_t maxRecords = argumentBytes[4];
+    HeaderPacket headerPacket = {
+        GET_SENSOR_LOG,
+        controllerInterface->mLog ? COMMAND_OK : HISTORY_NOT_AVAILABLE,
+    };
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    // Pack and stream the log packet. It can be far larger than the output buffer
+    if(headerPacket.mResponseCode == COMMAND_OK) {
+        response = pack_sensor_flash_log_packet(
+            controllerInterface->mLog,
+            fromSequence,
+            maxRecords,
+            controllerInterface->mMsgPackOutputBuffer,
+            MPACK_OUT_BUFFER_SIZE,
+            write_streamed_msgpack_bytes,
+            controllerInterface
+        );
+        if(response.mErrorCode) {
+            DEBUG_PRINT("Sensor log packing failed (error %d)\n", response.mErrorCode);
         }
     }
 
     // Pack and send terminator packet
-    response = pack_terminator_packet(GET_SENSOR_VALUE, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    response = pack_terminator_packet(GET_SENSOR_LOG, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+}
+
+// Send the timing stats of every hot path stage
+void handle_get_perf_stats_command(ControllerInterface *controllerInterface) {
+    PackResponse response;
+    HeaderPacket headerPacket = {
+        GET_PERF_STATS,
+        PERF_STATS_ON ? COMMAND_OK : PERF_STATS_NOT_AVAILABLE,
+    };
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+#if PERF_STATS_ON
+    // Pack and stream the stats packet. It is larger than the output buffer
+    response = pack_perf_stats_packet(
+        controllerInterface->mMsgPackOutputBuffer,
+        MPACK_OUT_BUFFER_SIZE,
+        write_streamed_msgpack_bytes,
+        controllerInterface
+    );
+    if(response.mErrorCode) {
+        DEBUG_PRINT("Perf stats packing failed (error %d)\n", response.mErrorCode);
+    }
+#endif
+
+    // Pack and send terminator packet
+    response = pack_terminator_packet(GET_PERF_STATS, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
     if(!response.mErrorCode) {
         write_msgpack_bytes(controllerInterface, response.mBytesUsed);
     }
 }
 
+// Send the sensor bus transaction counters, clearing them afterwards if asked, so the remote end can sample
+// them over fixed periods
+void handle_get_i2c_stats_command(
+    ControllerInterface *controllerInterface,
+    uint8_t *argumentBytes
+) {
+    PackResponse response;
+    bool reset = (argumentBytes[0] == 1);
+    HeaderPacket headerPacket = {
+        GET_I2C_STATS,
+        controllerInterface->mSensorBus ? COMMAND_OK : I2C_STATS_NOT_AVAILABLE,
+    };
+
+    // Pack and send the header data
+    response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+
+    // Pack and stream the stats packet. It is larger than the output buffer
+    if(headerPacket.mResponseCode == COMMAND_OK) {
+        response = pack_i2c_stats_packet(
+            controllerInterface->mSensorBus,
+            controllerInterface->mMsgPackOutputBuffer,
+            MPACK_OUT_BUFFER_SIZE,
+            write_streamed_msgpack_bytes,
+            controllerInterface
+        );
+        if(response.mErrorCode) {
+            DEBUG_PRINT("I2C stats packing failed (error %d)\n", response.mErrorCode);
+        }
+
+        if(reset) {
+            request_i2c_stats_reset(controllerInterface->mSensorBus);
+        }
+    }
+
+    // Pack and send terminator packet
+    response = pack_terminator_packet(GET_I2C_STATS, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+    if(!response.mErrorCode) {
+        write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+    }
+}
+
+// Push the data packet of every subscribed sensor which has changed since it was last sent, as long as its
+// minimum interval has passed. Changes within the interval are not lost, the latest data goes out once it ends
+void send_sensor_subscription_updates(ControllerInterface *controllerInterface) {
+    PackResponse response;
+    HeaderPacket headerPacket = {
+        SUBSCRIBE_SENSOR_UPDATES,
+        SENSOR_UPDATE,
+    };
+    uint32_t currentTimeMS = MILLIS();
+    bool sentHeader = false;
+
+    for(int i = 0; (i < controllerInterface->mNumMsgPackSensors) && (i < MAX_SUBSCRIBED_SENSORS); ++i) {
+        MsgPackSensorPacket *sensorPacket = &controllerInterface->mMsgPackSensors[i];
+        SensorSubscription *subscription = &controllerInterface->mSubscriptions[i];
+
+        if(!subscription->mSubscribed ||
+           (subscription->mLastSentChangeCount == sensorPacket->mChangeCount) ||
+           ((currentTimeMS - subscription->mLastSentTime) < subscription->mMinIntervalMS)) {
+            continue;
+        }
+
+        // Every changed sensor goes out in the same response
+        if(!sentHeader) {
+            response = pack_header_data(headerPacket, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+            if(!response.mErrorCode) {
+                write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+            }
+            sentHeader = true;
+        }
+
+        write_sensor_packet(controllerInterface, sensorPacket);
+        subscription->mLastSentTime = currentTimeMS;
+        subscription->mLastSentChangeCount = sensorPacket->mChangeCount;
+    }
+
+    // Pack and send terminator packet
+    if(sentHeader) {
+        response = pack_terminator_packet(SUBSCRIBE_SENSOR_UPDATES, controllerInterface->mMsgPackOutputBuffer, MPACK_OUT_BUFFER_SIZE);
+        if(!response.mErrorCode) {
+            write_msgpack_bytes(controllerInterface, response.mBytesUsed);
+        }
+    }
+}
+
 // Initialize serial interface and controller port
 void init_sensor_controller(
     ControllerInterface *controllerInterface,
@@ -250,13 +865,70 @@ void init_sensor_controller(
 ) {
     // Set up our UART with the required speed.
     uart_init(controllerInterface->mUART, baudrate);
+    controllerInterface->mBaudrate = baudrate;
+    controllerInterface->mFallbackBaudrate = baudrate;
+    controllerInterface->mBaudrateState = BAUDRATE_CONFIRMED;
+    memset(controllerInterface->mSubscriptions, 0, sizeof(controllerInterface->mSubscriptions));
 
     // Set the TX and RX pins by using the function select on the GPIO
     // Set datasheet for more information on function select
     gpio_set_function(txPin, GPIO_FUNC_UART);
     gpio_set_function(rxPin, GPIO_FUNC_UART);
 
+    // Set up the DMA channel which feeds the UART TX FIFO from the TX ring
+    controllerInterface->mTXDMAChannel = dma_claim_unused_channel(true);
+    controllerInterface->mTXRingReadPos = 0;
+    controllerInterface->mTXRingCount = 0;
+    controllerInterface->mTXInFlight = 0;
+
+    dma_channel_config txConfig = dma_channel_get_default_config(controllerInterface->mTXDMAChannel);
+    channel_config_set_transfer_data_size(&txConfig, DMA_SIZE_8);
+    channel_config_set_read_increment(&txConfig, true);
+    channel_config_set_write_increment(&txConfig, false);
+    channel_config_set_dreq(&txConfig, uart_get_dreq(controllerInterface->mUART, true));
+    dma_channel_configure(
+        controllerInterface->mTXDMAChannel,
+        &txConfig,
+        &uart_get_hw(controllerInterface->mUART)->dr,
+        NULL,
+        0,
+        false
+    );
+
+    // Set up the DMA channel which drains the UART RX FIFO into the RX ring. The write address wraps around the
+    // ring, so the channel runs continuously and its write address marks the end of the received data
+    controllerInterface->mRXDMAChannel = dma_claim_unused_channel(true);
+    controllerInterface->mRXRingReadPos = 0;
+    controllerInterface->mRXRingReadCount = 0;
+    controllerInterface->mRXOverrunBytes = 0;
+    controllerInterface->mPendingCommandsReadPos = 0;
+    controllerInterface->mPendingCommandsCount = 0;
+    controllerInterface->mDroppedCommands = 0;
+
+    dma_channel_config rxConfig = dma_channel_get_default_config(controllerInterface->mRXDMAChannel);
+    channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_8);
+    channel_config_set_read_increment(&rxConfig, false);
+    channel_config_set_write_increment(&rxConfig, true);
+    channel_config_set_ring(&rxConfig, true, RX_RING_SIZE_BITS);
+    channel_config_set_dreq(&rxConfig, uart_get_dreq(controllerInterface->mUART, false));
+    dma_channel_configure(
+        controllerInterface->mRXDMAChannel,
+        &rxConfig,
+        controllerInterface->mRXRing,
+        &uart_get_hw(controllerInterface->mUART)->dr,
+        UINT32_MAX,
+        true
+    );
+
     reset_controller_interface(controllerInterface, true);
+
+    // Pre-pack every sensor packet so responses only need to send the cached bytes
+    for(int i = 0; i < controllerInterface->mNumMsgPackSensors; ++i) {
+        PackResponse response = build_sensor_packet_cache(&controllerInterface->mMsgPackSensors[i]);
+        if(response.mErrorCode) {
+            DEBUG_PRINT("Unable to cache packet for sensor %d (error %d)\n", controllerInterface->mMsgPackSensors[i].mSensorID, response.mErrorCode);
+        }
+    }
 }
 
 // Transmit a single packet signalling the system is ready for data
@@ -276,53 +948,52 @@ void send_controller_ready(ControllerInterface *controllerInterface) {
     }
 }
 
-// Perform updates - will read from serial interface and if necessary transmit a response. Blocking
+// Perform updates - will read from serial interface and if necessary queue a response for transmission
 bool update_uart_sensor_controller(
     ControllerInterface *controllerInterface
 ) {
-    MsgPackSensorPacket *sensorPackets = controllerInterface->mMsgPackSensors;
-    uint8_t numSensors = controllerInterface->mNumMsgPackSensors;
+    // Keep the outgoing data moving
+    PERF_PROBE_START(tx);
+    service_tx_dma(controllerInterface);
+    PERF_PROBE_END(tx, PERF_STAGE_UART_TX);
 
-    // Check for heartbeat
     uint32_t currentTimeMS = MILLIS();
-    if(currentTimeMS > controllerInterface->mNextHeartbeatTime) {
+
+    // Start talking at a new baud rate once the remote end has had time to follow
+    if((controllerInterface->mBaudrateState == BAUDRATE_SETTLING) && (currentTimeMS >= controllerInterface->mBaudrateSettleTime)) {
+        controllerInterface->mBaudrateState = BAUDRATE_AWAITING_ACK;
+        controllerInterface->mBaudrateAckDeadline = currentTimeMS + BAUDRATE_ACK_TIMEOUT_MS;
+        controllerInterface->mNextHeartbeatTime = 0;
+        send_controller_ready(controllerInterface);
+    }
+
+    // Check for heartbeat. Nothing goes out while a baud rate change settles
+    if((controllerInterface->mBaudrateState != BAUDRATE_SETTLING) && (currentTimeMS > controllerInterface->mNextHeartbeatTime)) {
         send_heartbeat(controllerInterface);
         controllerInterface->mNextHeartbeatTime = (currentTimeMS + HEARTBEAT_TIMEOUT_MS);
     }
 
-    // Ready incoming bytes and handle responses if appropriate
-    // Loop until we run out of data or hit a complete command. This stops us just looping forever in this function
-    // if the remote end is flooding us with data
-    bool loopControl = true;
-    while (loopControl) {
-        if(uart_is_readable(controllerInterface->mUART)) {
-            handle_incoming_byte(controllerInterface, uart_getc(controllerInterface->mUART));
-        } else {
-            loopControl = false;
-        }
+    // Go back to the previous baud rate if the remote end never acknowledged a change
+    if((controllerInterface->mBaudrateState == BAUDRATE_AWAITING_ACK) && (currentTimeMS > controllerInterface->mBaudrateAckDeadline)) {
+        DEBUG_PRINT("No acknowledgement at %u baud, falling back to %u\n", controllerInterface->mBaudrate, controllerInterface->mFallbackBaudrate);
+        set_controller_baudrate(controllerInterface, controllerInterface->mFallbackBaudrate);
+        controllerInterface->mBaudrateState = BAUDRATE_CONFIRMED;
+        send_controller_ready(controllerInterface);
+    }
 
-        switch(controllerInterface->mCommandBufferState) {
-            case AWAITING_DATA:
-                break;
-            case PROCESSING_COMMAND_DATA:
-                break;
-            case HAS_COMPLETE_COMMAND:
-                handle_sensor_controller_command(
-                    controllerInterface,
-                    sensorPackets,
-                    numSensors
-                );
-                reset_controller_interface(controllerInterface, false);            
-                loopControl = false;
-                break;
-            case HAS_INVALID_COMMAND_DATA:
-                reset_controller_interface(controllerInterface, false);            
-                loopControl = false;
-                break;
-            default:
-                break;
-        }
+    // Parse incoming bytes and handle any complete commands. The RX DMA keeps draining the UART while we are
+    // busy elsewhere, so pipelined commands are queued up in the RX ring rather than overflowing the FIFO
+    PERF_PROBE_START(commands);
+    service_rx_dma(controllerInterface);
+    handle_pending_commands(controllerInterface);
+    PERF_PROBE_END(commands, PERF_STAGE_UART_COMMANDS);
+
+    // Push anything subscribed sensors have to report
+    PERF_PROBE_START(subscriptions);
+    if(controllerInterface->mBaudrateState != BAUDRATE_SETTLING) {
+        send_sensor_subscription_updates(controllerInterface);
     }
+    PERF_PROBE_END(subscriptions, PERF_STAGE_UART_SUBSCRIPTIONS);
 
     return true;
 }
@@ -5,12 +5,35 @@
 #include "hardware/sensors/sensor.h"
 #include "command_definitions.h"
 #include "sensor_msgpack.h"
-#include "pico/util/queue.h"
+#include "sensor_history.h"
+#include "sensor_multicore/sensor_flash_log.h"
 
 
 #define ARGUMENT_LENGTH         (8)
 #define COMMAND_LENGTH          (ARGUMENT_LENGTH + 1 + 1)   // Argument bytes +1 byte for command ID and +1 byte for checksum
 #define MPACK_OUT_BUFFER_SIZE   (1024)
+#define TX_RING_SIZE            (4096)                      // Outgoing bytes waiting for the TX DMA. Holds a complete response
+#define RX_RING_SIZE_BITS       (9)
+#define RX_RING_SIZE            (1 << RX_RING_SIZE_BITS)    // Incoming bytes written by the RX DMA. Must be a power of two
+#define MAX_SUBSCRIBED_SENSORS  (16)                        // Sensors beyond this many cannot be subscribed to
+#define PENDING_COMMANDS_LENGTH (8)                         // Complete commands waiting to be handled, e.g. received while a response was sent
+
+
+// State of a controller link baud rate change
+typedef enum {
+    BAUDRATE_CONFIRMED          = 0x00,                     // Running at a rate the remote end has acknowledged
+    BAUDRATE_AWAITING_ACK       = 0x01,                     // Switched rate, waiting for a HEARTBEAT_ACK before the fallback deadline
+    BAUDRATE_SETTLING           = 0x02                      // Switched rate, giving the remote end time to follow before we send anything
+} BaudrateState;
+
+
+// Streamed update subscription for a single sensor
+typedef struct {
+    bool mSubscribed;                                       // Whether changes to this sensor are pushed to the remote end
+    uint16_t mMinIntervalMS;                                // Minimum time between pushed updates
+    uint32_t mLastSentTime;                                 // Time the last update was pushed
+    uint32_t mLastSentChangeCount;                          // Change count of the sensor packet when it was last pushed
+} SensorSubscription;
 
 
 // States in which the incoming command buffer can be
@@ -18,7 +41,8 @@ typedef enum {
     AWAITING_DATA               = 0x00,
     PROCESSING_COMMAND_DATA     = 0x01,
     HAS_COMPLETE_COMMAND        = 0x02,
-    HAS_INVALID_COMMAND_DATA    = 0x03
+    HAS_INVALID_COMMAND_DATA    = 0x03,
+    AWAITING_START_BYTE         = 0x04                      // Incoming bytes were lost, skipping everything up to the next start byte
 } CommandBufferState;
 
 
@@ -28,11 +52,35 @@ typedef struct {
     SensorCommandIdentifier mCurrentCommand;                // The current command the command buffer is processing
     uint8_t mCommandBuffer[COMMAND_LENGTH];                 // Buffer for storing incoming serial bytes
     uint8_t mCurrentBufferPos;                              // Current write position in the incoming buffer
+    uint8_t mPendingCommands[PENDING_COMMANDS_LENGTH][COMMAND_LENGTH];  // Complete, valid commands waiting to be handled
+    uint8_t mPendingCommandsReadPos;                        // Position of the oldest pending command
+    uint8_t mPendingCommandsCount;                          // Number of pending commands
+    uint32_t mDroppedCommands;                              // Commands lost because the pending commands were full
+    uint8_t mHandledCommand[COMMAND_LENGTH];                // Command currently being handled, taken from the pending commands
     uint8_t mMsgPackOutputBuffer[MPACK_OUT_BUFFER_SIZE];    // Byte buffer for outgoing (mpack) serial data
+    uint8_t mTXRing[TX_RING_SIZE];                          // Ring of outgoing bytes, drained into the UART by DMA
+    size_t mTXRingReadPos;                                  // Position of the oldest unsent byte in the TX ring
+    size_t mTXRingCount;                                    // Number of bytes in the TX ring (including those being sent)
+    size_t mTXInFlight;                                     // Number of bytes handed to the current DMA transfer
+    int mTXDMAChannel;                                      // DMA channel feeding the UART TX FIFO
+    uint8_t mRXRing[RX_RING_SIZE]
+        __attribute__((aligned(RX_RING_SIZE)));             // Ring of incoming bytes, filled from the UART by DMA (aligned for address wrapping)
+    size_t mRXRingReadPos;                                  // Position of the oldest unparsed byte in the RX ring
+    uint32_t mRXRingReadCount;                              // Bytes received that have been parsed (or skipped)
+    uint32_t mRXOverrunBytes;                               // Bytes overwritten in the RX ring before they could be parsed
+    int mRXDMAChannel;                                      // DMA channel draining the UART RX FIFO
     uint32_t mNextHeartbeatTime;                            // Time for next heartbeat output pulse
+    uint mBaudrate;                                         // Current baud rate of the controller link
+    uint mFallbackBaudrate;                                 // Rate to return to if a baud rate change is not acknowledged
+    BaudrateState mBaudrateState;                           // State of any baud rate change in progress
+    uint32_t mBaudrateAckDeadline;                          // Time by which a baud rate change must be acknowledged
+    uint32_t mBaudrateSettleTime;                           // Time at which a baud rate change has settled and the new rate can be used
     MsgPackSensorPacket *mMsgPackSensors;                   // Description and data storage objects for outgoing packed data
     uint8_t mNumMsgPackSensors;                             // Number of elements in above array
-    queue_t *mSensorUpdateQueue;                            // The inter-core queue for passing sensor data updates between cores
+    SensorSubscription mSubscriptions[MAX_SUBSCRIBED_SENSORS];  // Streamed update subscriptions, indexed as mMsgPackSensors
+    SensorHistory *mHistory;                                // Recorded readings of mMsgPackSensors (optional)
+    SensorFlashLog *mLog;                                   // Readings of mMsgPackSensors kept in flash across reboots (optional)
+    I2CInterface *mSensorBus;                               // Bus whose transaction counters GET_I2C_STATS reports (optional)
     uint mSerialLEDPin;                                     // Pin for indicating serial communications via an LED
 } ControllerInterface;
 
@@ -54,4 +102,21 @@ bool update_uart_sensor_controller(
 // Sends a packet through the serial interface indicating that the controller is ready
 void send_controller_ready(ControllerInterface *controllerInterface);
 
+
+// Internals, only for the host tests and benchmarks which drive the controller a step at a time
+
+extern const uint32_t BAUDRATE_ACK_TIMEOUT_MS;
+
+// Parses everything the RX DMA has written to the RX ring since the last call, queueing any complete commands
+void service_rx_dma(ControllerInterface *controllerInterface);
+
+// Runs a contiguous span of incoming bytes through the command parser, queueing any complete commands
+void handle_incoming_bytes(ControllerInterface *controllerInterface, const uint8_t *bytes, size_t numBytes);
+
+// Handles every queued command, oldest first
+void handle_pending_commands(ControllerInterface *controllerInterface);
+
+// Waits until every queued outgoing byte has left the UART
+void flush_tx(ControllerInterface *controllerInterface);
+
 #endif  // SENSOR_CONTROLLER_H
@@ -4,5 +4,16 @@
 // Time utility
 #define MILLIS() (to_ms_since_boot(get_absolute_time()))
 
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+// Histogram bucket of a (32-bit) duration: bucket 0 is 0, bucket n is [2^(n-1), 2^n), the last takes everything above
+#define LOG2_BUCKET(value, numBuckets) (MIN(((value) ? (32 - __builtin_clz(value)) : 0), ((numBuckets) - 1)))
+
 
 #endif
\ No newline at end of file